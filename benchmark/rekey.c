@@ -0,0 +1,183 @@
+/**********************************************************************
+ *             Re-keying benchmark for gost-engine                    *
+ *                                                                    *
+ *   Measures the cost of one key change of the ACPKM modes and of    *
+ *   the CryptoPro key meshing: the same data is encrypted with short *
+ *   sections and in one section, and the difference is divided by    *
+ *   the number of extra key changes.                                 *
+ *                                                                    *
+ *       This file is distributed under the same license as OpenSSL   *
+ **********************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <getopt.h>
+#include <openssl/conf.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
+#include <openssl/engine.h>
+
+/*
+ * Cipher with key meshing, the same mode without it and the section size,
+ * or 0 for the fixed 1 KB CryptoPro key meshing.
+ */
+const struct {
+    const char *cipher;
+    const char *plain;
+    int section;
+} tests[] = {
+    { "kuznyechik-ctr-acpkm", "kuznyechik-ctr-acpkm", 32 },
+    { "kuznyechik-ctr-acpkm", "kuznyechik-ctr-acpkm", 256 },
+    { "magma-ctr-acpkm", "magma-ctr-acpkm", 16 },
+    { "magma-ctr-acpkm", "magma-ctr-acpkm", 256 },
+    { "gost89-cnt-12", "gost89-cnt", 0 },
+    { NULL },
+};
+
+static const unsigned char key[32] = {
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10,
+    0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+};
+
+static const unsigned char iv[EVP_MAX_IV_LENGTH] = {
+    0x12, 0x34, 0x56, 0x78, 0x90, 0xab, 0xce, 0xf0,
+};
+
+static int set_section(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *type,
+		       int section)
+{
+	if (EVP_CIPHER_get0_provider(type) != NULL) {
+		OSSL_PARAM params[] = { OSSL_PARAM_END, OSSL_PARAM_END };
+		size_t v = (size_t)section;
+
+		params[0] = OSSL_PARAM_construct_size_t("key-mesh", &v);
+		return EVP_CIPHER_CTX_set_params(ctx, params);
+	}
+	return EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_KEY_MESH, section, NULL) > 0;
+}
+
+/* Seconds to encrypt len bytes cycles times, section 0 is left as is */
+static double run(const char *name, int section, unsigned char *buf,
+		  unsigned int len, unsigned int cycles, clockid_t clock_type)
+{
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	const EVP_CIPHER *type;
+	struct timespec ts;
+	struct timeval debut, fin, delta;
+	unsigned int i;
+	int outlen;
+
+	ERR_set_mark();
+	type = EVP_get_cipherbyname(name);
+	ERR_pop_to_mark();
+	if (!ctx || !type)
+		return -1;
+
+	clock_gettime(clock_type, &ts);
+	TIMESPEC_TO_TIMEVAL(&debut, &ts);
+
+	for (i = 0; i < cycles; i++) {
+		if (!EVP_CIPHER_CTX_reset(ctx)
+		    || !EVP_EncryptInit_ex(ctx, type, NULL, key, iv)
+		    || (section && !set_section(ctx, type, section))
+		    || !EVP_EncryptUpdate(ctx, buf, &outlen, buf, len)) {
+			ERR_print_errors_fp(stderr);
+			exit(1);
+		}
+	}
+
+	clock_gettime(clock_type, &ts);
+	TIMESPEC_TO_TIMEVAL(&fin, &ts);
+	timersub(&fin, &debut, &delta);
+	EVP_CIPHER_CTX_free(ctx);
+	return (double)delta.tv_sec + (double)delta.tv_usec / 1000000;
+}
+
+void usage(char *name)
+{
+	fprintf(stderr, "usage: %s [-l data_len] [-c cycles]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int data_len = 65536;
+	unsigned int cycles = 1000;
+	int option;
+	clockid_t clock_type = CLOCK_MONOTONIC;
+	int test, test_count = 0;
+	unsigned char *buf;
+
+	opterr = 0;
+	while((option = getopt(argc, argv, "l:c:C")) >= 0)
+	{
+		switch (option)
+		{
+			case 'l':
+				data_len = atoi(optarg);
+				break;
+			case 'c':
+				cycles = atoi(optarg);
+				break;
+			case 'C':
+				clock_type = CLOCK_PROCESS_CPUTIME_ID;
+				break;
+			default:
+				usage(argv[0]);
+				break;
+		}
+	}
+	if (optind < argc) usage(argv[0]);
+	if (cycles < 100) { printf("cycles too low\n"); exit(1); }
+	/* Whole 1 KB sections, so that the long run never rekeys */
+	data_len &= ~1023U;
+	if (data_len < 2048) { printf("data_len too low\n"); exit(1); }
+
+	OPENSSL_add_all_algorithms_conf();
+	ERR_load_crypto_strings();
+
+	buf = calloc(1, data_len);
+	if (!buf) {
+	    fprintf(stderr, "No tests were run, malloc failure.\n");
+	    exit(1);
+	}
+
+	for (test = 0; tests[test].cipher; test++) {
+	    int section = tests[test].section;
+	    double with, without;
+	    unsigned int rekeys;
+
+	    printf("wait...");
+	    fflush(stdout);
+	    with = run(tests[test].cipher, section, buf, data_len, cycles,
+		       clock_type);
+	    without = run(tests[test].plain, section ? data_len : 0, buf,
+			  data_len, cycles, clock_type);
+	    if (with < 0 || without < 0) {
+		printf("\r");
+		continue;
+	    }
+
+	    test_count++;
+	    /* The first section uses the initial key */
+	    rekeys = data_len / (section ? section : 1024) - 1;
+	    printf("\r%s section %d: %.1f ns/rekey, %.1f MB/s\n",
+		tests[test].cipher, section ? section : 1024,
+		(with - without) * 1e9 / ((double)cycles * rekeys),
+		(double)data_len * cycles / with / 1e6);
+	}
+	free(buf);
+
+	if (!test_count) {
+	    fprintf(stderr, "No tests were run, something is wrong.\n");
+	    exit(1);
+	}
+	exit(0);
+}
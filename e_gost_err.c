@@ -45,6 +45,7 @@ static ERR_STRING_DATA GOST_str_functs[] = {
      "gost_cms_set_ktri_shared_info"},
     {ERR_PACK(0, GOST_F_GOST_CMS_SET_SHARED_INFO, 0),
      "gost_cms_set_shared_info"},
+    {ERR_PACK(0, GOST_F_GOST_DIGEST_STATE_CTRL, 0), "gost_digest_state_ctrl"},
     {ERR_PACK(0, GOST_F_GOST_EC_COMPUTE_PUBLIC, 0), "gost_ec_compute_public"},
     {ERR_PACK(0, GOST_F_GOST_EC_KEYGEN, 0), "gost_ec_keygen"},
     {ERR_PACK(0, GOST_F_GOST_EC_SIGN, 0), "gost_ec_sign"},
@@ -54,8 +55,12 @@ static ERR_STRING_DATA GOST_str_functs[] = {
      "gost_grasshopper_cipher_ctl"},
     {ERR_PACK(0, GOST_F_GOST_GRASSHOPPER_CIPHER_DO_CTRACPKM_OMAC, 0),
      "gost_grasshopper_cipher_do_ctracpkm_omac"},
+    {ERR_PACK(0, GOST_F_GOST_GRASSHOPPER_CIPHER_DO_MGM, 0),
+     "gost_grasshopper_cipher_do_mgm"},
     {ERR_PACK(0, GOST_F_GOST_GRASSHOPPER_CIPHER_INIT_CTRACPKM_OMAC, 0),
      "gost_grasshopper_cipher_init_ctracpkm_omac"},
+    {ERR_PACK(0, GOST_F_GOST_GRASSHOPPER_CIPHER_INIT_MGM, 0),
+     "gost_grasshopper_cipher_init_mgm"},
     {ERR_PACK(0, GOST_F_GOST_GRASSHOPPER_SET_ASN1_PARAMETERS, 0),
      "gost_grasshopper_set_asn1_parameters"},
     {ERR_PACK(0, GOST_F_GOST_IMIT_CTRL, 0), "gost_imit_ctrl"},
@@ -64,11 +69,15 @@ static ERR_STRING_DATA GOST_str_functs[] = {
     {ERR_PACK(0, GOST_F_GOST_KDFTREE2012_256, 0), "gost_kdftree2012_256"},
     {ERR_PACK(0, GOST_F_GOST_KEXP15, 0), "gost_kexp15"},
     {ERR_PACK(0, GOST_F_GOST_KIMP15, 0), "gost_kimp15"},
+    {ERR_PACK(0, GOST_F_GOST_PBKDF2_HMAC2012, 0), "gost_pbkdf2_hmac2012"},
     {ERR_PACK(0, GOST_F_MAGMA_CIPHER_CTL, 0), "magma_cipher_ctl"},
     {ERR_PACK(0, GOST_F_MAGMA_CIPHER_CTL_ACPKM_OMAC, 0),
      "magma_cipher_ctl_acpkm_omac"},
+    {ERR_PACK(0, GOST_F_MAGMA_CIPHER_CTL_MGM, 0), "magma_cipher_ctl_mgm"},
+    {ERR_PACK(0, GOST_F_MAGMA_CIPHER_DO_MGM, 0), "magma_cipher_do_mgm"},
     {ERR_PACK(0, GOST_F_MAGMA_CIPHER_INIT_CTR_ACPKM_OMAC, 0),
      "magma_cipher_init_ctr_acpkm_omac"},
+    {ERR_PACK(0, GOST_F_MAGMA_CIPHER_INIT_MGM, 0), "magma_cipher_init_mgm"},
     {ERR_PACK(0, GOST_F_OMAC_ACPKM_IMIT_CTRL, 0), "omac_acpkm_imit_ctrl"},
     {ERR_PACK(0, GOST_F_OMAC_ACPKM_IMIT_FINAL, 0), "omac_acpkm_imit_final"},
     {ERR_PACK(0, GOST_F_OMAC_ACPKM_IMIT_UPDATE, 0), "omac_acpkm_imit_update"},
@@ -146,13 +155,17 @@ static ERR_STRING_DATA GOST_str_reasons[] = {
     {ERR_PACK(0, 0, GOST_R_INVALID_CIPHER_PARAMS), "invalid cipher params"},
     {ERR_PACK(0, 0, GOST_R_INVALID_CIPHER_PARAM_OID),
     "invalid cipher param oid"},
+    {ERR_PACK(0, 0, GOST_R_INVALID_DIGEST_STATE), "invalid digest state"},
     {ERR_PACK(0, 0, GOST_R_INVALID_DIGEST_TYPE), "invalid digest type"},
     {ERR_PACK(0, 0, GOST_R_INVALID_IV_LENGTH), "invalid iv length"},
     {ERR_PACK(0, 0, GOST_R_INVALID_MAC_KEY_LENGTH), "invalid mac key length"},
     {ERR_PACK(0, 0, GOST_R_INVALID_MAC_KEY_SIZE), "invalid mac key size"},
     {ERR_PACK(0, 0, GOST_R_INVALID_MAC_PARAMS), "invalid mac params"},
     {ERR_PACK(0, 0, GOST_R_INVALID_MAC_SIZE), "invalid mac size"},
+    {ERR_PACK(0, 0, GOST_R_INVALID_MGM_INPUT), "invalid mgm input"},
+    {ERR_PACK(0, 0, GOST_R_INVALID_NONCE), "invalid nonce"},
     {ERR_PACK(0, 0, GOST_R_INVALID_PARAMSET), "invalid paramset"},
+    {ERR_PACK(0, 0, GOST_R_INVALID_TAG_LENGTH), "invalid tag length"},
     {ERR_PACK(0, 0, GOST_R_KEY_IS_NOT_INITIALIZED), "key is not initialized"},
     {ERR_PACK(0, 0, GOST_R_KEY_PARAMETERS_MISSING), "key parameters missing"},
     {ERR_PACK(0, 0, GOST_R_MAC_KEY_NOT_SET), "mac key not set"},
@@ -41,6 +41,7 @@ void ERR_GOST_error(int function, int reason, char *file, int line);
 # define GOST_F_GOST_CMS_SET_KARI_SHARED_INFO             156
 # define GOST_F_GOST_CMS_SET_KTRI_SHARED_INFO             157
 # define GOST_F_GOST_CMS_SET_SHARED_INFO                  155
+# define GOST_F_GOST_DIGEST_STATE_CTRL                    171
 # define GOST_F_GOST_EC_COMPUTE_PUBLIC                    107
 # define GOST_F_GOST_EC_KEYGEN                            108
 # define GOST_F_GOST_EC_SIGN                              109
@@ -48,7 +49,9 @@ void ERR_GOST_error(int function, int reason, char *file, int line);
 # define GOST_F_GOST_ENCODE_CMS_PARAMS                    161
 # define GOST_F_GOST_GRASSHOPPER_CIPHER_CTL               111
 # define GOST_F_GOST_GRASSHOPPER_CIPHER_DO_CTRACPKM_OMAC  160
+# define GOST_F_GOST_GRASSHOPPER_CIPHER_DO_MGM            166
 # define GOST_F_GOST_GRASSHOPPER_CIPHER_INIT_CTRACPKM_OMAC 162
+# define GOST_F_GOST_GRASSHOPPER_CIPHER_INIT_MGM          167
 # define GOST_F_GOST_GRASSHOPPER_SET_ASN1_PARAMETERS      112
 # define GOST_F_GOST_IMIT_CTRL                            113
 # define GOST_F_GOST_IMIT_FINAL                           114
@@ -56,9 +59,13 @@ void ERR_GOST_error(int function, int reason, char *file, int line);
 # define GOST_F_GOST_KDFTREE2012_256                      149
 # define GOST_F_GOST_KEXP15                               143
 # define GOST_F_GOST_KIMP15                               148
+# define GOST_F_GOST_PBKDF2_HMAC2012                      172
 # define GOST_F_MAGMA_CIPHER_CTL                          163
 # define GOST_F_MAGMA_CIPHER_CTL_ACPKM_OMAC               164
+# define GOST_F_MAGMA_CIPHER_CTL_MGM                      170
+# define GOST_F_MAGMA_CIPHER_DO_MGM                       168
 # define GOST_F_MAGMA_CIPHER_INIT_CTR_ACPKM_OMAC          165
+# define GOST_F_MAGMA_CIPHER_INIT_MGM                     169
 # define GOST_F_OMAC_ACPKM_IMIT_CTRL                      144
 # define GOST_F_OMAC_ACPKM_IMIT_FINAL                     145
 # define GOST_F_OMAC_ACPKM_IMIT_UPDATE                    146
@@ -119,13 +126,17 @@ void ERR_GOST_error(int function, int reason, char *file, int line);
 # define GOST_R_INVALID_CIPHER                            134
 # define GOST_R_INVALID_CIPHER_PARAMS                     110
 # define GOST_R_INVALID_CIPHER_PARAM_OID                  111
+# define GOST_R_INVALID_DIGEST_STATE                      144
 # define GOST_R_INVALID_DIGEST_TYPE                       112
 # define GOST_R_INVALID_IV_LENGTH                         113
 # define GOST_R_INVALID_MAC_KEY_LENGTH                    114
 # define GOST_R_INVALID_MAC_KEY_SIZE                      115
 # define GOST_R_INVALID_MAC_PARAMS                        116
 # define GOST_R_INVALID_MAC_SIZE                          117
+# define GOST_R_INVALID_MGM_INPUT                         143
+# define GOST_R_INVALID_NONCE                             141
 # define GOST_R_INVALID_PARAMSET                          118
+# define GOST_R_INVALID_TAG_LENGTH                        142
 # define GOST_R_KEY_IS_NOT_INITIALIZED                    119
 # define GOST_R_KEY_PARAMETERS_MISSING                    120
 # define GOST_R_MAC_KEY_NOT_SET                           121
@@ -3354,8 +3354,9 @@ static void scalar_wnaf(int8_t out[257], const unsigned char in[32]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
-                              const unsigned char b[32], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[32],
+                                  const unsigned char b[32],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[257] = {0};
     int8_t bnaf[257] = {0};
@@ -3412,6 +3413,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
         fiat_id_GostR3410_2001_CryptoPro_A_ParamSet_opp(Q.Y, Q.Y);
     }
 
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
+                              const unsigned char b[32], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_GostR3410_2001_CryptoPro_A_ParamSet_inv(Q.Z, Q.Z);
     fiat_id_GostR3410_2001_CryptoPro_A_ParamSet_carry_mul(out->X, Q.X, Q.Z);
@@ -3621,6 +3630,9 @@ static void point_mul(unsigned char outx[32], unsigned char outy[32],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 19
+#define ECP_CMB_COLS 3
 
 /* the zero field element */
 static const unsigned char const_zb[32] = {0};
@@ -8295,8 +8307,9 @@ static void scalar_wnaf(int8_t out[257], const unsigned char in[32]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
-                              const unsigned char b[32], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[32],
+                                  const unsigned char b[32],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[257] = {0};
     int8_t bnaf[257] = {0};
@@ -8353,6 +8366,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
         fiat_id_GostR3410_2001_CryptoPro_A_ParamSet_opp(Q.Y, Q.Y);
     }
 
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
+                              const unsigned char b[32], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_GostR3410_2001_CryptoPro_A_ParamSet_inv(Q.Z, Q.Z);
     fiat_id_GostR3410_2001_CryptoPro_A_ParamSet_carry_mul(out->X, Q.X, Q.Z);
@@ -8562,6 +8583,9 @@ static void point_mul(unsigned char outx[32], unsigned char outy[32],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 19
+#define ECP_CMB_COLS 3
 
 /* the zero field element */
 static const unsigned char const_zb[32] = {0};
@@ -8692,3 +8716,9 @@ err:
 
 
 #endif /* __SIZEOF_INT128__ */
+
+#define ECP_FIAT(f) fiat_id_GostR3410_2001_CryptoPro_A_ParamSet_##f
+#define ECP_RAW(f) f##_id_GostR3410_2001_CryptoPro_A_ParamSet
+#define ECP_BYTES 32
+#define ECP_RWNAF 52
+#include "ecp_raw_impl.h"
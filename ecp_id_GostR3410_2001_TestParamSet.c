@@ -3928,8 +3928,9 @@ static void scalar_wnaf(int8_t out[257], const unsigned char in[32]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
-                              const unsigned char b[32], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[32],
+                                  const unsigned char b[32],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[257] = {0};
     int8_t bnaf[257] = {0};
@@ -3986,6 +3987,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
         fiat_id_GostR3410_2001_TestParamSet_opp(Q.Y, Q.Y);
     }
 
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
+                              const unsigned char b[32], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_GostR3410_2001_TestParamSet_inv(Q.Z, Q.Z);
     fiat_id_GostR3410_2001_TestParamSet_mul(out->X, Q.X, Q.Z);
@@ -4202,6 +4211,9 @@ static void point_mul(unsigned char outx[32], unsigned char outy[32],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 27
+#define ECP_CMB_COLS 2
 
 /* the zero field element */
 static const unsigned char const_zb[32] = {0};
@@ -11256,8 +11268,9 @@ static void scalar_wnaf(int8_t out[257], const unsigned char in[32]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
-                              const unsigned char b[32], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[32],
+                                  const unsigned char b[32],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[257] = {0};
     int8_t bnaf[257] = {0};
@@ -11314,6 +11327,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
         fiat_id_GostR3410_2001_TestParamSet_opp(Q.Y, Q.Y);
     }
 
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
+                              const unsigned char b[32], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_GostR3410_2001_TestParamSet_inv(Q.Z, Q.Z);
     fiat_id_GostR3410_2001_TestParamSet_mul(out->X, Q.X, Q.Z);
@@ -11530,6 +11551,9 @@ static void point_mul(unsigned char outx[32], unsigned char outy[32],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 27
+#define ECP_CMB_COLS 2
 
 /* the zero field element */
 static const unsigned char const_zb[32] = {0};
@@ -11658,3 +11682,10 @@ err:
 
 
 #endif /* __SIZEOF_INT128__ */
+
+#define ECP_FIAT(f) fiat_id_GostR3410_2001_TestParamSet_##f
+#define ECP_RAW(f) f##_id_GostR3410_2001_TestParamSet
+#define ECP_BYTES 32
+#define ECP_RWNAF 52
+#define ECP_MONTGOMERY
+#include "ecp_raw_impl.h"
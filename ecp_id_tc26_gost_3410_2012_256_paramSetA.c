@@ -3521,8 +3521,9 @@ static void scalar_wnaf(int8_t out[257], const unsigned char in[32]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
-                              const unsigned char b[32], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[32],
+                                  const unsigned char b[32],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[257] = {0};
     int8_t bnaf[257] = {0};
@@ -3587,6 +3588,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
 
     /* move from Edwards projective to legacy projective */
     point_edwards2legacy(&Q, &Q);
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
+                              const unsigned char b[32], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_tc26_gost_3410_2012_256_paramSetA_inv(Q.Z, Q.Z);
     fiat_id_tc26_gost_3410_2012_256_paramSetA_carry_mul(out->X, Q.X, Q.Z);
@@ -3822,6 +3831,9 @@ static void point_mul(unsigned char outx[32], unsigned char outy[32],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 14
+#define ECP_CMB_COLS 4
 
 /* the zero field element */
 static const unsigned char const_zb[32] = {0};
@@ -8731,8 +8743,9 @@ static void scalar_wnaf(int8_t out[257], const unsigned char in[32]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
-                              const unsigned char b[32], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[32],
+                                  const unsigned char b[32],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[257] = {0};
     int8_t bnaf[257] = {0};
@@ -8797,6 +8810,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
 
     /* move from Edwards projective to legacy projective */
     point_edwards2legacy(&Q, &Q);
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[32],
+                              const unsigned char b[32], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_tc26_gost_3410_2012_256_paramSetA_inv(Q.Z, Q.Z);
     fiat_id_tc26_gost_3410_2012_256_paramSetA_carry_mul(out->X, Q.X, Q.Z);
@@ -9032,6 +9053,9 @@ static void point_mul(unsigned char outx[32], unsigned char outy[32],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 14
+#define ECP_CMB_COLS 4
 
 /* the zero field element */
 static const unsigned char const_zb[32] = {0};
@@ -9162,3 +9186,10 @@ err:
 
 
 #endif /* __SIZEOF_INT128__ */
+
+#define ECP_FIAT(f) fiat_id_tc26_gost_3410_2012_256_paramSetA_##f
+#define ECP_RAW(f) f##_id_tc26_gost_3410_2012_256_paramSetA
+#define ECP_BYTES 32
+#define ECP_RWNAF 52
+#define ECP_EDWARDS
+#include "ecp_raw_impl.h"
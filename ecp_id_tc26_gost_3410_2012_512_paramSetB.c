@@ -6595,8 +6595,9 @@ static void scalar_wnaf(int8_t out[513], const unsigned char in[64]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
-                              const unsigned char b[64], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[64],
+                                  const unsigned char b[64],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[513] = {0};
     int8_t bnaf[513] = {0};
@@ -6653,6 +6654,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
         fiat_id_tc26_gost_3410_2012_512_paramSetB_opp(Q.Y, Q.Y);
     }
 
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
+                              const unsigned char b[64], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_tc26_gost_3410_2012_512_paramSetB_inv(Q.Z, Q.Z);
     fiat_id_tc26_gost_3410_2012_512_paramSetB_mul(out->X, Q.X, Q.Z);
@@ -6872,6 +6881,9 @@ static void point_mul(unsigned char outx[64], unsigned char outy[64],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 14
+#define ECP_CMB_COLS 8
 
 /* the zero field element */
 static const unsigned char const_zb[64] = {0};
@@ -22079,8 +22091,9 @@ static void scalar_wnaf(int8_t out[513], const unsigned char in[64]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
-                              const unsigned char b[64], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[64],
+                                  const unsigned char b[64],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[513] = {0};
     int8_t bnaf[513] = {0};
@@ -22137,6 +22150,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
         fiat_id_tc26_gost_3410_2012_512_paramSetB_opp(Q.Y, Q.Y);
     }
 
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
+                              const unsigned char b[64], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_tc26_gost_3410_2012_512_paramSetB_inv(Q.Z, Q.Z);
     fiat_id_tc26_gost_3410_2012_512_paramSetB_mul(out->X, Q.X, Q.Z);
@@ -22356,6 +22377,9 @@ static void point_mul(unsigned char outx[64], unsigned char outy[64],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 14
+#define ECP_CMB_COLS 8
 
 /* the zero field element */
 static const unsigned char const_zb[64] = {0};
@@ -22486,3 +22510,10 @@ err:
 
 
 #endif /* __SIZEOF_INT128__ */
+
+#define ECP_FIAT(f) fiat_id_tc26_gost_3410_2012_512_paramSetB_##f
+#define ECP_RAW(f) f##_id_tc26_gost_3410_2012_512_paramSetB
+#define ECP_BYTES 64
+#define ECP_RWNAF 103
+#define ECP_MONTGOMERY
+#include "ecp_raw_impl.h"
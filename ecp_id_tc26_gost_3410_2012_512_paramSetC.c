@@ -4367,8 +4367,9 @@ static void scalar_wnaf(int8_t out[513], const unsigned char in[64]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
-                              const unsigned char b[64], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[64],
+                                  const unsigned char b[64],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[513] = {0};
     int8_t bnaf[513] = {0};
@@ -4433,6 +4434,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
 
     /* move from Edwards projective to legacy projective */
     point_edwards2legacy(&Q, &Q);
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
+                              const unsigned char b[64], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_tc26_gost_3410_2012_512_paramSetC_inv(Q.Z, Q.Z);
     fiat_id_tc26_gost_3410_2012_512_paramSetC_carry_mul(out->X, Q.X, Q.Z);
@@ -4668,6 +4677,9 @@ static void point_mul(unsigned char outx[64], unsigned char outy[64],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 8
+#define ECP_CMB_COLS 15
 
 /* the zero field element */
 static const unsigned char const_zb[64] = {0};
@@ -12297,8 +12309,9 @@ static void scalar_wnaf(int8_t out[513], const unsigned char in[64]) {
  * Simultaneous scalar multiplication: interleaved "textbook" wnaf.
  * NB: not constant time
  */
-static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
-                              const unsigned char b[64], const pt_aff_t *P) {
+static void var_smul_wnaf_two_prj(pt_prj_t *out, const unsigned char a[64],
+                                  const unsigned char b[64],
+                                  const pt_aff_t *P) {
     int i, d, is_neg, is_inf = 1, flipped = 0;
     int8_t anaf[513] = {0};
     int8_t bnaf[513] = {0};
@@ -12363,6 +12376,14 @@ static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
 
     /* move from Edwards projective to legacy projective */
     point_edwards2legacy(&Q, &Q);
+    *out = Q;
+}
+
+static void var_smul_wnaf_two(pt_aff_t *out, const unsigned char a[64],
+                              const unsigned char b[64], const pt_aff_t *P) {
+    pt_prj_t Q;
+
+    var_smul_wnaf_two_prj(&Q, a, b, P);
     /* convert to affine -- NB depends on coordinate system */
     fiat_id_tc26_gost_3410_2012_512_paramSetC_inv(Q.Z, Q.Z);
     fiat_id_tc26_gost_3410_2012_512_paramSetC_carry_mul(out->X, Q.X, Q.Z);
@@ -12598,6 +12619,9 @@ static void point_mul(unsigned char outx[64], unsigned char outy[64],
 
 
 #include <openssl/ec.h>
+/* the dimensions of lut_cmb, for ecp_raw_impl.h */
+#define ECP_CMB_ROWS 7
+#define ECP_CMB_COLS 18
 
 /* the zero field element */
 static const unsigned char const_zb[64] = {0};
@@ -12728,3 +12752,10 @@ err:
 
 
 #endif /* __SIZEOF_INT128__ */
+
+#define ECP_FIAT(f) fiat_id_tc26_gost_3410_2012_512_paramSetC_##f
+#define ECP_RAW(f) f##_id_tc26_gost_3410_2012_512_paramSetC
+#define ECP_BYTES 64
+#define ECP_RWNAF 103
+#define ECP_EDWARDS
+#include "ecp_raw_impl.h"
@@ -0,0 +1,291 @@
+/*
+ * This file is distributed under the same license as OpenSSL
+ *
+ * Raw wrappers, batched multiplications and comb tables of variable
+ * points for the ECCKiila curves, included at the end of each ecp_id_*.c,
+ * after the field and point arithmetic of whichever limb size was built.
+ * The includer defines:
+ *   ECP_FIAT(f)        the fiat function f of the field, e.g. carry_mul
+ *   ECP_RAW(f)         the exported name of f for the curve
+ *   ECP_BYTES          bytes of a field element or a scalar
+ *   ECP_RWNAF          digits of a scalar from scalar_rwnaf
+ *   ECP_CMB_ROWS       rows of lut_cmb
+ *   ECP_CMB_COLS       digits of a scalar per row of lut_cmb
+ * and, if the field elements are in Montgomery form, ECP_MONTGOMERY, if
+ * the points are twisted Edwards ones with a T coordinate, ECP_EDWARDS.
+ */
+#include <openssl/crypto.h>
+
+#ifdef ECP_MONTGOMERY
+# define ECP_MUL ECP_FIAT(mul)
+#else
+# define ECP_MUL ECP_FIAT(carry_mul)
+#endif
+
+static void ecp_fe_from_bytes(fe_t out, const unsigned char in[ECP_BYTES]) {
+    ECP_FIAT(from_bytes)(out, in);
+#ifdef ECP_MONTGOMERY
+    ECP_FIAT(to_montgomery)(out, out);
+#endif
+}
+
+/* destroys in */
+static void ecp_fe_to_bytes(unsigned char out[ECP_BYTES], fe_t in) {
+#ifdef ECP_MONTGOMERY
+    ECP_FIAT(from_montgomery)(in, in);
+#endif
+    ECP_FIAT(to_bytes)(out, in);
+}
+
+/*-
+ * Raw wrappers: the byte level multiplications of the curve for callers that
+ * keep scalars and coordinates as little-endian byte strings.
+ */
+void ECP_RAW(point_mul_two_raw)(unsigned char outx[ECP_BYTES],
+    unsigned char outy[ECP_BYTES], const unsigned char n[ECP_BYTES],
+    const unsigned char m[ECP_BYTES], const unsigned char inx[ECP_BYTES],
+    const unsigned char iny[ECP_BYTES]) {
+    point_mul_two(outx, outy, n, m, inx, iny);
+}
+
+void ECP_RAW(point_mul_g_raw)(unsigned char outx[ECP_BYTES],
+    unsigned char outy[ECP_BYTES], const unsigned char n[ECP_BYTES]) {
+    point_mul_g(outx, outy, n);
+}
+
+void ECP_RAW(point_mul_raw)(unsigned char outx[ECP_BYTES],
+    unsigned char outy[ECP_BYTES], const unsigned char m[ECP_BYTES],
+    const unsigned char inx[ECP_BYTES], const unsigned char iny[ECP_BYTES]) {
+    point_mul(outx, outy, m, inx, iny);
+}
+
+/*-
+ * Comb table for a variable point: row j holds the odd multiples
+ * 1, 3, ..., DRADIX - 1 of 2^(RADIX * ECP_CMB_COLS * j) * P, laid out as
+ * lut_cmb. Built for points used many times, e.g. a public key that
+ * verifies a lot of signatures. NULL on malloc failure, else free with
+ * OPENSSL_free.
+ */
+static pt_aff_t *point_table_new(const unsigned char inx[ECP_BYTES],
+                                 const unsigned char iny[ECP_BYTES]) {
+    const size_t cnt = ECP_CMB_ROWS * (DRADIX / 2);
+    pt_aff_t *lut, P;
+    pt_prj_t *prj, *row, B, D;
+    fe_t *acc, inv, t;
+    size_t j, k;
+
+    lut = OPENSSL_malloc(cnt * sizeof(*lut));
+    prj = OPENSSL_malloc(cnt * sizeof(*prj));
+    acc = OPENSSL_malloc(cnt * sizeof(*acc));
+    if (lut == NULL || prj == NULL || acc == NULL) {
+        OPENSSL_free(lut);
+        lut = NULL;
+        goto end;
+    }
+
+    ecp_fe_from_bytes(P.X, inx);
+    ecp_fe_from_bytes(P.Y, iny);
+#ifdef ECP_EDWARDS
+    /* move from legacy affine to Edwards projective */
+    point_legacy2edwards(&B, &P);
+#else
+    fe_copy(B.X, P.X);
+    fe_copy(B.Y, P.Y);
+    fe_copy(B.Z, const_one);
+#endif
+    for (j = 0; j < ECP_CMB_ROWS; j++) {
+        row = prj + j * (DRADIX / 2);
+        row[0] = B;
+        point_double(&D, &B);
+        for (k = 1; k < DRADIX / 2; k++)
+            point_add_proj(&row[k], &D, &row[k - 1]);
+        for (k = 0; k < RADIX * ECP_CMB_COLS; k++) point_double(&B, &B);
+    }
+
+    /* convert to affine with one inversion (Montgomery's trick) */
+    fe_copy(acc[0], prj[0].Z);
+    for (k = 1; k < cnt; k++) ECP_MUL(acc[k], acc[k - 1], prj[k].Z);
+    ECP_FIAT(inv)(inv, acc[cnt - 1]);
+    for (k = cnt; k-- > 0;) {
+        if (k > 0) {
+            ECP_MUL(t, inv, acc[k - 1]);
+            ECP_MUL(inv, inv, prj[k].Z);
+        } else {
+            fe_copy(t, inv);
+        }
+        ECP_MUL(lut[k].X, prj[k].X, t);
+        ECP_MUL(lut[k].Y, prj[k].Y, t);
+#ifdef ECP_EDWARDS
+        ECP_MUL(lut[k].T, prj[k].T, t);
+#endif
+    }
+
+end:
+    OPENSSL_free(prj);
+    OPENSSL_free(acc);
+    return lut;
+}
+
+/* Q := Q + d * row[0] for an odd digit d. NB: not constant time */
+static void var_cmb_add(pt_prj_t *Q, const pt_aff_t *row, int d) {
+    pt_aff_t T;
+
+    if (d > 0) {
+        point_add_mixed(Q, Q, &row[(d - 1) >> 1]);
+        return;
+    }
+    T = row[(-d - 1) >> 1];
+#ifdef ECP_EDWARDS
+    ECP_FIAT(opp)(T.X, T.X);
+    ECP_FIAT(opp)(T.T, T.T);
+#else
+    ECP_FIAT(opp)(T.Y, T.Y);
+#endif
+    point_add_mixed(Q, Q, &T);
+}
+
+/*-
+ * Simultaneous scalar multiplication a * G + b * P, P given by the table
+ * from point_table_new: the two combs share the doublings.
+ * NB: not constant time
+ */
+static void var_smul_cmb_two_prj(pt_prj_t *out,
+                                 const unsigned char a[ECP_BYTES],
+                                 const unsigned char b[ECP_BYTES],
+                                 const pt_aff_t *lut) {
+    int i, j;
+    int8_t anaf[ECP_RWNAF] = {0};
+    int8_t bnaf[ECP_RWNAF] = {0};
+    pt_prj_t Q;
+
+    scalar_rwnaf(anaf, a);
+    scalar_rwnaf(bnaf, b);
+
+    /* initalize accumulator to inf */
+    fe_set_zero(Q.X);
+    fe_copy(Q.Y, const_one);
+#ifdef ECP_EDWARDS
+    fe_set_zero(Q.T);
+    fe_copy(Q.Z, const_one);
+#else
+    fe_set_zero(Q.Z);
+#endif
+
+    for (i = ECP_CMB_COLS - 1; i >= 0; i--) {
+        for (j = 0; i != ECP_CMB_COLS - 1 && j < RADIX; j++)
+            point_double(&Q, &Q);
+        for (j = 0; j < ECP_CMB_ROWS; j++) {
+            if (j * ECP_CMB_COLS + i > ECP_RWNAF - 1) continue;
+            var_cmb_add(&Q, lut_cmb[j], anaf[j * ECP_CMB_COLS + i]);
+            var_cmb_add(&Q, lut + j * (DRADIX / 2),
+                        bnaf[j * ECP_CMB_COLS + i]);
+        }
+    }
+
+    /* the recodings made both scalars odd */
+    if (!(a[0] & 1)) var_cmb_add(&Q, lut_cmb[0], -1);
+    if (!(b[0] & 1)) var_cmb_add(&Q, lut, -1);
+
+#ifdef ECP_EDWARDS
+    /* move from Edwards projective to legacy projective */
+    point_edwards2legacy(&Q, &Q);
+#endif
+
+    *out = Q;
+}
+
+/*-
+ * Batch of simultaneous scalar multiplications with one field inversion
+ * for all the conversions to affine, by Montgomery's trick.
+ * outx[i], outy[i] := a[i] * G + b[i] * P[i], all zero at infinity.
+ * Arrays are n consecutive LE byte strings of ECP_BYTES bytes.
+ */
+#define MUL_TWO_BATCH 32
+
+void ECP_RAW(point_mul_two_batch_raw)(size_t n, unsigned char *outx,
+    unsigned char *outy, const unsigned char *a, const unsigned char *b,
+    const unsigned char *inx, const unsigned char *iny) {
+    pt_prj_t Q[MUL_TWO_BATCH];
+    fe_t acc[MUL_TWO_BATCH], inv, t;
+    pt_aff_t P;
+    unsigned char z[ECP_BYTES];
+    int inf[MUL_TWO_BATCH];
+    size_t i, j, m, k;
+
+    for (i = 0; i < n; i += m) {
+        m = n - i < MUL_TWO_BATCH ? n - i : MUL_TWO_BATCH;
+        for (j = 0; j < m; j++) {
+            k = (i + j) * ECP_BYTES;
+            ecp_fe_from_bytes(P.X, inx + k);
+            ecp_fe_from_bytes(P.Y, iny + k);
+            var_smul_wnaf_two_prj(&Q[j], a + k, b + k, &P);
+            /* Z = 0 at infinity would zero all the products */
+            ECP_MUL(Q[j].Z, Q[j].Z, const_one);
+            ECP_FIAT(to_bytes)(z, Q[j].Z);
+            inf[j] = CRYPTO_memcmp(z, const_zb, ECP_BYTES) == 0;
+            if (inf[j])
+                fe_copy(Q[j].Z, const_one);
+            /* acc[j] = Z[0] * ... * Z[j] */
+            if (j == 0)
+                fe_copy(acc[0], Q[0].Z);
+            else
+                ECP_MUL(acc[j], acc[j - 1], Q[j].Z);
+        }
+        ECP_FIAT(inv)(inv, acc[m - 1]);
+        for (j = m; j-- > 0;) {
+            /* inv = 1 / (Z[0] * ... * Z[j]) on entry */
+            if (j > 0) {
+                ECP_MUL(t, inv, acc[j - 1]);
+                ECP_MUL(inv, inv, Q[j].Z);
+            } else {
+                fe_copy(t, inv);
+            }
+            k = (i + j) * ECP_BYTES;
+            if (inf[j]) {
+                memset(outx + k, 0, ECP_BYTES);
+                memset(outy + k, 0, ECP_BYTES);
+                continue;
+            }
+            ECP_MUL(P.X, Q[j].X, t);
+            ECP_MUL(P.Y, Q[j].Y, t);
+            ecp_fe_to_bytes(outx + k, P.X);
+            ecp_fe_to_bytes(outy + k, P.Y);
+        }
+    }
+}
+
+/*-
+ * Repeated verification with one public point: tables from
+ * point_table_new_raw_*, released with OPENSSL_free, and
+ * outx, outy := a * G + b * P for the point of the table.
+ */
+void *ECP_RAW(point_table_new_raw)(const unsigned char inx[ECP_BYTES],
+    const unsigned char iny[ECP_BYTES]) {
+    return point_table_new(inx, iny);
+}
+
+void ECP_RAW(point_mul_two_table_raw)(unsigned char outx[ECP_BYTES],
+    unsigned char outy[ECP_BYTES], const unsigned char a[ECP_BYTES],
+    const unsigned char b[ECP_BYTES], const void *table) {
+    pt_prj_t Q;
+    pt_aff_t P;
+
+    var_smul_cmb_two_prj(&Q, a, b, table);
+    /* convert to affine -- NB depends on coordinate system */
+    ECP_FIAT(inv)(Q.Z, Q.Z);
+    ECP_MUL(P.X, Q.X, Q.Z);
+    ECP_MUL(P.Y, Q.Y, Q.Z);
+    ecp_fe_to_bytes(outx, P.X);
+    ecp_fe_to_bytes(outy, P.Y);
+}
+
+#undef MUL_TWO_BATCH
+#undef ECP_MUL
+#undef ECP_EDWARDS
+#undef ECP_MONTGOMERY
+#undef ECP_CMB_COLS
+#undef ECP_CMB_ROWS
+#undef ECP_RWNAF
+#undef ECP_BYTES
+#undef ECP_RAW
+#undef ECP_FIAT
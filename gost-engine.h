@@ -9,6 +9,25 @@
 #ifndef GOST_ENGINE_H
 # define GOST_ENGINE_H
 
+# include <stddef.h>
+# include <openssl/evp.h>
+
 void ENGINE_load_gost(void);
 
+/*
+ * An item for the VERIFY_BATCH control, which takes the number of items
+ * as i and an array of them as p: the arguments EVP_PKEY_verify() would
+ * get for a GOST R 34.10 key, and the result it would return. With the
+ * DIGEST_VERIFY_BATCH control tbs is the message, as for EVP_DigestVerify()
+ * with the default digest of the key.
+ */
+typedef struct {
+    EVP_PKEY *pkey;
+    const unsigned char *sig;
+    size_t siglen;
+    const unsigned char *tbs;
+    size_t tbslen;
+    int result;
+} GOST_VERIFY_BATCH_ITEM;
+
 #endif
@@ -22,32 +22,49 @@ typedef SSIZE_T ssize_t;
 #endif
 #include <limits.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
 #ifdef _WIN32
 # include <io.h>
+#else
+# include <pthread.h>
+# define TREE_THREADS
 #endif
 #include <string.h>
 #include "gosthash2012.h"
-#define BUF_SIZE 262144
+#include "gostsum_pool.h"
 #define MAX_HASH_TXT_BYTES 128
 #define gost_hash_ctx gost2012_hash_ctx
+/*
+ * Tree mode chunk sizes, in KiB. Each thread holds GOST2012_HASH_LANES
+ * chunks, 8 MiB at most.
+ */
+#define TREE_CHUNK_DEFAULT 256
+#define TREE_CHUNK_MAX 1024
 
 typedef unsigned char byte;
 int hash_file(gost_hash_ctx * ctx, char *filename, char *sum, int mode,
-              int hashsize);
-int hash_stream(gost_hash_ctx * ctx, int fd, char *sum, int hashsize);
-int get_line(FILE *f, char *hash, char *filename, int verbose, int *size);
+              int hashsize, unsigned int tree);
+int hash_stream(gost_hash_ctx * ctx, int fd, char *sum, int hashsize,
+                unsigned int tree);
+int hash_tree(int fd, byte * digest, int hashsize, size_t chunk);
+int get_line(FILE *f, char *hash, char *filename, int verbose, int *size,
+             unsigned int *tree);
 
 void help()
 {
     fprintf(stderr, "Calculates GOST R 34.11-2012 hash function\n\n");
-    fprintf(stderr, "gost12sum [-vl] [-c [file]]| [files]|-x\n"
+    fprintf(stderr, "gost12sum [-vl] [-t[size]] [-j jobs] [-c [file]]| [files]|-x\n"
             "\t-c check message digests (default is generate)\n"
             "\t-v verbose, print file names when checking\n"
             "\t-l use 512 bit hash (default 256 bit)\n"
+            "\t-t hash in parallel as a tree of size KiB chunks (default %d)\n"
+            "\t-j hash jobs files at once, 0 for one per processor (default 1)\n"
             "\t-x read filenames from stdin rather than from arguments (256 bit only)\n"
             "\t-h print this help\n"
             "The input for -c should be the list of message digests and file names\n"
-            "that is printed on stdout by this program when it generates digests.\n");
+            "that is printed on stdout by this program when it generates digests.\n",
+            TREE_CHUNK_DEFAULT);
     exit(3);
 }
 
@@ -73,18 +90,105 @@ int finish_hash(gost_hash_ctx * ctx, byte * hashval)
     return 1;
 }
 
+/* A file to hash, and in check mode its expected digest */
+struct sum_item {
+    char filename[PATH_MAX + 1];
+    char inhash[MAX_HASH_TXT_BYTES + 1];
+    char sum[MAX_HASH_TXT_BYTES + 1];
+    int hashsize;               /* 0 for a check line of invalid length */
+    unsigned int tree;
+    int error;                  /* errno of a failure */
+};
+
+struct sum_run {
+    int check;
+    int verbose;
+    int open_mode;
+    int count;
+    int errors;
+    int failcount;
+};
+
+/* Threads a file is hashed with in tree mode */
+static int tree_threads = 1;
+
+/* Tree mode digests are tagged with the chunk size */
+void print_sum(const char *sum, const char *filename, unsigned int tree)
+{
+    if (tree)
+        printf("tree:%u:%s %s\n", tree, sum, filename);
+    else
+        printf("%s %s\n", sum, filename);
+}
+
+/* Runs on the workers of the pool */
+static void hash_item(void *p, void *arg)
+{
+    struct sum_item *item = p;
+    struct sum_run *run = arg;
+    gost_hash_ctx ctx;
+
+    item->error = 0;
+    if (item->hashsize
+        && !hash_file(&ctx, item->filename, item->sum, run->open_mode,
+                      item->hashsize, item->tree))
+        item->error = errno ? errno : EIO;
+}
+
+/* Runs on the main thread, in the order of the files */
+static void report_item(void *p, void *arg)
+{
+    struct sum_item *item = p;
+    struct sum_run *run = arg;
+
+    run->count++;
+    if (item->hashsize == 0) {
+        fprintf(stderr, "%s: invalid hash length\n", item->filename);
+        run->errors++;
+        return;
+    }
+    if (item->error) {
+        fprintf(stderr, "%s: %s\n", item->filename, strerror(item->error));
+        run->errors++;
+        return;
+    }
+    if (!run->check) {
+        print_sum(item->sum, item->filename, item->tree);
+        return;
+    }
+
+    if (!strncmp(item->sum, item->inhash, item->hashsize * 2 + 1)) {
+        if (run->verbose) {
+            fprintf(stderr, "%s\tOK\n", item->filename);
+        }
+    } else {
+        if (run->verbose) {
+            fprintf(stderr, "%s\tFAILED\n", item->filename);
+        } else {
+            fprintf(stderr, "%s: GOST hash sum check failed\n",
+                    item->filename);
+        }
+        run->failcount++;
+    }
+}
+
 int main(int argc, char **argv)
 {
     int c, i;
     int verbose = 0;
-    int errors = 0;
     int open_mode = O_RDONLY | O_BINARY;
     FILE *check_file = NULL;
     int filenames_from_stdin = 0;
     int hashsize = 32;
+    unsigned int tree = 0;
+    int jobs = 1;
     gost_hash_ctx ctx;
+    struct sum_item item;
+    struct sum_run run;
+    sum_pool *pool;
 
-    while ((c = getopt(argc, argv, "hxlvc::")) != -1) {
+    memset(&item, 0, sizeof(item));
+    while ((c = getopt(argc, argv, "hxlvc::t::j:")) != -1) {
         switch (c) {
         case 'h':
             help();
@@ -99,6 +203,32 @@ int main(int argc, char **argv)
         case 'x':
             filenames_from_stdin = 1;
             break;
+        case 't':
+            if (optarg) {
+                char *end;
+                unsigned long chunk;
+
+                errno = 0;
+                chunk = strtoul(optarg, &end, 10);
+                if (errno || end == optarg || *end || chunk > TREE_CHUNK_MAX)
+                    chunk = 0;
+                tree = (unsigned int)chunk;
+            } else {
+                tree = TREE_CHUNK_DEFAULT;
+            }
+            if (tree < 1 || tree > TREE_CHUNK_MAX) {
+                fprintf(stderr, "invalid chunk size %s, 1 to %d KiB\n",
+                        optarg, TREE_CHUNK_MAX);
+                exit(3);
+            }
+            break;
+        case 'j':
+            jobs = sum_pool_jobs(optarg);
+            if (jobs < 0) {
+                fprintf(stderr, "invalid number of jobs %s\n", optarg);
+                exit(3);
+            }
+            break;
         case 'c':
             if (optarg) {
                 check_file = fopen(optarg, "r");
@@ -116,11 +246,33 @@ int main(int argc, char **argv)
         }
     }
 
+    if (jobs == 0)
+        jobs = sum_pool_cpus();
+    /* Tree mode shares the processors among the files hashed at once */
+    tree_threads = sum_pool_cpus() / jobs;
+    if (tree_threads < 1)
+        tree_threads = 1;
+
+    memset(&run, 0, sizeof(run));
+    run.check = check_file != NULL;
+    run.verbose = verbose;
+    run.open_mode = open_mode;
+    if (optind == argc && !check_file && !filenames_from_stdin) {
+        char sum[MAX_HASH_TXT_BYTES + 1];
+        if (!hash_stream(&ctx, fileno(stdin), sum, hashsize, tree)) {
+            perror("stdin");
+            exit(1);
+        }
+        print_sum(sum, "-", tree);
+        exit(0);
+    }
+    if (!(pool = sum_pool_new(jobs, sizeof(item), hash_item, report_item,
+                              &run))) {
+        perror(argv[0]);
+        exit(2);
+    }
+
     if (check_file) {
-        char inhash[MAX_HASH_TXT_BYTES + 1], calcsum[MAX_HASH_TXT_BYTES + 1],
-            filename[PATH_MAX];
-        int failcount = 0, count = 0;
-        int expected_hash_size = 0;
         if (check_file == stdin && optind < argc) {
             check_file = fopen(argv[optind], "r");
             if (!check_file) {
@@ -129,117 +281,100 @@ int main(int argc, char **argv)
             }
         }
         while (get_line
-               (check_file, inhash, filename, verbose, &expected_hash_size)) {
-            int error = 0;
-            if (expected_hash_size == 0) {
-                fprintf(stderr, "%s: invalid hash length\n", filename);
-                errors++;
-                count++;
-                continue;
-            }
-
-            if (!hash_file
-                (&ctx, filename, calcsum, open_mode, expected_hash_size)) {
-                errors++;
-                error = 1;
-            }
-            count++;
-            if (error)
-                continue;
-
-            if (!strncmp(calcsum, inhash, expected_hash_size * 2 + 1)) {
-                if (verbose) {
-                    fprintf(stderr, "%s\tOK\n", filename);
-                }
-            } else {
-                if (verbose) {
-                    fprintf(stderr, "%s\tFAILED\n", filename);
-                } else {
-                    fprintf(stderr, "%s: GOST hash sum check failed\n",
-                            filename);
-                }
-                failcount++;
-            }
+               (check_file, item.inhash, item.filename, verbose,
+                &item.hashsize, &item.tree)) {
+            sum_pool_add(pool, &item);
         }
-        if (errors) {
+        sum_pool_finish(pool);
+        if (run.errors) {
             fprintf(stderr,
                     "%s: WARNING %d of %d file(s) cannot be processed\n",
-                    argv[0], errors, count);
+                    argv[0], run.errors, run.count);
 
         }
-        if (failcount) {
+        if (run.failcount) {
             fprintf(stderr,
                     "%s: WARNING %d of %d processed file(s) failed GOST hash sum check\n",
-                    argv[0], failcount, count - errors);
+                    argv[0], run.failcount, run.count - run.errors);
         }
-        exit((failcount || errors) ? 1 : 0);
-    } else if (filenames_from_stdin) {
-        char sum[MAX_HASH_TXT_BYTES + 1];
-        char filename[PATH_MAX + 1], *end;
+        exit((run.failcount || run.errors) ? 1 : 0);
+    }
+
+    item.hashsize = hashsize;
+    item.tree = tree;
+    if (filenames_from_stdin) {
+        char *end;
         while (!feof(stdin)) {
-            if (!fgets(filename, PATH_MAX, stdin))
+            if (!fgets(item.filename, PATH_MAX + 1, stdin))
                 break;
-            for (end = filename; *end; end++) ;
+            for (end = item.filename; *end; end++) ;
             end--;
+            /* A line that did not fit is skipped rather than split */
+            if (*end != '\n' && !feof(stdin)) {
+                fprintf(stderr, "%.64s...: %s\n", item.filename,
+                        strerror(ENAMETOOLONG));
+                run.errors++;
+                while ((c = getchar()) != EOF && c != '\n') ;
+                continue;
+            }
             for (; *end == '\n' || *end == '\r'; end--)
                 *end = 0;
-            if (!hash_file(&ctx, filename, sum, open_mode, hashsize)) {
-                errors++;
-            } else {
-                printf("%s %s\n", sum, filename);
-            }
-        }
-
-    } else if (optind == argc) {
-        char sum[MAX_HASH_TXT_BYTES + 1];
-        if (!hash_stream(&ctx, fileno(stdin), sum, hashsize)) {
-            perror("stdin");
-            exit(1);
+            sum_pool_add(pool, &item);
         }
-        printf("%s -\n", sum);
-        exit(0);
     } else {
         for (i = optind; i < argc; i++) {
-            char sum[MAX_HASH_TXT_BYTES + 1];
-            if (!hash_file(&ctx, argv[i], sum, open_mode, hashsize)) {
-                errors++;
-            } else {
-                printf("%s %s\n", sum, argv[i]);
+            if (strlen(argv[i]) > PATH_MAX) {
+                fprintf(stderr, "%s: %s\n", argv[i], strerror(ENAMETOOLONG));
+                run.errors++;
+                continue;
             }
+            strcpy(item.filename, argv[i]);
+            sum_pool_add(pool, &item);
         }
     }
-    exit(errors ? 1 : 0);
+    sum_pool_finish(pool);
+    exit(run.errors ? 1 : 0);
 }
 
+/* Leaves errno set on failure, for the caller to report */
 int hash_file(gost_hash_ctx * ctx, char *filename, char *sum, int mode,
-              int hashsize)
+              int hashsize, unsigned int tree)
 {
-    int fd;
+    int fd, error;
     if ((fd = open(filename, mode)) < 0) {
-        perror(filename);
         return 0;
     }
-    if (!hash_stream(ctx, fd, sum, hashsize)) {
-        perror(filename);
+    if (!hash_stream(ctx, fd, sum, hashsize, tree)) {
+        error = errno;
         close(fd);
+        errno = error;
         return 0;
     }
     close(fd);
     return 1;
 }
 
-int hash_stream(gost_hash_ctx * ctx, int fd, char *sum, int hashsize)
+static void sum_update(void *ctx, const unsigned char *data, size_t len)
 {
-    unsigned char buffer[BUF_SIZE];
-    ssize_t bytes;
+    hash_block(ctx, data, len);
+}
+
+int hash_stream(gost_hash_ctx * ctx, int fd, char *sum, int hashsize,
+                unsigned int tree)
+{
+    unsigned char buffer[64];
     int i;
-    start_hash(ctx, hashsize * 8);
-    while ((bytes = read(fd, buffer, BUF_SIZE)) > 0) {
-        hash_block(ctx, buffer, bytes);
+    if (tree) {
+        if (!hash_tree(fd, buffer, hashsize, (size_t)tree * 1024))
+            return 0;
+        for (i = 0; i < hashsize; i++) {
+            sprintf(sum + 2 * i, "%02x", buffer[i]);
+        }
+        return 1;
     }
-    if (bytes < 0) {
+    start_hash(ctx, hashsize * 8);
+    if (!sum_read(fd, sum_update, ctx))
         return 0;
-    }
     finish_hash(ctx, buffer);
     for (i = 0; i < hashsize; i++) {
         sprintf(sum + 2 * i, "%02x", buffer[i]);
@@ -247,7 +382,229 @@ int hash_stream(gost_hash_ctx * ctx, int fd, char *sum, int hashsize)
     return 1;
 }
 
-int get_line(FILE *f, char *hash, char *filename, int verbose, int *size)
+/*
+ * Tree mode. The input is cut into chunks of the given size, the last one
+ * possibly shorter, and the digest is the root of a binary hash tree over
+ * them, shaped as in RFC 6962: a leaf is H(0x00 || chunk), a node is
+ * H(0x01 || left || right), and at every level an odd last node is carried
+ * up unchanged. An empty input is one empty chunk. H is Streebog of the
+ * selected size throughout.
+ *
+ * Runs of GOST2012_HASH_LANES chunks are read in turn and hashed by a pool
+ * of threads, each run with the multi-buffer functions, and reduced to the
+ * root of its subtree. Runs start at multiples of the lane count, so the
+ * roots of the runs are nodes of the whole tree.
+ */
+struct tree_job {
+    int fd;
+    int hashsize;
+    size_t chunk;
+    size_t runs;                /* runs read so far */
+    size_t alloc;               /* runs the roots array holds */
+    byte *roots;                /* hashsize bytes per run */
+    int eof;
+    int error;                  /* errno of the first failure */
+#ifdef TREE_THREADS
+    pthread_mutex_t lock;
+#endif
+};
+
+#ifdef TREE_THREADS
+# define TREE_LOCK(job) pthread_mutex_lock(&(job)->lock)
+# define TREE_UNLOCK(job) pthread_mutex_unlock(&(job)->lock)
+#else
+# define TREE_LOCK(job)
+# define TREE_UNLOCK(job)
+#endif
+
+static ssize_t read_full(int fd, byte * buf, size_t len)
+{
+    size_t done = 0;
+    ssize_t bytes;
+
+    while (done < len) {
+        bytes = read(fd, buf + done, len - done);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes < 0)
+            return -1;
+        if (bytes == 0)
+            break;
+        done += bytes;
+    }
+    return done;
+}
+
+/* Replaces the n nodes of a level at nodes with the root above them */
+static void tree_reduce(byte * nodes, size_t n, int hashsize)
+{
+    static const byte node = 1;
+    gost_hash_ctx ctx;
+    size_t i;
+
+    while (n > 1) {
+        for (i = 0; 2 * i + 1 < n; i++) {
+            start_hash(&ctx, hashsize * 8);
+            hash_block(&ctx, &node, 1);
+            hash_block(&ctx, nodes + 2 * i * hashsize, 2 * hashsize);
+            finish_hash(&ctx, nodes + i * hashsize);
+        }
+        if (n & 1)
+            memmove(nodes + i * hashsize, nodes + (n - 1) * hashsize,
+                    hashsize);
+        n = (n + 1) / 2;
+    }
+}
+
+/* Leaves of n chunks of len bytes */
+static void tree_leaves(const byte * const data[], size_t len,
+                        byte * const digest[], unsigned int n, int hashsize)
+{
+    static const byte leaf = 0;
+    gost_hash_ctx ctx[GOST2012_HASH_LANES], *pctx[GOST2012_HASH_LANES];
+    const byte *prefix[GOST2012_HASH_LANES];
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        start_hash(&ctx[i], hashsize * 8);
+        pctx[i] = &ctx[i];
+        prefix[i] = &leaf;
+    }
+    gost2012_hash_block_multi(pctx, prefix, 1, n);
+    gost2012_hash_block_multi(pctx, data, len, n);
+    gost2012_finish_hash_multi(pctx, digest, n);
+}
+
+static void *tree_worker(void *arg)
+{
+    struct tree_job *job = arg;
+    byte *buf = malloc(GOST2012_HASH_LANES * job->chunk);
+    byte nodes[GOST2012_HASH_LANES * 64];
+    const byte *data[GOST2012_HASH_LANES];
+    byte *digest[GOST2012_HASH_LANES];
+    size_t run, last;
+    unsigned int n, i;
+    ssize_t bytes;
+
+    if (buf == NULL) {
+        TREE_LOCK(job);
+        job->error = ENOMEM;
+        TREE_UNLOCK(job);
+        return NULL;
+    }
+    for (i = 0; i < GOST2012_HASH_LANES; i++) {
+        data[i] = buf + i * job->chunk;
+        digest[i] = nodes + i * job->hashsize;
+    }
+
+    for (;;) {
+        TREE_LOCK(job);
+        last = job->chunk;
+        for (n = 0; n < GOST2012_HASH_LANES && !job->eof && !job->error;
+             n++) {
+            bytes = read_full(job->fd, buf + n * job->chunk, job->chunk);
+            if (bytes < 0) {
+                job->error = errno;
+                break;
+            }
+            if ((size_t)bytes < job->chunk) {
+                job->eof = 1;
+                /* No empty chunk at the end, unless the input is empty */
+                if (bytes == 0 && (n > 0 || job->runs > 0))
+                    break;
+                last = bytes;
+            }
+        }
+        if (job->error || n == 0) {
+            TREE_UNLOCK(job);
+            break;
+        }
+        run = job->runs++;
+        if (job->runs > job->alloc) {
+            size_t alloc = job->alloc ? job->alloc * 2 : 64;
+            byte *roots = realloc(job->roots, alloc * job->hashsize);
+
+            if (roots == NULL) {
+                job->error = ENOMEM;
+                TREE_UNLOCK(job);
+                break;
+            }
+            job->roots = roots;
+            job->alloc = alloc;
+        }
+        TREE_UNLOCK(job);
+
+        /* Only the last chunk of the input may be short */
+        if (last == job->chunk) {
+            tree_leaves(data, job->chunk, digest, n, job->hashsize);
+        } else {
+            if (n > 1)
+                tree_leaves(data, job->chunk, digest, n - 1, job->hashsize);
+            tree_leaves(data + n - 1, last, digest + n - 1, 1,
+                        job->hashsize);
+        }
+        tree_reduce(nodes, n, job->hashsize);
+
+        TREE_LOCK(job);
+        memcpy(job->roots + run * job->hashsize, nodes, job->hashsize);
+        TREE_UNLOCK(job);
+    }
+    free(buf);
+    return NULL;
+}
+
+int hash_tree(int fd, byte * digest, int hashsize, size_t chunk)
+{
+    struct tree_job job;
+    struct stat st;
+    long threads = tree_threads;
+#ifdef TREE_THREADS
+    pthread_t tid[256];
+    long i, started = 0;
+#endif
+
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    job.hashsize = hashsize;
+    job.chunk = chunk;
+
+    /* No more threads than runs in a regular file */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        size_t runs = st.st_size / (chunk * GOST2012_HASH_LANES) + 1;
+
+        if ((size_t)threads > runs)
+            threads = (long)runs;
+    }
+#ifdef TREE_THREADS
+    if (threads > 256)
+        threads = 256;
+    pthread_mutex_init(&job.lock, NULL);
+    for (i = 0; i < threads - 1; i++) {
+        if (pthread_create(&tid[started], NULL, tree_worker, &job) == 0)
+            started++;
+    }
+    tree_worker(&job);
+    for (i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    pthread_mutex_destroy(&job.lock);
+#else
+    tree_worker(&job);
+#endif
+
+    if (!job.error)
+        tree_reduce(job.roots, job.runs, hashsize);
+    if (!job.error)
+        memcpy(digest, job.roots, hashsize);
+    free(job.roots);
+    if (job.error) {
+        errno = job.error;
+        return 0;
+    }
+    return 1;
+}
+
+int get_line(FILE *f, char *hash, char *filename, int verbose, int *size,
+             unsigned int *tree)
 {
     int i, len;
     char *ptr = filename;
@@ -267,6 +624,17 @@ int get_line(FILE *f, char *hash, char *filename, int verbose, int *size)
         if (len == 0)
             goto nextline;
 
+        *tree = 0;
+        if (!strncmp(ptr, "tree:", 5)) {
+            char *end;
+            unsigned long chunk = strtoul(ptr + 5, &end, 10);
+
+            if (*end != ':' || chunk < 1 || chunk > TREE_CHUNK_MAX)
+                goto nextline;
+            *tree = (unsigned int)chunk;
+            ptr = end + 1;
+        }
+
         spacepos = strchr(ptr, ' ');
         if (spacepos == NULL || strlen(spacepos + 1) == 0)
             goto nextline;
@@ -251,25 +251,147 @@ const byte ACPKM_D_const[] = {
     0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
 };
 
-/* Initialization of gost_ctx subst blocks*/
-void kboxinit(gost_ctx * c, const gost_subst_block * b)
+/* Parameter sets which have shared expanded tables */
+static const gost_subst_block *const gost_kbox_sblocks[] = {
+    &GostR3411_94_TestParamSet,
+    &GostR3411_94_CryptoProParamSet,
+    &Gost28147_TestParamSet,
+    &Gost28147_CryptoProParamSetA,
+    &Gost28147_CryptoProParamSetB,
+    &Gost28147_CryptoProParamSetC,
+    &Gost28147_CryptoProParamSetD,
+    &Gost28147_TC26ParamSetZ,
+};
+
+#define GOST_KBOX_COUNT \
+    (sizeof(gost_kbox_sblocks) / sizeof(gost_kbox_sblocks[0]))
+
+static gost_kbox gost_kboxes[GOST_KBOX_COUNT];
+static CRYPTO_ONCE gost_kbox_once = CRYPTO_ONCE_STATIC_INIT;
+
+/*
+ * Other substitution blocks are expanded on first use into this list,
+ * which is also shared and kept until gost_kbox_free(). Its lock comes
+ * from gost_kbox_lock_init() at engine load rather than gost_kbox_once,
+ * so that a reload after gost_kbox_free() gets a new one. The parameter
+ * sets need no lock and remain usable after it.
+ */
+typedef struct gost_kbox_custom_st {
+    gost_subst_block sblock;
+    gost_kbox kbox;
+    struct gost_kbox_custom_st *next;
+} GOST_KBOX_CUSTOM;
+
+static GOST_KBOX_CUSTOM *gost_kbox_custom;
+static CRYPTO_RWLOCK *gost_kbox_lock;
+
+static void gost_kbox_expand(gost_kbox * k, const gost_subst_block * b)
 {
     int i;
 
     for (i = 0; i < 256; i++) {
-        c->k87[i] = (word32) (b->k8[i >> 4] << 4 | b->k7[i & 15]) << 24;
-        c->k65[i] = (b->k6[i >> 4] << 4 | b->k5[i & 15]) << 16;
-        c->k43[i] = (b->k4[i >> 4] << 4 | b->k3[i & 15]) << 8;
-        c->k21[i] = b->k2[i >> 4] << 4 | b->k1[i & 15];
+        k->k87[i] = (word32) (b->k8[i >> 4] << 4 | b->k7[i & 15]) << 24;
+        k->k65[i] = (b->k6[i >> 4] << 4 | b->k5[i & 15]) << 16;
+        k->k43[i] = (b->k4[i >> 4] << 4 | b->k3[i & 15]) << 8;
+        k->k21[i] = b->k2[i >> 4] << 4 | b->k1[i & 15];
+
+    }
+}
+
+static void gost_kbox_init(void)
+{
+    size_t i;
+
+    for (i = 0; i < GOST_KBOX_COUNT; i++)
+        gost_kbox_expand(&gost_kboxes[i], gost_kbox_sblocks[i]);
+}
+
+int gost_kbox_lock_init(void)
+{
+    if (gost_kbox_lock == NULL)
+        gost_kbox_lock = CRYPTO_THREAD_lock_new();
+    return gost_kbox_lock != NULL;
+}
+
+static const gost_kbox *gost_kbox_find(const gost_subst_block * b)
+{
+    GOST_KBOX_CUSTOM *k;
+
+    for (k = gost_kbox_custom; k != NULL; k = k->next)
+        if (memcmp(b, &k->sblock, sizeof(*b)) == 0)
+            return &k->kbox;
+    return NULL;
+}
+
+const gost_kbox *gost_kbox_get(const gost_subst_block * b)
+{
+    const gost_kbox *kbox;
+    GOST_KBOX_CUSTOM *k;
+    size_t i;
+
+    if (!CRYPTO_THREAD_run_once(&gost_kbox_once, gost_kbox_init))
+        return NULL;
+    for (i = 0; i < GOST_KBOX_COUNT; i++)
+        if (b == gost_kbox_sblocks[i])
+            return &gost_kboxes[i];
+    /* A copy of one of the parameter sets */
+    for (i = 0; i < GOST_KBOX_COUNT; i++)
+        if (memcmp(b, gost_kbox_sblocks[i], sizeof(*b)) == 0)
+            return &gost_kboxes[i];
+
+    if (gost_kbox_lock == NULL || !CRYPTO_THREAD_read_lock(gost_kbox_lock))
+        return NULL;
+    kbox = gost_kbox_find(b);
+    CRYPTO_THREAD_unlock(gost_kbox_lock);
+    if (kbox != NULL)
+        return kbox;
+
+    if ((k = OPENSSL_malloc(sizeof(*k))) == NULL)
+        return NULL;
+    memcpy(&k->sblock, b, sizeof(*b));
+    gost_kbox_expand(&k->kbox, b);
+    if (!CRYPTO_THREAD_write_lock(gost_kbox_lock)) {
+        OPENSSL_free(k);
+        return NULL;
+    }
+    /* Another thread may have added it meanwhile */
+    if ((kbox = gost_kbox_find(b)) == NULL) {
+        k->next = gost_kbox_custom;
+        gost_kbox_custom = k;
+        kbox = &k->kbox;
+        k = NULL;
+    }
+    CRYPTO_THREAD_unlock(gost_kbox_lock);
+    OPENSSL_free(k);
+    return kbox;
+}
+
+void gost_kbox_free(void)
+{
+    GOST_KBOX_CUSTOM *k;
 
+    while ((k = gost_kbox_custom) != NULL) {
+        gost_kbox_custom = k->next;
+        OPENSSL_free(k);
     }
+    CRYPTO_THREAD_lock_free(gost_kbox_lock);
+    gost_kbox_lock = NULL;
+}
+
+/* Initialization of gost_ctx subst blocks, 0 if out of memory */
+int kboxinit(gost_ctx * c, const gost_subst_block * b)
+{
+    c->kbox = gost_kbox_get(b);
+    return c->kbox != NULL;
 }
 
 /* Part of GOST 28147 algorithm moved into separate function */
 static word32 f(gost_ctx * c, word32 x)
 {
-    x = c->k87[x >> 24 & 255] | c->k65[x >> 16 & 255] |
-        c->k43[x >> 8 & 255] | c->k21[x & 255];
+    const gost_kbox *k = c->kbox;
+
+    x = k->k87[x >> 24 & 255] | k->k65[x >> 16 & 255] |
+        k->k43[x >> 8 & 255] | k->k21[x & 255];
     /* Rotate left 11 bits */
     return x << 11 | x >> (32 - 11);
 }
@@ -488,27 +610,56 @@ void magmadecrypt(gost_ctx * c, const byte * in, byte * out)
     out[7-7] = (byte) (n1 >> 24);
 }
 
+/*
+ * Multi-block routines. Whole batches go to the SIMD kernels, the rest
+ * block by block.
+ */
+void gostcrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                      size_t blocks)
+{
+    size_t i = gost_vperm_blocks(c, in, out, blocks, 0, 0);
+
+    for (; i < blocks; i++)
+        gostcrypt(c, in + 8 * i, out + 8 * i);
+}
+
+void gostdecrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                        size_t blocks)
+{
+    size_t i = gost_vperm_blocks(c, in, out, blocks, 1, 0);
+
+    for (; i < blocks; i++)
+        gostdecrypt(c, in + 8 * i, out + 8 * i);
+}
+
+void magmacrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                       size_t blocks)
+{
+    size_t i = gost_vperm_blocks(c, in, out, blocks, 0, 1);
+
+    for (; i < blocks; i++)
+        magmacrypt(c, in + 8 * i, out + 8 * i);
+}
+
+void magmadecrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                         size_t blocks)
+{
+    size_t i = gost_vperm_blocks(c, in, out, blocks, 1, 1);
+
+    for (; i < blocks; i++)
+        magmadecrypt(c, in + 8 * i, out + 8 * i);
+}
 
 /* Encrypts several blocks in ECB mode */
 void gost_enc(gost_ctx * c, const byte * clear, byte * cipher, int blocks)
 {
-    int i;
-    for (i = 0; i < blocks; i++) {
-        gostcrypt(c, clear, cipher);
-        clear += 8;
-        cipher += 8;
-    }
+    gostcrypt_blocks(c, clear, cipher, blocks);
 }
 
 /* Decrypts several blocks in ECB mode */
 void gost_dec(gost_ctx * c, const byte * cipher, byte * clear, int blocks)
 {
-    int i;
-    for (i = 0; i < blocks; i++) {
-        gostdecrypt(c, cipher, clear);
-        clear += 8;
-        cipher += 8;
-    }
+    gostdecrypt_blocks(c, cipher, clear, blocks);
 }
 
 /* Encrypts several full blocks in CFB mode using 8byte IV */
@@ -620,12 +771,12 @@ void magma_get_key(gost_ctx * c, byte * k)
 }
 
 /* Initalize context. Provides default value for subst_block */
-void gost_init(gost_ctx * c, const gost_subst_block * b)
+int gost_init(gost_ctx * c, const gost_subst_block * b)
 {
     if (!b) {
         b = &GostR3411_94_TestParamSet;
     }
-    kboxinit(c, b);
+    return kboxinit(c, b);
 }
 
 /* Cleans up key from context */
@@ -750,9 +901,12 @@ int gost_mac_iv(gost_ctx * ctx, int mac_len, const unsigned char *iv,
 void cryptopro_key_meshing(gost_ctx * ctx, unsigned char *iv)
 {
     unsigned char newkey[32];
+    int i;
     /* Set static keymeshing key */
     /* "Decrypt" key with keymeshing key */
-    gost_dec(ctx, CryptoProKeyMeshingKey, newkey, 4);
+    for (i = 0; i < 4; i++) {
+        gostdecrypt(ctx, CryptoProKeyMeshingKey + 8 * i, newkey + 8 * i);
+    }
     /* set new key */
     gost_key(ctx, newkey);
     OPENSSL_cleanse(newkey, sizeof(newkey));
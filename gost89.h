@@ -10,6 +10,8 @@
 #ifndef GOST89_H
 # define GOST89_H
 
+# include <stddef.h>
+
 /* Typedef for unsigned 32-bit integer */
 # if __LONG_MAX__ > 2147483647L
 typedef unsigned int u4;
@@ -31,13 +33,21 @@ typedef struct {
     byte k1[16];
 } gost_subst_block;
 
+/* Substitution block expanded into lookup tables for the bytes of a word */
+typedef struct {
+    u4 k87[256], k65[256], k43[256], k21[256];
+} gost_kbox;
+
 /* Cipher context includes key and preprocessed  substitution block */
 typedef struct {
     u4 master_key[8];
     u4 key[8];
     u4 mask[8];
-    /* Constant s-boxes -- set up in gost_init(). */
-    u4 k87[256], k65[256], k43[256], k21[256];
+    /*
+     * Constant s-boxes -- set up in gost_init(). The tables are built once
+     * per substitution block and shared between contexts.
+     */
+    const gost_kbox *kbox;
 } gost_ctx;
 /*
  * Note: encrypt and decrypt expect full blocks--padding blocks is caller's
@@ -63,6 +73,25 @@ void gostdecrypt(gost_ctx * c, const byte * in, byte * out);
 void magmacrypt(gost_ctx * c, const byte * in, byte * out);
 /* Decrypt one  block */
 void magmadecrypt(gost_ctx * c, const byte * in, byte * out);
+/*
+ * Encrypt or decrypt several independent blocks, in SIMD lanes where the
+ * CPU allows. Modes feed them batches of GOST_PARALLEL_BLOCKS blocks.
+ */
+# define GOST_PARALLEL_BLOCKS 64
+void gostcrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                      size_t blocks);
+void gostdecrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                        size_t blocks);
+void magmacrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                       size_t blocks);
+void magmadecrypt_blocks(gost_ctx * c, const byte * in, byte * out,
+                         size_t blocks);
+/*
+ * SSSE3, AVX2 and AVX-512 kernels of gost89_vperm.c for whole batches of
+ * 4, 8 or 16 blocks. Return the number of blocks done.
+ */
+size_t gost_vperm_blocks(gost_ctx * c, const byte * in, byte * out,
+                         size_t blocks, int decrypt, int magma);
 /* Set key into context */
 void gost_key(gost_ctx * c, const byte * k);
 /* Set key into context without key mask */
@@ -73,8 +102,8 @@ void magma_key(gost_ctx * c, const byte * k);
 void magma_master_key(gost_ctx *c, const byte *k);
 /* Get key from context */
 void gost_get_key(gost_ctx * c, byte * k);
-/* Set S-blocks into context */
-void gost_init(gost_ctx * c, const gost_subst_block * b);
+/* Set S-blocks into context, 0 if out of memory */
+int gost_init(gost_ctx * c, const gost_subst_block * b);
 /* Clean up context */
 void gost_destroy(gost_ctx * c);
 /* Intermediate function used for calculate hash */
@@ -107,8 +136,19 @@ extern gost_subst_block Gost28147_CryptoProParamSetD;
 extern gost_subst_block Gost28147_TC26ParamSetZ;
 extern const byte CryptoProKeyMeshingKey[];
 typedef unsigned int word32;
+/*
+ * Returns the shared expanded tables of a substitution block, built once
+ * for each of the parameter sets above and on first use for others, or
+ * NULL if out of memory. Other blocks need gost_kbox_lock_init(), called
+ * once at load, and contexts with them must be done with before
+ * gost_kbox_free(), which frees their tables; only the parameter sets are
+ * available after it until gost_kbox_lock_init() is called again.
+ */
+const gost_kbox *gost_kbox_get(const gost_subst_block * b);
+int gost_kbox_lock_init(void);
+void gost_kbox_free(void);
 /* For tests. */
-void kboxinit(gost_ctx * c, const gost_subst_block * b);
+int kboxinit(gost_ctx * c, const gost_subst_block * b);
 void magma_get_key(gost_ctx * c, byte * k);
 void acpkm_magma_key_meshing(gost_ctx * ctx);
 #endif
@@ -0,0 +1,212 @@
+/*
+ * This file is distributed under the same license as OpenSSL
+ *
+ * Multi-lane implementation of GOST 28147-89 and Magma for SSSE3, AVX2 and
+ * AVX-512, selected at run time. See gost89_vperm_impl.h for the algorithm.
+ */
+
+#include "gost89.h"
+#include "gost_cpu.h"
+
+#if defined(GOST_X86_DISPATCH)
+#include <immintrin.h>
+
+// S-boxes 2p + 1 and 2p + 2 of byte p, the latter shifted to the high nibble
+typedef struct {
+    byte lo[4][16];
+    byte hi[4][16];
+} gost_vperm_sbox;
+
+// reverses the bytes of every 64-bit block
+static const byte gost_vperm_bswap64[16] = {
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+};
+
+// SSSE3: 4 blocks
+
+#define VPERM_SUFFIX ssse3
+#define VPERM_TARGET GOST_TARGET("ssse3")
+#define VPERM_BLOCKS 4
+#define vperm_t __m128i
+
+#define V_SET1_32(w) _mm_set1_epi32((int) (w))
+#define V_TABLE(p) _mm_loadu_si128((const __m128i*) (p))
+#define V_LOAD(p) _mm_loadu_si128((const __m128i*) (p))
+#define V_STORE(p, v) _mm_storeu_si128((__m128i*) (p), v)
+#define V_AND(a, b) _mm_and_si128(a, b)
+#define V_OR(a, b) _mm_or_si128(a, b)
+#define V_XOR(a, b) _mm_xor_si128(a, b)
+#define V_ADD32(a, b) _mm_add_epi32(a, b)
+#define V_SRLI32(a, n) _mm_srli_epi32(a, n)
+#define V_ROL32(a, n) _mm_or_si128(_mm_slli_epi32(a, n), _mm_srli_epi32(a, 32 - (n)))
+#define V_SHUFFLE(t, i) _mm_shuffle_epi8(t, i)
+#define V_BSWAP64(a) _mm_shuffle_epi8(a, V_TABLE(gost_vperm_bswap64))
+#define V_EVEN32(a, b) _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), 0x88))
+#define V_ODD32(a, b) _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), 0xDD))
+#define V_UNPACKLO32(a, b) _mm_unpacklo_epi32(a, b)
+#define V_UNPACKHI32(a, b) _mm_unpackhi_epi32(a, b)
+
+#include "gost89_vperm_impl.h"
+
+#undef VPERM_SUFFIX
+#undef VPERM_TARGET
+#undef VPERM_BLOCKS
+#undef vperm_t
+#undef V_SET1_32
+#undef V_TABLE
+#undef V_LOAD
+#undef V_STORE
+#undef V_AND
+#undef V_OR
+#undef V_XOR
+#undef V_ADD32
+#undef V_SRLI32
+#undef V_ROL32
+#undef V_SHUFFLE
+#undef V_BSWAP64
+#undef V_EVEN32
+#undef V_ODD32
+#undef V_UNPACKLO32
+#undef V_UNPACKHI32
+
+// AVX2: 8 blocks, the shuffles work within the 128-bit lanes
+
+#define VPERM_SUFFIX avx2
+#define VPERM_TARGET GOST_TARGET("avx2")
+#define VPERM_BLOCKS 8
+#define vperm_t __m256i
+
+#define V_SET1_32(w) _mm256_set1_epi32((int) (w))
+#define V_TABLE(p) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) (p)))
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i*) (p))
+#define V_STORE(p, v) _mm256_storeu_si256((__m256i*) (p), v)
+#define V_AND(a, b) _mm256_and_si256(a, b)
+#define V_OR(a, b) _mm256_or_si256(a, b)
+#define V_XOR(a, b) _mm256_xor_si256(a, b)
+#define V_ADD32(a, b) _mm256_add_epi32(a, b)
+#define V_SRLI32(a, n) _mm256_srli_epi32(a, n)
+#define V_ROL32(a, n) _mm256_or_si256(_mm256_slli_epi32(a, n), _mm256_srli_epi32(a, 32 - (n)))
+#define V_SHUFFLE(t, i) _mm256_shuffle_epi8(t, i)
+#define V_BSWAP64(a) _mm256_shuffle_epi8(a, V_TABLE(gost_vperm_bswap64))
+#define V_EVEN32(a, b) _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), 0x88))
+#define V_ODD32(a, b) _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), 0xDD))
+#define V_UNPACKLO32(a, b) _mm256_unpacklo_epi32(a, b)
+#define V_UNPACKHI32(a, b) _mm256_unpackhi_epi32(a, b)
+
+#include "gost89_vperm_impl.h"
+
+#undef VPERM_SUFFIX
+#undef VPERM_TARGET
+#undef VPERM_BLOCKS
+#undef vperm_t
+#undef V_SET1_32
+#undef V_TABLE
+#undef V_LOAD
+#undef V_STORE
+#undef V_AND
+#undef V_OR
+#undef V_XOR
+#undef V_ADD32
+#undef V_SRLI32
+#undef V_ROL32
+#undef V_SHUFFLE
+#undef V_BSWAP64
+#undef V_EVEN32
+#undef V_ODD32
+#undef V_UNPACKLO32
+#undef V_UNPACKHI32
+
+/*
+ * AVX-512 with VBMI: 16 blocks. vpermb takes a 6-bit index, so the byte
+ * position goes to bits 4 and 5 of it and one lookup serves all four
+ * S-boxes of the low or of the high nibbles.
+ */
+
+#define VPERM_SUFFIX avx512
+#define VPERM_TARGET GOST_TARGET("avx512f,avx512bw,avx512vbmi")
+#define VPERM_BLOCKS 16
+#define vperm_t __m512i
+
+#define V_SET1_32(w) _mm512_set1_epi32((int) (w))
+#define V_LOAD(p) _mm512_loadu_si512(p)
+#define V_STORE(p, v) _mm512_storeu_si512(p, v)
+#define V_XOR(a, b) _mm512_xor_si512(a, b)
+#define V_ADD32(a, b) _mm512_add_epi32(a, b)
+#define V_BSWAP64(a) _mm512_shuffle_epi8(a, _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*) gost_vperm_bswap64)))
+#define V_EVEN32(a, b) _mm512_castps_si512(_mm512_shuffle_ps(_mm512_castsi512_ps(a), _mm512_castsi512_ps(b), 0x88))
+#define V_ODD32(a, b) _mm512_castps_si512(_mm512_shuffle_ps(_mm512_castsi512_ps(a), _mm512_castsi512_ps(b), 0xDD))
+#define V_UNPACKLO32(a, b) _mm512_unpacklo_epi32(a, b)
+#define V_UNPACKHI32(a, b) _mm512_unpackhi_epi32(a, b)
+
+#define VPERM_NATIVE_F
+#define VPERM_TABLES 2
+
+static VPERM_TARGET void gost_vperm_tables_avx512(__m512i* t, const gost_vperm_sbox* s) {
+    t[0] = _mm512_loadu_si512(s->lo);
+    t[1] = _mm512_loadu_si512(s->hi);
+}
+
+static VPERM_TARGET __m512i gost_vperm_f_avx512(__m512i x, const __m512i* t) {
+    const __m512i c0f = _mm512_set1_epi32(0x0F0F0F0F), pos = _mm512_set1_epi32(0x30201000);
+    // (x & c0f) | pos
+    __m512i lo = _mm512_ternarylogic_epi32(x, c0f, pos, 0xEA);
+    __m512i hi = _mm512_ternarylogic_epi32(_mm512_srli_epi32(x, 4), c0f, pos, 0xEA);
+
+    return _mm512_rol_epi32(_mm512_or_si512(_mm512_permutexvar_epi8(lo, t[0]),
+                                            _mm512_permutexvar_epi8(hi, t[1])), 11);
+}
+
+#include "gost89_vperm_impl.h"
+
+#define GOST_VPERM_AVX512 (GOST_CPU_AVX512F | GOST_CPU_AVX512BW | GOST_CPU_AVX512VBMI)
+
+// key words of the rounds
+static const unsigned char gost_vperm_encrypt_order[32] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7,
+    0, 1, 2, 3, 4, 5, 6, 7, 7, 6, 5, 4, 3, 2, 1, 0
+};
+
+static const unsigned char gost_vperm_decrypt_order[32] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 7, 6, 5, 4, 3, 2, 1, 0,
+    7, 6, 5, 4, 3, 2, 1, 0, 7, 6, 5, 4, 3, 2, 1, 0
+};
+
+// recovers the S-boxes from the expanded tables of the context
+static void gost_vperm_sbox_init(gost_vperm_sbox* s, const gost_ctx* c) {
+    const u4* k[4] = {c->kbox->k21, c->kbox->k43, c->kbox->k65, c->kbox->k87};
+    int p, n;
+
+    for (p = 0; p < 4; p++) {
+        for (n = 0; n < 16; n++) {
+            s->lo[p][n] = (byte) ((k[p][n] >> (8 * p)) & 0x0F);
+            s->hi[p][n] = (byte) ((k[p][n << 4] >> (8 * p)) & 0xF0);
+        }
+    }
+}
+
+size_t gost_vperm_blocks(gost_ctx* c, const byte* in, byte* out, size_t blocks, int decrypt, int magma) {
+    const unsigned char* order = decrypt ? gost_vperm_decrypt_order : gost_vperm_encrypt_order;
+    unsigned int caps = gost_cpu_caps();
+    gost_vperm_sbox s;
+    size_t done = 0;
+
+    if (blocks < 4 || !(caps & (GOST_CPU_SSSE3 | GOST_CPU_AVX2 | GOST_CPU_AVX512F)))
+        return 0;
+
+    gost_vperm_sbox_init(&s, c);
+    if ((caps & GOST_VPERM_AVX512) == GOST_VPERM_AVX512)
+        done = gost_vperm_crypt_avx512(c, &s, order, magma, in, out, blocks);
+    if (caps & GOST_CPU_AVX2)
+        done += gost_vperm_crypt_avx2(c, &s, order, magma, in + 8 * done, out + 8 * done, blocks - done);
+    if (caps & GOST_CPU_SSSE3)
+        done += gost_vperm_crypt_ssse3(c, &s, order, magma, in + 8 * done, out + 8 * done, blocks - done);
+    return done;
+}
+
+#else
+
+size_t gost_vperm_blocks(gost_ctx* c, const byte* in, byte* out, size_t blocks, int decrypt, int magma) {
+    return 0;
+}
+
+#endif
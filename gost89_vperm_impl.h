@@ -0,0 +1,99 @@
+/*
+ * This file is distributed under the same license as OpenSSL
+ *
+ * Multi-lane GOST 28147-89 (Magma) kernel, included by gost89_vperm.c once
+ * per instruction set. The includer defines:
+ *   VPERM_SUFFIX       suffix of the generated function names
+ *   VPERM_TARGET       target attribute of the generated functions
+ *   VPERM_BLOCKS       32-bit lanes of a register, the blocks of a batch
+ *   vperm_t            the vector type
+ * and the V_* operations on it used below. It may also provide its own
+ * gost_vperm_tables and gost_vperm_f, defining VPERM_NATIVE_F.
+ *
+ * Lane i of two registers holds the halves n1 and n2 of block i, so every
+ * round is the same for all lanes. The 4-bit S-boxes are pshufb lookups of
+ * the nibbles, and nothing depends on secret-indexed memory.
+ */
+
+#define VPERM_CAT_(a, b) a##_##b
+#define VPERM_CAT(a, b) VPERM_CAT_(a, b)
+#define VPERM(name) VPERM_CAT(name, VPERM_SUFFIX)
+
+#if !defined(VPERM_NATIVE_F)
+# define VPERM_TABLES 12
+
+static VPERM_TARGET void VPERM(gost_vperm_tables)(vperm_t* t, const gost_vperm_sbox* s) {
+    int p;
+
+    for (p = 0; p < 4; p++) {
+        t[p] = V_TABLE(s->lo[p]);
+        t[p + 4] = V_TABLE(s->hi[p]);
+        // bit 7 of the index in the other bytes makes pshufb return 0
+        t[p + 8] = V_SET1_32(0x80808080U & ~(0xFFU << (8 * p)));
+    }
+}
+
+// the lookups of the four bytes of x are merged by or
+static VPERM_TARGET vperm_t VPERM(gost_vperm_f)(vperm_t x, const vperm_t* t) {
+    const vperm_t c0f = V_SET1_32(0x0F0F0F0FU);
+    vperm_t lo = V_AND(x, c0f), hi = V_AND(V_SRLI32(x, 4), c0f);
+    vperm_t y;
+
+    y = V_OR(V_SHUFFLE(t[0], V_OR(lo, t[8])), V_SHUFFLE(t[4], V_OR(hi, t[8])));
+    y = V_OR(y, V_OR(V_SHUFFLE(t[1], V_OR(lo, t[9])), V_SHUFFLE(t[5], V_OR(hi, t[9]))));
+    y = V_OR(y, V_OR(V_SHUFFLE(t[2], V_OR(lo, t[10])), V_SHUFFLE(t[6], V_OR(hi, t[10]))));
+    y = V_OR(y, V_OR(V_SHUFFLE(t[3], V_OR(lo, t[11])), V_SHUFFLE(t[7], V_OR(hi, t[11]))));
+    return V_ROL32(y, 11);
+}
+#endif
+
+/*
+ * Runs the 32 rounds with the key words in order on whole batches, for
+ * Magma with the bytes of every block reversed. Returns the number of
+ * blocks done.
+ */
+static VPERM_TARGET size_t VPERM(gost_vperm_crypt)(const gost_ctx* c, const gost_vperm_sbox* s,
+                                                   const unsigned char* order, int magma,
+                                                   const byte* in, byte* out, size_t blocks) {
+    vperm_t t[VPERM_TABLES], k[8], m[8], n1, n2, a, b;
+    size_t done;
+    int i;
+
+    VPERM(gost_vperm_tables)(t, s);
+    for (i = 0; i < 8; i++) {
+        k[i] = V_SET1_32(c->key[i]);
+        m[i] = V_SET1_32(c->mask[i]);
+    }
+
+    for (done = 0; blocks - done >= VPERM_BLOCKS; done += VPERM_BLOCKS) {
+        a = V_LOAD(in + 8 * done);
+        b = V_LOAD(in + 8 * done + 4 * VPERM_BLOCKS);
+        if (magma) {
+            a = V_BSWAP64(a);
+            b = V_BSWAP64(b);
+        }
+        n1 = V_EVEN32(a, b);
+        n2 = V_ODD32(a, b);
+
+        for (i = 0; i < 32; i += 2) {
+            n2 = V_XOR(n2, VPERM(gost_vperm_f)(V_ADD32(V_ADD32(n1, k[order[i]]), m[order[i]]), t));
+            n1 = V_XOR(n1, VPERM(gost_vperm_f)(V_ADD32(V_ADD32(n2, k[order[i + 1]]), m[order[i + 1]]), t));
+        }
+
+        a = V_UNPACKLO32(n2, n1);
+        b = V_UNPACKHI32(n2, n1);
+        if (magma) {
+            a = V_BSWAP64(a);
+            b = V_BSWAP64(b);
+        }
+        V_STORE(out + 8 * done, a);
+        V_STORE(out + 8 * done + 4 * VPERM_BLOCKS, b);
+    }
+
+    return done;
+}
+
+#undef VPERM_TABLES
+#undef VPERM
+#undef VPERM_CAT
+#undef VPERM_CAT_
@@ -0,0 +1,112 @@
+/**********************************************************************
+ *                           gost_cpu.c                               *
+ *         Runtime CPU feature detection for optimized kernels        *
+ *                                                                    *
+ *       This file is distributed under the same license as OpenSSL   *
+ *                                                                    *
+ *                      Doesn't need OpenSSL                          *
+ **********************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include "gost_cpu.h"
+
+#if defined(GOST_X86_DISPATCH)
+# if defined(_MSC_VER)
+#  include <intrin.h>
+
+static void cpuid(unsigned int leaf, unsigned int sub, unsigned int r[4])
+{
+    __cpuidex((int *)r, (int)leaf, (int)sub);
+}
+
+static uint64_t xgetbv0(void)
+{
+    return _xgetbv(0);
+}
+# else
+#  include <cpuid.h>
+
+static void cpuid(unsigned int leaf, unsigned int sub, unsigned int r[4])
+{
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+}
+
+static uint64_t xgetbv0(void)
+{
+    uint32_t eax, edx;
+
+    __asm__ volatile (".byte 0x0f, 0x01, 0xd0" /* xgetbv */
+                      : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((uint64_t)edx << 32) | eax;
+}
+# endif
+
+static unsigned int cpu_probe(void)
+{
+    unsigned int r[4], max_leaf, caps = 0;
+    uint64_t xcr0 = 0;
+
+    cpuid(0, 0, r);
+    max_leaf = r[0];
+    if (max_leaf < 1)
+        return 0;
+
+    cpuid(1, 0, r);
+    if (r[2] & (1U << 9))
+        caps |= GOST_CPU_SSSE3;
+    if (r[2] & (1U << 1))
+        caps |= GOST_CPU_PCLMUL;
+    /* OSXSAVE: extended state is managed by the OS */
+    if (r[2] & (1U << 27))
+        xcr0 = xgetbv0();
+
+    if (max_leaf < 7)
+        return caps;
+    cpuid(7, 0, r);
+    if (r[2] & (1U << 8))
+        caps |= GOST_CPU_GFNI;
+    /* XMM and YMM state */
+    if ((xcr0 & 0x06) == 0x06 && (r[1] & (1U << 5)))
+        caps |= GOST_CPU_AVX2;
+    /* Opmask, ZMM_Hi256 and Hi16_ZMM state */
+    if ((xcr0 & 0xe6) == 0xe6 && (r[1] & (1U << 16))) {
+        caps |= GOST_CPU_AVX512F;
+        if (r[1] & (1U << 30))
+            caps |= GOST_CPU_AVX512BW;
+        if (r[1] & (1U << 31))
+            caps |= GOST_CPU_AVX512VL;
+        if (r[1] & (1U << 21))
+            caps |= GOST_CPU_AVX512IFMA;
+        if (r[2] & (1U << 1))
+            caps |= GOST_CPU_AVX512VBMI;
+    }
+    return caps;
+}
+#else
+static unsigned int cpu_probe(void)
+{
+    return 0;
+}
+#endif
+
+unsigned int gost_cpu_caps(void)
+{
+    /*
+     * Probing is idempotent, so a concurrent first call at worst
+     * repeats it and stores the same value.
+     */
+    static volatile int probed = 0;
+    static volatile unsigned int caps;
+
+    if (!probed) {
+        unsigned int c = cpu_probe();
+        const char *mask = getenv("GOST_CPUCAP");
+
+        if (mask != NULL)
+            c &= (unsigned int)strtoul(mask, NULL, 16);
+        caps = c;
+        probed = 1;
+    }
+    return caps;
+}
+/* vim: set expandtab cinoptions=\:0,l1,t0,g0,(0 sw=4 : */
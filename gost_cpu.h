@@ -0,0 +1,42 @@
+/**********************************************************************
+ *                           gost_cpu.h                               *
+ *         Runtime CPU feature detection for optimized kernels        *
+ *                                                                    *
+ *       This file is distributed under the same license as OpenSSL   *
+ *                                                                    *
+ * Kernels using instruction set extensions are compiled with         *
+ * per-function target attributes and selected at run time, so a     *
+ * single binary works on every x86 CPU. Doesn't need OpenSSL.        *
+ **********************************************************************/
+#ifndef GOST_CPU_H
+# define GOST_CPU_H
+
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define GOST_X86_DISPATCH
+#  define GOST_TARGET(isa) __attribute__((target(isa)))
+# elif defined(_MSC_VER) && defined(_M_X64)
+#  define GOST_X86_DISPATCH
+#  define GOST_TARGET(isa)
+# endif
+
+# define GOST_CPU_SSSE3         0x0001
+# define GOST_CPU_PCLMUL        0x0002
+# define GOST_CPU_AVX2          0x0004
+# define GOST_CPU_AVX512F       0x0008
+# define GOST_CPU_AVX512BW      0x0010
+# define GOST_CPU_AVX512VL      0x0020
+# define GOST_CPU_AVX512IFMA    0x0040
+# define GOST_CPU_AVX512VBMI    0x0080
+# define GOST_CPU_GFNI          0x0100
+
+/*-
+ * Returns the set of GOST_CPU_* features usable on this machine (both
+ * the CPU and the OS saving the extended register state). The result
+ * is masked by the hexadecimal value of the GOST_CPUCAP environment
+ * variable, if set, so the portable code paths can be forced for
+ * testing: GOST_CPUCAP=0 disables every optimized kernel.
+ */
+unsigned int gost_cpu_caps(void);
+
+#endif
+/* vim: set expandtab cinoptions=\:0,l1,t0,g0,(0 sw=4 : */
@@ -64,12 +64,19 @@ static int magma_cipher_do_ctr(EVP_CIPHER_CTX *ctx, unsigned char *out,
 static int magma_cipher_do_ctr_acpkm_omac(EVP_CIPHER_CTX *ctx, unsigned char *out,
                                const unsigned char *in, size_t inl);
 
+static int magma_cipher_init_mgm(EVP_CIPHER_CTX *ctx, const unsigned char *key,
+                                 const unsigned char *iv, int enc);
+static int magma_cipher_do_mgm(EVP_CIPHER_CTX *ctx, unsigned char *out,
+                               const unsigned char *in, size_t inl);
+static int magma_cipher_cleanup_mgm(EVP_CIPHER_CTX *ctx);
+
 /* set/get cipher parameters */
 static int magma_set_asn1_parameters(EVP_CIPHER_CTX *ctx, ASN1_TYPE *params);
 static int magma_get_asn1_parameters(EVP_CIPHER_CTX *ctx, ASN1_TYPE *params);
 /* Control function */
 static int magma_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr);
 static int magma_cipher_ctl_acpkm_omac(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr);
+static int magma_cipher_ctl_mgm(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr);
 
 /*
  * Single level template accessor.
@@ -99,6 +106,12 @@ EVP_CIPHER *GOST_init_cipher(GOST_cipher *c)
         OPENSSL_assert(flags & EVP_CIPH_NO_PADDING);
         break;
     default:
+        /* AEAD modes process the payload as a stream */
+        if (flags & EVP_CIPH_FLAG_AEAD_CIPHER) {
+            OPENSSL_assert(block_size == 1);
+            OPENSSL_assert(flags & EVP_CIPH_NO_PADDING);
+            break;
+        }
         OPENSSL_assert(block_size != 1);
         OPENSSL_assert(!(flags & EVP_CIPH_NO_PADDING));
     }
@@ -238,6 +251,24 @@ GOST_cipher magma_ctr_acpkm_omac_cipher = {
     .ctrl = magma_cipher_ctl_acpkm_omac,
 };
 
+/* NID is allocated at load time, see create_NIDs() in gost_eng.c */
+GOST_cipher magma_mgm_cipher = {
+    .nid = NID_undef,
+    .template = &magma_template_cipher,
+    .block_size = 1,
+    .iv_len = 8,
+    .flags = EVP_CIPH_CUSTOM_IV |
+        EVP_CIPH_NO_PADDING |
+        EVP_CIPH_CUSTOM_COPY |
+        EVP_CIPH_FLAG_CUSTOM_CIPHER |
+        EVP_CIPH_FLAG_AEAD_CIPHER,
+    .init = magma_cipher_init_mgm,
+    .do_cipher = magma_cipher_do_mgm,
+    .cleanup = magma_cipher_cleanup_mgm,
+    .ctx_size = sizeof(struct ossl_gost_mgm_ctx),
+    .ctrl = magma_cipher_ctl_mgm,
+};
+
 GOST_cipher magma_ecb_cipher = {
     .nid = NID_magma_ecb,
     .template = &magma_template_cipher,
@@ -377,8 +408,7 @@ static int gost_cipher_set_param(struct ossl_gost_cipher_ctx *c, int nid)
     c->paramNID = param->nid;
     c->key_meshing = param->key_meshing;
     c->count = 0;
-    gost_init(&(c->cctx), param->sblock);
-    return 1;
+    return gost_init(&(c->cctx), param->sblock);
 }
 
 /* Initializes EVP_CIPHER_CTX by paramset NID */
@@ -410,7 +440,8 @@ static int gost_cipher_init_cnt(EVP_CIPHER_CTX *ctx,
                                 gost_subst_block * block)
 {
     struct ossl_gost_cipher_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
-    gost_init(&(c->cctx), block);
+    if (!gost_init(&(c->cctx), block))
+        return 0;
     c->key_meshing = 1;
     c->count = 0;
     if (key)
@@ -473,6 +504,7 @@ static int magma_cipher_init(EVP_CIPHER_CTX *ctx, const unsigned char *key,
     if (key) {
         magma_key(&(c->cctx), key);
         magma_master_key(&(c->cctx), key);
+        c->tlstree.levels = 0;
     }
     if (iv) {
         memcpy((unsigned char *)EVP_CIPHER_CTX_original_iv(ctx), iv,
@@ -518,6 +550,48 @@ static int magma_cipher_init_ctr_acpkm_omac(EVP_CIPHER_CTX *ctx, const unsigned
 	return magma_cipher_init(ctx, key, iv, enc);
 }
 
+/* Block function for the MGM implementation */
+static void magma_mgm_block(const unsigned char *in, unsigned char *out,
+                            void *key)
+{
+    magmacrypt((gost_ctx *)key, in, out);
+}
+
+static int magma_cipher_init_mgm(EVP_CIPHER_CTX *ctx, const unsigned char *key,
+                                 const unsigned char *iv, int enc)
+{
+    struct ossl_gost_mgm_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+
+    if (EVP_CIPHER_CTX_get_app_data(ctx) == NULL) {
+        if (!gost_init(&c->cctx, &Gost28147_TC26ParamSetZ))
+            return 0;
+        EVP_CIPHER_CTX_set_app_data(ctx, c);
+    }
+    if (key != NULL) {
+        magma_key(&c->cctx, key);
+        magma_master_key(&c->cctx, key);
+        gost_mgm128_init(&c->mgm, &c->cctx, magma_mgm_block, 8);
+        c->key_set = 1;
+    }
+    if (iv != NULL) {
+        memcpy((unsigned char *)EVP_CIPHER_CTX_original_iv(ctx), iv,
+               EVP_CIPHER_CTX_iv_length(ctx));
+        memcpy(EVP_CIPHER_CTX_iv_noconst(ctx), iv,
+               EVP_CIPHER_CTX_iv_length(ctx));
+        /* A message is only started by an explicitly supplied nonce */
+        c->iv_set = 1;
+        if (enc)
+            c->taglen = 0;
+    }
+    if (c->key_set && c->iv_set
+        && !gost_mgm128_setiv(&c->mgm, EVP_CIPHER_CTX_iv(ctx))) {
+        GOSTerr(GOST_F_MAGMA_CIPHER_INIT_MGM, GOST_R_INVALID_NONCE);
+        c->iv_set = 0;
+        return 0;
+    }
+    return 1;
+}
+
 /*
  * Wrapper around gostcrypt function from gost89.c which perform key meshing
  * when nesseccary
@@ -533,20 +607,10 @@ static void gost_crypt_mesh(void *ctx, unsigned char *iv, unsigned char *buf)
     c->count = c->count % 1024 + 8;
 }
 
-static void gost_cnt_next(void *ctx, unsigned char *iv, unsigned char *buf)
+/* Advances the CryptoPro counter mode counter */
+static void gost_cnt_step(unsigned char *buf1)
 {
-    struct ossl_gost_cipher_ctx *c = ctx;
     word32 g, go;
-    unsigned char buf1[8];
-    assert(c->count % 8 == 0 && c->count <= 1024);
-    if (c->key_meshing && c->count == 1024) {
-        cryptopro_key_meshing(&(c->cctx), iv);
-    }
-    if (c->count == 0) {
-        gostcrypt(&(c->cctx), iv, buf1);
-    } else {
-        memcpy(buf1, iv, 8);
-    }
     g = buf1[0] | (buf1[1] << 8) | (buf1[2] << 16) | ((word32) buf1[3] << 24);
     g += 0x01010101;
     buf1[0] = (unsigned char)(g & 0xff);
@@ -562,11 +626,94 @@ static void gost_cnt_next(void *ctx, unsigned char *iv, unsigned char *buf)
     buf1[5] = (unsigned char)((g >> 8) & 0xff);
     buf1[6] = (unsigned char)((g >> 16) & 0xff);
     buf1[7] = (unsigned char)((g >> 24) & 0xff);
+}
+
+static void gost_cnt_next(void *ctx, unsigned char *iv, unsigned char *buf)
+{
+    struct ossl_gost_cipher_ctx *c = ctx;
+    unsigned char buf1[8];
+    assert(c->count % 8 == 0 && c->count <= 1024);
+    if (c->key_meshing && c->count == 1024) {
+        cryptopro_key_meshing(&(c->cctx), iv);
+    }
+    if (c->count == 0) {
+        gostcrypt(&(c->cctx), iv, buf1);
+    } else {
+        memcpy(buf1, iv, 8);
+    }
+    gost_cnt_step(buf1);
     memcpy(iv, buf1, 8);
     gostcrypt(&(c->cctx), buf1, buf);
     c->count = c->count % 1024 + 8;
 }
 
+/*
+ * Same as gost_cnt_next for a number of full blocks, which are xored with
+ * the gamma. The gamma of a run of blocks within one 1 KB key meshing
+ * section is computed by the multi-block routine.
+ */
+static void gost_cnt_blocks(struct ossl_gost_cipher_ctx *c, unsigned char *iv,
+                            const unsigned char *in, unsigned char *out,
+                            size_t blocks)
+{
+    unsigned char gamma[GOST_PARALLEL_BLOCKS * 8];
+    size_t i, n;
+
+    for (; blocks > 0; blocks -= n, in += n * 8, out += n * 8) {
+        assert(c->count % 8 == 0 && c->count <= 1024);
+        if (c->key_meshing && c->count == 1024) {
+            cryptopro_key_meshing(&(c->cctx), iv);
+        }
+        if (c->count == 0) {
+            gostcrypt(&(c->cctx), iv, iv);
+        }
+        n = (1024 - c->count % 1024) / 8;
+        if (n > GOST_PARALLEL_BLOCKS)
+            n = GOST_PARALLEL_BLOCKS;
+        if (n > blocks)
+            n = blocks;
+
+        for (i = 0; i < n; i++) {
+            gost_cnt_step(iv);
+            memcpy(gamma + i * 8, iv, 8);
+        }
+        gostcrypt_blocks(&(c->cctx), gamma, gamma, n);
+        for (i = 0; i < n * 8; i++) {
+            out[i] = gamma[i] ^ in[i];
+        }
+        c->count = c->count % 1024 + n * 8;
+    }
+    OPENSSL_cleanse(gamma, sizeof(gamma));
+}
+
+/*
+ * CBC decryption of different blocks is independent, so it is done in
+ * batches by the multi-block routine decrypt
+ */
+static void gost_cbc_decrypt_blocks(gost_ctx *cctx, unsigned char *iv,
+                                    const unsigned char *in,
+                                    unsigned char *out, size_t blocks,
+                                    void (*decrypt) (gost_ctx *,
+                                                     const byte *, byte *,
+                                                     size_t))
+{
+    unsigned char tmp[GOST_PARALLEL_BLOCKS * 8];
+    size_t i, n;
+
+    for (; blocks > 0; blocks -= n, in += n * 8, out += n * 8) {
+        n = blocks < GOST_PARALLEL_BLOCKS ? blocks : GOST_PARALLEL_BLOCKS;
+
+        /* Ciphertext is still needed when out and in are the same */
+        memcpy(tmp, in, n * 8);
+        decrypt(cctx, tmp, out, n);
+        for (i = 0; i < 8; i++)
+            out[i] ^= iv[i];
+        for (i = 8; i < n * 8; i++)
+            out[i] ^= tmp[i - 8];
+        memcpy(iv, tmp + (n - 1) * 8, 8);
+    }
+}
+
 /* GOST encryption in CBC mode */
 static int gost_cipher_do_cbc(EVP_CIPHER_CTX *ctx, unsigned char *out,
                        const unsigned char *in, size_t inl)
@@ -590,18 +737,8 @@ static int gost_cipher_do_cbc(EVP_CIPHER_CTX *ctx, unsigned char *out,
             inl -= 8;
         }
     } else {
-        while (inl > 0) {
-            unsigned char tmpiv[8];
-            gostdecrypt(&(c->cctx), in_ptr, b);
-            memcpy(tmpiv, in_ptr, 8);
-            for (i = 0; i < 8; i++) {
-                out_ptr[i] = iv[i] ^ b[i];
-            }
-            memcpy(iv, tmpiv, 8);
-            out_ptr += 8;
-            in_ptr += 8;
-            inl -= 8;
-        }
+        gost_cbc_decrypt_blocks(&(c->cctx), iv, in_ptr, out_ptr, inl / 8,
+                                gostdecrypt_blocks);
     }
     return 1;
 }
@@ -612,19 +749,9 @@ static int magma_cipher_do_ecb(EVP_CIPHER_CTX *ctx, unsigned char *out,
 {
     struct ossl_gost_cipher_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
     if (EVP_CIPHER_CTX_encrypting(ctx)) {
-        while (inl > 0) {
-            magmacrypt(&(c->cctx), in, out);
-            out += 8;
-            in += 8;
-            inl -= 8;
-        }
+        magmacrypt_blocks(&(c->cctx), in, out, inl / 8);
     } else {
-        while (inl > 0) {
-            magmadecrypt(&(c->cctx), in, out);
-            out += 8;
-            in += 8;
-            inl -= 8;
-        }
+        magmadecrypt_blocks(&(c->cctx), in, out, inl / 8);
     }
     return 1;
 }
@@ -633,8 +760,6 @@ static int magma_cipher_do_ecb(EVP_CIPHER_CTX *ctx, unsigned char *out,
 static int magma_cipher_do_cbc(EVP_CIPHER_CTX *ctx, unsigned char *out,
                         const unsigned char *in, size_t inl)
 {
-    unsigned char b[8];
-    unsigned char d[8];
     const unsigned char *in_ptr = in;
     unsigned char *out_ptr = out;
     int i;
@@ -653,17 +778,8 @@ static int magma_cipher_do_cbc(EVP_CIPHER_CTX *ctx, unsigned char *out,
             inl -= 8;
         }
     } else {
-        while (inl > 0) {
-            magmadecrypt(&(c->cctx), in_ptr, b);
-            memcpy(d, in_ptr, 8);
-            for (i = 0; i < 8; i++) {
-                out_ptr[i] = iv[i] ^ b[i];
-            }
-            memcpy(iv, d, 8);
-            out_ptr += 8;
-            in_ptr += 8;
-            inl -= 8;
-        }
+        gost_cbc_decrypt_blocks(&(c->cctx), iv, in_ptr, out_ptr, inl / 8,
+                                magmadecrypt_blocks);
     }
     return 1;
 }
@@ -705,19 +821,29 @@ static int magma_cipher_do_ctr(EVP_CIPHER_CTX *ctx, unsigned char *out,
     }
     blocks = lasted / MAGMA_BLOCK_SIZE;
 
-/* Process full blocks */
-    for (i = 0; i < blocks; i++) {
+/* Process full blocks, a run of blocks never crosses a section boundary */
+    while (blocks > 0) {
+        unsigned char ks[GOST_PARALLEL_BLOCKS * MAGMA_BLOCK_SIZE];
+        size_t n = blocks < GOST_PARALLEL_BLOCKS ? blocks : GOST_PARALLEL_BLOCKS;
+
         apply_acpkm_magma(c, &num);
-        magmacrypt(&(c->cctx), iv, buf);
-        for (j = 0; j < 8; j++) {
-            out_ptr[j] = buf[j] ^ in_ptr[j];
+        if (c->key_meshing
+            && n > ((unsigned int)c->key_meshing - num) / MAGMA_BLOCK_SIZE)
+            n = ((unsigned int)c->key_meshing - num) / MAGMA_BLOCK_SIZE;
+        for (i = 0; i < n; i++) {
+            memcpy(ks + i * MAGMA_BLOCK_SIZE, iv, MAGMA_BLOCK_SIZE);
+            ctr64_inc(iv);
         }
-        ctr64_inc(iv);
-        c->count += MAGMA_BLOCK_SIZE;
-        in_ptr += MAGMA_BLOCK_SIZE;
-        out_ptr += MAGMA_BLOCK_SIZE;
-        num += MAGMA_BLOCK_SIZE;
-        lasted -= MAGMA_BLOCK_SIZE;
+        magmacrypt_blocks(&(c->cctx), ks, ks, n);
+        for (j = 0; j < n * MAGMA_BLOCK_SIZE; j++) {
+            out_ptr[j] = ks[j] ^ in_ptr[j];
+        }
+        c->count += n * MAGMA_BLOCK_SIZE;
+        in_ptr += n * MAGMA_BLOCK_SIZE;
+        out_ptr += n * MAGMA_BLOCK_SIZE;
+        num += n * MAGMA_BLOCK_SIZE;
+        lasted -= n * MAGMA_BLOCK_SIZE;
+        blocks -= n;
     }
 
 /* Process the rest of plaintext */
@@ -761,6 +887,54 @@ static int magma_cipher_do_ctr_acpkm_omac(EVP_CIPHER_CTX *ctx, unsigned char *ou
 
 	return inl;
 }
+
+/*
+ * MAGMA in MGM mode: AAD is passed with out == NULL, the final call has
+ * in == NULL and computes (encryption) or verifies (decryption) the tag.
+ */
+static int magma_cipher_do_mgm(EVP_CIPHER_CTX *ctx, unsigned char *out,
+                               const unsigned char *in, size_t inl)
+{
+    struct ossl_gost_mgm_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+    int enc = EVP_CIPHER_CTX_encrypting(ctx);
+    int ok;
+
+    if (!c->key_set || !c->iv_set) {
+        GOSTerr(GOST_F_MAGMA_CIPHER_DO_MGM, GOST_R_KEY_IS_NOT_INITIALIZED);
+        return -1;
+    }
+
+    if (in == NULL && inl == 0) { /* Final call */
+        c->iv_set = 0;
+        if (enc) {
+            gost_mgm128_tag(&c->mgm, c->tag, MAGMA_BLOCK_SIZE);
+            c->taglen = MAGMA_BLOCK_SIZE;
+            return 0;
+        }
+        ok = c->taglen > 0 && gost_mgm128_finish(&c->mgm, c->tag, c->taglen);
+        c->taglen = 0;
+        return ok ? 0 : -1;
+    }
+
+    if (in == NULL) {
+        GOSTerr(GOST_F_MAGMA_CIPHER_DO_MGM, ERR_R_EVP_LIB);
+        return -1;
+    }
+
+    if (out == NULL)
+        ok = gost_mgm128_aad(&c->mgm, in, inl);
+    else if (enc)
+        ok = gost_mgm128_encrypt(&c->mgm, in, out, inl);
+    else
+        ok = gost_mgm128_decrypt(&c->mgm, in, out, inl);
+
+    if (!ok) {
+        GOSTerr(GOST_F_MAGMA_CIPHER_DO_MGM, GOST_R_INVALID_MGM_INPUT);
+        return -1;
+    }
+    return (int)inl;
+}
+
 /* GOST encryption in CFB mode */
 static int gost_cipher_do_cfb(EVP_CIPHER_CTX *ctx, unsigned char *out,
                        const unsigned char *in, size_t inl)
@@ -851,21 +1025,13 @@ static int gost_cipher_do_cnt(EVP_CIPHER_CTX *ctx, unsigned char *out,
         }
     }
 
-    for (; (inl - i) >= 8; i += 8, in_ptr += 8, out_ptr += 8) {
-        /*
-         * block cipher current iv
-         */
-        /* Encrypt */
-        gost_cnt_next(EVP_CIPHER_CTX_get_cipher_data(ctx), iv, buf);
-        /*
-         * xor next block of input text with it and output it
-         */
-        /*
-         * output this block
-         */
-        for (j = 0; j < 8; j++) {
-            out_ptr[j] = buf[j] ^ in_ptr[j];
-        }
+    if (inl - i >= 8) {
+        j = (inl - i) & ~(size_t)7;
+        gost_cnt_blocks(EVP_CIPHER_CTX_get_cipher_data(ctx), iv, in_ptr,
+                        out_ptr, j / 8);
+        i += j;
+        in_ptr += j;
+        out_ptr += j;
     }
 /* Process rest of buffer */
     if (i < inl) {
@@ -886,6 +1052,17 @@ static int gost_cipher_cleanup(EVP_CIPHER_CTX *ctx)
     struct ossl_gost_cipher_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
 		EVP_MD_CTX_free(c->omac_ctx);
     gost_destroy(&(c->cctx));
+    OPENSSL_cleanse(&c->tlstree, sizeof(c->tlstree));
+    EVP_CIPHER_CTX_set_app_data(ctx, NULL);
+    return 1;
+}
+
+static int magma_cipher_cleanup_mgm(EVP_CIPHER_CTX *ctx)
+{
+    struct ossl_gost_mgm_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+
+    gost_destroy(&c->cctx);
+    OPENSSL_cleanse(&c->mgm, sizeof(c->mgm));
     EVP_CIPHER_CTX_set_app_data(ctx, NULL);
     return 1;
 }
@@ -1018,6 +1195,10 @@ static int magma_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr)
                 return -1;
             }
 
+            /* Sections are whole blocks, the CTR runs stop at their ends */
+            if (arg < 0 || arg % MAGMA_BLOCK_SIZE)
+                return -1;
+
             c->key_meshing = arg;
             return 1;
         }
@@ -1030,7 +1211,7 @@ static int magma_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr)
 
             unsigned char adjusted_iv[8];
             unsigned char seq[8];
-            int j, carry, decrement_arg;
+            int j, carry, decrement_arg, ret;
             if (mode != EVP_CIPH_CTR_MODE)
                 return -1;
 
@@ -1051,8 +1232,11 @@ static int magma_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr)
                 return -1;
             }
 
-            if (gost_tlstree(NID_magma_cbc, (const unsigned char *)c->master_key, newkey,
-                             (const unsigned char *)seq) > 0) {
+            ret = gost_tlstree_cached(NID_magma_cbc,
+                                      (const unsigned char *)c->master_key,
+                                      newkey, (const unsigned char *)seq,
+                                      &ctr_ctx->tlstree);
+            if (ret > 0) {
                 memset(adjusted_iv, 0, 8);
                 memcpy(adjusted_iv, EVP_CIPHER_CTX_original_iv(ctx), 4);
                 for (j = 3, carry = 0; j >= 0; j--)
@@ -1064,7 +1248,10 @@ static int magma_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr)
                 EVP_CIPHER_CTX_set_num(ctx, 0);
                 memcpy(EVP_CIPHER_CTX_iv_noconst(ctx), adjusted_iv, 8);
 
-                magma_key(c, newkey);
+                /* without ACPKM the key of the previous record is in place */
+                if (ret == 1 || ctr_ctx->key_meshing)
+                    magma_key(c, newkey);
+                OPENSSL_cleanse(newkey, sizeof(newkey));
                 return 1;
           }
         }
@@ -1106,6 +1293,57 @@ static int magma_cipher_ctl_acpkm_omac(EVP_CIPHER_CTX *ctx, int type, int arg, v
 	}
 }
 
+static int magma_cipher_ctl_mgm(EVP_CIPHER_CTX *ctx, int type, int arg, void *ptr)
+{
+    struct ossl_gost_mgm_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+
+    switch (type) {
+    case EVP_CTRL_RAND_KEY:
+        return magma_cipher_ctl(ctx, type, arg, ptr);
+    case EVP_CTRL_AEAD_SET_IVLEN:
+        /* MGM nonce is always one block long */
+        if (arg != MAGMA_BLOCK_SIZE) {
+            GOSTerr(GOST_F_MAGMA_CIPHER_CTL_MGM, GOST_R_INVALID_IV_LENGTH);
+            return -1;
+        }
+        return 1;
+    case EVP_CTRL_AEAD_GET_TAG:
+    case EVP_CTRL_AEAD_SET_TAG:
+        if (arg < MGM_MIN_TAG_SIZE || arg > MAGMA_MAC_MAX_SIZE) {
+            GOSTerr(GOST_F_MAGMA_CIPHER_CTL_MGM, GOST_R_INVALID_TAG_LENGTH);
+            return -1;
+        }
+        if (type == EVP_CTRL_AEAD_GET_TAG) {
+            if (!EVP_CIPHER_CTX_encrypting(ctx) || c->taglen == 0)
+                return -1;
+            memcpy(ptr, c->tag, arg);
+            return 1;
+        }
+        /* Tag length only matters for decryption */
+        if (EVP_CIPHER_CTX_encrypting(ctx))
+            return 1;
+        if (ptr == NULL)
+            return -1;
+        memcpy(c->tag, ptr, arg);
+        c->taglen = arg;
+        return 1;
+    case EVP_CTRL_COPY:
+        {
+            EVP_CIPHER_CTX *out = ptr;
+            struct ossl_gost_mgm_ctx *out_cctx =
+                EVP_CIPHER_CTX_get_cipher_data(out);
+
+            /* MGM state refers to the key schedule of its own context */
+            out_cctx->mgm.key = &out_cctx->cctx;
+            return 1;
+        }
+    default:
+        GOSTerr(GOST_F_MAGMA_CIPHER_CTL_MGM,
+                GOST_R_UNSUPPORTED_CIPHER_CTL_COMMAND);
+        return -1;
+    }
+}
+
 /* Set cipher parameters from ASN1 structure */
 static int gost89_set_asn1_parameters(EVP_CIPHER_CTX *ctx, ASN1_TYPE *params)
 {
@@ -1234,8 +1472,7 @@ static int gost_imit_init(EVP_MD_CTX *ctx, gost_subst_block * block)
     c->bytes_left = 0;
     c->key_meshing = 1;
     c->dgst_size = 4;
-    gost_init(&(c->cctx), block);
-    return 1;
+    return gost_init(&(c->cctx), block);
 }
 
 static int gost_imit_init_cpa(EVP_MD_CTX *ctx)
@@ -1346,7 +1583,8 @@ static int gost_imit_ctrl(EVP_MD_CTX *ctx, int type, int arg, void *ptr)
                                 GOST_R_INVALID_MAC_PARAMS);
                         return 0;
                     }
-                    gost_init(&(gost_imit_ctx->cctx), param->sblock);
+                    if (!gost_init(&(gost_imit_ctx->cctx), param->sblock))
+                        return 0;
                 }
                 gost_key(&(gost_imit_ctx->cctx), key->key);
                 gost_imit_ctx->key_set = 1;
@@ -16,7 +16,34 @@
 
 static char *gost_params[GOST_PARAM_MAX + 1] = { NULL };
 static const char *gost_envnames[] =
-    { "CRYPT_PARAMS", "GOST_PBE_HMAC", "GOST_PK_FORMAT" };
+    { "CRYPT_PARAMS", "GOST_PBE_HMAC", "GOST_PK_FORMAT",
+      "GOST_KUZNYECHIK_BULK" };
+
+/*
+ * KUZNYECHIK_BULK is consulted on every Kuznyechik key set, so it is kept
+ * as a flag: the environment is read once, the control overrides it.
+ */
+static CRYPTO_ONCE bulk_once = CRYPTO_ONCE_STATIC_INIT;
+static int bulk_env_constant_time, bulk_constant_time;
+
+static int bulk_is_constant_time(const char *value)
+{
+    return value != NULL && strcmp(value, "CONSTANT_TIME") == 0;
+}
+
+static void bulk_init(void)
+{
+    bulk_env_constant_time =
+        bulk_is_constant_time(getenv(gost_envnames[GOST_PARAM_KUZNYECHIK_BULK]));
+    bulk_constant_time = bulk_env_constant_time;
+}
+
+int gost_kuznyechik_constant_time(void)
+{
+    if (!CRYPTO_THREAD_run_once(&bulk_once, bulk_init))
+        return 0;
+    return bulk_constant_time;
+}
 
 void gost_param_free()
 {
@@ -26,13 +53,31 @@ void gost_param_free()
         OPENSSL_free(gost_params[i]);
         gost_params[i] = NULL;
     }
-
+    bulk_constant_time = bulk_env_constant_time;
 }
 
 int gost_control_func(ENGINE *e, int cmd, long i, void *p, void (*f) (void))
 {
     int param = cmd - ENGINE_CMD_BASE;
     int ret = 0;
+
+    switch (cmd) {
+    case GOST_CTRL_SIGN_POOL:
+        return gost_ec_pool_set_capacity(i);
+    case GOST_CTRL_SIGN_POOL_THREAD:
+        return gost_ec_pool_set_thread(i);
+    case GOST_CTRL_SIGN_POOL_PRECOMPUTE:
+        return gost_ec_pool_precompute(p);
+    case GOST_CTRL_SIGN_POOL_STATS:
+        return gost_ec_pool_stats((int)i, p);
+    case GOST_CTRL_VERIFY_BATCH:
+        return i >= 0 && gost_ec_verify_batch(p, (size_t)i);
+    case GOST_CTRL_VERIFY_CACHE:
+        return gost_ec_verify_cache_set(i);
+    case GOST_CTRL_DIGEST_VERIFY_BATCH:
+        return i >= 0 && gost_ec_digest_verify_batch(p, (size_t)i);
+    }
+
     if (param < 0 || param > GOST_PARAM_MAX) {
         return -1;
     }
@@ -72,6 +117,11 @@ int gost_set_default_param(int param, const char *value)
     }
     OPENSSL_free(gost_params[param]);
     gost_params[param] = BUF_strdup(tmp);
+    if (param == GOST_PARAM_KUZNYECHIK_BULK) {
+        if (!CRYPTO_THREAD_run_once(&bulk_once, bulk_init))
+            return 0;
+        bulk_constant_time = bulk_is_constant_time(tmp);
+    }
 
     return 1;
 }
@@ -0,0 +1,862 @@
+/**********************************************************************
+ *                        gost_ec_ifma.c                              *
+ *         This file is distributed under the same license as OpenSSL *
+ *                                                                    *
+ *    a * G + b * P on the 512-bit curves for eight points at once,   *
+ *    one in each lane of AVX-512 IFMA vectors, selected at run time  *
+ **********************************************************************/
+#include <stdint.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include "gost_lcl.h"
+#include "gost_cpu.h"
+
+/*-
+ * Field elements are ten 52-bit limbs in Montgomery form, R = 2^520;
+ * a vector holds limb i of eight elements. The primes are 2^e + s with
+ * a small s, so a step of the Montgomery reduction takes a product by s
+ * and shifts rather than ten products by the limbs of p. Values stay
+ * below 2^513 without being fully reduced: sums and differences fold
+ * the bits above 2^e back with s.
+ *
+ * Points are projective and the formulas complete, so no lane branches
+ * on its point and infinity is added and doubled as any other point:
+ * those of Renes, Costello and Batina (2016) for the curves with a = -3,
+ * the unified ones of Hisil et al. (2008) in extended coordinates on
+ * the twisted Edwards form of paramSetC, where d is not a square.
+ */
+#define IFMA_LIMBS 10
+#define IFMA_LANES 8
+
+struct gost_ec_ifma_curve {
+    uint64_t p[IFMA_LIMBS];
+    uint64_t p8[IFMA_LIMBS];    /* 8 * p, limbs but the top one >= 2^52 - 1 */
+    uint64_t rr[IFMA_LIMBS];    /* R^2 mod p */
+    uint64_t one[IFMA_LIMBS];   /* R mod p */
+    uint64_t b[IFMA_LIMBS];     /* Weierstrass b */
+    uint64_t d[IFMA_LIMBS];     /* Edwards d */
+    /* x = es (1 + v) / (1 - v) + et, y = (x - et) / u from Edwards (u, v) */
+    uint64_t es[IFMA_LIMBS], et[IFMA_LIMBS];
+    uint64_t gx[IFMA_LIMBS], gy[IFMA_LIMBS];   /* Weierstrass generator */
+    uint64_t pm2[8];            /* p - 2 */
+    uint64_t m0;                /* -1 / p mod 2^52 */
+    int e, s;                   /* p = 2^e + s */
+    int edwards;
+};
+
+/* All elements times R */
+/* id-tc26-gost-3410-2012-512-paramSetA */
+const GOST_EC_IFMA_CURVE gost_ec_ifma_512_a = {
+    {0xffffffffffdc7ULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0x00fffffffffffULL},
+    {0x1fffffffffee38ULL, 0x1ffffffffffffeULL, 0x1ffffffffffffeULL,
+     0x1ffffffffffffeULL, 0x1ffffffffffffeULL, 0x1ffffffffffffeULL,
+     0x1ffffffffffffeULL, 0x1ffffffffffffeULL, 0x1ffffffffffffeULL,
+     0x07ffffffffffeULL},
+    {0x00004f0b10000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x0000000023900ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0xb8106e8a23e5fULL, 0x649ca74b3e2a1ULL, 0xbfc5f3e694a40ULL,
+     0x437cd5ed6575cULL, 0x4e4722c383c87ULL, 0x086e6e4db48e8ULL,
+     0xa85c534b69527ULL, 0x088dff2d4b3fdULL, 0x2e39d2dd3769dULL,
+     0x00e4a0c5f647cULL},
+    {0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x000000006ab00ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x4e972ca9096adULL, 0xa9ef2729f0ef4ULL, 0xc7ffddb1d62d6ULL,
+     0x699b0da4dc9f7ULL, 0x83c1cff65ca0cULL, 0x781a47aeec48dULL,
+     0xb6526c1029c60ULL, 0x67d100af2d843ULL, 0x3fc33317add0dULL,
+     0x00791bb84e189ULL},
+    {0xfffffffffffffdc5ULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL},
+    0x1f7e6ce0f4c09ULL, 512, -569, 0
+};
+
+/* id-tc26-gost-3410-2012-512-paramSetB */
+const GOST_EC_IFMA_CURVE gost_ec_ifma_512_b = {
+    {0x000000000006fULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0080000000000ULL},
+    {0x10000000000378ULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0x03fffffffffffULL},
+    {0x00000c0840000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0xfffffffff226fULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0x007ffffffffffULL},
+    {0x8c318a75d7fb7ULL, 0x9097bfc1dbe74ULL, 0x5a471c954a780ULL,
+     0xf36553cd27e2dULL, 0x99b326049435cULL, 0xc8a216d2c5e7bULL,
+     0x102d0cc51e9eaULL, 0x5bd56d260b45aULL, 0x5bc8636181d6cULL,
+     0x000259a12c576ULL},
+    {0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0xffffffffe446fULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0x007ffffffffffULL},
+    {0x17e238312135fULL, 0xcf48ceea9f34eULL, 0xe1bed4c79d571ULL,
+     0x7fa33463bc494ULL, 0xd80747f3a5da2ULL, 0x09ddc2f4174a9ULL,
+     0xc2147b2e0dcbdULL, 0xcf9ac9e8307a8ULL, 0xff1d1d3cceddbULL,
+     0x000ffec2e98deULL},
+    {0x000000000000006dULL, 0x0000000000000000ULL,
+     0x0000000000000000ULL, 0x0000000000000000ULL,
+     0x0000000000000000ULL, 0x0000000000000000ULL,
+     0x0000000000000000ULL, 0x8000000000000000ULL},
+    0xa171024e6a171ULL, 511, 111, 0
+};
+
+/* id-tc26-gost-3410-2012-512-paramSetC, as the twisted Edwards curve */
+const GOST_EC_IFMA_CURVE gost_ec_ifma_512_c = {
+    {0xffffffffffdc7ULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0xfffffffffffffULL, 0xfffffffffffffULL, 0xfffffffffffffULL,
+     0x00fffffffffffULL},
+    {0x1fffffffffee38ULL, 0x1ffffffffffffeULL, 0x1ffffffffffffeULL,
+     0x1ffffffffffffeULL, 0x1ffffffffffffeULL, 0x1ffffffffffffeULL,
+     0x1ffffffffffffeULL, 0x1ffffffffffffeULL, 0x1ffffffffffffeULL,
+     0x07ffffffffffeULL},
+    {0x00004f0b10000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x0000000023900ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL, 0x0000000000000ULL, 0x0000000000000ULL,
+     0x0000000000000ULL},
+    {0x5166d05cce46eULL, 0x39a723d56515aULL, 0x76671ae6dc7d4ULL,
+     0xe5dc1c74edceaULL, 0x53a44eed58ae3ULL, 0x79f64266472e8ULL,
+     0xccd0cf540c84cULL, 0x783aa1a1a4bfeULL, 0x692ab899e4c73ULL,
+     0x0066ec2f500fcULL},
+    {0x6ba64be8d5408ULL, 0xf196370aa6ba9ULL, 0x6266394648e0aULL,
+     0x0688f8e2c48c5ULL, 0xeb16ec44a9d47ULL, 0xe1826f666e345ULL,
+     0x4ccbcc2afcdecULL, 0x21f1579796d00ULL, 0xe5b551d986ce3ULL,
+     0x006644f42bfc0ULL},
+    {0x62e6780f7da3dULL, 0xb44685f8e62e4ULL, 0x13bbd9d124bf8ULL,
+     0x50fa04be27a27ULL, 0x63460d278ec7bULL, 0x69a90b110bdd1ULL,
+     0xcccd77e3576b7ULL, 0xe95f1af0461ffULL, 0x11871ec450cbdULL,
+     0x0011275d3802aULL},
+    {0xb96443439e47aULL, 0x920f1a917fe94ULL, 0xd2b4a450b3e21ULL,
+     0x56ca383432403ULL, 0x060d6b293c1aeULL, 0x0f39f42366531ULL,
+     0x5b7d3bb2f24c2ULL, 0xf07abadec5386ULL, 0x52149e443a45cULL,
+     0x00cf9f56bb981ULL},
+    {0x5a236ed83aa5fULL, 0x4535cf5dcfa6dULL, 0x5ff160954f102ULL,
+     0xd5a802dbe4253ULL, 0x50278538fb682ULL, 0xb3dd624821785ULL,
+     0x5d42a752a50c7ULL, 0xd5ba6c70ce2c0ULL, 0xd8eb6aa38cf88ULL,
+     0x006e231c15884ULL},
+    {0xfffffffffffffdc5ULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL},
+    0x1f7e6ce0f4c09ULL, 512, -569, 1
+};
+
+#if defined(GOST_X86_DISPATCH) && (defined(__x86_64__) || defined(_M_X64))
+# include <immintrin.h>
+
+# define IFMA GOST_TARGET("avx512f,avx512ifma")
+# define IFMA_CAPS (GOST_CPU_AVX512F | GOST_CPU_AVX512IFMA)
+# define M52 0xfffffffffffffULL
+
+/* Signed digits of 5 bits, in [-16, 16], and the multiples 0 .. 16 */
+# define IFMA_WINDOWS 103
+# define IFMA_TABLE 17
+/* Fewer points than this are left to the scalar code */
+# define IFMA_MIN_LANES 4
+
+typedef __m512i fe8[IFMA_LIMBS];
+/* T = X * Y / Z on the Edwards curve, unused on the others */
+typedef struct {
+    fe8 X, Y, Z, T;
+} pt8;
+
+static IFMA __m512i bcast(uint64_t x)
+{
+    return _mm512_set1_epi64((long long)x);
+}
+
+static IFMA void fe8_bcast(fe8 r, const uint64_t *a)
+{
+    int i;
+
+    for (i = 0; i < IFMA_LIMBS; i++)
+        r[i] = bcast(a[i]);
+}
+
+static IFMA void fe8_copy(fe8 r, const fe8 a)
+{
+    memcpy(r, a, sizeof(fe8));
+}
+
+/* Signed carries up to the top limb, which keeps the excess */
+static IFMA void fe8_carry(__m512i *t)
+{
+    const __m512i mask = bcast(M52);
+    int i;
+
+    for (i = 0; i < IFMA_LIMBS - 1; i++) {
+        t[i + 1] = _mm512_add_epi64(t[i + 1], _mm512_srai_epi64(t[i], 52));
+        t[i] = _mm512_and_si512(t[i], mask);
+    }
+}
+
+/*
+ * r := r mod 2^e - s * (r >> e), plus p if s > 0, carried. The limbs
+ * must not be negative and those below the top one not above 2^62.
+ */
+static IFMA void fe8_fold(const GOST_EC_IFMA_CURVE *c, fe8 r)
+{
+    const __m512i sh = bcast(c->e - 52 * (IFMA_LIMBS - 1));
+    __m512i hi, u;
+    int i;
+
+    hi = _mm512_srlv_epi64(r[IFMA_LIMBS - 1], sh);
+    r[IFMA_LIMBS - 1] = _mm512_sub_epi64(r[IFMA_LIMBS - 1],
+                                         _mm512_sllv_epi64(hi, sh));
+    if (c->s < 0) {
+        u = _mm512_madd52lo_epu64(_mm512_setzero_si512(), hi, bcast(-c->s));
+        r[0] = _mm512_add_epi64(r[0], u);
+    } else {
+        u = _mm512_madd52lo_epu64(_mm512_setzero_si512(), hi, bcast(c->s));
+        for (i = 0; i < IFMA_LIMBS; i++)
+            r[i] = _mm512_add_epi64(r[i], bcast(c->p[i]));
+        r[0] = _mm512_sub_epi64(r[0], u);
+    }
+    fe8_carry(r);
+}
+
+static IFMA void fe8_add(const GOST_EC_IFMA_CURVE *c, fe8 r, const fe8 a,
+                         const fe8 b)
+{
+    int i;
+
+    for (i = 0; i < IFMA_LIMBS; i++)
+        r[i] = _mm512_add_epi64(a[i], b[i]);
+    fe8_fold(c, r);
+}
+
+/* a + 8 * p - b, every limb non-negative before the fold */
+static IFMA void fe8_sub(const GOST_EC_IFMA_CURVE *c, fe8 r, const fe8 a,
+                         const fe8 b)
+{
+    int i;
+
+    for (i = 0; i < IFMA_LIMBS; i++)
+        r[i] = _mm512_sub_epi64(_mm512_add_epi64(a[i], bcast(c->p8[i])),
+                                b[i]);
+    fe8_fold(c, r);
+}
+
+/*
+ * Products are summed by columns, each in a register, the low halves of
+ * the a_i * b_j with i + j = k into lo[k] and the high ones into hi[k].
+ */
+# define IFMA_COLUMNS (2 * IFMA_LIMBS - 1)
+
+static IFMA void fe8_mul_columns(__m512i *lo, __m512i *hi, const fe8 a,
+                                 const fe8 b)
+{
+    __m512i l, h;
+    int i, k;
+
+    for (k = 0; k < IFMA_COLUMNS; k++) {
+        l = h = _mm512_setzero_si512();
+        for (i = k < IFMA_LIMBS ? 0 : k - IFMA_LIMBS + 1;
+             i < IFMA_LIMBS && i <= k; i++) {
+            l = _mm512_madd52lo_epu64(l, a[i], b[k - i]);
+            h = _mm512_madd52hi_epu64(h, a[i], b[k - i]);
+        }
+        lo[k] = l;
+        hi[k] = h;
+    }
+}
+
+static IFMA void fe8_sqr_columns(__m512i *lo, __m512i *hi, const fe8 a)
+{
+    __m512i l, h;
+    int i, k;
+
+    for (k = 0; k < IFMA_COLUMNS; k++) {
+        l = h = _mm512_setzero_si512();
+        for (i = k < IFMA_LIMBS ? 0 : k - IFMA_LIMBS + 1; 2 * i < k; i++) {
+            l = _mm512_madd52lo_epu64(l, a[i], a[k - i]);
+            h = _mm512_madd52hi_epu64(h, a[i], a[k - i]);
+        }
+        l = _mm512_add_epi64(l, l);
+        h = _mm512_add_epi64(h, h);
+        if (k % 2 == 0) {
+            l = _mm512_madd52lo_epu64(l, a[k / 2], a[k / 2]);
+            h = _mm512_madd52hi_epu64(h, a[k / 2], a[k / 2]);
+        }
+        lo[k] = l;
+        hi[k] = h;
+    }
+}
+
+/*
+ * r := t / R mod p for the product t in columns, by the same columns:
+ * m_k, chosen to clear column k, adds m_k * p = m_k * 2^e + m_k * s.
+ */
+static IFMA void fe8_redc(const GOST_EC_IFMA_CURVE *c, fe8 r,
+                          const __m512i *lo, const __m512i *hi)
+{
+    const __m512i zero = _mm512_setzero_si512(), mask = bcast(M52);
+    const __m512i m0 = bcast(c->m0), s = bcast(c->s < 0 ? -c->s : c->s);
+    const __m512i sh = bcast(c->e - 52 * (IFMA_LIMBS - 1));
+    const __m512i rsh = bcast(52 * IFMA_LIMBS - c->e);
+    __m512i m[IFMA_LIMBS], ms[IFMA_LIMBS], acc, carry = zero;
+    int k;
+
+    for (k = 0; k <= IFMA_COLUMNS; k++) {
+        acc = carry;
+        if (k < IFMA_COLUMNS)
+            acc = _mm512_add_epi64(acc, lo[k]);
+        if (k > 0)
+            acc = _mm512_add_epi64(acc, hi[k - 1]);
+        if (k >= IFMA_LIMBS - 1 && k < IFMA_COLUMNS)
+            acc = _mm512_add_epi64(acc,
+                                   _mm512_and_si512(_mm512_sllv_epi64(m[k - 9],
+                                                                      sh),
+                                                    mask));
+        if (k >= IFMA_LIMBS)
+            acc = _mm512_add_epi64(acc, _mm512_srlv_epi64(m[k - 10], rsh));
+        if (k > 0 && k <= IFMA_LIMBS)
+            acc = c->s < 0 ? _mm512_sub_epi64(acc, ms[k - 1])
+                : _mm512_add_epi64(acc, ms[k - 1]);
+        if (k < IFMA_LIMBS) {
+            m[k] = _mm512_madd52lo_epu64(zero, acc, m0);
+            ms[k] = _mm512_madd52hi_epu64(zero, m[k], s);
+            acc = c->s < 0
+                ? _mm512_sub_epi64(acc, _mm512_madd52lo_epu64(zero, m[k], s))
+                : _mm512_add_epi64(acc, _mm512_madd52lo_epu64(zero, m[k], s));
+        }
+        if (k == IFMA_COLUMNS) {
+            r[IFMA_LIMBS - 1] = acc;
+        } else {
+            carry = _mm512_srai_epi64(acc, 52);
+            if (k >= IFMA_LIMBS)
+                r[k - IFMA_LIMBS] = _mm512_and_si512(acc, mask);
+        }
+    }
+}
+
+/* r := a * b / R mod p */
+static IFMA void fe8_mul(const GOST_EC_IFMA_CURVE *c, fe8 r, const fe8 a,
+                         const fe8 b)
+{
+    __m512i lo[IFMA_COLUMNS], hi[IFMA_COLUMNS];
+
+    fe8_mul_columns(lo, hi, a, b);
+    fe8_redc(c, r, lo, hi);
+}
+
+static IFMA void fe8_sqr(const GOST_EC_IFMA_CURVE *c, fe8 r, const fe8 a)
+{
+    __m512i lo[IFMA_COLUMNS], hi[IFMA_COLUMNS];
+
+    fe8_sqr_columns(lo, hi, a);
+    fe8_redc(c, r, lo, hi);
+}
+
+/* a^(p - 2), by windows of 4 bits of the public exponent; 0 stays 0 */
+static IFMA void fe8_inv(const GOST_EC_IFMA_CURVE *c, fe8 r, const fe8 a)
+{
+    fe8 tab[16], t;
+    int i, j, w;
+
+    fe8_bcast(tab[0], c->one);
+    fe8_copy(tab[1], a);
+    for (i = 2; i < 16; i++)
+        fe8_mul(c, tab[i], tab[i - 1], a);
+    fe8_copy(t, tab[c->pm2[7] >> 60]);
+    for (i = 126; i >= 0; i--) {
+        for (j = 0; j < 4; j++)
+            fe8_sqr(c, t, t);
+        w = (int)(c->pm2[i / 16] >> (4 * (i % 16))) & 15;
+        fe8_mul(c, t, t, tab[w]);
+    }
+    fe8_copy(r, t);
+}
+
+/* Lane l from the little-endian bytes at in[l], into Montgomery form */
+static IFMA void fe8_from_bytes(const GOST_EC_IFMA_CURVE *c, fe8 r,
+                                const unsigned char *const in[IFMA_LANES])
+{
+    uint64_t w[9], limbs[IFMA_LIMBS][IFMA_LANES];
+    fe8 rr;
+    int i, j, l;
+
+    for (l = 0; l < IFMA_LANES; l++) {
+        for (i = 0; i < 8; i++)
+            for (w[i] = 0, j = 7; j >= 0; j--)
+                w[i] = w[i] << 8 | in[l][8 * i + j];
+        w[8] = 0;
+        for (i = 0; i < IFMA_LIMBS; i++) {
+            j = 52 * i % 64;
+            limbs[i][l] = w[52 * i / 64] >> j;
+            if (j > 12)
+                limbs[i][l] |= w[52 * i / 64 + 1] << (64 - j);
+            limbs[i][l] &= M52;
+        }
+    }
+    for (i = 0; i < IFMA_LIMBS; i++)
+        r[i] = _mm512_loadu_si512(limbs[i]);
+    fe8_bcast(rr, c->rr);
+    fe8_mul(c, r, r, rr);
+}
+
+/* Lane l, fully reduced, as little-endian bytes to out[l] */
+static IFMA void fe8_to_bytes(const GOST_EC_IFMA_CURVE *c,
+                              unsigned char *const out[IFMA_LANES],
+                              const fe8 a)
+{
+    uint64_t w[9], limbs[IFMA_LIMBS][IFMA_LANES];
+    fe8 t, d;
+    __mmask8 ge;
+    int i, j, l;
+
+    /* a / R < p + 1 */
+    for (i = 0; i < IFMA_LIMBS; i++)
+        t[i] = _mm512_setzero_si512();
+    t[0] = bcast(1);
+    fe8_mul(c, t, a, t);
+    for (i = 0; i < IFMA_LIMBS; i++)
+        d[i] = _mm512_sub_epi64(t[i], bcast(c->p[i]));
+    fe8_carry(d);
+    ge = _mm512_cmpge_epi64_mask(d[IFMA_LIMBS - 1], _mm512_setzero_si512());
+    for (i = 0; i < IFMA_LIMBS; i++)
+        _mm512_storeu_si512(limbs[i], _mm512_mask_blend_epi64(ge, t[i], d[i]));
+
+    for (l = 0; l < IFMA_LANES; l++) {
+        memset(w, 0, sizeof(w));
+        for (i = 0; i < IFMA_LIMBS; i++) {
+            j = 52 * i % 64;
+            w[52 * i / 64] |= limbs[i][l] << j;
+            if (j > 12)
+                w[52 * i / 64 + 1] |= limbs[i][l] >> (64 - j);
+        }
+        for (i = 0; i < 64; i++)
+            out[l][i] = (unsigned char)(w[i / 8] >> (8 * (i % 8)));
+    }
+}
+
+/*
+ * r := p + q, r may be either. Algorithm 4 of Renes et al., or
+ * add-2008-hwcd with T1 * d * T2 for C.
+ */
+static IFMA void pt8_add(const GOST_EC_IFMA_CURVE *c, pt8 *r, const pt8 *p,
+                         const pt8 *q)
+{
+    fe8 t0, t1, t2, t3, t4, X3, Y3, Z3, k;
+
+    if (c->edwards) {
+        fe8_mul(c, t0, p->X, q->X);
+        fe8_mul(c, t1, p->Y, q->Y);
+        fe8_bcast(k, c->d);
+        fe8_mul(c, t2, p->T, k);
+        fe8_mul(c, t2, t2, q->T);
+        fe8_mul(c, t3, p->Z, q->Z);
+        fe8_add(c, t4, p->X, p->Y);
+        fe8_add(c, X3, q->X, q->Y);
+        fe8_mul(c, t4, t4, X3);
+        fe8_sub(c, t4, t4, t0);
+        fe8_sub(c, t4, t4, t1);         /* E */
+        fe8_sub(c, X3, t3, t2);         /* F */
+        fe8_add(c, Y3, t3, t2);         /* G */
+        fe8_sub(c, t1, t1, t0);         /* H */
+        fe8_mul(c, r->X, t4, X3);
+        fe8_mul(c, r->T, t4, t1);
+        fe8_mul(c, r->Z, X3, Y3);
+        fe8_mul(c, r->Y, Y3, t1);
+        return;
+    }
+
+    fe8_bcast(k, c->b);
+    fe8_mul(c, t0, p->X, q->X);
+    fe8_mul(c, t1, p->Y, q->Y);
+    fe8_mul(c, t2, p->Z, q->Z);
+    fe8_add(c, t3, p->X, p->Y);
+    fe8_add(c, t4, q->X, q->Y);
+    fe8_mul(c, t3, t3, t4);
+    fe8_add(c, t4, t0, t1);
+    fe8_sub(c, t3, t3, t4);
+    fe8_add(c, t4, p->Y, p->Z);
+    fe8_add(c, X3, q->Y, q->Z);
+    fe8_mul(c, t4, t4, X3);
+    fe8_add(c, X3, t1, t2);
+    fe8_sub(c, t4, t4, X3);
+    fe8_add(c, X3, p->X, p->Z);
+    fe8_add(c, Y3, q->X, q->Z);
+    fe8_mul(c, X3, X3, Y3);
+    fe8_add(c, Y3, t0, t2);
+    fe8_sub(c, Y3, X3, Y3);
+    fe8_mul(c, Z3, k, t2);
+    fe8_sub(c, X3, Y3, Z3);
+    fe8_add(c, Z3, X3, X3);
+    fe8_add(c, X3, X3, Z3);
+    fe8_sub(c, Z3, t1, X3);
+    fe8_add(c, X3, t1, X3);
+    fe8_mul(c, Y3, k, Y3);
+    fe8_add(c, t1, t2, t2);
+    fe8_add(c, t2, t1, t2);
+    fe8_sub(c, Y3, Y3, t2);
+    fe8_sub(c, Y3, Y3, t0);
+    fe8_add(c, t1, Y3, Y3);
+    fe8_add(c, Y3, t1, Y3);
+    fe8_add(c, t1, t0, t0);
+    fe8_add(c, t0, t1, t0);
+    fe8_sub(c, t0, t0, t2);
+    fe8_mul(c, t1, t4, Y3);
+    fe8_mul(c, t2, t0, Y3);
+    fe8_mul(c, Y3, X3, Z3);
+    fe8_add(c, r->Y, Y3, t2);
+    fe8_mul(c, X3, t3, X3);
+    fe8_sub(c, r->X, X3, t1);
+    fe8_mul(c, Z3, t4, Z3);
+    fe8_mul(c, t1, t3, t0);
+    fe8_add(c, r->Z, Z3, t1);
+}
+
+/* r := 2 * p, r may be p. Algorithm 6 of Renes et al., or dbl-2008-hwcd */
+static IFMA void pt8_dbl(const GOST_EC_IFMA_CURVE *c, pt8 *r, const pt8 *p)
+{
+    fe8 t0, t1, t2, t3, X3, Y3, Z3, k;
+
+    if (c->edwards) {
+        fe8_sqr(c, t0, p->X);
+        fe8_sqr(c, t1, p->Y);
+        fe8_sqr(c, t2, p->Z);
+        fe8_add(c, t2, t2, t2);         /* C */
+        fe8_add(c, t3, p->X, p->Y);
+        fe8_sqr(c, t3, t3);
+        fe8_sub(c, t3, t3, t0);
+        fe8_sub(c, t3, t3, t1);         /* E */
+        fe8_add(c, Y3, t0, t1);         /* G */
+        fe8_sub(c, X3, Y3, t2);         /* F */
+        fe8_sub(c, t1, t0, t1);         /* H */
+        fe8_mul(c, r->X, t3, X3);
+        fe8_mul(c, r->T, t3, t1);
+        fe8_mul(c, r->Z, X3, Y3);
+        fe8_mul(c, r->Y, Y3, t1);
+        return;
+    }
+
+    fe8_bcast(k, c->b);
+    fe8_sqr(c, t0, p->X);
+    fe8_sqr(c, t1, p->Y);
+    fe8_sqr(c, t2, p->Z);
+    fe8_mul(c, t3, p->X, p->Y);
+    fe8_add(c, t3, t3, t3);
+    fe8_mul(c, Z3, p->X, p->Z);
+    fe8_add(c, Z3, Z3, Z3);
+    fe8_mul(c, Y3, k, t2);
+    fe8_sub(c, Y3, Y3, Z3);
+    fe8_add(c, X3, Y3, Y3);
+    fe8_add(c, Y3, X3, Y3);
+    fe8_sub(c, X3, t1, Y3);
+    fe8_add(c, Y3, t1, Y3);
+    fe8_mul(c, Y3, X3, Y3);
+    fe8_mul(c, X3, X3, t3);
+    fe8_add(c, t3, t2, t2);
+    fe8_add(c, t2, t2, t3);
+    fe8_mul(c, Z3, k, Z3);
+    fe8_sub(c, Z3, Z3, t2);
+    fe8_sub(c, Z3, Z3, t0);
+    fe8_add(c, t3, Z3, Z3);
+    fe8_add(c, Z3, Z3, t3);
+    fe8_add(c, t3, t0, t0);
+    fe8_add(c, t0, t3, t0);
+    fe8_sub(c, t0, t0, t2);
+    fe8_mul(c, t0, t0, Z3);
+    fe8_add(c, Y3, Y3, t0);
+    fe8_mul(c, t0, p->Y, p->Z);
+    fe8_add(c, t0, t0, t0);
+    fe8_mul(c, Z3, t0, Z3);
+    fe8_sub(c, r->X, X3, Z3);
+    fe8_mul(c, Z3, t0, t1);
+    fe8_add(c, Z3, Z3, Z3);
+    fe8_add(c, r->Z, Z3, Z3);
+    fe8_copy(r->Y, Y3);
+}
+
+/*
+ * The Weierstrass point (x, y) of each lane. On the Edwards curve
+ * u = (x - et) / y and v = (x - et - es) / (x - et + es).
+ */
+static IFMA void pt8_from_affine(const GOST_EC_IFMA_CURVE *c, pt8 *r,
+                                 const fe8 x, const fe8 y)
+{
+    fe8 t0, t1, k;
+
+    if (c->edwards) {
+        fe8_bcast(k, c->et);
+        fe8_sub(c, t0, x, k);
+        fe8_bcast(k, c->es);
+        fe8_add(c, t1, t0, k);
+        fe8_mul(c, r->Z, y, t1);
+        fe8_mul(c, r->X, t0, t1);
+        fe8_sub(c, t0, t0, k);
+        fe8_mul(c, r->Y, t0, y);
+        /* (X : Y : Z) to (XZ : YZ : Z^2) with T = XY */
+        fe8_mul(c, r->T, r->X, r->Y);
+        fe8_mul(c, r->X, r->X, r->Z);
+        fe8_mul(c, r->Y, r->Y, r->Z);
+        fe8_sqr(c, r->Z, r->Z);
+        return;
+    }
+    fe8_copy(r->X, x);
+    fe8_copy(r->Y, y);
+    fe8_bcast(r->Z, c->one);
+}
+
+/*
+ * Weierstrass (x, y) of each lane, (0, 0) at infinity. On the Edwards
+ * curve x = (es (Z + Y) X + et (Z - Y) X) / ((Z - Y) X) and
+ * y = es (Z + Y) Z / ((Z - Y) X), where X = 0 only at infinity.
+ */
+static IFMA void pt8_to_affine(const GOST_EC_IFMA_CURVE *c, fe8 x, fe8 y,
+                               const pt8 *p)
+{
+    fe8 t0, t1, t2, k;
+
+    if (c->edwards) {
+        fe8_sub(c, t0, p->Z, p->Y);
+        fe8_mul(c, t0, t0, p->X);
+        fe8_inv(c, t1, t0);
+        fe8_add(c, t2, p->Z, p->Y);
+        fe8_bcast(k, c->es);
+        fe8_mul(c, t2, t2, k);
+        fe8_bcast(k, c->et);
+        fe8_mul(c, t0, t0, k);
+        fe8_mul(c, x, t2, p->X);
+        fe8_add(c, x, x, t0);
+        fe8_mul(c, x, x, t1);
+        fe8_mul(c, y, t2, p->Z);
+        fe8_mul(c, y, y, t1);
+        return;
+    }
+    fe8_inv(c, t1, p->Z);
+    fe8_mul(c, x, p->X, t1);
+    fe8_mul(c, y, p->Y, t1);
+}
+
+/* table[i] = i * table[1] for i = 0, 2 .. IFMA_TABLE - 1 */
+static IFMA void pt8_table(const GOST_EC_IFMA_CURVE *c, pt8 *table)
+{
+    int i;
+
+    memset(&table[0], 0, sizeof(pt8));
+    fe8_bcast(table[0].Y, c->one);
+    if (c->edwards)
+        fe8_bcast(table[0].Z, c->one);
+    pt8_dbl(c, &table[2], &table[1]);
+    for (i = 3; i < IFMA_TABLE; i++)
+        pt8_add(c, &table[i], &table[i - 1], &table[1]);
+}
+
+/* r := d[l] * table[1] in lane l, by gathers: the digits are public */
+static IFMA void pt8_lookup(const GOST_EC_IFMA_CURVE *c, pt8 *r,
+                            const pt8 *table,
+                            const signed char d[IFMA_LANES])
+{
+    const long long *base = (const long long *)table;
+    long long v[IFMA_LANES];
+    __m512i idx, dv;
+    __mmask8 neg;
+    fe8 t;
+    int i;
+
+    for (i = 0; i < IFMA_LANES; i++)
+        v[i] = d[i];
+    dv = _mm512_loadu_si512(v);
+    neg = _mm512_cmplt_epi64_mask(dv, _mm512_setzero_si512());
+    /* Limb k of coordinate j in lane l of table[n] */
+# define IFMA_AT(j, k) (base + 8 * ((j) * IFMA_LIMBS + (k)))
+    idx = _mm512_madd52lo_epu64(_mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0),
+                                _mm512_abs_epi64(dv), bcast(sizeof(pt8) / 8));
+    for (i = 0; i < IFMA_LIMBS; i++) {
+        r->X[i] = _mm512_i64gather_epi64(idx, IFMA_AT(0, i), 8);
+        r->Y[i] = _mm512_i64gather_epi64(idx, IFMA_AT(1, i), 8);
+        r->Z[i] = _mm512_i64gather_epi64(idx, IFMA_AT(2, i), 8);
+        if (c->edwards)
+            r->T[i] = _mm512_i64gather_epi64(idx, IFMA_AT(3, i), 8);
+    }
+# undef IFMA_AT
+
+    /* -(x, y) = (x, -y), -(u, v) = (-u, v) */
+    memset(t, 0, sizeof(t));
+    if (c->edwards) {
+        fe8_sub(c, t, t, r->X);
+        for (i = 0; i < IFMA_LIMBS; i++)
+            r->X[i] = _mm512_mask_blend_epi64(neg, r->X[i], t[i]);
+        memset(t, 0, sizeof(t));
+        fe8_sub(c, t, t, r->T);
+        for (i = 0; i < IFMA_LIMBS; i++)
+            r->T[i] = _mm512_mask_blend_epi64(neg, r->T[i], t[i]);
+    } else {
+        fe8_sub(c, t, t, r->Y);
+        for (i = 0; i < IFMA_LIMBS; i++)
+            r->Y[i] = _mm512_mask_blend_epi64(neg, r->Y[i], t[i]);
+    }
+}
+
+/* Signed windows: k = sum of d[i] * 32^i */
+static void ifma_recode(signed char d[IFMA_WINDOWS], const unsigned char *k)
+{
+    int i, bit, w, carry = 0;
+
+    for (i = 0; i < IFMA_WINDOWS; i++) {
+        bit = 5 * i;
+        w = k[bit / 8] >> (bit % 8);
+        if (bit % 8 > 3 && bit / 8 + 1 < 64)
+            w |= k[bit / 8 + 1] << (8 - bit % 8);
+        w = (w & 31) + carry;
+        carry = w > 16;
+        d[i] = (signed char)(w - (carry << 5));
+    }
+}
+
+/* out[l] := a[l] * G + b[l] * P[l], 0 at infinity, tabs 64-byte aligned */
+static IFMA void ifma_mul_two(const GOST_EC_IFMA_CURVE *c, pt8 *tabs,
+                              unsigned char *const outx[IFMA_LANES],
+                              unsigned char *const outy[IFMA_LANES],
+                              const unsigned char *const a[IFMA_LANES],
+                              const unsigned char *const b[IFMA_LANES],
+                              const unsigned char *const inx[IFMA_LANES],
+                              const unsigned char *const iny[IFMA_LANES])
+{
+    pt8 *tp = tabs, *tg = tabs + IFMA_TABLE, R, Q;
+    signed char da[IFMA_WINDOWS][IFMA_LANES], db[IFMA_WINDOWS][IFMA_LANES];
+    signed char d[IFMA_WINDOWS];
+    fe8 x, y;
+    int i, l;
+
+    for (l = 0; l < IFMA_LANES; l++) {
+        ifma_recode(d, a[l]);
+        for (i = 0; i < IFMA_WINDOWS; i++)
+            da[i][l] = d[i];
+        ifma_recode(d, b[l]);
+        for (i = 0; i < IFMA_WINDOWS; i++)
+            db[i][l] = d[i];
+    }
+
+    fe8_from_bytes(c, x, inx);
+    fe8_from_bytes(c, y, iny);
+    pt8_from_affine(c, &tp[1], x, y);
+    pt8_table(c, tp);
+    fe8_bcast(x, c->gx);
+    fe8_bcast(y, c->gy);
+    pt8_from_affine(c, &tg[1], x, y);
+    pt8_table(c, tg);
+
+    pt8_lookup(c, &R, tp, db[IFMA_WINDOWS - 1]);
+    pt8_lookup(c, &Q, tg, da[IFMA_WINDOWS - 1]);
+    pt8_add(c, &R, &R, &Q);
+    for (i = IFMA_WINDOWS - 2; i >= 0; i--) {
+        for (l = 0; l < 5; l++)
+            pt8_dbl(c, &R, &R);
+        pt8_lookup(c, &Q, tp, db[i]);
+        pt8_add(c, &R, &R, &Q);
+        pt8_lookup(c, &Q, tg, da[i]);
+        pt8_add(c, &R, &R, &Q);
+    }
+
+    pt8_to_affine(c, x, y, &R);
+    fe8_to_bytes(c, outx, x);
+    fe8_to_bytes(c, outy, y);
+}
+
+size_t gost_ec_ifma_mul_two_batch(const GOST_EC_IFMA_CURVE *curve, size_t n,
+                                  unsigned char *outx, unsigned char *outy,
+                                  const unsigned char *a,
+                                  const unsigned char *b,
+                                  const unsigned char *inx,
+                                  const unsigned char *iny)
+{
+    unsigned char *ox[IFMA_LANES], *oy[IFMA_LANES], spare[2][64];
+    const unsigned char *pa[IFMA_LANES], *pb[IFMA_LANES];
+    const unsigned char *px[IFMA_LANES], *py[IFMA_LANES];
+    unsigned char *buf;
+    size_t i, j, k;
+
+    if ((gost_cpu_caps() & IFMA_CAPS) != IFMA_CAPS || n < IFMA_MIN_LANES
+        || (buf = OPENSSL_malloc(2 * IFMA_TABLE * sizeof(pt8) + 63)) == NULL)
+        return 0;
+
+    for (i = 0; n - i >= IFMA_MIN_LANES; i += IFMA_LANES) {
+        /* Lanes past the end repeat the first and write to spare */
+        for (j = 0; j < IFMA_LANES; j++) {
+            k = i + j < n ? (i + j) * 64 : i * 64;
+            ox[j] = i + j < n ? outx + k : spare[0];
+            oy[j] = i + j < n ? outy + k : spare[1];
+            pa[j] = a + k;
+            pb[j] = b + k;
+            px[j] = inx + k;
+            py[j] = iny + k;
+        }
+        ifma_mul_two(curve, (pt8 *)(buf + (-(uintptr_t)buf & 63)),
+                     ox, oy, pa, pb, px, py);
+        if (n - i <= IFMA_LANES) {
+            i = n;
+            break;
+        }
+    }
+    OPENSSL_free(buf);
+    return i;
+}
+
+#else
+
+size_t gost_ec_ifma_mul_two_batch(const GOST_EC_IFMA_CURVE *curve, size_t n,
+                                  unsigned char *outx, unsigned char *outy,
+                                  const unsigned char *a,
+                                  const unsigned char *b,
+                                  const unsigned char *inx,
+                                  const unsigned char *iny)
+{
+    return 0;
+}
+
+#endif
+/* vim: set expandtab cinoptions=\:0,l1,t0,g0,(0 sw=4 : */
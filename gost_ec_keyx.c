@@ -23,6 +23,25 @@
 #include "gost_keywrap.h"
 #include "gost_lcl.h"
 
+/*
+ * The VKO point (ukm * priv) * pub serialized as X || Y by the raw
+ * backend of the curve
+ */
+static int vko_point_raw(const GOST_EC_RAW_CURVE *raw, unsigned char *databuf,
+                         const EC_POINT *pub_key, const EC_KEY *priv_key,
+                         const unsigned char *ukm, const size_t ukm_size)
+{
+    unsigned char d[64], x[64], y[64];
+    int size = (int)gost_ec_raw_size(raw), ok = 0;
+
+    if (BN_bn2lebinpad(EC_KEY_get0_private_key(priv_key), d, size) == size
+        && gost_ec_raw_point(raw, EC_KEY_get0_group(priv_key), pub_key, x, y))
+        ok = gost_ec_raw_derive(raw, databuf, databuf + size, d, ukm, ukm_size,
+                                x, y);
+    OPENSSL_cleanse(d, sizeof(d));
+    return ok;
+}
+
 /* Implementation of CryptoPro VKO 34.10-2001/2012 algorithm */
 int VKO_compute_key(unsigned char *shared_key,
                     const EC_POINT *pub_key, const EC_KEY *priv_key,
@@ -36,22 +55,39 @@ int VKO_compute_key(unsigned char *shared_key,
     BN_CTX *ctx = NULL;
     EVP_MD_CTX *mdctx = NULL;
     const EVP_MD *md = NULL;
+    const GOST_EC_RAW_CURVE *raw;
     int buf_len, half_len;
     int ret = 0;
 
-    if ((ctx = BN_CTX_secure_new()) == NULL) {
-        GOSTerr(GOST_F_VKO_COMPUTE_KEY, ERR_R_MALLOC_FAILURE);
-        return 0;
-    }
-    BN_CTX_start(ctx);
-
     md = EVP_get_digestbynid(vko_dgst_nid);
     if (!md) {
         GOSTerr(GOST_F_VKO_COMPUTE_KEY, GOST_R_INVALID_DIGEST_TYPE);
-        goto err;
+        return 0;
     }
 
     grp = EC_KEY_get0_group(priv_key);
+    raw = gost_ec_raw_curve(EC_GROUP_get_curve_name(grp));
+    if (raw && ukm_size <= gost_ec_raw_size(raw)
+        && (size_t)BN_num_bytes(EC_KEY_get0_private_key(priv_key))
+           <= gost_ec_raw_size(raw)) {
+        buf_len = 2 * (int)gost_ec_raw_size(raw);
+        if ((databuf = OPENSSL_malloc(buf_len)) == NULL) {
+            GOSTerr(GOST_F_VKO_COMPUTE_KEY, ERR_R_MALLOC_FAILURE);
+            goto err;
+        }
+        if (!vko_point_raw(raw, databuf, pub_key, priv_key, ukm, ukm_size)) {
+            GOSTerr(GOST_F_VKO_COMPUTE_KEY, GOST_R_ERROR_POINT_MUL);
+            goto err;
+        }
+        goto hash;
+    }
+
+    if ((ctx = BN_CTX_secure_new()) == NULL) {
+        GOSTerr(GOST_F_VKO_COMPUTE_KEY, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    BN_CTX_start(ctx);
+
     scalar = BN_CTX_get(ctx);
     X = BN_CTX_get(ctx);
 
@@ -100,6 +136,7 @@ int VKO_compute_key(unsigned char *shared_key,
         || BN_bn2lebinpad(Y, databuf + half_len, half_len) != half_len)
         goto err;
 
+ hash:
     if ((mdctx = EVP_MD_CTX_new()) == NULL) {
         GOSTerr(GOST_F_VKO_COMPUTE_KEY, ERR_R_MALLOC_FAILURE);
         goto err;
@@ -116,8 +153,10 @@ int VKO_compute_key(unsigned char *shared_key,
     ret = (EVP_MD_size(md) > 0) ? EVP_MD_size(md) : 0;
 
  err:
-    BN_CTX_end(ctx);
-    BN_CTX_free(ctx);
+    if (ctx) {
+        BN_CTX_end(ctx);
+        BN_CTX_free(ctx);
+    }
     EC_POINT_free(pnt);
     EVP_MD_CTX_free(mdctx);
     OPENSSL_free(databuf);
@@ -338,7 +377,8 @@ static int pkey_GOST_ECcp_encrypt(EVP_PKEY_CTX *pctx, unsigned char *out,
                     GOST_R_ERROR_COMPUTING_SHARED_KEY);
             goto err;
         }
-        gost_init(&cctx, param->sblock);
+        if (!gost_init(&cctx, param->sblock))
+            goto err;
         keyWrapCryptoPro(&cctx, shared_key, ukm, key, crypted_key);
     }
     gkt = GOST_KEY_TRANSPORT_new();
@@ -623,7 +663,8 @@ static int pkey_GOST_ECcp_decrypt(EVP_PKEY_CTX *pctx, unsigned char *key,
         goto err;
     }
 
-    gost_init(&ctx, param->sblock);
+    if (!gost_init(&ctx, param->sblock))
+        goto err;
     OPENSSL_assert(gkt->key_agreement_info->eph_iv->length == 8);
     memcpy(wrappedKey, gkt->key_agreement_info->eph_iv->data, 8);
     OPENSSL_assert(gkt->key_info->encrypted_key->length == 32);
@@ -0,0 +1,330 @@
+/**********************************************************************
+ *                        gost_ec_pool.c                              *
+ *         This file is distributed under the same license as OpenSSL *
+ *                                                                    *
+ *    Pools of precomputed GOST R 34.10 signing nonces: pairs of k    *
+ *    and r = (k * P).x mod q made ahead of the messages, by an       *
+ *    explicit control or by a background refill thread              *
+ **********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/objects.h>
+#include "gost_lcl.h"
+#ifndef _WIN32
+# include <pthread.h>
+# define POOL_THREADS
+#endif
+
+#ifdef POOL_THREADS
+
+/*
+ * Pairs are k || r, each gost_ec_raw_size() bytes, taken from the end.
+ * All state is under pool_lock; the points are multiplied outside it.
+ */
+typedef struct {
+    const GOST_EC_RAW_CURVE *curve;     /* set once the curve is used */
+    unsigned char *pairs;
+    size_t count;
+    unsigned long hits, misses, generated;
+} GOST_EC_POOL;
+
+static GOST_EC_POOL pools[GOST_EC_RAW_CURVES];
+static size_t pool_capacity;            /* pairs per curve, 0 disables */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_low = PTHREAD_COND_INITIALIZER;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_t pool_tid;
+static int pool_thread, pool_stop;
+
+static size_t pair_size(const GOST_EC_POOL *pool)
+{
+    return 2 * gost_ec_raw_size(pool->curve);
+}
+
+static void pool_prepare(void)
+{
+    pthread_mutex_lock(&pool_lock);
+}
+
+static void pool_parent(void)
+{
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/*
+ * The child must not sign with nonces the parent may use as well. The
+ * refill thread did not survive the fork; the secure heap lock may be
+ * held by a thread that did not either, so the memory is kept.
+ */
+static void pool_child(void)
+{
+    int i;
+
+    for (i = 0; i < GOST_EC_RAW_CURVES; i++) {
+        if (pools[i].pairs != NULL)
+            OPENSSL_cleanse(pools[i].pairs,
+                            pool_capacity * pair_size(&pools[i]));
+        pools[i].count = 0;
+    }
+    pool_thread = 0;
+    pthread_cond_init(&pool_low, NULL);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void pool_init(void)
+{
+    pthread_atfork(pool_prepare, pool_parent, pool_child);
+}
+
+/* Lock held */
+static void pool_wipe(GOST_EC_POOL *pool)
+{
+    if (pool->pairs != NULL)
+        OPENSSL_secure_clear_free(pool->pairs,
+                                  pool_capacity * pair_size(pool));
+    pool->pairs = NULL;
+    pool->count = 0;
+}
+
+/* Lock held */
+static int pool_add(GOST_EC_POOL *pool, const unsigned char *pair)
+{
+    size_t size = pair_size(pool);
+
+    if (pool->count >= pool_capacity)
+        return 0;
+    if (pool->pairs == NULL
+        && (pool->pairs = OPENSSL_secure_zalloc(pool_capacity * size)) == NULL)
+        return 0;
+    memcpy(pool->pairs + pool->count++ * size, pair, size);
+    pool->generated++;
+    return 1;
+}
+
+/* Adds up to n pairs, returns how many */
+static size_t pool_fill(const GOST_EC_RAW_CURVE *curve, size_t n)
+{
+    GOST_EC_POOL *pool = &pools[gost_ec_raw_index(curve)];
+    size_t size = gost_ec_raw_size(curve), done;
+    unsigned char pair[2 * 64];
+    int added;
+
+    for (done = 0; done < n; done++) {
+        if (!gost_ec_raw_pair(curve, pair, pair + size))
+            break;
+        pthread_mutex_lock(&pool_lock);
+        pool->curve = curve;
+        added = pool_add(pool, pair);
+        pthread_mutex_unlock(&pool_lock);
+        if (!added)
+            break;
+    }
+    OPENSSL_cleanse(pair, sizeof(pair));
+    return done;
+}
+
+int gost_ec_pool_take(const GOST_EC_RAW_CURVE *curve, unsigned char *k,
+                      unsigned char *r)
+{
+    GOST_EC_POOL *pool = &pools[gost_ec_raw_index(curve)];
+    size_t size = gost_ec_raw_size(curve);
+    unsigned char *pair;
+    int ok = 0;
+
+    pthread_mutex_lock(&pool_lock);
+    if (pool_capacity == 0)
+        goto end;
+    pool->curve = curve;
+    if (pool->count == 0) {
+        pool->misses++;
+    } else {
+        pair = pool->pairs + --pool->count * 2 * size;
+        memcpy(k, pair, size);
+        memcpy(r, pair + size, size);
+        OPENSSL_cleanse(pair, 2 * size);
+        pool->hits++;
+        ok = 1;
+    }
+    /* Refilled to capacity once down to half */
+    if (pool_thread && pool->count <= pool_capacity / 2)
+        pthread_cond_signal(&pool_low);
+ end:
+    pthread_mutex_unlock(&pool_lock);
+    return ok;
+}
+
+static void *pool_refill(void *arg)
+{
+    const GOST_EC_RAW_CURVE *curve;
+    int i, added;
+
+    pthread_mutex_lock(&pool_lock);
+    while (!pool_stop) {
+        curve = NULL;
+        for (i = 0; i < GOST_EC_RAW_CURVES && curve == NULL; i++)
+            if (pools[i].curve != NULL && pools[i].count < pool_capacity)
+                curve = pools[i].curve;
+        if (curve == NULL) {
+            pthread_cond_wait(&pool_low, &pool_lock);
+            continue;
+        }
+        /* One pair at a time, so a stop request is not kept waiting */
+        pthread_mutex_unlock(&pool_lock);
+        added = pool_fill(curve, 1) == 1;
+        pthread_mutex_lock(&pool_lock);
+        if (!added && !pool_stop)
+            pthread_cond_wait(&pool_low, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+static void pool_stop_thread(void)
+{
+    int running;
+
+    pthread_mutex_lock(&pool_lock);
+    running = pool_thread;
+    pool_stop = 1;
+    pthread_cond_broadcast(&pool_low);
+    pthread_mutex_unlock(&pool_lock);
+    if (running)
+        pthread_join(pool_tid, NULL);
+    pthread_mutex_lock(&pool_lock);
+    pool_thread = 0;
+    pool_stop = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int gost_ec_pool_set_thread(long on)
+{
+    int ret = 1;
+
+    pthread_once(&pool_once, pool_init);
+    if (!on) {
+        pool_stop_thread();
+        return 1;
+    }
+    pthread_mutex_lock(&pool_lock);
+    if (!pool_thread)
+        ret = pool_thread =
+            pthread_create(&pool_tid, NULL, pool_refill, NULL) == 0;
+    pthread_mutex_unlock(&pool_lock);
+    return ret;
+}
+
+int gost_ec_pool_set_capacity(long capacity)
+{
+    int i;
+
+    if (capacity < 0)
+        return 0;
+    pthread_once(&pool_once, pool_init);
+    pthread_mutex_lock(&pool_lock);
+    for (i = 0; i < GOST_EC_RAW_CURVES; i++)
+        pool_wipe(&pools[i]);
+    pool_capacity = capacity;
+    pthread_cond_signal(&pool_low);
+    pthread_mutex_unlock(&pool_lock);
+    return 1;
+}
+
+int gost_ec_pool_precompute(const char *arg)
+{
+    const GOST_EC_RAW_CURVE *curve;
+    const char *sep;
+    char name[80];
+    long n;
+    char *end;
+
+    if (arg == NULL || (sep = strrchr(arg, ':')) == NULL
+        || (size_t)(sep - arg) >= sizeof(name))
+        return 0;
+    memcpy(name, arg, sep - arg);
+    name[sep - arg] = '\0';
+    n = strtol(sep + 1, &end, 10);
+    if (*end != '\0' || n < 0
+        || (curve = gost_ec_raw_curve(OBJ_txt2nid(name))) == NULL)
+        return 0;
+
+    pthread_once(&pool_once, pool_init);
+    pthread_mutex_lock(&pool_lock);
+    if (pool_capacity == 0) {
+        pthread_mutex_unlock(&pool_lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    pool_fill(curve, n);
+    return 1;
+}
+
+int gost_ec_pool_stats(int nid, long *stats)
+{
+    const GOST_EC_RAW_CURVE *curve = gost_ec_raw_curve(nid);
+    GOST_EC_POOL *pool;
+
+    if (curve == NULL || stats == NULL)
+        return 0;
+    pool = &pools[gost_ec_raw_index(curve)];
+    pthread_mutex_lock(&pool_lock);
+    stats[0] = (long)pool_capacity;
+    stats[1] = (long)pool->count;
+    stats[2] = (long)pool->hits;
+    stats[3] = (long)pool->misses;
+    stats[4] = (long)pool->generated;
+    pthread_mutex_unlock(&pool_lock);
+    return 1;
+}
+
+void gost_ec_pool_free(void)
+{
+    int i;
+
+    pool_stop_thread();
+    pthread_mutex_lock(&pool_lock);
+    for (i = 0; i < GOST_EC_RAW_CURVES; i++) {
+        pool_wipe(&pools[i]);
+        pools[i].curve = NULL;
+        pools[i].hits = pools[i].misses = pools[i].generated = 0;
+    }
+    pool_capacity = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+#else /* POOL_THREADS */
+
+int gost_ec_pool_take(const GOST_EC_RAW_CURVE *curve, unsigned char *k,
+                      unsigned char *r)
+{
+    return 0;
+}
+
+int gost_ec_pool_set_capacity(long capacity)
+{
+    return capacity == 0;
+}
+
+int gost_ec_pool_set_thread(long on)
+{
+    return !on;
+}
+
+int gost_ec_pool_precompute(const char *arg)
+{
+    return 0;
+}
+
+int gost_ec_pool_stats(int nid, long *stats)
+{
+    if (stats == NULL)
+        return 0;
+    memset(stats, 0, GOST_EC_POOL_STATS * sizeof(*stats));
+    return 1;
+}
+
+void gost_ec_pool_free(void)
+{
+}
+
+#endif /* POOL_THREADS */
@@ -0,0 +1,668 @@
+/**********************************************************************
+ *                        gost_ec_raw.c                               *
+ *         This file is distributed under the same license as OpenSSL *
+ *                                                                    *
+ *    GOST R 34.10 signature and VKO on little-endian byte strings:   *
+ *    point multiplication by the ECCKiila backends, arithmetic       *
+ *    modulo the subgroup order in fixed-width Montgomery form        *
+ **********************************************************************/
+#include "gost_lcl.h"
+#include <stdint.h>
+#include <string.h>
+#include <openssl/buffer.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#define SC_LIMBS 8
+#define SC_BYTES (8 * SC_LIMBS)
+
+struct gost_ec_raw_curve {
+    int index;                  /* 0 .. GOST_EC_RAW_CURVES - 1 */
+    size_t size;                /* bytes in a coordinate or a scalar */
+    int limbs;                  /* 64-bit words in a scalar */
+    int bits;                   /* bit length of q */
+    uint64_t q[SC_LIMBS];
+    uint64_t rr[SC_LIMBS];      /* 2^(128 * limbs) mod q */
+    uint64_t q0inv;             /* -q^-1 mod 2^64 */
+    void (*mul_g)(unsigned char *outx, unsigned char *outy,
+                  const unsigned char *n);
+    void (*mul)(unsigned char *outx, unsigned char *outy,
+                const unsigned char *m, const unsigned char *inx,
+                const unsigned char *iny);
+    void (*mul_two)(unsigned char *outx, unsigned char *outy,
+                    const unsigned char *n, const unsigned char *m,
+                    const unsigned char *inx, const unsigned char *iny);
+    void (*mul_two_batch)(size_t count, unsigned char *outx,
+                          unsigned char *outy, const unsigned char *n,
+                          const unsigned char *m, const unsigned char *inx,
+                          const unsigned char *iny);
+    void *(*table_new)(const unsigned char *inx, const unsigned char *iny);
+    void (*mul_two_table)(unsigned char *outx, unsigned char *outy,
+                          const unsigned char *n, const unsigned char *m,
+                          const void *table);
+    const GOST_EC_IFMA_CURVE *ifma;     /* NULL but for 512-bit curves */
+};
+
+#define RAW_MUL(a) point_mul_g_raw_##a, point_mul_raw_##a, \
+    point_mul_two_raw_##a, point_mul_two_batch_raw_##a, \
+    point_table_new_raw_##a, point_mul_two_table_raw_##a
+
+static const GOST_EC_RAW_CURVE raw_cp_test = {
+    0, 32, 4, 256,
+    {0xc59cfc193accf5b3ULL, 0x50fe8a1892976154ULL,
+     0x0000000000000001ULL, 0x8000000000000000ULL},
+    {0xecaed44677f7f28dULL, 0x4af1f8ac73c6c555ULL,
+     0xc0db8b05c83ad16aULL, 0x6e749e5b503b112aULL},
+    0x66ff43a234713e85ULL,
+    RAW_MUL(id_GostR3410_2001_TestParamSet),
+    NULL
+};
+
+static const GOST_EC_RAW_CURVE raw_cp_a = {
+    1, 32, 4, 256,
+    {0x45841b09b761b893ULL, 0x6c611070995ad100ULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL},
+    {0x9ac2d7858e79a469ULL, 0xfb07f8222e76dd52ULL,
+     0xf74885d08a3714c6ULL, 0x551fe9cb451179dbULL},
+    0x9ee6ea0b57c7da65ULL,
+    RAW_MUL(id_GostR3410_2001_CryptoPro_A_ParamSet),
+    NULL
+};
+
+static const GOST_EC_RAW_CURVE raw_cp_b = {
+    2, 32, 4, 256,
+    {0xe497161bcc8a198fULL, 0x5f700cfff1a624e5ULL,
+     0x0000000000000001ULL, 0x8000000000000000ULL},
+    {0x29b721f4e6cd7823ULL, 0x2a3104a7ea43e855ULL,
+     0x4a2e7e2f6882cf10ULL, 0x09d1d2c4e5082466ULL},
+    0xca89614990611a91ULL,
+    RAW_MUL(id_GostR3410_2001_CryptoPro_B_ParamSet),
+    NULL
+};
+
+static const GOST_EC_RAW_CURVE raw_cp_c = {
+    3, 32, 4, 256,
+    {0xf02f3a6598980bb9ULL, 0x582ca3511eddfb74ULL,
+     0xab1ec85e6b41c8aaULL, 0x9b9f605f5a858107ULL},
+    {0xe94faab66aba180eULL, 0x04fda8694afda24bULL,
+     0xc67e5d0ee96e8ed3ULL, 0x7aa61b49a49d4759ULL},
+    0xa1c6af0a552f7577ULL,
+    RAW_MUL(id_GostR3410_2001_CryptoPro_C_ParamSet),
+    NULL
+};
+
+static const GOST_EC_RAW_CURVE raw_tc_256_a = {
+    4, 32, 4, 255,
+    {0xc115af556c360c67ULL, 0x0fd8cddfc87b6635ULL,
+     0x0000000000000000ULL, 0x4000000000000000ULL},
+    {0x57cb446240dd1710ULL, 0x7556091c4805caa4ULL,
+     0xd0593365f9384bcdULL, 0x0fb1fbc48b0f0eb4ULL},
+    0x035bdd1aeafdb0a9ULL,
+    RAW_MUL(id_tc26_gost_3410_2012_256_paramSetA),
+    NULL
+};
+
+static const GOST_EC_RAW_CURVE raw_tc_512_a = {
+    5, 64, 8, 512,
+    {0xcacdb1411f10b275ULL, 0x9b4b38abfad2b85dULL,
+     0x6ff22b8d4e056060ULL, 0x27e69532f48d8911ULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL},
+    {0x546775b92106e979ULL, 0xb55cd33800ab10e6ULL,
+     0x80b08b27e9cebbc7ULL, 0xa06b76a2bae6fc86ULL,
+     0xc7433579e382956fULL, 0xbab8be5dd7b1651dULL,
+     0xee028bf9d8ed3314ULL, 0xb66ae6c00bebd6c3ULL},
+    0x02ccc1665d51f223ULL,
+    RAW_MUL(id_tc26_gost_3410_2012_512_paramSetA),
+    &gost_ec_ifma_512_a
+};
+
+static const GOST_EC_RAW_CURVE raw_tc_512_b = {
+    6, 64, 8, 512,
+    {0xc6346c54374f25bdULL, 0x8b996712101bea0eULL,
+     0xacfdb77bd9d40cfaULL, 0x49a1ec142565a545ULL,
+     0x0000000000000001ULL, 0x0000000000000000ULL,
+     0x0000000000000000ULL, 0x8000000000000000ULL},
+    {0x3163da9749d3cb8bULL, 0x267d56905313f38bULL,
+     0xc55538cf997acac4ULL, 0xb1532b08f1e25e5cULL,
+     0xc385980eb887a3f9ULL, 0x9f96043308eeb401ULL,
+     0xf96232d7a52b18feULL, 0x21c65cda4cadccc0ULL},
+    0xc07d62492cbac26bULL,
+    RAW_MUL(id_tc26_gost_3410_2012_512_paramSetB),
+    &gost_ec_ifma_512_b
+};
+
+static const GOST_EC_RAW_CURVE raw_tc_512_c = {
+    7, 64, 8, 510,
+    {0x94623cef47f023edULL, 0xc8eda9e7a769a126ULL,
+     0x4c33a9ff5147502cULL, 0xc98cdba46506ab00ULL,
+     0xffffffffffffffffULL, 0xffffffffffffffffULL,
+     0xffffffffffffffffULL, 0x3fffffffffffffffULL},
+    {0xe58fa18ee6ca4eb6ULL, 0xe79280282d956fcaULL,
+     0xd016086ec2d4f903ULL, 0x542f8f3fa490666aULL,
+     0x04f77045db49adc9ULL, 0x314e0a57f445b20eULL,
+     0x8910352f3bea2192ULL, 0x394c72054d8503beULL},
+    0x0ed9d8e0b6624e1bULL,
+    RAW_MUL(id_tc26_gost_3410_2012_512_paramSetC),
+    &gost_ec_ifma_512_c
+};
+
+#undef RAW_MUL
+
+/* Same curve mapping as gost_ec_point_mul */
+const GOST_EC_RAW_CURVE *gost_ec_raw_curve(int nid)
+{
+    switch (nid) {
+    case NID_id_GostR3410_2001_CryptoPro_A_ParamSet:
+    case NID_id_GostR3410_2001_CryptoPro_XchA_ParamSet:
+    case NID_id_tc26_gost_3410_2012_256_paramSetB:
+        return &raw_cp_a;
+    case NID_id_GostR3410_2001_CryptoPro_B_ParamSet:
+    case NID_id_tc26_gost_3410_2012_256_paramSetC:
+        return &raw_cp_b;
+    case NID_id_GostR3410_2001_CryptoPro_C_ParamSet:
+    case NID_id_GostR3410_2001_CryptoPro_XchB_ParamSet:
+    case NID_id_tc26_gost_3410_2012_256_paramSetD:
+        return &raw_cp_c;
+    case NID_id_GostR3410_2001_TestParamSet:
+        return &raw_cp_test;
+    case NID_id_tc26_gost_3410_2012_256_paramSetA:
+        return &raw_tc_256_a;
+    case NID_id_tc26_gost_3410_2012_512_paramSetA:
+        return &raw_tc_512_a;
+    case NID_id_tc26_gost_3410_2012_512_paramSetB:
+        return &raw_tc_512_b;
+    case NID_id_tc26_gost_3410_2012_512_paramSetC:
+        return &raw_tc_512_c;
+    }
+    return NULL;
+}
+
+size_t gost_ec_raw_size(const GOST_EC_RAW_CURVE *curve)
+{
+    return curve->size;
+}
+
+int gost_ec_raw_index(const GOST_EC_RAW_CURVE *curve)
+{
+    return curve->index;
+}
+
+/*
+ * Scalars modulo q: curve->limbs words, least significant first. The
+ * helpers do not branch on their values, except sc_inv, which walks the
+ * public exponent q - 2.
+ */
+
+/* a * b + c + d as (hi, return value) */
+static inline uint64_t sc_mac(uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+                              uint64_t *hi)
+{
+#if defined(__SIZEOF_INT128__) && !defined(PEDANTIC)
+    unsigned __int128 t = (unsigned __int128)a * b + c + d;
+
+    *hi = (uint64_t)(t >> 64);
+    return (uint64_t)t;
+#else
+    uint64_t al = a & 0xffffffff, ah = a >> 32;
+    uint64_t bl = b & 0xffffffff, bh = b >> 32;
+    uint64_t ll = al * bl, lh = al * bh, hl = ah * bl;
+    uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+    uint64_t lo = (ll & 0xffffffff) | (mid << 32);
+    uint64_t h = ah * bh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+    lo += c;
+    h += lo < c;
+    lo += d;
+    h += lo < d;
+    *hi = h;
+    return lo;
+#endif
+}
+
+static void sc_from_bytes(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                          const unsigned char *in, size_t len)
+{
+    size_t i;
+
+    memset(out, 0, c->limbs * sizeof(*out));
+    for (i = 0; i < len; i++)
+        out[i / 8] |= (uint64_t)in[i] << (8 * (i % 8));
+}
+
+static void sc_to_bytes(const GOST_EC_RAW_CURVE *c, unsigned char *out,
+                        const uint64_t *in)
+{
+    size_t i;
+
+    for (i = 0; i < c->size; i++)
+        out[i] = (unsigned char)(in[i / 8] >> (8 * (i % 8)));
+}
+
+/* a - q, and whether it borrowed */
+static uint64_t sc_sub_q(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                         const uint64_t *a)
+{
+    uint64_t borrow = 0, d;
+    int i;
+
+    for (i = 0; i < c->limbs; i++) {
+        d = a[i] - c->q[i];
+        out[i] = d - borrow;
+        borrow = (a[i] < c->q[i]) | (d < borrow);
+    }
+    return borrow;
+}
+
+/* top * 2^(64 * limbs) + t, known to be below 2q, reduced mod q */
+static void sc_reduce(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                      const uint64_t *t, uint64_t top)
+{
+    uint64_t u[SC_LIMBS], mask;
+    int i;
+
+    mask = 0 - (top | (sc_sub_q(c, u, t) ^ 1));
+    for (i = 0; i < c->limbs; i++)
+        out[i] = (u[i] & mask) | (t[i] & ~mask);
+}
+
+/*
+ * Montgomery product a * b / 2^(64 * limbs) mod q. The result is reduced
+ * for any a below 2^(64 * limbs) as long as b < q. Out may alias a or b.
+ */
+static void sc_mul(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                   const uint64_t *a, const uint64_t *b)
+{
+    uint64_t t[SC_LIMBS + 2] = { 0 }, m, carry;
+    int n = c->limbs, i, j;
+
+    for (i = 0; i < n; i++) {
+        carry = 0;
+        for (j = 0; j < n; j++)
+            t[j] = sc_mac(a[i], b[j], t[j], carry, &carry);
+        t[n] += carry;
+        t[n + 1] = t[n] < carry;
+
+        m = t[0] * c->q0inv;
+        sc_mac(m, c->q[0], t[0], 0, &carry);
+        for (j = 1; j < n; j++)
+            t[j - 1] = sc_mac(m, c->q[j], t[j], carry, &carry);
+        t[n - 1] = t[n] + carry;
+        t[n] = t[n + 1] + (t[n - 1] < carry);
+    }
+    sc_reduce(c, out, t, t[n]);
+    OPENSSL_cleanse(t, sizeof(t));
+}
+
+/* a mod q for any a below 2^(64 * limbs) */
+static void sc_mod(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                   const uint64_t *a)
+{
+    uint64_t one[SC_LIMBS] = { 1 };
+
+    sc_mul(c, out, a, c->rr);
+    sc_mul(c, out, out, one);
+}
+
+static void sc_add(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                   const uint64_t *a, const uint64_t *b)
+{
+    uint64_t t[SC_LIMBS], carry = 0;
+    int i;
+
+    for (i = 0; i < c->limbs; i++) {
+        t[i] = a[i] + carry;
+        carry = t[i] < carry;
+        t[i] += b[i];
+        carry |= t[i] < b[i];
+    }
+    sc_reduce(c, out, t, carry);
+}
+
+/* q - a, for a not above q */
+static void sc_neg(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                   const uint64_t *a)
+{
+    uint64_t borrow = 0, d, t;
+    int i;
+
+    for (i = 0; i < c->limbs; i++) {
+        d = c->q[i] - a[i];
+        t = d - borrow;
+        borrow = (c->q[i] < a[i]) | (d < borrow);
+        out[i] = t;
+    }
+}
+
+static uint64_t sc_is_zero(const GOST_EC_RAW_CURVE *c, const uint64_t *a)
+{
+    uint64_t acc = 0;
+    int i;
+
+    for (i = 0; i < c->limbs; i++)
+        acc |= a[i];
+    return ((acc | (0 - acc)) >> 63) ^ 1;
+}
+
+/* a^-1 in Montgomery form by a^(q-2), a in Montgomery form and public */
+static void sc_inv(const GOST_EC_RAW_CURVE *c, uint64_t *out,
+                   const uint64_t *a)
+{
+    uint64_t e[SC_LIMBS], acc[SC_LIMBS], one[SC_LIMBS] = { 1 };
+    uint64_t two[SC_LIMBS] = { 2 };
+    int i;
+
+    sc_neg(c, e, two);
+    sc_mul(c, acc, one, c->rr);
+    for (i = c->bits - 1; i >= 0; i--) {
+        sc_mul(c, acc, acc, acc);
+        if ((e[i / 64] >> (i % 64)) & 1)
+            sc_mul(c, acc, acc, a);
+    }
+    memcpy(out, acc, c->limbs * sizeof(*out));
+}
+
+int gost_ec_raw_check_scalar(const GOST_EC_RAW_CURVE *curve,
+                             const unsigned char *a)
+{
+    uint64_t t[SC_LIMBS], u[SC_LIMBS];
+
+    sc_from_bytes(curve, t, a, curve->size);
+    return !sc_is_zero(curve, t) && sc_sub_q(curve, u, t);
+}
+
+/* Uniform k in [1, q - 1] by rejection, also left as bytes in buf */
+static int sc_rand(const GOST_EC_RAW_CURVE *c, uint64_t *k,
+                   unsigned char *buf)
+{
+    uint64_t u[SC_LIMBS];
+    int top = (c->bits - 1) / 8;
+
+    do {
+        if (RAND_priv_bytes(buf, (int)c->size) <= 0)
+            return 0;
+        buf[top] &= 0xff >> (7 - (c->bits - 1) % 8);
+        memset(buf + top + 1, 0, c->size - top - 1);
+        sc_from_bytes(c, k, buf, c->size);
+    } while (sc_is_zero(c, k) || !sc_sub_q(c, u, k));
+    return 1;
+}
+
+int gost_ec_raw_pair(const GOST_EC_RAW_CURVE *curve, unsigned char *k,
+                     unsigned char *r)
+{
+    uint64_t t[SC_LIMBS];
+    unsigned char x[SC_BYTES], y[SC_BYTES];
+
+    do {
+        if (!sc_rand(curve, t, k))
+            return 0;
+        curve->mul_g(x, y, k);
+        sc_from_bytes(curve, t, x, curve->size);
+        sc_mod(curve, t, t);
+    } while (sc_is_zero(curve, t));
+    sc_to_bytes(curve, r, t);
+    OPENSSL_cleanse(t, sizeof(t));
+    return 1;
+}
+
+/* e = digest mod q, replaced by 1 when zero, in Montgomery form */
+static void sc_digest(const GOST_EC_RAW_CURVE *c, uint64_t *e,
+                      const unsigned char *dgst, size_t dgst_len)
+{
+    uint64_t t[SC_LIMBS], one[SC_LIMBS] = { 1 };
+
+    sc_from_bytes(c, t, dgst, dgst_len);
+    sc_mul(c, e, t, c->rr);
+    if (sc_is_zero(c, e))
+        sc_mul(c, e, one, c->rr);
+}
+
+int gost_ec_raw_sign(const GOST_EC_RAW_CURVE *curve, unsigned char *r_out,
+                     unsigned char *s_out, const unsigned char *priv,
+                     const unsigned char *dgst, size_t dgst_len)
+{
+    uint64_t d[SC_LIMBS], e[SC_LIMBS], k[SC_LIMBS], r[SC_LIMBS];
+    uint64_t s[SC_LIMBS], t[SC_LIMBS];
+    unsigned char kb[SC_BYTES], rb[SC_BYTES];
+    int ok = 0;
+
+    if (dgst_len > curve->size)
+        return 0;
+
+    sc_from_bytes(curve, t, priv, curve->size);
+    sc_mul(curve, d, t, curve->rr);
+    sc_digest(curve, e, dgst, dgst_len);
+    do {
+        /* k and r = (k * P).x mod q do not depend on the message */
+        if (!gost_ec_pool_take(curve, kb, rb)
+            && !gost_ec_raw_pair(curve, kb, rb))
+            goto err;
+        sc_from_bytes(curve, k, kb, curve->size);
+        sc_from_bytes(curve, r, rb, curve->size);
+        /* s = (r * d + k * e) mod q */
+        sc_mul(curve, s, r, d);
+        sc_mul(curve, t, k, e);
+        sc_add(curve, s, s, t);
+    } while (sc_is_zero(curve, s));
+
+    memcpy(r_out, rb, curve->size);
+    sc_to_bytes(curve, s_out, s);
+    ok = 1;
+ err:
+    OPENSSL_cleanse(d, sizeof(d));
+    OPENSSL_cleanse(k, sizeof(k));
+    OPENSSL_cleanse(t, sizeof(t));
+    OPENSSL_cleanse(kb, sizeof(kb));
+    return ok;
+}
+
+/* z1 = s / e and z2 = (q - r) / e, r also as limbs */
+static void sc_verify_scalars(const GOST_EC_RAW_CURVE *c, unsigned char *z1,
+                              unsigned char *z2, uint64_t *r,
+                              const unsigned char *r_in,
+                              const unsigned char *s_in,
+                              const unsigned char *dgst, size_t dgst_len)
+{
+    uint64_t e[SC_LIMBS], v[SC_LIMBS], t[SC_LIMBS];
+
+    sc_digest(c, e, dgst, dgst_len);
+    sc_inv(c, v, e);
+    sc_from_bytes(c, t, s_in, c->size);
+    sc_mul(c, t, t, v);
+    sc_to_bytes(c, z1, t);
+    sc_from_bytes(c, r, r_in, c->size);
+    sc_neg(c, t, r);
+    sc_mul(c, t, t, v);
+    sc_to_bytes(c, z2, t);
+}
+
+/* Whether the point z1 * P + z2 * Q is finite and its x is r mod q */
+static int sc_verify_point(const GOST_EC_RAW_CURVE *c, const unsigned char *x,
+                           const unsigned char *y, const uint64_t *r)
+{
+    uint64_t t[SC_LIMBS];
+    static const unsigned char zero[SC_BYTES];
+
+    if (memcmp(x, zero, c->size) == 0 && memcmp(y, zero, c->size) == 0)
+        return 0;
+    sc_from_bytes(c, t, x, c->size);
+    sc_mod(c, t, t);
+    return memcmp(t, r, c->limbs * sizeof(*t)) == 0;
+}
+
+int gost_ec_raw_verify(const GOST_EC_RAW_CURVE *curve,
+                       const unsigned char *r_in, const unsigned char *s_in,
+                       const unsigned char *pub_x, const unsigned char *pub_y,
+                       const unsigned char *dgst, size_t dgst_len)
+{
+    uint64_t r[SC_LIMBS];
+    unsigned char z1[SC_BYTES], z2[SC_BYTES], x[SC_BYTES], y[SC_BYTES];
+
+    if (dgst_len > curve->size)
+        return 0;
+
+    sc_verify_scalars(curve, z1, z2, r, r_in, s_in, dgst, dgst_len);
+    curve->mul_two(x, y, z1, z2, pub_x, pub_y);
+    return sc_verify_point(curve, x, y, r);
+}
+
+void *gost_ec_raw_table_new(const GOST_EC_RAW_CURVE *curve,
+                            const unsigned char *pub_x,
+                            const unsigned char *pub_y)
+{
+    return curve->table_new(pub_x, pub_y);
+}
+
+int gost_ec_raw_verify_table(const GOST_EC_RAW_CURVE *curve,
+                             const unsigned char *r_in,
+                             const unsigned char *s_in, const void *table,
+                             const unsigned char *dgst, size_t dgst_len)
+{
+    uint64_t r[SC_LIMBS];
+    unsigned char z1[SC_BYTES], z2[SC_BYTES], x[SC_BYTES], y[SC_BYTES];
+
+    if (dgst_len > curve->size)
+        return 0;
+
+    sc_verify_scalars(curve, z1, z2, r, r_in, s_in, dgst, dgst_len);
+    curve->mul_two_table(x, y, z1, z2, table);
+    return sc_verify_point(curve, x, y, r);
+}
+
+/*
+ * As gost_ec_raw_verify for each item, in chunks sharing one inversion
+ * of the e values (Montgomery's trick) and one field inversion for the
+ * points, eight points at a time with IFMA on the 512-bit curves. Items
+ * are checked here, so any may be out of range.
+ */
+#define VERIFY_BATCH 32
+
+int gost_ec_raw_verify_batch(const GOST_EC_RAW_CURVE *curve,
+                             const GOST_EC_RAW_VERIFY *items, size_t n,
+                             int *ok)
+{
+    uint64_t e[VERIFY_BATCH][SC_LIMBS], acc[VERIFY_BATCH][SC_LIMBS];
+    uint64_t v[SC_LIMBS], w[SC_LIMBS], t[SC_LIMBS];
+    size_t idx[VERIFY_BATCH], size = curve->size, i, j, m, done;
+    unsigned char *buf, *z1, *z2, *px, *py, *x, *y;
+
+    if ((buf = OPENSSL_malloc(6 * VERIFY_BATCH * size)) == NULL)
+        return 0;
+    z1 = buf;
+    z2 = z1 + VERIFY_BATCH * size;
+    px = z2 + VERIFY_BATCH * size;
+    py = px + VERIFY_BATCH * size;
+    x = py + VERIFY_BATCH * size;
+    y = x + VERIFY_BATCH * size;
+
+    for (i = 0; i < n;) {
+        /* Take up to VERIFY_BATCH well-formed items, acc[j] = e[0]...e[j] */
+        for (m = 0; m < VERIFY_BATCH && i < n; i++) {
+            ok[i] = 0;
+            if (items[i].dgst_len > size
+                || !gost_ec_raw_check_scalar(curve, items[i].r)
+                || !gost_ec_raw_check_scalar(curve, items[i].s))
+                continue;
+            sc_digest(curve, e[m], items[i].dgst, items[i].dgst_len);
+            if (m == 0)
+                memcpy(acc[0], e[0], sizeof(acc[0]));
+            else
+                sc_mul(curve, acc[m], acc[m - 1], e[m]);
+            idx[m++] = i;
+        }
+        if (m == 0)
+            break;
+
+        sc_inv(curve, w, acc[m - 1]);
+        for (j = m; j-- > 0;) {
+            /* w = 1 / (e[0] ... e[j]), v = 1 / e[j] */
+            if (j > 0) {
+                sc_mul(curve, v, w, acc[j - 1]);
+                sc_mul(curve, w, w, e[j]);
+            } else {
+                memcpy(v, w, sizeof(v));
+            }
+            /* z1 = s / e, z2 = (q - r) / e */
+            sc_from_bytes(curve, t, items[idx[j]].s, size);
+            sc_mul(curve, t, t, v);
+            sc_to_bytes(curve, z1 + j * size, t);
+            sc_from_bytes(curve, t, items[idx[j]].r, size);
+            sc_neg(curve, t, t);
+            sc_mul(curve, t, t, v);
+            sc_to_bytes(curve, z2 + j * size, t);
+            memcpy(px + j * size, items[idx[j]].pub_x, size);
+            memcpy(py + j * size, items[idx[j]].pub_y, size);
+        }
+
+        done = curve->ifma != NULL
+            ? gost_ec_ifma_mul_two_batch(curve->ifma, m, x, y, z1, z2, px, py)
+            : 0;
+        if (done < m)
+            curve->mul_two_batch(m - done, x + done * size, y + done * size,
+                                 z1 + done * size, z2 + done * size,
+                                 px + done * size, py + done * size);
+        for (j = 0; j < m; j++) {
+            sc_from_bytes(curve, t, items[idx[j]].r, size);
+            ok[idx[j]] = sc_verify_point(curve, x + j * size, y + j * size, t);
+            /*
+             * The Edwards form of paramSetC has no image for a few points of
+             * small order, which give 0 there: redo rejected items here
+             */
+            if (!ok[idx[j]] && j < done) {
+                curve->mul_two(x + j * size, y + j * size, z1 + j * size,
+                               z2 + j * size, px + j * size, py + j * size);
+                ok[idx[j]] = sc_verify_point(curve, x + j * size,
+                                             y + j * size, t);
+            }
+        }
+    }
+    OPENSSL_free(buf);
+    return 1;
+}
+
+int gost_ec_raw_derive(const GOST_EC_RAW_CURVE *curve,
+                       unsigned char *out_x, unsigned char *out_y,
+                       const unsigned char *priv,
+                       const unsigned char *ukm, size_t ukm_len,
+                       const unsigned char *pub_x, const unsigned char *pub_y)
+{
+    uint64_t d[SC_LIMBS], u[SC_LIMBS];
+    unsigned char buf[SC_BYTES];
+    static const unsigned char zero[SC_BYTES];
+    int ok;
+
+    if (ukm_len > curve->size)
+        return 0;
+
+    /* ukm * R, then the Montgomery product with d drops the R */
+    sc_from_bytes(curve, u, ukm, ukm_len);
+    sc_mul(curve, u, u, curve->rr);
+    sc_from_bytes(curve, d, priv, curve->size);
+    sc_mul(curve, d, d, u);
+    sc_to_bytes(curve, buf, d);
+
+    curve->mul(out_x, out_y, buf, pub_x, pub_y);
+    ok = CRYPTO_memcmp(out_x, zero, curve->size) != 0
+        || CRYPTO_memcmp(out_y, zero, curve->size) != 0;
+
+    OPENSSL_cleanse(d, sizeof(d));
+    OPENSSL_cleanse(u, sizeof(u));
+    OPENSSL_cleanse(buf, sizeof(buf));
+    return ok;
+}
+
+int gost_ec_raw_point(const GOST_EC_RAW_CURVE *curve, const EC_GROUP *group,
+                      const EC_POINT *point, unsigned char *x,
+                      unsigned char *y)
+{
+    unsigned char buf[1 + 2 * SC_BYTES];
+    size_t size = curve->size;
+
+    if (EC_POINT_point2oct(group, point, POINT_CONVERSION_UNCOMPRESSED,
+                           buf, sizeof(buf), NULL) != 1 + 2 * size)
+        return 0;
+    BUF_reverse(x, buf + 1, size);
+    BUF_reverse(y, buf + 1 + size, size);
+    return 1;
+}
@@ -11,7 +11,9 @@
 #include <openssl/rand.h>
 #include <openssl/ecdsa.h>
 #include <openssl/err.h>
+#include <openssl/buffer.h>
 #include "e_gost_err.h"
+#include "gosthash2012.h"
 #ifdef DEBUG_SIGN
 extern
 void dump_signature(const char *message, const unsigned char *buffer,
@@ -175,6 +177,42 @@ int fill_GOST_EC_params(EC_KEY *eckey, int nid)
     return ok;
 }
 
+/*
+ * Signature on a curve with a raw backend: the private key is converted
+ * to bytes once and the rest is done by gost_ec_raw_sign
+ */
+static ECDSA_SIG *gost_ec_sign_raw(const GOST_EC_RAW_CURVE *raw,
+                                   const unsigned char *dgst, int dlen,
+                                   const BIGNUM *priv_key)
+{
+    unsigned char d[64], r[64], s[64];
+    int size = (int)gost_ec_raw_size(raw);
+    ECDSA_SIG *sig = NULL;
+    BIGNUM *bn_r = NULL, *bn_s = NULL;
+
+    if (BN_bn2lebinpad(priv_key, d, size) != size) {
+        GOSTerr(GOST_F_GOST_EC_SIGN, ERR_R_INTERNAL_ERROR);
+        goto err;
+    }
+    if (!gost_ec_raw_sign(raw, r, s, d, dgst, dlen)) {
+        GOSTerr(GOST_F_GOST_EC_SIGN, GOST_R_RNG_ERROR);
+        goto err;
+    }
+    sig = ECDSA_SIG_new();
+    bn_r = BN_lebin2bn(r, size, NULL);
+    bn_s = BN_lebin2bn(s, size, NULL);
+    if (!sig || !bn_r || !bn_s || !ECDSA_SIG_set0(sig, bn_r, bn_s)) {
+        GOSTerr(GOST_F_GOST_EC_SIGN, ERR_R_MALLOC_FAILURE);
+        ECDSA_SIG_free(sig);
+        BN_free(bn_r);
+        BN_free(bn_s);
+        sig = NULL;
+    }
+ err:
+    OPENSSL_cleanse(d, sizeof(d));
+    return sig;
+}
+
 /*
  * Computes gost_ec signature as ECDSA_SIG structure
  *
@@ -193,9 +231,18 @@ ECDSA_SIG *gost_ec_sign(const unsigned char *dgst, int dlen, EC_KEY *eckey)
 
     EC_POINT *C = NULL;
     BN_CTX *ctx;
+    const GOST_EC_RAW_CURVE *raw;
 
     OPENSSL_assert(dgst != NULL && eckey != NULL);
 
+    group = EC_KEY_get0_group(eckey);
+    priv_key = EC_KEY_get0_private_key(eckey);
+    if (group && priv_key
+        && (raw = gost_ec_raw_curve(EC_GROUP_get_curve_name(group)))
+        && (size_t)dlen <= gost_ec_raw_size(raw)
+        && (size_t)BN_num_bytes(priv_key) <= gost_ec_raw_size(raw))
+        return gost_ec_sign_raw(raw, dgst, dlen, priv_key);
+
     if (!(ctx = BN_CTX_secure_new())) {
         GOSTerr(GOST_F_GOST_EC_SIGN, ERR_R_MALLOC_FAILURE);
         return NULL;
@@ -318,6 +365,230 @@ ECDSA_SIG *gost_ec_sign(const unsigned char *dgst, int dlen, EC_KEY *eckey)
     return ret;
 }
 
+/*
+ * Verification on a curve with a raw backend
+ */
+/*
+ * Verification tables cached on public keys. A key gets one once it has
+ * verified cache_uses signatures; the tables live in the key's ex_data
+ * until the key is freed. Set at configuration, before verifying in
+ * threads. The entries are also kept in a list, so that those of keys
+ * still alive when the engine goes are freed with it.
+ */
+typedef struct gost_verify_cache_st {
+    const GOST_EC_RAW_CURVE *curve;
+    unsigned char x[64], y[64];     /* the point the table is for */
+    long uses;
+    int building;
+    void *table;
+    struct gost_verify_cache_st *prev, *next;
+} GOST_VERIFY_CACHE;
+
+static CRYPTO_RWLOCK *cache_lock;
+static int cache_index = -1;
+static long cache_uses;         /* 0 disables */
+static GOST_VERIFY_CACHE *cache_list;
+
+static void verify_cache_unlink(GOST_VERIFY_CACHE *c)
+{
+    if (c->prev != NULL)
+        c->prev->next = c->next;
+    else
+        cache_list = c->next;
+    if (c->next != NULL)
+        c->next->prev = c->prev;
+}
+
+static void verify_cache_free(void *parent, void *ptr, CRYPTO_EX_DATA *ad,
+                              int idx, long argl, void *argp)
+{
+    GOST_VERIFY_CACHE *c = ptr;
+
+    if (c == NULL)
+        return;
+    CRYPTO_THREAD_write_lock(cache_lock);
+    verify_cache_unlink(c);
+    CRYPTO_THREAD_unlock(cache_lock);
+    OPENSSL_free(c->table);
+    OPENSSL_free(c);
+}
+
+/* A copy of a key starts counting afresh */
+static int verify_cache_dup(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from,
+                            void **from_d, int idx, long argl, void *argp)
+{
+    *from_d = NULL;
+    return 1;
+}
+
+int gost_ec_verify_cache_set(long uses)
+{
+    if (uses < 0)
+        return 0;
+    if (uses > 0 && cache_lock == NULL) {
+        if ((cache_lock = CRYPTO_THREAD_lock_new()) == NULL)
+            return 0;
+        cache_index = EC_KEY_get_ex_new_index(0, NULL, NULL, verify_cache_dup,
+                                              verify_cache_free);
+        if (cache_index < 0) {
+            CRYPTO_THREAD_lock_free(cache_lock);
+            cache_lock = NULL;
+            return 0;
+        }
+    }
+    cache_uses = uses;
+    return 1;
+}
+
+/*
+ * Freeing the index stops the callbacks for the keys still alive, their
+ * entries are freed here and their ex_data slots no longer read.
+ */
+void gost_ec_verify_cache_free(void)
+{
+    GOST_VERIFY_CACHE *c;
+
+    if (cache_lock == NULL)
+        return;
+    CRYPTO_free_ex_index(CRYPTO_EX_INDEX_EC_KEY, cache_index);
+    while ((c = cache_list) != NULL) {
+        cache_list = c->next;
+        OPENSSL_free(c->table);
+        OPENSSL_free(c);
+    }
+    CRYPTO_THREAD_lock_free(cache_lock);
+    cache_lock = NULL;
+    cache_index = -1;
+    cache_uses = 0;
+}
+
+/*
+ * Counts a verification with (x, y) and returns its table if there is
+ * one, with cache_lock read-locked until verify_cache_release. The
+ * common case, a key with its table, takes only the read lock; counting,
+ * installing a table and moving the entry to another point of the key
+ * take the write lock.
+ */
+static const void *verify_cache_table(EC_KEY *ec,
+                                      const GOST_EC_RAW_CURVE *raw,
+                                      const unsigned char *x,
+                                      const unsigned char *y)
+{
+    GOST_VERIFY_CACHE *c;
+    size_t size = gost_ec_raw_size(raw);
+    void *table;
+
+    if (cache_uses == 0)
+        return NULL;
+    for (;;) {
+        if (!CRYPTO_THREAD_read_lock(cache_lock))
+            return NULL;
+        c = EC_KEY_get_ex_data(ec, cache_index);
+        if (c != NULL && c->table != NULL && c->curve == raw
+            && memcmp(c->x, x, size) == 0 && memcmp(c->y, y, size) == 0)
+            return c->table;
+        CRYPTO_THREAD_unlock(cache_lock);
+
+        if (!CRYPTO_THREAD_write_lock(cache_lock))
+            return NULL;
+        c = EC_KEY_get_ex_data(ec, cache_index);
+        if (c == NULL) {
+            if ((c = OPENSSL_zalloc(sizeof(*c))) == NULL
+                || !EC_KEY_set_ex_data(ec, cache_index, c)) {
+                CRYPTO_THREAD_unlock(cache_lock);
+                OPENSSL_free(c);
+                return NULL;
+            }
+            if ((c->next = cache_list) != NULL)
+                cache_list->prev = c;
+            cache_list = c;
+        }
+        /* A key which got another point starts over with it */
+        if (c->curve != raw || memcmp(c->x, x, size) != 0
+            || memcmp(c->y, y, size) != 0) {
+            OPENSSL_free(c->table);
+            c->table = NULL;
+            c->uses = 0;
+            c->curve = raw;
+            memcpy(c->x, x, size);
+            memcpy(c->y, y, size);
+        }
+        if (c->table != NULL) {
+            /* Built by another thread meanwhile */
+            CRYPTO_THREAD_unlock(cache_lock);
+            continue;
+        }
+        if (c->building || ++c->uses < cache_uses) {
+            CRYPTO_THREAD_unlock(cache_lock);
+            return NULL;
+        }
+        c->building = 1;
+        CRYPTO_THREAD_unlock(cache_lock);
+
+        /* Built outside the lock; on malloc failure the count starts over */
+        table = gost_ec_raw_table_new(raw, x, y);
+        CRYPTO_THREAD_write_lock(cache_lock);
+        c->building = 0;
+        c->uses = 0;
+        /* Unless the key moved to another point meanwhile */
+        if (table != NULL && c->table == NULL && c->curve == raw
+            && memcmp(c->x, x, size) == 0 && memcmp(c->y, y, size) == 0) {
+            c->table = table;
+            table = NULL;
+        }
+        CRYPTO_THREAD_unlock(cache_lock);
+        if (table != NULL) {
+            OPENSSL_free(table);
+            return NULL;
+        }
+    }
+}
+
+static void verify_cache_release(const void *table)
+{
+    if (table != NULL)
+        CRYPTO_THREAD_unlock(cache_lock);
+}
+
+static int gost_ec_verify_raw(const GOST_EC_RAW_CURVE *raw,
+                              const unsigned char *dgst, int dgst_len,
+                              ECDSA_SIG *sig, EC_KEY *ec)
+{
+    unsigned char r[64], s[64], x[64], y[64];
+    int size = (int)gost_ec_raw_size(raw);
+    const BIGNUM *sig_s = NULL, *sig_r = NULL;
+    const EC_POINT *pub_key = EC_KEY_get0_public_key(ec);
+    const void *table;
+    int ok;
+
+    if (!pub_key
+        || !gost_ec_raw_point(raw, EC_KEY_get0_group(ec), pub_key, x, y)) {
+        GOSTerr(GOST_F_GOST_EC_VERIFY, ERR_R_INTERNAL_ERROR);
+        return 0;
+    }
+
+    ECDSA_SIG_get0(sig, &sig_r, &sig_s);
+    if (BN_is_negative(sig_s) || BN_is_negative(sig_r)
+        || BN_bn2lebinpad(sig_r, r, size) != size
+        || BN_bn2lebinpad(sig_s, s, size) != size
+        || !gost_ec_raw_check_scalar(raw, r)
+        || !gost_ec_raw_check_scalar(raw, s)) {
+        GOSTerr(GOST_F_GOST_EC_VERIFY, GOST_R_SIGNATURE_PARTS_GREATER_THAN_Q);
+        return 0;
+    }
+
+    table = verify_cache_table(ec, raw, x, y);
+    ok = table != NULL
+        ? gost_ec_raw_verify_table(raw, r, s, table, dgst, dgst_len)
+        : gost_ec_raw_verify(raw, r, s, x, y, dgst, dgst_len);
+    verify_cache_release(table);
+    if (!ok) {
+        GOSTerr(GOST_F_GOST_EC_VERIFY, GOST_R_SIGNATURE_MISMATCH);
+        return 0;
+    }
+    return 1;
+}
+
 /*
  * Verifies gost ec signature
  *
@@ -333,10 +604,15 @@ int gost_ec_verify(const unsigned char *dgst, int dgst_len,
     BIGNUM *X = NULL, *tmp = NULL;
     EC_POINT *C = NULL;
     const EC_POINT *pub_key = NULL;
+    const GOST_EC_RAW_CURVE *raw;
     int ok = 0;
 
     OPENSSL_assert(dgst != NULL && sig != NULL && group != NULL);
 
+    if ((raw = gost_ec_raw_curve(EC_GROUP_get_curve_name(group)))
+        && (size_t)dgst_len <= gost_ec_raw_size(raw))
+        return gost_ec_verify_raw(raw, dgst, dgst_len, sig, ec);
+
     if (!(ctx = BN_CTX_new())) {
         GOSTerr(GOST_F_GOST_EC_VERIFY, ERR_R_MALLOC_FAILURE);
         return 0;
@@ -441,6 +717,238 @@ int gost_ec_verify(const unsigned char *dgst, int dgst_len,
     return ok;
 }
 
+/*
+ * Batch verification. Signatures of the same curve, which would take the
+ * raw path of gost_ec_verify, are collected in runs for
+ * gost_ec_raw_verify_batch; the others are verified one at a time. Bad
+ * signatures leave nothing in the error queue, the results tell which
+ * they are.
+ */
+#define VERIFY_BATCH_RUN 32
+
+typedef struct {
+    const GOST_EC_RAW_CURVE *raw;
+    size_t count;
+    GOST_EC_RAW_VERIFY items[VERIFY_BATCH_RUN];
+    GOST_VERIFY_BATCH_ITEM *from[VERIFY_BATCH_RUN];
+    unsigned char buf[VERIFY_BATCH_RUN][4 * 64];   /* r, s, x, y */
+} GOST_VERIFY_RUN;
+
+static int verify_run_flush(GOST_VERIFY_RUN *run)
+{
+    int ok[VERIFY_BATCH_RUN];
+    size_t i;
+
+    if (run->count == 0)
+        return 1;
+    if (!gost_ec_raw_verify_batch(run->raw, run->items, run->count, ok)) {
+        GOSTerr(GOST_F_GOST_EC_VERIFY, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    for (i = 0; i < run->count; i++)
+        run->from[i]->result = ok[i];
+    run->count = 0;
+    return 1;
+}
+
+/* Adds item to the run, 0 if it does not fit the raw path */
+static int verify_run_add(GOST_VERIFY_RUN *run, GOST_VERIFY_BATCH_ITEM *item,
+                          EC_KEY *ec, int *flushed)
+{
+    const EC_GROUP *group = EC_KEY_get0_group(ec);
+    const EC_POINT *pub_key = EC_KEY_get0_public_key(ec);
+    const GOST_EC_RAW_CURVE *raw;
+    GOST_EC_RAW_VERIFY *it;
+    unsigned char *buf;
+    size_t size;
+
+    *flushed = 1;
+    if (group == NULL || pub_key == NULL
+        || (raw = gost_ec_raw_curve(EC_GROUP_get_curve_name(group))) == NULL)
+        return 0;
+    size = gost_ec_raw_size(raw);
+    if (item->siglen != 2 * size || item->tbslen > size)
+        return 0;
+    if (run->raw != raw || run->count == VERIFY_BATCH_RUN) {
+        if (!(*flushed = verify_run_flush(run)))
+            return 0;
+        run->raw = raw;
+    }
+
+    it = &run->items[run->count];
+    buf = run->buf[run->count];
+    /* s || r, big-endian */
+    BUF_reverse(buf, item->sig + size, size);
+    BUF_reverse(buf + size, item->sig, size);
+    it->r = buf;
+    it->s = buf + size;
+    it->dgst = item->tbs;
+    it->dgst_len = item->tbslen;
+    /* Runs of one key convert it once */
+    if (run->count > 0 && run->from[run->count - 1]->pkey == item->pkey) {
+        it->pub_x = it[-1].pub_x;
+        it->pub_y = it[-1].pub_y;
+    } else if (gost_ec_raw_point(raw, group, pub_key, buf + 2 * size,
+                                 buf + 3 * size)) {
+        it->pub_x = buf + 2 * size;
+        it->pub_y = buf + 3 * size;
+    } else {
+        return 0;
+    }
+    run->from[run->count++] = item;
+    return 1;
+}
+
+int gost_ec_verify_batch(GOST_VERIFY_BATCH_ITEM *items, size_t n)
+{
+    GOST_VERIFY_RUN *run;
+    ECDSA_SIG *sig;
+    EC_KEY *ec;
+    size_t i;
+    int flushed, ok = 1;
+
+    if (n > 0 && items == NULL)
+        return 0;
+    if ((run = OPENSSL_zalloc(sizeof(*run))) == NULL) {
+        GOSTerr(GOST_F_GOST_EC_VERIFY, ERR_R_MALLOC_FAILURE);
+        return 0;
+    }
+    for (i = 0; i < n; i++)
+        items[i].result = 0;
+
+    for (i = 0; i < n; i++) {
+        GOST_VERIFY_BATCH_ITEM *item = &items[i];
+
+        switch (item->pkey ? EVP_PKEY_base_id(item->pkey) : NID_undef) {
+        case NID_id_GostR3410_2001:
+        case NID_id_GostR3410_2001DH:
+        case NID_id_GostR3410_2012_256:
+        case NID_id_GostR3410_2012_512:
+            break;
+        default:
+            continue;
+        }
+        if (item->sig == NULL || item->tbs == NULL
+            || (ec = EVP_PKEY_get0(item->pkey)) == NULL)
+            continue;
+        if (verify_run_add(run, item, ec, &flushed))
+            continue;
+        if (!flushed) {
+            ok = 0;
+            break;
+        }
+        /* gost_ec_verify asserts on other lengths */
+        if (item->tbslen != 32 && item->tbslen != 64)
+            continue;
+        ERR_set_mark();
+        if ((sig = unpack_cp_signature(item->sig, item->siglen)) != NULL) {
+            item->result = gost_ec_verify(item->tbs, (int)item->tbslen, sig,
+                                          ec);
+            ECDSA_SIG_free(sig);
+        }
+        ERR_pop_to_mark();
+    }
+    if (ok)
+        ok = verify_run_flush(run);
+    OPENSSL_free(run);
+
+    for (i = 0; ok && i < n; i++)
+        ok = items[i].result;
+    return ok;
+}
+
+/* Digest of the key's signatures, NID_undef for other keys */
+static int verify_batch_md(const GOST_VERIFY_BATCH_ITEM *item)
+{
+    if (item->pkey == NULL || item->tbs == NULL)
+        return NID_undef;
+    switch (EVP_PKEY_base_id(item->pkey)) {
+    case NID_id_GostR3410_2001:
+    case NID_id_GostR3410_2001DH:
+        return NID_id_GostR3411_94;
+    case NID_id_GostR3410_2012_256:
+        return NID_id_GostR3411_2012_256;
+    case NID_id_GostR3410_2012_512:
+        return NID_id_GostR3411_2012_512;
+    }
+    return NID_undef;
+}
+
+/*
+ * Batch verification of messages rather than digests. Streebog digests of
+ * messages of equal length within a window of VERIFY_BATCH_RUN items are
+ * computed GOST2012_HASH_LANES at a time by gost2012_hash_multi, then the
+ * signatures go to gost_ec_verify_batch.
+ */
+int gost_ec_digest_verify_batch(GOST_VERIFY_BATCH_ITEM *items, size_t n)
+{
+    GOST_VERIFY_BATCH_ITEM *dgst = NULL;
+    unsigned char (*md)[64] = NULL;
+    int *nid = NULL;
+    gost_hash_ctx hctx;
+    size_t i, j;
+    int ok = 0;
+
+    if (n == 0 || items == NULL)
+        return gost_ec_verify_batch(items, n);
+    if ((dgst = OPENSSL_malloc(n * sizeof(*dgst))) == NULL
+        || (md = OPENSSL_malloc(n * sizeof(*md))) == NULL
+        || (nid = OPENSSL_malloc(n * sizeof(*nid))) == NULL) {
+        GOSTerr(GOST_F_GOST_EC_VERIFY, ERR_R_MALLOC_FAILURE);
+        goto err;
+    }
+    for (i = 0; i < n; i++) {
+        dgst[i] = items[i];
+        dgst[i].tbs = NULL;
+        nid[i] = verify_batch_md(&items[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+        const unsigned char *data[GOST2012_HASH_LANES];
+        unsigned char *out[GOST2012_HASH_LANES];
+        unsigned int lanes = 0;
+
+        switch (nid[i]) {
+        case NID_undef:
+            continue;
+        case NID_id_GostR3411_94:
+            if (!init_gost_hash_ctx(&hctx, &GostR3411_94_CryptoProParamSet)) {
+                GOSTerr(GOST_F_GOST_EC_VERIFY, ERR_R_MALLOC_FAILURE);
+                goto err;
+            }
+            start_hash(&hctx);
+            hash_block(&hctx, items[i].tbs, items[i].tbslen);
+            finish_hash(&hctx, md[i]);
+            done_gost_hash_ctx(&hctx);
+            dgst[i].tbs = md[i];
+            dgst[i].tbslen = 32;
+            continue;
+        }
+        for (j = i; j < n && j - i < VERIFY_BATCH_RUN
+             && lanes < GOST2012_HASH_LANES; j++) {
+            if (nid[j] != nid[i] || items[j].tbslen != items[i].tbslen)
+                continue;
+            data[lanes] = items[j].tbs;
+            out[lanes++] = md[j];
+            dgst[j].tbs = md[j];
+            dgst[j].tbslen = nid[i] == NID_id_GostR3411_2012_256 ? 32 : 64;
+            if (j > i)
+                nid[j] = NID_undef;
+        }
+        gost2012_hash_multi(dgst[i].tbslen * 8, data, items[i].tbslen, out,
+                            lanes);
+    }
+
+    ok = gost_ec_verify_batch(dgst, n);
+    for (i = 0; i < n; i++)
+        items[i].result = dgst[i].result;
+ err:
+    OPENSSL_free(nid);
+    OPENSSL_free(md);
+    OPENSSL_free(dgst);
+    return ok;
+}
+
 /*
  * Computes GOST R 34.10-2001 public key
  * or GOST R 34.10-2012 public key
@@ -38,6 +38,38 @@ const ENGINE_CMD_DEFN gost_cmds[] = {
      "GOST_PK_FORMAT",
      "Private key format params",
      ENGINE_CMD_FLAG_STRING},
+    {GOST_CTRL_KUZNYECHIK_BULK,
+     "KUZNYECHIK_BULK",
+     "Kuznyechik bulk implementation: DEFAULT or CONSTANT_TIME",
+     ENGINE_CMD_FLAG_STRING},
+    {GOST_CTRL_SIGN_POOL,
+     "SIGN_POOL",
+     "Precomputed signature nonces kept per curve, 0 disables",
+     ENGINE_CMD_FLAG_NUMERIC},
+    {GOST_CTRL_SIGN_POOL_THREAD,
+     "SIGN_POOL_THREAD",
+     "Refill the signature nonce pools in a background thread: 1 or 0",
+     ENGINE_CMD_FLAG_NUMERIC},
+    {GOST_CTRL_SIGN_POOL_PRECOMPUTE,
+     "SIGN_POOL_PRECOMPUTE",
+     "Precompute signature nonces now: curve:count",
+     ENGINE_CMD_FLAG_STRING},
+    {GOST_CTRL_SIGN_POOL_STATS,
+     "SIGN_POOL_STATS",
+     "Nonce pool statistics of the curve given as i into long[5] at p",
+     ENGINE_CMD_FLAG_INTERNAL},
+    {GOST_CTRL_VERIFY_BATCH,
+     "VERIFY_BATCH",
+     "Verify i signatures given as GOST_VERIFY_BATCH_ITEM[i] at p",
+     ENGINE_CMD_FLAG_INTERNAL},
+    {GOST_CTRL_VERIFY_CACHE,
+     "VERIFY_CACHE",
+     "Verifications with a public key before it gets a table, 0 disables",
+     ENGINE_CMD_FLAG_NUMERIC},
+    {GOST_CTRL_DIGEST_VERIFY_BATCH,
+     "DIGEST_VERIFY_BATCH",
+     "Verify i signatures of messages given as GOST_VERIFY_BATCH_ITEM[i] at p",
+     ENGINE_CMD_FLAG_INTERNAL},
     {0, NULL, NULL, 0}
 };
 
@@ -101,6 +133,18 @@ GOST_cipher *gost_cipher_array[] = {
     &grasshopper_ctr_acpkm_omac_cipher,
     &magma_kexp15_cipher,
     &kuznyechik_kexp15_cipher,
+    &grasshopper_mgm_cipher,
+    &magma_mgm_cipher,
+};
+
+/* Algorithms without an object in OpenSSL get a NID at load time */
+static struct gost_missing_nid {
+    const char *sn;
+    const char *ln;
+    GOST_cipher *cipher;
+} missing_NIDs[] = {
+    { SN_kuznyechik_mgm, LN_kuznyechik_mgm, &grasshopper_mgm_cipher },
+    { SN_magma_mgm, LN_magma_mgm, &magma_mgm_cipher },
 };
 
 static struct gost_meth_minfo {
@@ -304,6 +348,9 @@ static int gost_engine_destroy(ENGINE* e) {
         GOST_deinit_cipher(gost_cipher_array[i]);
 
     gost_param_free();
+    gost_ec_pool_free();
+    gost_ec_verify_cache_free();
+    gost_kbox_free();
 
     struct gost_meth_minfo *minfo = gost_meth_array;
     for (; minfo->nid; minfo++) {
@@ -325,6 +372,29 @@ static int gost_engine_destroy(ENGINE* e) {
  * binds it to OpenSSL libraries
  */
 
+static int create_NIDs(void)
+{
+    int i;
+
+    for (i = 0; i < OSSL_NELEM(missing_NIDs); i++) {
+        int nid = OBJ_sn2nid(missing_NIDs[i].sn);
+
+        if (nid == NID_undef) {
+            /* Object without OID, only names are registered */
+            ASN1_OBJECT *obj = ASN1_OBJECT_create(OBJ_new_nid(1), NULL, 0,
+                                                  missing_NIDs[i].sn,
+                                                  missing_NIDs[i].ln);
+
+            nid = obj != NULL ? OBJ_add_object(obj) : NID_undef;
+            ASN1_OBJECT_free(obj);
+            if (nid == NID_undef)
+                return 0;
+        }
+        missing_NIDs[i].cipher->nid = nid;
+    }
+    return 1;
+}
+
 # ifndef BUILDING_GOST_PROVIDER
 static
 # endif
@@ -333,6 +403,14 @@ int populate_gost_engine(ENGINE* e) {
 
     if (e == NULL)
         goto end;
+    if (!create_NIDs()) {
+        fprintf(stderr, "NID creation failed\n");
+        goto end;
+    }
+    if (!gost_kbox_lock_init()) {
+        fprintf(stderr, "S-box lock creation failed\n");
+        goto end;
+    }
     if (!ENGINE_set_id(e, engine_gost_id)) {
         fprintf(stderr, "ENGINE_set_id failed\n");
         goto end;
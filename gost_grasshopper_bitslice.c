@@ -0,0 +1,364 @@
+/*
+ * This file is distributed under the same license as OpenSSL
+ *
+ * Bitsliced implementation of Kuznyechik in portable C. A batch of 64
+ * blocks is transposed so that bit k of a 64-bit word is one bit of block
+ * k, and then the cipher is computed with boolean operations only. Memory
+ * is indexed by loop counters and by the public S-box and constants, never
+ * by the data or the key.
+ *
+ * It is the constant-time fallback for hosts which have none of the vector
+ * permute kernels of gost_grasshopper_vperm.c. The key schedules for those
+ * kernels are here as well, with the bytes of one block as the lanes.
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include <string.h>
+#include <openssl/crypto.h>
+#include "gost_grasshopper_core.h"
+#include "gost_grasshopper_defines.h"
+#include "gost_grasshopper_math.h"
+#include "gost_grasshopper_precompiled.h"
+
+#define GRASSHOPPER_BITSLICE_BLOCKS 64
+
+// transposes the 8x8 bit matrix with byte i as row i
+static uint64_t grasshopper_bitslice_transpose8(uint64_t x) {
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+// byte j of blocks 8q..8q+7 go to byte q of planes j, missing blocks are zero
+static void grasshopper_bitslice_load(uint64_t s[16][8], const grasshopper_w128_t* source, size_t blocks) {
+    size_t k;
+    int j, b, q;
+
+    memset(s, 0, 16 * 8 * sizeof(uint64_t));
+    for (q = 0; q < 8; q++) {
+        for (j = 0; j < 16; j++) {
+            uint64_t x = 0;
+
+            for (k = 8 * q; k < 8 * q + 8 && k < blocks; k++) {
+                x |= (uint64_t) source[k].b[j] << (8 * (k - 8 * q));
+            }
+            x = grasshopper_bitslice_transpose8(x);
+            for (b = 0; b < 8; b++) {
+                s[j][b] |= ((x >> (8 * b)) & 0xFF) << (8 * q);
+            }
+        }
+    }
+}
+
+static void grasshopper_bitslice_store(grasshopper_w128_t* target, uint64_t s[16][8], size_t blocks) {
+    size_t k;
+    int j, b, q;
+
+    for (q = 0; q < 8; q++) {
+        for (j = 0; j < 16; j++) {
+            uint64_t x = 0;
+
+            for (b = 0; b < 8; b++) {
+                x |= ((s[j][b] >> (8 * q)) & 0xFF) << (8 * b);
+            }
+            x = grasshopper_bitslice_transpose8(x);
+            for (k = 8 * q; k < 8 * q + 8 && k < blocks; k++) {
+                target[k].b[j] = (uint8_t) (x >> (8 * (k - 8 * q)));
+            }
+        }
+    }
+}
+
+static void grasshopper_bitslice_add_key(uint64_t s[16][8], const grasshopper_w128_t* key) {
+    int j, b;
+
+    for (j = 0; j < 16; j++) {
+        for (b = 0; b < 8; b++) {
+            s[j][b] ^= 0 - (uint64_t) ((key->b[j] >> b) & 1);
+        }
+    }
+}
+
+/*
+ * The S-box is computed through the one-hot form of its output: m[u] is set
+ * in the lanes where the output is u, as a minterm of the input inv[u]. Bit
+ * b of the output is the sum of m[u] over the u with bit b set, and halving
+ * m by sums of pairs shares the work between the bits. The first halving is
+ * done as the minterms are computed.
+ */
+static void grasshopper_bitslice_sbox(uint64_t x[8], const uint8_t* inv) {
+    uint64_t lo[16], hi[16], m[128], y;
+    int i, b, n;
+
+    // minterms of the low and of the high nibble
+    for (i = 0; i < 16; i++) {
+        lo[i] = hi[i] = ~(uint64_t) 0;
+        for (b = 0; b < 4; b++) {
+            lo[i] &= ((i >> b) & 1) ? x[b] : ~x[b];
+            hi[i] &= ((i >> b) & 1) ? x[b + 4] : ~x[b + 4];
+        }
+    }
+    y = 0;
+    for (i = 0; i < 128; i++) {
+        uint64_t m0 = hi[inv[2 * i] >> 4] & lo[inv[2 * i] & 15];
+        uint64_t m1 = hi[inv[2 * i + 1] >> 4] & lo[inv[2 * i + 1] & 15];
+
+        y ^= m1;
+        m[i] = m0 ^ m1;
+    }
+    x[0] = y;
+
+    for (b = 1, n = 128; b < 8; b++, n /= 2) {
+        y = 0;
+
+        for (i = 0; i < n; i += 2) {
+            y ^= m[i + 1];
+            m[i / 2] = m[i] ^ m[i + 1];
+        }
+        x[b] = y;
+    }
+}
+
+/*
+ * x += 0x94 u0 + 0x20 u1 + 0x85 u2 + 0x10 u3 + 0xC2 u4 + 0xC0 u5 + 0xFB u6,
+ * the products by lvec[0..5] and lvec[7]. The terms are grouped by the bits
+ * of the constants, and the groups are summed by Horner's rule, where the
+ * multiplication by 2 only moves planes and reduces by x^8 + x^7 + x^6 + x + 1.
+ */
+static void grasshopper_bitslice_lin(uint64_t x[8], uint64_t u[7][8]) {
+    uint64_t v[8][8], t;
+    int i, j;
+
+    for (i = 0; i < 8; i++) {
+        v[0][i] = x[i] ^ u[2][i] ^ u[6][i];
+        v[1][i] = u[4][i] ^ u[6][i];
+        v[2][i] = u[0][i] ^ u[2][i];
+        v[3][i] = u[6][i];
+        v[4][i] = u[0][i] ^ u[3][i] ^ u[6][i];
+        v[5][i] = u[1][i] ^ u[6][i];
+        v[6][i] = u[4][i] ^ u[5][i] ^ u[6][i];
+        v[7][i] = u[0][i] ^ u[2][i] ^ u[4][i] ^ u[5][i] ^ u[6][i];
+    }
+
+    memcpy(x, v[7], sizeof(v[7]));
+    for (j = 6; j >= 0; j--) {
+        t = x[7];
+        x[7] = x[6] ^ t ^ v[j][7];
+        x[6] = x[5] ^ t ^ v[j][6];
+        x[5] = x[4] ^ v[j][5];
+        x[4] = x[3] ^ v[j][4];
+        x[3] = x[2] ^ v[j][3];
+        x[2] = x[1] ^ v[j][2];
+        x[1] = x[0] ^ t ^ v[j][1];
+        x[0] = t ^ v[j][0];
+    }
+}
+
+// the LFSR steps of gost_grasshopper_vperm_impl.h on bit planes
+static void grasshopper_bitslice_l(uint64_t s[16][8]) {
+    uint64_t w[32][8], u[7][8];
+    int i, k;
+
+    for (i = 0; i < 16; i++) {
+        memcpy(w[15 - i], s[i], sizeof(w[0]));
+    }
+
+    for (k = 15; k < 31; k++) {
+        for (i = 0; i < 8; i++) {
+            w[k + 1][i] = w[k - 15][i] ^ w[k - 6][i] ^ w[k - 8][i];
+            u[0][i] = w[k][i] ^ w[k - 14][i];
+            u[1][i] = w[k - 1][i] ^ w[k - 13][i];
+            u[2][i] = w[k - 2][i] ^ w[k - 12][i];
+            u[3][i] = w[k - 3][i] ^ w[k - 11][i];
+            u[4][i] = w[k - 4][i] ^ w[k - 10][i];
+            u[5][i] = w[k - 5][i] ^ w[k - 9][i];
+            u[6][i] = w[k - 7][i];
+        }
+        grasshopper_bitslice_lin(w[k + 1], u);
+    }
+
+    for (i = 0; i < 16; i++) {
+        memcpy(s[i], w[31 - i], sizeof(w[0]));
+    }
+}
+
+static void grasshopper_bitslice_l_inv(uint64_t s[16][8]) {
+    uint64_t w[32][8], u[7][8];
+    int i, k;
+
+    memcpy(w, s, 16 * sizeof(w[0]));
+
+    for (k = 0; k < 16; k++) {
+        for (i = 0; i < 8; i++) {
+            w[k + 16][i] = w[k][i] ^ w[k + 7][i] ^ w[k + 9][i];
+            u[0][i] = w[k + 1][i] ^ w[k + 15][i];
+            u[1][i] = w[k + 2][i] ^ w[k + 14][i];
+            u[2][i] = w[k + 3][i] ^ w[k + 13][i];
+            u[3][i] = w[k + 4][i] ^ w[k + 12][i];
+            u[4][i] = w[k + 5][i] ^ w[k + 11][i];
+            u[5][i] = w[k + 6][i] ^ w[k + 10][i];
+            u[6][i] = w[k + 8][i];
+        }
+        grasshopper_bitslice_lin(w[k + 16], u);
+    }
+
+    memcpy(s, w[16], 16 * sizeof(w[0]));
+}
+
+void grasshopper_bitslice_encrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                         grasshopper_w128_t* target, size_t blocks) {
+    uint64_t s[16][8];
+    int i, j;
+
+    while (blocks > 0) {
+        size_t n = blocks < GRASSHOPPER_BITSLICE_BLOCKS ? blocks : GRASSHOPPER_BITSLICE_BLOCKS;
+
+        grasshopper_bitslice_load(s, source, n);
+        for (i = 0; i < 9; i++) {
+            grasshopper_bitslice_add_key(s, &subkeys->k[i]);
+            for (j = 0; j < 16; j++) {
+                grasshopper_bitslice_sbox(s[j], grasshopper_pi_inv);
+            }
+            grasshopper_bitslice_l(s);
+        }
+        grasshopper_bitslice_add_key(s, &subkeys->k[9]);
+        grasshopper_bitslice_store(target, s, n);
+
+        source += n;
+        target += n;
+        blocks -= n;
+    }
+
+    OPENSSL_cleanse(s, sizeof(s));
+}
+
+// takes the decryption schedule, with L^-1 applied to keys 1..9
+void grasshopper_bitslice_decrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                         grasshopper_w128_t* target, size_t blocks) {
+    uint64_t s[16][8];
+    int i, j;
+
+    while (blocks > 0) {
+        size_t n = blocks < GRASSHOPPER_BITSLICE_BLOCKS ? blocks : GRASSHOPPER_BITSLICE_BLOCKS;
+
+        grasshopper_bitslice_load(s, source, n);
+        grasshopper_bitslice_l_inv(s);
+        for (i = 9; i > 1; i--) {
+            grasshopper_bitslice_add_key(s, &subkeys->k[i]);
+            for (j = 0; j < 16; j++) {
+                grasshopper_bitslice_sbox(s[j], grasshopper_pi);
+            }
+            grasshopper_bitslice_l_inv(s);
+        }
+        grasshopper_bitslice_add_key(s, &subkeys->k[1]);
+        for (j = 0; j < 16; j++) {
+            grasshopper_bitslice_sbox(s[j], grasshopper_pi);
+        }
+        grasshopper_bitslice_add_key(s, &subkeys->k[0]);
+        grasshopper_bitslice_store(target, s, n);
+
+        source += n;
+        target += n;
+        blocks -= n;
+    }
+
+    OPENSSL_cleanse(s, sizeof(s));
+}
+
+/*
+ * y = L(x) through the columns of L, the images of the single bits, with
+ * x given as planes: bit j of x[b] is bit b of byte j, which L maps to
+ * t[j][index[1 << b]]. Only these fixed entries of the tables are read,
+ * and they are selected by masks.
+ */
+static void grasshopper_bitslice_linear(grasshopper_w128_t* y, const uint64_t x[8],
+                                        const grasshopper_w128_t t[][256], const uint8_t* index) {
+    uint64_t y0 = 0, y1 = 0, m;
+    int j, b;
+
+    for (b = 0; b < 8; b++) {
+        for (j = 0; j < 16; j++) {
+            const grasshopper_w128_t* c = &t[j][index != NULL ? index[1 << b] : 1 << b];
+
+            m = 0 - ((x[b] >> j) & 1);
+            y0 ^= m & c->q[0];
+            y1 ^= m & c->q[1];
+        }
+    }
+    y->q[0] = y0;
+    y->q[1] = y1;
+}
+
+// the planes of one block, byte j in bit j
+static void grasshopper_bitslice_planes(uint64_t s[8], const grasshopper_w128_t* x) {
+    int j, b;
+
+    for (b = 0; b < 8; b++) {
+        s[b] = 0;
+        for (j = 0; j < 16; j++) {
+            s[b] |= (uint64_t) ((x->b[j] >> b) & 1) << j;
+        }
+    }
+}
+
+// as grasshopper_set_encrypt_key()
+void grasshopper_bitslice_set_encrypt_key(grasshopper_round_keys_t* subkeys, const grasshopper_key_t* key) {
+    grasshopper_w128_t x, y, z;
+    uint64_t s[8];
+    int i;
+
+    grasshopper_copy128(&x, &key->k.k[0]);
+    grasshopper_copy128(&y, &key->k.k[1]);
+    grasshopper_copy128(&subkeys->k[0], &x);
+    grasshopper_copy128(&subkeys->k[1], &y);
+
+    for (i = 1; i <= 32; i++) {
+        // z = L(S(x + c)) + y, pil_enc128[j][v] is L of pi(v) in byte j
+        grasshopper_plus128(&z, &x, &grasshopper_keyschedule_c128[i - 1]);
+        grasshopper_bitslice_planes(s, &z);
+        grasshopper_bitslice_sbox(s, grasshopper_pi_inv);
+        grasshopper_bitslice_linear(&z, s, grasshopper_pil_enc128, grasshopper_pi_inv);
+        grasshopper_append128(&z, &y);
+
+        grasshopper_copy128(&y, &x);
+        grasshopper_copy128(&x, &z);
+
+        if ((i & 7) == 0) {
+            int k = i >> 2;
+            grasshopper_copy128(&subkeys->k[k], &x);
+            grasshopper_copy128(&subkeys->k[k + 1], &y);
+        }
+    }
+
+    grasshopper_zero128(&x);
+    grasshopper_zero128(&y);
+    grasshopper_zero128(&z);
+    OPENSSL_cleanse(s, sizeof(s));
+}
+
+// as grasshopper_decrypt_key_from_encrypt(), l_dec128[j][v] is L^-1 of v in byte j
+void grasshopper_bitslice_decrypt_key_from_encrypt(grasshopper_round_keys_t* decrypt,
+                                                   const grasshopper_round_keys_t* encrypt) {
+    uint64_t s[8];
+    int i;
+
+    grasshopper_copy128(&decrypt->k[0], &encrypt->k[0]);
+    for (i = 1; i < 10; i++) {
+        grasshopper_bitslice_planes(s, &encrypt->k[i]);
+        grasshopper_bitslice_linear(&decrypt->k[i], s, grasshopper_l_dec128, NULL);
+    }
+    OPENSSL_cleanse(s, sizeof(s));
+}
+
+#if defined(__cplusplus)
+}
+#endif
@@ -26,6 +26,7 @@ enum GRASSHOPPER_CIPHER_TYPE {
     GRASSHOPPER_CIPHER_CTR,
     GRASSHOPPER_CIPHER_CTRACPKM,
     GRASSHOPPER_CIPHER_CTRACPKMOMAC,
+    GRASSHOPPER_CIPHER_MGM,
 };
 
 static GOST_cipher grasshopper_template_cipher = {
@@ -124,6 +125,22 @@ GOST_cipher grasshopper_ctr_acpkm_omac_cipher = {
     .ctx_size = sizeof(gost_grasshopper_cipher_ctx_ctr),
 };
 
+/* NID is allocated at load time, see create_NIDs() in gost_eng.c */
+GOST_cipher grasshopper_mgm_cipher = {
+    .nid = NID_undef,
+    .template = &grasshopper_template_cipher,
+    .block_size = 1,
+    .iv_len = 16,
+    .flags = EVP_CIPH_NO_PADDING |
+        EVP_CIPH_CUSTOM_IV |
+        EVP_CIPH_FLAG_CUSTOM_CIPHER |
+        EVP_CIPH_FLAG_AEAD_CIPHER |
+        EVP_CIPH_CUSTOM_COPY,
+    .init = gost_grasshopper_cipher_init_mgm,
+    .do_cipher = gost_grasshopper_cipher_do_mgm,
+    .ctx_size = sizeof(gost_grasshopper_cipher_ctx_mgm),
+};
+
 /* first 256 bit of D from draft-irtf-cfrg-re-keying-12 */
 static const unsigned char ACPKM_D_2018[] = {
     0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, /*  64 bit */
@@ -132,27 +149,50 @@ static const unsigned char ACPKM_D_2018[] = {
     0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f, /* 256 bit */
 };
 
-static void acpkm_next(gost_grasshopper_cipher_ctx * c)
+/*
+ * Runs of independent blocks go through here. With KUZNYECHIK_BULK set to
+ * CONSTANT_TIME they are done without table lookups, see
+ * grasshopper_encrypt_blocks_ct().
+ */
+static void gost_grasshopper_encrypt_blocks(gost_grasshopper_cipher_ctx *c,
+                                            const grasshopper_w128_t *in,
+                                            grasshopper_w128_t *out,
+                                            size_t blocks)
 {
-    unsigned char newkey[GRASSHOPPER_KEY_SIZE];
-    const int J = GRASSHOPPER_KEY_SIZE / GRASSHOPPER_BLOCK_SIZE;
-    int n;
-
-    for (n = 0; n < J; n++) {
-        const unsigned char *D_n = &ACPKM_D_2018[n * GRASSHOPPER_BLOCK_SIZE];
+    if (c->constant_time)
+        grasshopper_encrypt_blocks_ct(&c->encrypt_round_keys, in, out, blocks);
+    else
+        grasshopper_encrypt_blocks(&c->encrypt_round_keys, in, out, blocks);
+}
 
-        grasshopper_encrypt_block(&c->encrypt_round_keys,
-                                  (grasshopper_w128_t *) D_n,
-                                  (grasshopper_w128_t *) & newkey[n *
-                                                                  GRASSHOPPER_BLOCK_SIZE],
-                                  &c->buffer);
+static void gost_grasshopper_decrypt_blocks(gost_grasshopper_cipher_ctx *c,
+                                            const grasshopper_w128_t *in,
+                                            grasshopper_w128_t *out,
+                                            size_t blocks)
+{
+    if (!c->decrypt_key_set) {
+        if (c->constant_time)
+            grasshopper_bitslice_decrypt_key_from_encrypt(&c->decrypt_round_keys,
+                                                          &c->encrypt_round_keys);
+        else
+            grasshopper_decrypt_key_from_encrypt(&c->decrypt_round_keys,
+                                                 &c->encrypt_round_keys);
+        c->decrypt_key_set = 1;
     }
-    gost_grasshopper_cipher_key(c, newkey);
+    if (c->constant_time)
+        grasshopper_decrypt_blocks_ct(&c->decrypt_round_keys, in, out, blocks);
+    else
+        grasshopper_decrypt_blocks(&c->decrypt_round_keys, in, out, blocks);
 }
 
-/* Set 256 bit  key into context */
-static GRASSHOPPER_INLINE void
-gost_grasshopper_cipher_key(gost_grasshopper_cipher_ctx * c, const uint8_t *k)
+/*
+ * Sets the key and its encryption schedule. The decryption schedule is
+ * only needed by ECB and CBC decryption and is built on their first use.
+ * In the constant-time mode both are built without table lookups, so that
+ * ACPKM and TLSTREE rekeying do not index memory by the key either.
+ */
+static void gost_grasshopper_set_key(gost_grasshopper_cipher_ctx * c,
+                                     const uint8_t *k)
 {
     int i;
     for (i = 0; i < 2; i++) {
@@ -160,8 +200,33 @@ gost_grasshopper_cipher_key(gost_grasshopper_cipher_ctx * c, const uint8_t *k)
                             (const grasshopper_w128_t *)(k + i * 16));
     }
 
-    grasshopper_set_encrypt_key(&c->encrypt_round_keys, &c->key);
-    grasshopper_set_decrypt_key(&c->decrypt_round_keys, &c->key);
+    if (c->constant_time)
+        grasshopper_bitslice_set_encrypt_key(&c->encrypt_round_keys, &c->key);
+    else
+        grasshopper_set_encrypt_key(&c->encrypt_round_keys, &c->key);
+    if (c->decrypt_key_set) {
+        OPENSSL_cleanse(&c->decrypt_round_keys, sizeof(c->decrypt_round_keys));
+        c->decrypt_key_set = 0;
+    }
+}
+
+static void acpkm_next(gost_grasshopper_cipher_ctx * c)
+{
+    unsigned char newkey[GRASSHOPPER_KEY_SIZE];
+    const int J = GRASSHOPPER_KEY_SIZE / GRASSHOPPER_BLOCK_SIZE;
+
+    gost_grasshopper_encrypt_blocks(c, (const grasshopper_w128_t *) ACPKM_D_2018,
+                                    (grasshopper_w128_t *) newkey, J);
+    gost_grasshopper_set_key(c, newkey);
+    OPENSSL_cleanse(newkey, sizeof(newkey));
+}
+
+/* Set 256 bit  key into context */
+static GRASSHOPPER_INLINE void
+gost_grasshopper_cipher_key(gost_grasshopper_cipher_ctx * c, const uint8_t *k)
+{
+    c->constant_time = gost_kuznyechik_constant_time();
+    gost_grasshopper_set_key(c, k);
 }
 
 /* Set master 256-bit key to be used in TLSTREE calculation into context */
@@ -190,6 +255,7 @@ gost_grasshopper_cipher_destroy(gost_grasshopper_cipher_ctx * c)
     for (i = 0; i < GRASSHOPPER_ROUND_KEYS_COUNT; i++) {
         grasshopper_zero128(&c->decrypt_round_keys.k[i]);
     }
+    c->decrypt_key_set = 0;
     grasshopper_zero128(&c->buffer);
 }
 
@@ -203,6 +269,7 @@ gost_grasshopper_cipher_destroy_ctr(gost_grasshopper_cipher_ctx * c)
         EVP_MD_CTX_free(ctx->omac_ctx);
 
     grasshopper_zero128(&ctx->partial_buffer);
+    OPENSSL_cleanse(&ctx->tlstree, sizeof(ctx->tlstree));
 }
 
 static int gost_grasshopper_cipher_init(EVP_CIPHER_CTX *ctx,
@@ -223,6 +290,8 @@ static int gost_grasshopper_cipher_init(EVP_CIPHER_CTX *ctx,
     if (key != NULL) {
         gost_grasshopper_cipher_key(c, key);
         gost_grasshopper_master_key(c, key);
+        if (EVP_CIPHER_CTX_mode(ctx) == EVP_CIPH_CTR_MODE)
+            ((gost_grasshopper_cipher_ctx_ctr *)c)->tlstree.levels = 0;
     }
 
     if (iv != NULL) {
@@ -344,31 +413,61 @@ gost_grasshopper_cipher_init_ctracpkm_omac(EVP_CIPHER_CTX
     return gost_grasshopper_cipher_init(ctx, key, iv, enc);
 }
 
+/* Block function for the MGM implementation */
+static void gost_grasshopper_mgm_block(const unsigned char *in,
+                                       unsigned char *out, void *key)
+{
+    gost_grasshopper_cipher_ctx *c = key;
+
+    grasshopper_encrypt_block(&c->encrypt_round_keys,
+                              (grasshopper_w128_t *) in,
+                              (grasshopper_w128_t *) out, &c->buffer);
+}
+
+static int gost_grasshopper_cipher_init_mgm(EVP_CIPHER_CTX *ctx,
+                                            const unsigned char *key,
+                                            const unsigned char *iv, int enc)
+{
+    gost_grasshopper_cipher_ctx_mgm *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+
+    c->c.type = GRASSHOPPER_CIPHER_MGM;
+    if (key != NULL) {
+        gost_mgm128_init(&c->mgm, &c->c, gost_grasshopper_mgm_block,
+                         GRASSHOPPER_BLOCK_SIZE);
+        c->key_set = 1;
+    }
+    if (gost_grasshopper_cipher_init(ctx, key, iv, enc) <= 0)
+        return 0;
+
+    /* A message is only started by an explicitly supplied nonce */
+    if (iv != NULL) {
+        c->iv_set = 1;
+        if (enc)
+            c->taglen = 0;
+    }
+    if (c->key_set && c->iv_set
+        && !gost_mgm128_setiv(&c->mgm, EVP_CIPHER_CTX_iv(ctx))) {
+        GOSTerr(GOST_F_GOST_GRASSHOPPER_CIPHER_INIT_MGM, GOST_R_INVALID_NONCE);
+        c->iv_set = 0;
+        return 0;
+    }
+    return 1;
+}
+
 static int gost_grasshopper_cipher_do_ecb(EVP_CIPHER_CTX *ctx, unsigned char *out,
                                           const unsigned char *in, size_t inl)
 {
     gost_grasshopper_cipher_ctx *c =
         (gost_grasshopper_cipher_ctx *) EVP_CIPHER_CTX_get_cipher_data(ctx);
     bool encrypting = (bool) EVP_CIPHER_CTX_encrypting(ctx);
-    const unsigned char *current_in = in;
-    unsigned char *current_out = out;
     size_t blocks = inl / GRASSHOPPER_BLOCK_SIZE;
-    size_t i;
 
-    for (i = 0; i < blocks;
-         i++, current_in += GRASSHOPPER_BLOCK_SIZE, current_out +=
-         GRASSHOPPER_BLOCK_SIZE) {
-        if (encrypting) {
-            grasshopper_encrypt_block(&c->encrypt_round_keys,
-                                      (grasshopper_w128_t *) current_in,
-                                      (grasshopper_w128_t *) current_out,
-                                      &c->buffer);
-        } else {
-            grasshopper_decrypt_block(&c->decrypt_round_keys,
-                                      (grasshopper_w128_t *) current_in,
-                                      (grasshopper_w128_t *) current_out,
-                                      &c->buffer);
-        }
+    if (encrypting) {
+        gost_grasshopper_encrypt_blocks(c, (const grasshopper_w128_t *) in,
+                                        (grasshopper_w128_t *) out, blocks);
+    } else {
+        gost_grasshopper_decrypt_blocks(c, (const grasshopper_w128_t *) in,
+                                        (grasshopper_w128_t *) out, blocks);
     }
 
     return 1;
@@ -389,26 +488,38 @@ static int gost_grasshopper_cipher_do_cbc(EVP_CIPHER_CTX *ctx, unsigned char *ou
 
     currentBlock = (grasshopper_w128_t *) iv;
 
-    for (i = 0; i < blocks;
-         i++, current_in += GRASSHOPPER_BLOCK_SIZE, current_out +=
-         GRASSHOPPER_BLOCK_SIZE) {
-        grasshopper_w128_t *currentInputBlock = (grasshopper_w128_t *) current_in;
-        grasshopper_w128_t *currentOutputBlock = (grasshopper_w128_t *) current_out;
-        if (encrypting) {
+    if (encrypting) {
+        for (i = 0; i < blocks;
+             i++, current_in += GRASSHOPPER_BLOCK_SIZE, current_out +=
+             GRASSHOPPER_BLOCK_SIZE) {
+            grasshopper_w128_t *currentInputBlock = (grasshopper_w128_t *) current_in;
+            grasshopper_w128_t *currentOutputBlock = (grasshopper_w128_t *) current_out;
+
             grasshopper_append128(currentBlock, currentInputBlock);
             grasshopper_encrypt_block(&c->encrypt_round_keys, currentBlock,
                                       currentOutputBlock, &c->buffer);
             grasshopper_copy128(currentBlock, currentOutputBlock);
-        } else {
-            grasshopper_w128_t tmp;
-
-            grasshopper_copy128(&tmp, currentInputBlock);
-            grasshopper_decrypt_block(&c->decrypt_round_keys,
-                                      currentInputBlock, currentOutputBlock,
-                                      &c->buffer);
-            grasshopper_append128(currentOutputBlock, currentBlock);
-            grasshopper_copy128(currentBlock, &tmp);
         }
+        return 1;
+    }
+
+    /* Decryption of different blocks is independent */
+    while (blocks > 0) {
+        grasshopper_w128_t tmp[GRASSHOPPER_PARALLEL_BLOCKS];
+        grasshopper_w128_t *currentOutputBlock = (grasshopper_w128_t *) current_out;
+        size_t n = blocks < GRASSHOPPER_PARALLEL_BLOCKS ?
+            blocks : GRASSHOPPER_PARALLEL_BLOCKS;
+
+        /* Ciphertext is still needed when out and in are the same */
+        memcpy(tmp, current_in, n * GRASSHOPPER_BLOCK_SIZE);
+        gost_grasshopper_decrypt_blocks(c, tmp, currentOutputBlock, n);
+        for (i = 0; i < n; i++) {
+            grasshopper_append128(&currentOutputBlock[i], currentBlock);
+            grasshopper_copy128(currentBlock, &tmp[i]);
+        }
+        current_in += n * GRASSHOPPER_BLOCK_SIZE;
+        current_out += n * GRASSHOPPER_BLOCK_SIZE;
+        blocks -= n;
     }
 
     return 1;
@@ -435,6 +546,31 @@ static void ctr128_inc(unsigned char *counter)
     inc_counter(counter, 16);
 }
 
+/* Processes full blocks in CTR mode, advancing the counter */
+static void gost_grasshopper_ctr_blocks(gost_grasshopper_cipher_ctx *c,
+                                        unsigned char *iv,
+                                        const unsigned char *in,
+                                        unsigned char *out, size_t blocks)
+{
+    grasshopper_w128_t ks[GRASSHOPPER_PARALLEL_BLOCKS];
+    size_t i, n;
+
+    for (; blocks > 0; blocks -= n, in += n * GRASSHOPPER_BLOCK_SIZE,
+         out += n * GRASSHOPPER_BLOCK_SIZE) {
+        n = blocks < GRASSHOPPER_PARALLEL_BLOCKS ?
+            blocks : GRASSHOPPER_PARALLEL_BLOCKS;
+        for (i = 0; i < n; i++) {
+            memcpy(&ks[i], iv, GRASSHOPPER_BLOCK_SIZE);
+            ctr128_inc(iv);
+        }
+        gost_grasshopper_encrypt_blocks(c, ks, ks, n);
+        for (i = 0; i < n; i++) {
+            grasshopper_append128(&ks[i], (const grasshopper_w128_t *) in + i);
+            grasshopper_copy128((grasshopper_w128_t *) out + i, &ks[i]);
+        }
+    }
+}
+
 static int gost_grasshopper_cipher_do_ctr(EVP_CIPHER_CTX *ctx, unsigned char *out,
                                           const unsigned char *in, size_t inl)
 {
@@ -450,7 +586,6 @@ static int gost_grasshopper_cipher_do_ctr(EVP_CIPHER_CTX *ctx, unsigned char *ou
     size_t i;
     size_t blocks;
     grasshopper_w128_t *iv_buffer;
-    grasshopper_w128_t tmp;
 
     while (n && lasted) {
         *(current_out++) = *(current_in++) ^ c->partial_buffer.b[n];
@@ -463,24 +598,16 @@ static int gost_grasshopper_cipher_do_ctr(EVP_CIPHER_CTX *ctx, unsigned char *ou
     iv_buffer = (grasshopper_w128_t *) iv;
 
     // full parts
-    for (i = 0; i < blocks; i++) {
-        currentInputBlock = (grasshopper_w128_t *) current_in;
-        currentOutputBlock = (grasshopper_w128_t *) current_out;
-        grasshopper_encrypt_block(&c->c.encrypt_round_keys, iv_buffer,
-                                  &c->partial_buffer, &c->c.buffer);
-        grasshopper_plus128(&tmp, &c->partial_buffer, currentInputBlock);
-        grasshopper_copy128(currentOutputBlock, &tmp);
-        ctr128_inc(iv_buffer->b);
-        current_in += GRASSHOPPER_BLOCK_SIZE;
-        current_out += GRASSHOPPER_BLOCK_SIZE;
-        lasted -= GRASSHOPPER_BLOCK_SIZE;
-    }
+    gost_grasshopper_ctr_blocks(&c->c, iv, current_in, current_out, blocks);
+    current_in += blocks * GRASSHOPPER_BLOCK_SIZE;
+    current_out += blocks * GRASSHOPPER_BLOCK_SIZE;
+    lasted -= blocks * GRASSHOPPER_BLOCK_SIZE;
 
     if (lasted > 0) {
         currentInputBlock = (grasshopper_w128_t *) current_in;
         currentOutputBlock = (grasshopper_w128_t *) current_out;
-        grasshopper_encrypt_block(&c->c.encrypt_round_keys, iv_buffer,
-                                  &c->partial_buffer, &c->c.buffer);
+        gost_grasshopper_encrypt_blocks(&c->c, iv_buffer,
+                                        &c->partial_buffer, 1);
         for (i = 0; i < lasted; i++) {
             currentOutputBlock->b[i] =
                 c->partial_buffer.b[i] ^ currentInputBlock->b[i];
@@ -513,7 +640,6 @@ static int gost_grasshopper_cipher_do_ctracpkm(EVP_CIPHER_CTX *ctx,
     unsigned char *iv = EVP_CIPHER_CTX_iv_noconst(ctx);
     unsigned int num = EVP_CIPHER_CTX_num(ctx);
     size_t blocks, i, lasted = inl;
-    grasshopper_w128_t tmp;
 
     while ((num & GRASSHOPPER_BLOCK_MASK) && lasted) {
         *out++ = *in++ ^ c->partial_buffer.b[num & GRASSHOPPER_BLOCK_MASK];
@@ -522,29 +648,27 @@ static int gost_grasshopper_cipher_do_ctracpkm(EVP_CIPHER_CTX *ctx,
     }
     blocks = lasted / GRASSHOPPER_BLOCK_SIZE;
 
-    // full parts
-    for (i = 0; i < blocks; i++) {
+    // full parts, a run of blocks never crosses a section boundary
+    while (blocks > 0) {
+        size_t n = blocks;
+
         apply_acpkm_grasshopper(c, &num);
-        grasshopper_encrypt_block(&c->c.encrypt_round_keys,
-                                  (grasshopper_w128_t *) iv,
-                                  (grasshopper_w128_t *) & c->partial_buffer,
-                                  &c->c.buffer);
-        grasshopper_plus128(&tmp, &c->partial_buffer,
-                            (grasshopper_w128_t *) in);
-        grasshopper_copy128((grasshopper_w128_t *) out, &tmp);
-        ctr128_inc(iv);
-        in += GRASSHOPPER_BLOCK_SIZE;
-        out += GRASSHOPPER_BLOCK_SIZE;
-        num += GRASSHOPPER_BLOCK_SIZE;
-        lasted -= GRASSHOPPER_BLOCK_SIZE;
+        if (c->section_size
+            && n > (c->section_size - num) / GRASSHOPPER_BLOCK_SIZE)
+            n = (c->section_size - num) / GRASSHOPPER_BLOCK_SIZE;
+        gost_grasshopper_ctr_blocks(&c->c, iv, in, out, n);
+        in += n * GRASSHOPPER_BLOCK_SIZE;
+        out += n * GRASSHOPPER_BLOCK_SIZE;
+        num += n * GRASSHOPPER_BLOCK_SIZE;
+        lasted -= n * GRASSHOPPER_BLOCK_SIZE;
+        blocks -= n;
     }
 
     // last part
     if (lasted > 0) {
         apply_acpkm_grasshopper(c, &num);
-        grasshopper_encrypt_block(&c->c.encrypt_round_keys,
-                                  (grasshopper_w128_t *) iv,
-                                  &c->partial_buffer, &c->c.buffer);
+        gost_grasshopper_encrypt_blocks(&c->c, (grasshopper_w128_t *) iv,
+                                        &c->partial_buffer, 1);
         for (i = 0; i < lasted; i++)
             out[i] = c->partial_buffer.b[i] ^ in[i];
         ctr128_inc(iv);
@@ -582,6 +706,57 @@ static int gost_grasshopper_cipher_do_ctracpkm_omac(EVP_CIPHER_CTX *ctx,
 
     return result;
 }
+/*
+ * Single pass MGM: AAD is passed with out == NULL, the final call has
+ * in == NULL and computes (encryption) or verifies (decryption) the tag.
+ */
+static int gost_grasshopper_cipher_do_mgm(EVP_CIPHER_CTX *ctx,
+                                          unsigned char *out,
+                                          const unsigned char *in,
+                                          size_t inl)
+{
+    gost_grasshopper_cipher_ctx_mgm *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+    int enc = EVP_CIPHER_CTX_encrypting(ctx);
+    int ok;
+
+    if (!c->key_set || !c->iv_set) {
+        GOSTerr(GOST_F_GOST_GRASSHOPPER_CIPHER_DO_MGM,
+                GOST_R_KEY_IS_NOT_INITIALIZED);
+        return -1;
+    }
+
+    if (in == NULL && inl == 0) { /* Final call */
+        c->iv_set = 0;
+        if (enc) {
+            gost_mgm128_tag(&c->mgm, c->tag, GRASSHOPPER_BLOCK_SIZE);
+            c->taglen = GRASSHOPPER_BLOCK_SIZE;
+            return 0;
+        }
+        ok = c->taglen > 0 && gost_mgm128_finish(&c->mgm, c->tag, c->taglen);
+        c->taglen = 0;
+        return ok ? 0 : -1;
+    }
+
+    if (in == NULL) {
+        GOSTerr(GOST_F_GOST_GRASSHOPPER_CIPHER_DO_MGM, ERR_R_EVP_LIB);
+        return -1;
+    }
+
+    if (out == NULL)
+        ok = gost_mgm128_aad(&c->mgm, in, inl);
+    else if (enc)
+        ok = gost_mgm128_encrypt(&c->mgm, in, out, inl);
+    else
+        ok = gost_mgm128_decrypt(&c->mgm, in, out, inl);
+
+    if (!ok) {
+        GOSTerr(GOST_F_GOST_GRASSHOPPER_CIPHER_DO_MGM,
+                GOST_R_INVALID_MGM_INPUT);
+        return -1;
+    }
+    return (int)inl;
+}
+
 /*
  * Fixed 128-bit IV implementation make shift regiser redundant.
  */
@@ -695,6 +870,29 @@ static int gost_grasshopper_cipher_do_cfb(EVP_CIPHER_CTX *ctx, unsigned char *ou
         }
     }
 
+    /*
+     * Decryption keystream only depends on the ciphertext, so the blocks
+     * can be encrypted in parallel. The last full block is left to the
+     * code below, which keeps its keystream in buf.
+     */
+    while (!encrypting && i + GRASSHOPPER_BLOCK_SIZE < inl) {
+        grasshopper_w128_t ks[GRASSHOPPER_PARALLEL_BLOCKS];
+        size_t n = (inl - i - 1) / GRASSHOPPER_BLOCK_SIZE;
+
+        if (n > GRASSHOPPER_PARALLEL_BLOCKS)
+            n = GRASSHOPPER_PARALLEL_BLOCKS;
+        memcpy(&ks[0], iv, GRASSHOPPER_BLOCK_SIZE);
+        memcpy(&ks[1], in_ptr, (n - 1) * GRASSHOPPER_BLOCK_SIZE);
+        memcpy(iv, in_ptr + (n - 1) * GRASSHOPPER_BLOCK_SIZE,
+               GRASSHOPPER_BLOCK_SIZE);
+        gost_grasshopper_encrypt_blocks(c, ks, ks, n);
+        for (j = 0; j < n * GRASSHOPPER_BLOCK_SIZE; j++)
+            out_ptr[j] = ((unsigned char *)ks)[j] ^ in_ptr[j];
+        i += n * GRASSHOPPER_BLOCK_SIZE;
+        in_ptr += n * GRASSHOPPER_BLOCK_SIZE;
+        out_ptr += n * GRASSHOPPER_BLOCK_SIZE;
+    }
+
     for (; i + GRASSHOPPER_BLOCK_SIZE <
          inl;
          i += GRASSHOPPER_BLOCK_SIZE, in_ptr +=
@@ -830,7 +1028,7 @@ static int gost_grasshopper_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, v
 
           unsigned char adjusted_iv[16];
           unsigned char seq[8];
-          int j, carry, decrement_arg;
+          int j, carry, decrement_arg, ret;
           if (mode != EVP_CIPH_CTR_MODE)
               return -1;
 
@@ -853,8 +1051,10 @@ static int gost_grasshopper_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, v
               return -1;
           }
 
-          if (gost_tlstree(NID_grasshopper_cbc, c->master_key.k.b, newkey,
-                (const unsigned char *)seq) > 0) {
+          ret = gost_tlstree_cached(NID_grasshopper_cbc, c->master_key.k.b,
+                                    newkey, (const unsigned char *)seq,
+                                    &ctr_ctx->tlstree);
+          if (ret > 0) {
             memset(adjusted_iv, 0, 16);
             memcpy(adjusted_iv, EVP_CIPHER_CTX_original_iv(ctx), 8);
             for(j=7,carry=0; j>=0; j--)
@@ -866,36 +1066,58 @@ static int gost_grasshopper_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, v
             EVP_CIPHER_CTX_set_num(ctx, 0);
             memcpy(EVP_CIPHER_CTX_iv_noconst(ctx), adjusted_iv, 16);
 
-            gost_grasshopper_cipher_key(c, newkey);
+            /* without ACPKM the key of the previous record is in place */
+            if (ret == 1 || c->type != GRASSHOPPER_CIPHER_CTR)
+                gost_grasshopper_cipher_key(c, newkey);
+            OPENSSL_cleanse(newkey, sizeof(newkey));
             return 1;
           }
         }
         return -1;
-#if 0
+    case EVP_CTRL_AEAD_SET_IVLEN:
+        {
+            gost_grasshopper_cipher_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+
+            if (c->type != GRASSHOPPER_CIPHER_MGM)
+                return -1;
+            /* MGM nonce is always one block long */
+            if (arg != GRASSHOPPER_BLOCK_SIZE) {
+                GOSTerr(GOST_F_GOST_GRASSHOPPER_CIPHER_CTL,
+                        GOST_R_INVALID_IV_LENGTH);
+                return -1;
+            }
+            break;
+        }
     case EVP_CTRL_AEAD_GET_TAG:
     case EVP_CTRL_AEAD_SET_TAG:
         {
             int taglen = arg;
             unsigned char *tag = ptr;
+            int enc = EVP_CIPHER_CTX_encrypting(ctx);
 
-            gost_grasshopper_cipher_ctx *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
+            gost_grasshopper_cipher_ctx_mgm *c = EVP_CIPHER_CTX_get_cipher_data(ctx);
             if (c->c.type != GRASSHOPPER_CIPHER_MGM)
                 return -1;
 
-            if (taglen > KUZNYECHIK_MAC_MAX_SIZE) {
-                CRYPTOCOMerr(CRYPTOCOM_F_GOST_GRASSHOPPER_CIPHER_CTL,
-                        CRYPTOCOM_R_INVALID_TAG_LENGTH);
+            if (taglen < MGM_MIN_TAG_SIZE || taglen > KUZNYECHIK_MAC_MAX_SIZE) {
+                GOSTerr(GOST_F_GOST_GRASSHOPPER_CIPHER_CTL,
+                        GOST_R_INVALID_TAG_LENGTH);
                 return -1;
             }
 
-            if (type == EVP_CTRL_AEAD_GET_TAG)
-                memcpy(tag, c->final_tag, taglen);
-            else
-                memcpy(c->final_tag, tag, taglen);
-
+            if (type == EVP_CTRL_AEAD_GET_TAG) {
+                if (!enc || c->taglen == 0)
+                    return -1;
+                memcpy(tag, c->tag, taglen);
+            } else {
+                /* Tag length only matters for decryption */
+                if (enc || tag == NULL)
+                    return enc ? 1 : -1;
+                memcpy(c->tag, tag, taglen);
+                c->taglen = taglen;
+            }
             return 1;
         }
-#endif
     case EVP_CTRL_PROCESS_UNPROTECTED:
     {
       STACK_OF(X509_ATTRIBUTE) *x = ptr;
@@ -912,6 +1134,15 @@ static int gost_grasshopper_cipher_ctl(EVP_CIPHER_CTX *ctx, int type, int arg, v
         gost_grasshopper_cipher_ctx_ctr *out_cctx = EVP_CIPHER_CTX_get_cipher_data(out);
         gost_grasshopper_cipher_ctx_ctr *in_cctx  = EVP_CIPHER_CTX_get_cipher_data(ctx);
 
+        if (in_cctx->c.type == GRASSHOPPER_CIPHER_MGM) {
+            gost_grasshopper_cipher_ctx_mgm *out_mctx =
+                EVP_CIPHER_CTX_get_cipher_data(out);
+
+            /* MGM state refers to the key schedule of its own context */
+            out_mctx->mgm.key = &out_mctx->c;
+            return 1;
+        }
+
         if (in_cctx->c.type != GRASSHOPPER_CIPHER_CTRACPKMOMAC)
             return -1;
 
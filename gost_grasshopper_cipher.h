@@ -11,6 +11,8 @@ extern "C" {
 #endif
 
 #include "gost_grasshopper_defines.h"
+#include "gost_mgm128.h"
+#include "gost_lcl.h"
 
 #include <openssl/evp.h>
 
@@ -22,7 +24,9 @@ typedef struct {
     grasshopper_key_t key;
     grasshopper_round_keys_t encrypt_round_keys;
     grasshopper_round_keys_t decrypt_round_keys;
+    int decrypt_key_set;        /* decrypt_round_keys are built on demand */
     grasshopper_w128_t buffer;
+    int constant_time;          /* KUZNYECHIK_BULK is CONSTANT_TIME */
 } gost_grasshopper_cipher_ctx;
 
 typedef struct {
@@ -33,8 +37,18 @@ typedef struct {
     unsigned char kdf_seed[8];
 		unsigned char tag[16];
 		EVP_MD_CTX *omac_ctx;
+    gost_tlstree_cache tlstree;
 } gost_grasshopper_cipher_ctx_ctr;
 
+typedef struct {
+    gost_grasshopper_cipher_ctx c;
+    mgm128_context mgm;
+    int key_set;
+    int iv_set;                 /* cleared by the final call */
+    int taglen;                 /* 0 while there is no tag */
+    unsigned char tag[16];
+} gost_grasshopper_cipher_ctx_mgm;
+
 static void gost_grasshopper_cipher_key(gost_grasshopper_cipher_ctx* c, const uint8_t* k);
 
 static void gost_grasshopper_cipher_destroy(gost_grasshopper_cipher_ctx* c);
@@ -60,6 +74,9 @@ static int gost_grasshopper_cipher_init_ctracpkm(EVP_CIPHER_CTX* ctx,
 static int gost_grasshopper_cipher_init_ctracpkm_omac(EVP_CIPHER_CTX* ctx,
     const unsigned char* key, const unsigned char* iv, int enc);
 
+static int gost_grasshopper_cipher_init_mgm(EVP_CIPHER_CTX* ctx,
+    const unsigned char* key, const unsigned char* iv, int enc);
+
 static int gost_grasshopper_cipher_init(EVP_CIPHER_CTX* ctx, const unsigned char* key,
     const unsigned char* iv, int enc);
 
@@ -87,6 +104,9 @@ static int gost_grasshopper_cipher_do_ctracpkm(EVP_CIPHER_CTX* ctx, unsigned cha
 static int gost_grasshopper_cipher_do_ctracpkm_omac(EVP_CIPHER_CTX* ctx, unsigned char* out,
     const unsigned char* in, size_t inl);
 
+static int gost_grasshopper_cipher_do_mgm(EVP_CIPHER_CTX* ctx, unsigned char* out,
+    const unsigned char* in, size_t inl);
+
 static int gost_grasshopper_cipher_cleanup(EVP_CIPHER_CTX* ctx);
 
 static int gost_grasshopper_set_asn1_parameters(EVP_CIPHER_CTX* ctx, ASN1_TYPE* params);
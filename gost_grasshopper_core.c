@@ -7,49 +7,18 @@
 extern "C" {
 #endif
 
+#include <string.h>
+#include <openssl/crypto.h>
 #include "gost_grasshopper_core.h"
 #include "gost_grasshopper_math.h"
 #include "gost_grasshopper_precompiled.h"
 #include "gost_grasshopper_defines.h"
 
-static GRASSHOPPER_INLINE void grasshopper_l(grasshopper_w128_t* w) {
-    unsigned int j;
-    int i;
-
-    // 16 rounds
-    for (j = 0; j < sizeof(grasshopper_lvec) / sizeof(grasshopper_lvec[0]); j++) {
-        uint8_t x;
-
-        // An LFSR with 16 elements from GF(2^8)
-        x = w->b[15];    // since lvec[15] = 1
-
-        for (i = 14; i >= 0; i--) {
-            w->b[i + 1] = w->b[i];
-            x ^= grasshopper_galois_mul(w->b[i], grasshopper_lvec[i]);
-        }
-        w->b[0] = x;
-    }
-}
-
-static GRASSHOPPER_INLINE void grasshopper_l_inv(grasshopper_w128_t* w) {
-    unsigned int j;
-    int i;
-
-    // 16 rounds
-    for (j = 0; j < sizeof(grasshopper_lvec) / sizeof(grasshopper_lvec[0]); j++) {
-        uint8_t x = w->b[0];
-        for (i = 0; i < 15; i++) {
-            w->b[i] = w->b[i + 1];
-            x ^= grasshopper_galois_mul(w->b[i], grasshopper_lvec[i]);
-        }
-        w->b[15] = x;
-    }
-}
-
 // key setup
 
+// the round constants are precomputed and L(S(x)) is the table of the rounds
 void grasshopper_set_encrypt_key(grasshopper_round_keys_t* subkeys, const grasshopper_key_t* key) {
-    grasshopper_w128_t c, x, y, z;
+    grasshopper_w128_t x, y, z, buffer;
     int i;
 
     for (i = 0; i < 16; i++) {
@@ -62,15 +31,8 @@ void grasshopper_set_encrypt_key(grasshopper_round_keys_t* subkeys, const grassh
     grasshopper_copy128(&subkeys->k[1], &y);
 
     for (i = 1; i <= 32; i++) {
-
-        // C Value
-        grasshopper_zero128(&c);
-        c.b[15] = (uint8_t) i;        // load round in lsb
-        grasshopper_l(&c);
-
-        grasshopper_plus128(&z, &x, &c);
-        grasshopper_convert128(&z, grasshopper_pi);
-        grasshopper_l(&z);
+        grasshopper_plus128(&z, &x, &grasshopper_keyschedule_c128[i - 1]);
+        grasshopper_append128multi(&buffer, &z, grasshopper_pil_enc128);
         grasshopper_append128(&z, &y);
 
         grasshopper_copy128(&y, &x);
@@ -84,19 +46,28 @@ void grasshopper_set_encrypt_key(grasshopper_round_keys_t* subkeys, const grassh
     }
 
     // security++
-    grasshopper_zero128(&c);
     grasshopper_zero128(&x);
     grasshopper_zero128(&y);
     grasshopper_zero128(&z);
+    grasshopper_zero128(&buffer);
 }
 
 void grasshopper_set_decrypt_key(grasshopper_round_keys_t* subkeys, const grasshopper_key_t* key) {
-		int i;
     grasshopper_set_encrypt_key(subkeys, key);
+    grasshopper_decrypt_key_from_encrypt(subkeys, subkeys);
+}
 
+// L^-1 of keys 1..9 by the table of the first decryption round
+void grasshopper_decrypt_key_from_encrypt(grasshopper_round_keys_t* decrypt, const grasshopper_round_keys_t* encrypt) {
+    grasshopper_w128_t buffer;
+    int i;
+
+    grasshopper_copy128(&decrypt->k[0], &encrypt->k[0]);
     for (i = 1; i < 10; i++) {
-        grasshopper_l_inv(&subkeys->k[i]);
+        grasshopper_copy128(&decrypt->k[i], &encrypt->k[i]);
+        grasshopper_append128multi(&buffer, &decrypt->k[i], grasshopper_l_dec128);
     }
+    grasshopper_zero128(&buffer);
 }
 
 void grasshopper_encrypt_block(grasshopper_round_keys_t* subkeys, grasshopper_w128_t* source,
@@ -129,6 +100,169 @@ void grasshopper_decrypt_block(grasshopper_round_keys_t* subkeys, grasshopper_w1
     grasshopper_append128(target, &subkeys->k[0]);
 }
 
+/*
+ * The multi-block functions hand whole batches to the vector permute
+ * kernels when the cpu has them. The rest is done here, interleaving four
+ * blocks per round: lookups of different blocks are independent, so their
+ * latencies overlap instead of adding up. Eight blocks need more registers
+ * than x86-64 has and run slower than four. The round state lives in
+ * locals rather than in a shared buffer, so source and target may be the
+ * same array.
+ */
+#define GRASSHOPPER_LOOKUP4(t, i) do { \
+        const grasshopper_w128_t *e0 = &t[i][x0.b[i]]; \
+        const grasshopper_w128_t *e1 = &t[i][x1.b[i]]; \
+        const grasshopper_w128_t *e2 = &t[i][x2.b[i]]; \
+        const grasshopper_w128_t *e3 = &t[i][x3.b[i]]; \
+        y00 ^= e0->q[0]; y01 ^= e0->q[1]; \
+        y10 ^= e1->q[0]; y11 ^= e1->q[1]; \
+        y20 ^= e2->q[0]; y21 ^= e2->q[1]; \
+        y30 ^= e3->q[0]; y31 ^= e3->q[1]; \
+    } while (0)
+
+#define GRASSHOPPER_ROUND4(t) do { \
+        GRASSHOPPER_LOOKUP4(t, 0); GRASSHOPPER_LOOKUP4(t, 1); \
+        GRASSHOPPER_LOOKUP4(t, 2); GRASSHOPPER_LOOKUP4(t, 3); \
+        GRASSHOPPER_LOOKUP4(t, 4); GRASSHOPPER_LOOKUP4(t, 5); \
+        GRASSHOPPER_LOOKUP4(t, 6); GRASSHOPPER_LOOKUP4(t, 7); \
+        GRASSHOPPER_LOOKUP4(t, 8); GRASSHOPPER_LOOKUP4(t, 9); \
+        GRASSHOPPER_LOOKUP4(t, 10); GRASSHOPPER_LOOKUP4(t, 11); \
+        GRASSHOPPER_LOOKUP4(t, 12); GRASSHOPPER_LOOKUP4(t, 13); \
+        GRASSHOPPER_LOOKUP4(t, 14); GRASSHOPPER_LOOKUP4(t, 15); \
+        x0.q[0] = y00; x0.q[1] = y01; \
+        x1.q[0] = y10; x1.q[1] = y11; \
+        x2.q[0] = y20; x2.q[1] = y21; \
+        x3.q[0] = y30; x3.q[1] = y31; \
+    } while (0)
+
+void grasshopper_encrypt_blocks(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                grasshopper_w128_t* target, size_t blocks) {
+    grasshopper_w128_t x0, x1, x2, x3;
+    uint64_t y00, y01, y10, y11, y20, y21, y30, y31;
+    size_t done;
+    int r;
+
+    done = grasshopper_vperm_encrypt_blocks_fast(subkeys, source, target, blocks);
+    source += done;
+    target += done;
+    blocks -= done;
+
+    for (; blocks >= 4; blocks -= 4, source += 4, target += 4) {
+        grasshopper_plus128(&x0, &source[0], &subkeys->k[0]);
+        grasshopper_plus128(&x1, &source[1], &subkeys->k[0]);
+        grasshopper_plus128(&x2, &source[2], &subkeys->k[0]);
+        grasshopper_plus128(&x3, &source[3], &subkeys->k[0]);
+
+        for (r = 1; r < GRASSHOPPER_ROUND_KEYS_COUNT; r++) {
+            // the round key is folded into the accumulators
+            y00 = y10 = y20 = y30 = subkeys->k[r].q[0];
+            y01 = y11 = y21 = y31 = subkeys->k[r].q[1];
+            GRASSHOPPER_ROUND4(grasshopper_pil_enc128);
+        }
+
+        grasshopper_copy128(&target[0], &x0);
+        grasshopper_copy128(&target[1], &x1);
+        grasshopper_copy128(&target[2], &x2);
+        grasshopper_copy128(&target[3], &x3);
+    }
+
+    for (; blocks > 0; blocks--, source++, target++) {
+        grasshopper_copy128(&x0, source);
+        grasshopper_encrypt_block(subkeys, &x0, target, &x1);
+    }
+}
+
+void grasshopper_decrypt_blocks(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                grasshopper_w128_t* target, size_t blocks) {
+    grasshopper_w128_t x0, x1, x2, x3;
+    uint64_t y00, y01, y10, y11, y20, y21, y30, y31;
+    size_t done;
+    int r;
+
+    done = grasshopper_vperm_decrypt_blocks_fast(subkeys, source, target, blocks);
+    source += done;
+    target += done;
+    blocks -= done;
+
+    for (; blocks >= 4; blocks -= 4, source += 4, target += 4) {
+        y00 = y01 = y10 = y11 = y20 = y21 = y30 = y31 = 0;
+        grasshopper_copy128(&x0, &source[0]);
+        grasshopper_copy128(&x1, &source[1]);
+        grasshopper_copy128(&x2, &source[2]);
+        grasshopper_copy128(&x3, &source[3]);
+        GRASSHOPPER_ROUND4(grasshopper_l_dec128);
+
+        for (r = GRASSHOPPER_ROUND_KEYS_COUNT - 1; r > 1; r--) {
+            grasshopper_append128(&x0, &subkeys->k[r]);
+            grasshopper_append128(&x1, &subkeys->k[r]);
+            grasshopper_append128(&x2, &subkeys->k[r]);
+            grasshopper_append128(&x3, &subkeys->k[r]);
+            y00 = y01 = y10 = y11 = y20 = y21 = y30 = y31 = 0;
+            GRASSHOPPER_ROUND4(grasshopper_pil_dec128);
+        }
+
+        grasshopper_append128(&x0, &subkeys->k[1]);
+        grasshopper_append128(&x1, &subkeys->k[1]);
+        grasshopper_append128(&x2, &subkeys->k[1]);
+        grasshopper_append128(&x3, &subkeys->k[1]);
+        grasshopper_convert128(&x0, grasshopper_pi_inv);
+        grasshopper_convert128(&x1, grasshopper_pi_inv);
+        grasshopper_convert128(&x2, grasshopper_pi_inv);
+        grasshopper_convert128(&x3, grasshopper_pi_inv);
+        grasshopper_plus128(&target[0], &x0, &subkeys->k[0]);
+        grasshopper_plus128(&target[1], &x1, &subkeys->k[0]);
+        grasshopper_plus128(&target[2], &x2, &subkeys->k[0]);
+        grasshopper_plus128(&target[3], &x3, &subkeys->k[0]);
+    }
+
+    for (; blocks > 0; blocks--, source++, target++) {
+        grasshopper_copy128(&x0, source);
+        grasshopper_decrypt_block(subkeys, &x0, target, &x1);
+    }
+}
+
+#undef GRASSHOPPER_ROUND4
+#undef GRASSHOPPER_LOOKUP4
+
+/*
+ * A tail shorter than a vector batch is padded with zero blocks up to the
+ * next multiple of 16, so that it is done by the vector kernels as well.
+ * Without them everything is left to the bitsliced code.
+ */
+#define GRASSHOPPER_BLOCKS_CT(vperm, bitslice) \
+    do { \
+        grasshopper_w128_t buf[GRASSHOPPER_PARALLEL_BLOCKS]; \
+        size_t done = vperm(subkeys, source, target, blocks); \
+        source += done; \
+        target += done; \
+        blocks -= done; \
+        if (blocks > 0 && blocks < GRASSHOPPER_PARALLEL_BLOCKS) { \
+            size_t padded = (blocks + 15) & ~(size_t) 15; \
+            memcpy(buf, source, blocks * sizeof(buf[0])); \
+            memset(buf + blocks, 0, (padded - blocks) * sizeof(buf[0])); \
+            done = vperm(subkeys, buf, buf, padded); \
+            if (done < blocks) { \
+                bitslice(subkeys, buf + done, buf + done, blocks - done); \
+            } \
+            memcpy(target, buf, blocks * sizeof(buf[0])); \
+            OPENSSL_cleanse(buf, sizeof(buf)); \
+        } else if (blocks > 0) { \
+            bitslice(subkeys, source, target, blocks); \
+        } \
+    } while (0)
+
+void grasshopper_encrypt_blocks_ct(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                   grasshopper_w128_t* target, size_t blocks) {
+    GRASSHOPPER_BLOCKS_CT(grasshopper_vperm_encrypt_blocks, grasshopper_bitslice_encrypt_blocks);
+}
+
+void grasshopper_decrypt_blocks_ct(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                   grasshopper_w128_t* target, size_t blocks) {
+    GRASSHOPPER_BLOCKS_CT(grasshopper_vperm_decrypt_blocks, grasshopper_bitslice_decrypt_blocks);
+}
+
+#undef GRASSHOPPER_BLOCKS_CT
+
 #if defined(__cplusplus)
 }
 #endif
@@ -11,18 +11,47 @@ extern "C" {
 #endif
 
 #include "gost_grasshopper_defines.h"
-
-static void grasshopper_l(grasshopper_w128_t* w);
-static void grasshopper_l_inv(grasshopper_w128_t* w);
+#include <stddef.h>
 
 // key setup
 extern void grasshopper_set_encrypt_key(grasshopper_round_keys_t* subkeys, const grasshopper_key_t* key);
 extern void grasshopper_set_decrypt_key(grasshopper_round_keys_t* subkeys, const grasshopper_key_t* key);
+// the decryption schedule from an encryption one, which may be the same
+extern void grasshopper_decrypt_key_from_encrypt(grasshopper_round_keys_t* decrypt, const grasshopper_round_keys_t* encrypt);
 
 // single-block ecp ops
 extern void grasshopper_encrypt_block(grasshopper_round_keys_t* subkeys, grasshopper_w128_t* source, grasshopper_w128_t* target, grasshopper_w128_t* buffer);
 extern void grasshopper_decrypt_block(grasshopper_round_keys_t* subkeys, grasshopper_w128_t* source, grasshopper_w128_t* target, grasshopper_w128_t* buffer);
 
+// multi-block ecb ops, independent blocks are processed interleaved;
+// modes feed them batches of GRASSHOPPER_PARALLEL_BLOCKS blocks
+#define GRASSHOPPER_PARALLEL_BLOCKS 64
+
+extern void grasshopper_encrypt_blocks(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+extern void grasshopper_decrypt_blocks(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+
+// vector permute ops for whole batches of 16, 32 or 64 blocks, when the cpu
+// has ssse3, avx2 or avx-512 with vbmi and gfni; return the number of blocks
+// done
+extern size_t grasshopper_vperm_encrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+extern size_t grasshopper_vperm_decrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+// only the avx-512 kernel, the one which is faster than the lookup tables
+extern size_t grasshopper_vperm_encrypt_blocks_fast(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+extern size_t grasshopper_vperm_decrypt_blocks_fast(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+
+// bitsliced ops for any number of blocks, 64 per batch, in portable code
+extern void grasshopper_bitslice_encrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+extern void grasshopper_bitslice_decrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+
+// key schedules which never index memory by the key, for the ct ops
+extern void grasshopper_bitslice_set_encrypt_key(grasshopper_round_keys_t* subkeys, const grasshopper_key_t* key);
+extern void grasshopper_bitslice_decrypt_key_from_encrypt(grasshopper_round_keys_t* decrypt, const grasshopper_round_keys_t* encrypt);
+
+// multi-block ecb ops which never index memory by the data or the key: the
+// vector permute kernels on padded batches, or the bitsliced ones
+extern void grasshopper_encrypt_blocks_ct(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+extern void grasshopper_decrypt_blocks_ct(grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source, grasshopper_w128_t* target, size_t blocks);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -15,4 +15,6 @@ extern const grasshopper_w128_t grasshopper_l_dec128[GRASSHOPPER_MAX_BIT_PARTS][
 
 extern const grasshopper_w128_t grasshopper_pil_dec128[GRASSHOPPER_MAX_BIT_PARTS][256];
 
+extern const grasshopper_w128_t grasshopper_keyschedule_c128[32];
+
 #endif
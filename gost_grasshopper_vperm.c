@@ -0,0 +1,291 @@
+/*
+ * This file is distributed under the same license as OpenSSL
+ *
+ * Vector permute implementation of Kuznyechik for SSSE3 and AVX2, selected
+ * at run time. See gost_grasshopper_vperm_impl.h for the algorithm.
+ */
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#include "gost_grasshopper_core.h"
+#include "gost_grasshopper_defines.h"
+#include "gost_cpu.h"
+
+#if defined(GOST_X86_DISPATCH)
+#include <immintrin.h>
+
+// products by lvec[0..5] and lvec[7] of a low and of a high nibble
+static const uint8_t grasshopper_vperm_mul[7][32] = {
+        {
+                0x00, 0x94, 0xEB, 0x7F, 0x15, 0x81, 0xFE, 0x6A, 0x2A, 0xBE, 0xC1, 0x55, 0x3F, 0xAB, 0xD4, 0x40,
+                0x00, 0x54, 0xA8, 0xFC, 0x93, 0xC7, 0x3B, 0x6F, 0xE5, 0xB1, 0x4D, 0x19, 0x76, 0x22, 0xDE, 0x8A
+        },
+        {
+                0x00, 0x20, 0x40, 0x60, 0x80, 0xA0, 0xC0, 0xE0, 0xC3, 0xE3, 0x83, 0xA3, 0x43, 0x63, 0x03, 0x23,
+                0x00, 0x45, 0x8A, 0xCF, 0xD7, 0x92, 0x5D, 0x18, 0x6D, 0x28, 0xE7, 0xA2, 0xBA, 0xFF, 0x30, 0x75
+        },
+        {
+                0x00, 0x85, 0xC9, 0x4C, 0x51, 0xD4, 0x98, 0x1D, 0xA2, 0x27, 0x6B, 0xEE, 0xF3, 0x76, 0x3A, 0xBF,
+                0x00, 0x87, 0xCD, 0x4A, 0x59, 0xDE, 0x94, 0x13, 0xB2, 0x35, 0x7F, 0xF8, 0xEB, 0x6C, 0x26, 0xA1
+        },
+        {
+                0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xA0, 0xB0, 0xC0, 0xD0, 0xE0, 0xF0,
+                0x00, 0xC3, 0x45, 0x86, 0x8A, 0x49, 0xCF, 0x0C, 0xD7, 0x14, 0x92, 0x51, 0x5D, 0x9E, 0x18, 0xDB
+        },
+        {
+                0x00, 0xC2, 0x47, 0x85, 0x8E, 0x4C, 0xC9, 0x0B, 0xDF, 0x1D, 0x98, 0x5A, 0x51, 0x93, 0x16, 0xD4,
+                0x00, 0x7D, 0xFA, 0x87, 0x37, 0x4A, 0xCD, 0xB0, 0x6E, 0x13, 0x94, 0xE9, 0x59, 0x24, 0xA3, 0xDE
+        },
+        {
+                0x00, 0xC0, 0x43, 0x83, 0x86, 0x46, 0xC5, 0x05, 0xCF, 0x0F, 0x8C, 0x4C, 0x49, 0x89, 0x0A, 0xCA,
+                0x00, 0x5D, 0xBA, 0xE7, 0xB7, 0xEA, 0x0D, 0x50, 0xAD, 0xF0, 0x17, 0x4A, 0x1A, 0x47, 0xA0, 0xFD
+        },
+        {
+                0x00, 0xFB, 0x35, 0xCE, 0x6A, 0x91, 0x5F, 0xA4, 0xD4, 0x2F, 0xE1, 0x1A, 0xBE, 0x45, 0x8B, 0x70,
+                0x00, 0x6B, 0xD6, 0xBD, 0x6F, 0x04, 0xB9, 0xD2, 0xDE, 0xB5, 0x08, 0x63, 0xB1, 0xDA, 0x67, 0x0C
+        },
+};
+
+// the same products as 8x8 bit matrices for gf2p8affineqb
+static const uint64_t grasshopper_vperm_gfni[7] = {
+        0xC64A952A55AA92E3ULL, 0xD868D0A04081DA6CULL, 0x77983162C48866BBULL, 0xB0D0A0408102B4D8ULL,
+        0x5AEFDEBC78F0BB2DULL, 0xDA6EDCB870E01BEDULL, 0x53F5EAD5AB57FDA9ULL
+};
+
+// SSSE3: 16 blocks, one per register lane
+
+#define VPERM_SUFFIX ssse3
+#define VPERM_TARGET GOST_TARGET("ssse3")
+#define VPERM_LANES 1
+#define vperm_t __m128i
+
+#define V_ZERO() _mm_setzero_si128()
+#define V_SET1(b) _mm_set1_epi8((char) (b))
+#define V_TABLE(p) _mm_loadu_si128((const __m128i*) (p))
+#define V_AND(a, b) _mm_and_si128(a, b)
+#define V_XOR(a, b) _mm_xor_si128(a, b)
+#define V_SHUFFLE(t, i) _mm_shuffle_epi8(t, i)
+#define V_OR(a, b) _mm_or_si128(a, b)
+#define V_SRLI16(a, n) _mm_srli_epi16(a, n)
+#define V_SLLI16(a, n) _mm_slli_epi16(a, n)
+// b in the lanes where bit 7 of m is set, a elsewhere
+#define V_BLEND(a, b, m) _mm_xor_si128(a, _mm_and_si128(_mm_cmpgt_epi8(_mm_setzero_si128(), m), \
+                                                        _mm_xor_si128(a, b)))
+#define V_UNPACKLO8(a, b) _mm_unpacklo_epi8(a, b)
+#define V_UNPACKHI8(a, b) _mm_unpackhi_epi8(a, b)
+#define V_LOAD_BATCH(s, src) do { \
+        int l_; \
+        for (l_ = 0; l_ < 16; l_++) \
+            (s)[l_] = _mm_loadu_si128((const __m128i*) &(src)[l_]); \
+    } while (0)
+#define V_STORE_BATCH(dst, s) do { \
+        int l_; \
+        for (l_ = 0; l_ < 16; l_++) \
+            _mm_storeu_si128((__m128i*) &(dst)[l_], (s)[l_]); \
+    } while (0)
+
+#include "gost_grasshopper_vperm_impl.h"
+
+#undef VPERM_SUFFIX
+#undef VPERM_TARGET
+#undef VPERM_LANES
+#undef vperm_t
+#undef V_ZERO
+#undef V_SET1
+#undef V_TABLE
+#undef V_AND
+#undef V_XOR
+#undef V_SHUFFLE
+#undef V_OR
+#undef V_SRLI16
+#undef V_SLLI16
+#undef V_BLEND
+#undef V_UNPACKLO8
+#undef V_UNPACKHI8
+#undef V_LOAD_BATCH
+#undef V_STORE_BATCH
+
+// AVX2: 32 blocks, block i in the low and block i + 16 in the high lane
+
+#define VPERM_SUFFIX avx2
+#define VPERM_TARGET GOST_TARGET("avx2")
+#define VPERM_LANES 2
+#define vperm_t __m256i
+
+#define V_ZERO() _mm256_setzero_si256()
+#define V_SET1(b) _mm256_set1_epi8((char) (b))
+#define V_TABLE(p) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) (p)))
+#define V_AND(a, b) _mm256_and_si256(a, b)
+#define V_XOR(a, b) _mm256_xor_si256(a, b)
+#define V_SHUFFLE(t, i) _mm256_shuffle_epi8(t, i)
+#define V_OR(a, b) _mm256_or_si256(a, b)
+#define V_SRLI16(a, n) _mm256_srli_epi16(a, n)
+#define V_SLLI16(a, n) _mm256_slli_epi16(a, n)
+#define V_BLEND(a, b, m) _mm256_blendv_epi8(a, b, m)
+#define V_UNPACKLO8(a, b) _mm256_unpacklo_epi8(a, b)
+#define V_UNPACKHI8(a, b) _mm256_unpackhi_epi8(a, b)
+#define V_LOAD_BATCH(s, src) do { \
+        int l_; \
+        for (l_ = 0; l_ < 16; l_++) \
+            (s)[l_] = _mm256_inserti128_si256( \
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) &(src)[l_])), \
+                _mm_loadu_si128((const __m128i*) &(src)[l_ + 16]), 1); \
+    } while (0)
+#define V_STORE_BATCH(dst, s) do { \
+        int l_; \
+        for (l_ = 0; l_ < 16; l_++) { \
+            _mm_storeu_si128((__m128i*) &(dst)[l_], _mm256_castsi256_si128((s)[l_])); \
+            _mm_storeu_si128((__m128i*) &(dst)[l_ + 16], _mm256_extracti128_si256((s)[l_], 1)); \
+        } \
+    } while (0)
+
+#include "gost_grasshopper_vperm_impl.h"
+
+#undef VPERM_SUFFIX
+#undef VPERM_TARGET
+#undef VPERM_LANES
+#undef vperm_t
+#undef V_ZERO
+#undef V_SET1
+#undef V_TABLE
+#undef V_AND
+#undef V_XOR
+#undef V_SHUFFLE
+#undef V_OR
+#undef V_SRLI16
+#undef V_SLLI16
+#undef V_BLEND
+#undef V_UNPACKLO8
+#undef V_UNPACKHI8
+#undef V_LOAD_BATCH
+#undef V_STORE_BATCH
+
+/*
+ * AVX-512 with VBMI and GFNI: 64 blocks, block i + 16 * l in lane l. The
+ * S-box is two 128-byte vpermi2b lookups merged by bit 7, and the products
+ * are gf2p8affineqb with the matrices above.
+ */
+
+#define VPERM_SUFFIX avx512
+#define VPERM_TARGET GOST_TARGET("avx512f,avx512bw,avx512vbmi,gfni")
+#define VPERM_LANES 4
+#define vperm_t __m512i
+
+#define V_SET1(b) _mm512_set1_epi8((char) (b))
+#define V_XOR(a, b) _mm512_xor_si512(a, b)
+#define V_UNPACKLO8(a, b) _mm512_unpacklo_epi8(a, b)
+#define V_UNPACKHI8(a, b) _mm512_unpackhi_epi8(a, b)
+#define V_LOAD_BATCH(s, src) do { \
+        int l_; \
+        for (l_ = 0; l_ < 16; l_++) { \
+            __m512i v_ = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*) &(src)[l_])); \
+            v_ = _mm512_inserti32x4(v_, _mm_loadu_si128((const __m128i*) &(src)[l_ + 16]), 1); \
+            v_ = _mm512_inserti32x4(v_, _mm_loadu_si128((const __m128i*) &(src)[l_ + 32]), 2); \
+            (s)[l_] = _mm512_inserti32x4(v_, _mm_loadu_si128((const __m128i*) &(src)[l_ + 48]), 3); \
+        } \
+    } while (0)
+#define V_STORE_BATCH(dst, s) do { \
+        int l_; \
+        for (l_ = 0; l_ < 16; l_++) { \
+            _mm_storeu_si128((__m128i*) &(dst)[l_], _mm512_castsi512_si128((s)[l_])); \
+            _mm_storeu_si128((__m128i*) &(dst)[l_ + 16], _mm512_extracti32x4_epi32((s)[l_], 1)); \
+            _mm_storeu_si128((__m128i*) &(dst)[l_ + 32], _mm512_extracti32x4_epi32((s)[l_], 2)); \
+            _mm_storeu_si128((__m128i*) &(dst)[l_ + 48], _mm512_extracti32x4_epi32((s)[l_], 3)); \
+        } \
+    } while (0)
+
+#define VPERM_NATIVE_SBOX
+#define VPERM_NATIVE_MUL
+
+static VPERM_TARGET void vperm_sbox_avx512(__m512i* s, const uint8_t* sbox) {
+    const __m512i t0 = _mm512_loadu_si512(sbox), t1 = _mm512_loadu_si512(sbox + 64);
+    const __m512i t2 = _mm512_loadu_si512(sbox + 128), t3 = _mm512_loadu_si512(sbox + 192);
+    int j;
+
+    for (j = 0; j < 16; j++) {
+        __m512i lo = _mm512_permutex2var_epi8(t0, s[j], t1);
+        __m512i hi = _mm512_permutex2var_epi8(t2, s[j], t3);
+
+        s[j] = _mm512_mask_blend_epi8(_mm512_movepi8_mask(s[j]), lo, hi);
+    }
+}
+
+static VPERM_TARGET __m512i vperm_mul_avx512(__m512i x, int c) {
+    return _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64((long long) grasshopper_vperm_gfni[c]), 0);
+}
+
+#include "gost_grasshopper_vperm_impl.h"
+
+#define GRASSHOPPER_VPERM_AVX512 (GOST_CPU_AVX512F | GOST_CPU_AVX512BW | GOST_CPU_AVX512VBMI | GOST_CPU_GFNI)
+
+size_t grasshopper_vperm_encrypt_blocks_fast(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                             grasshopper_w128_t* target, size_t blocks) {
+    if ((gost_cpu_caps() & GRASSHOPPER_VPERM_AVX512) != GRASSHOPPER_VPERM_AVX512)
+        return 0;
+    return grasshopper_vperm_encrypt_avx512(subkeys, source, target, blocks);
+}
+
+size_t grasshopper_vperm_decrypt_blocks_fast(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                             grasshopper_w128_t* target, size_t blocks) {
+    if ((gost_cpu_caps() & GRASSHOPPER_VPERM_AVX512) != GRASSHOPPER_VPERM_AVX512)
+        return 0;
+    return grasshopper_vperm_decrypt_avx512(subkeys, source, target, blocks);
+}
+
+size_t grasshopper_vperm_encrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                        grasshopper_w128_t* target, size_t blocks) {
+    unsigned int caps = gost_cpu_caps();
+    size_t done = 0;
+
+    if ((caps & GRASSHOPPER_VPERM_AVX512) == GRASSHOPPER_VPERM_AVX512)
+        done = grasshopper_vperm_encrypt_avx512(subkeys, source, target, blocks);
+    if (caps & GOST_CPU_AVX2)
+        done += grasshopper_vperm_encrypt_avx2(subkeys, source + done, target + done, blocks - done);
+    if (caps & GOST_CPU_SSSE3)
+        done += grasshopper_vperm_encrypt_ssse3(subkeys, source + done, target + done, blocks - done);
+    return done;
+}
+
+size_t grasshopper_vperm_decrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                        grasshopper_w128_t* target, size_t blocks) {
+    unsigned int caps = gost_cpu_caps();
+    size_t done = 0;
+
+    if ((caps & GRASSHOPPER_VPERM_AVX512) == GRASSHOPPER_VPERM_AVX512)
+        done = grasshopper_vperm_decrypt_avx512(subkeys, source, target, blocks);
+    if (caps & GOST_CPU_AVX2)
+        done += grasshopper_vperm_decrypt_avx2(subkeys, source + done, target + done, blocks - done);
+    if (caps & GOST_CPU_SSSE3)
+        done += grasshopper_vperm_decrypt_ssse3(subkeys, source + done, target + done, blocks - done);
+    return done;
+}
+
+#else
+
+size_t grasshopper_vperm_encrypt_blocks_fast(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                             grasshopper_w128_t* target, size_t blocks) {
+    return 0;
+}
+
+size_t grasshopper_vperm_decrypt_blocks_fast(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                             grasshopper_w128_t* target, size_t blocks) {
+    return 0;
+}
+
+size_t grasshopper_vperm_encrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                        grasshopper_w128_t* target, size_t blocks) {
+    return 0;
+}
+
+size_t grasshopper_vperm_decrypt_blocks(const grasshopper_round_keys_t* subkeys, const grasshopper_w128_t* source,
+                                        grasshopper_w128_t* target, size_t blocks) {
+    return 0;
+}
+
+#endif
+
+#if defined(__cplusplus)
+}
+#endif
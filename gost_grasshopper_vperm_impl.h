@@ -0,0 +1,224 @@
+/*
+ * This file is distributed under the same license as OpenSSL
+ *
+ * Byte-sliced Kuznyechik kernel, included by gost_grasshopper_vperm.c once
+ * per instruction set. The includer defines:
+ *   VPERM_SUFFIX       suffix of the generated function names
+ *   VPERM_TARGET       target attribute of the generated functions
+ *   VPERM_LANES        blocks per 16-byte lane of a register (1 or 2)
+ *   vperm_t            the vector type
+ * and the V_* operations on it used below. It may also provide its own
+ * vperm_sbox and vperm_mul, defining VPERM_NATIVE_SBOX and VPERM_NATIVE_MUL.
+ *
+ * A batch of 16 * VPERM_LANES blocks is transposed so that register j
+ * holds byte j of every block. Then every operation of a round is the same
+ * for all lanes: the S-box is 16 pshufb lookups merged by the high
+ * nibble, and multiplication by a constant of the linear transform is two
+ * pshufb nibble lookups. Nothing depends on secret-indexed memory.
+ */
+
+#define VPERM_CAT_(a, b) a##_##b
+#define VPERM_CAT(a, b) VPERM_CAT_(a, b)
+#define VPERM(name) VPERM_CAT(name, VPERM_SUFFIX)
+
+#define VPERM_BATCH (16 * VPERM_LANES)
+
+static VPERM_TARGET void VPERM(vperm_transpose)(vperm_t* s) {
+    vperm_t t[16];
+    int i, j;
+
+    // four rounds of the perfect shuffle transpose every 16x16 lane
+    for (j = 0; j < 4; j++) {
+        for (i = 0; i < 8; i++) {
+            t[2 * i] = V_UNPACKLO8(s[i], s[i + 8]);
+            t[2 * i + 1] = V_UNPACKHI8(s[i], s[i + 8]);
+        }
+        for (i = 0; i < 16; i++) {
+            s[i] = t[i];
+        }
+    }
+}
+
+static VPERM_TARGET void VPERM(vperm_add_key)(vperm_t* s, const grasshopper_w128_t* key) {
+    int j;
+
+    for (j = 0; j < 16; j++) {
+        s[j] = V_XOR(s[j], V_SET1(key->b[j]));
+    }
+}
+
+#if !defined(VPERM_NATIVE_SBOX)
+/*
+ * pshufb returns 0 in lanes whose index has bit 7 set. With bit 4 of x
+ * moved to bit 7 of the index, the rows for even and odd high nibbles
+ * are looked up in disjoint lanes, so a pair is merged by xor. The
+ * remaining three bits of the high nibble select by blends.
+ */
+static VPERM_TARGET void VPERM(vperm_sbox)(vperm_t* s, const uint8_t* sbox) {
+    const vperm_t c0f = V_SET1(0x0f), c80 = V_SET1(0x80);
+    int j;
+
+    for (j = 0; j < 16; j++) {
+        vperm_t x = s[j], m;
+        vperm_t even = V_OR(V_AND(x, c0f), V_AND(V_SLLI16(x, 3), c80));
+        vperm_t odd = V_XOR(even, c80);
+        vperm_t y0, y1, y2, y3, y4, y5, y6, y7;
+
+#define VPERM_SBOX_PAIR(i) \
+        V_XOR(V_SHUFFLE(V_TABLE(sbox + 32 * (i)), even), \
+              V_SHUFFLE(V_TABLE(sbox + 32 * (i) + 16), odd))
+        y0 = VPERM_SBOX_PAIR(0);
+        y1 = VPERM_SBOX_PAIR(1);
+        y2 = VPERM_SBOX_PAIR(2);
+        y3 = VPERM_SBOX_PAIR(3);
+        y4 = VPERM_SBOX_PAIR(4);
+        y5 = VPERM_SBOX_PAIR(5);
+        y6 = VPERM_SBOX_PAIR(6);
+        y7 = VPERM_SBOX_PAIR(7);
+#undef VPERM_SBOX_PAIR
+
+        m = V_SLLI16(x, 2);
+        y0 = V_BLEND(y0, y1, m);
+        y2 = V_BLEND(y2, y3, m);
+        y4 = V_BLEND(y4, y5, m);
+        y6 = V_BLEND(y6, y7, m);
+        m = V_SLLI16(x, 1);
+        y0 = V_BLEND(y0, y2, m);
+        y4 = V_BLEND(y4, y6, m);
+        s[j] = V_BLEND(y0, y4, x);
+    }
+}
+#endif
+
+#if !defined(VPERM_NATIVE_MUL)
+// multiplies by the constant c of grasshopper_vperm_mul
+static VPERM_TARGET vperm_t VPERM(vperm_mul)(vperm_t x, int c) {
+    const vperm_t c0f = V_SET1(0x0f);
+
+    return V_XOR(V_SHUFFLE(V_TABLE(grasshopper_vperm_mul[c]), V_AND(x, c0f)),
+                 V_SHUFFLE(V_TABLE(grasshopper_vperm_mul[c] + 16), V_AND(V_SRLI16(x, 4), c0f)));
+}
+#endif
+
+/*
+ * 16 LFSR steps. With b_i kept in w[k - i], a step only appends the new b_0
+ * as w[k + 1]. lvec is symmetric around lvec[7], so equal coefficients are
+ * applied to the sum of their bytes, and three of them are 1.
+ */
+static VPERM_TARGET void VPERM(vperm_l)(vperm_t* s) {
+    vperm_t w[32];
+    int i, k;
+
+    for (i = 0; i < 16; i++) {
+        w[15 - i] = s[i];
+    }
+
+    for (k = 15; k < 31; k++) {
+        vperm_t x = V_XOR(V_XOR(w[k - 15], w[k - 6]), w[k - 8]);
+
+#define VPERM_L_TERM(i) \
+        x = V_XOR(x, VPERM(vperm_mul)(V_XOR(w[k - (i)], w[k - 14 + (i)]), i))
+        x = V_XOR(x, VPERM(vperm_mul)(w[k - 7], 6));
+        VPERM_L_TERM(0);
+        VPERM_L_TERM(1);
+        VPERM_L_TERM(2);
+        VPERM_L_TERM(3);
+        VPERM_L_TERM(4);
+        VPERM_L_TERM(5);
+#undef VPERM_L_TERM
+        w[k + 1] = x;
+    }
+
+    for (i = 0; i < 16; i++) {
+        s[i] = w[31 - i];
+    }
+}
+
+// the inverse steps, with b_i kept in w[k + i] and the new b_15 in w[k + 16]
+static VPERM_TARGET void VPERM(vperm_l_inv)(vperm_t* s) {
+    vperm_t w[32];
+    int i, k;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = s[i];
+    }
+
+    for (k = 0; k < 16; k++) {
+        vperm_t x = V_XOR(V_XOR(w[k], w[k + 7]), w[k + 9]);
+
+#define VPERM_L_INV_TERM(i) \
+        x = V_XOR(x, VPERM(vperm_mul)(V_XOR(w[k + 1 + (i)], w[k + 15 - (i)]), i))
+        x = V_XOR(x, VPERM(vperm_mul)(w[k + 8], 6));
+        VPERM_L_INV_TERM(0);
+        VPERM_L_INV_TERM(1);
+        VPERM_L_INV_TERM(2);
+        VPERM_L_INV_TERM(3);
+        VPERM_L_INV_TERM(4);
+        VPERM_L_INV_TERM(5);
+#undef VPERM_L_INV_TERM
+        w[k + 16] = x;
+    }
+
+    for (i = 0; i < 16; i++) {
+        s[i] = w[16 + i];
+    }
+}
+
+static VPERM_TARGET size_t VPERM(grasshopper_vperm_encrypt)(const grasshopper_round_keys_t* subkeys,
+                                                            const grasshopper_w128_t* source,
+                                                            grasshopper_w128_t* target, size_t blocks) {
+    size_t done;
+    vperm_t s[16];
+    int i;
+
+    for (done = 0; blocks - done >= VPERM_BATCH; done += VPERM_BATCH) {
+        V_LOAD_BATCH(s, source + done);
+        VPERM(vperm_transpose)(s);
+
+        for (i = 0; i < 9; i++) {
+            VPERM(vperm_add_key)(s, &subkeys->k[i]);
+            VPERM(vperm_sbox)(s, grasshopper_pi);
+            VPERM(vperm_l)(s);
+        }
+        VPERM(vperm_add_key)(s, &subkeys->k[9]);
+
+        VPERM(vperm_transpose)(s);
+        V_STORE_BATCH(target + done, s);
+    }
+
+    return done;
+}
+
+// takes the decryption schedule, with L^-1 applied to keys 1..9
+static VPERM_TARGET size_t VPERM(grasshopper_vperm_decrypt)(const grasshopper_round_keys_t* subkeys,
+                                                            const grasshopper_w128_t* source,
+                                                            grasshopper_w128_t* target, size_t blocks) {
+    size_t done;
+    vperm_t s[16];
+    int i;
+
+    for (done = 0; blocks - done >= VPERM_BATCH; done += VPERM_BATCH) {
+        V_LOAD_BATCH(s, source + done);
+        VPERM(vperm_transpose)(s);
+
+        VPERM(vperm_l_inv)(s);
+        for (i = 9; i > 1; i--) {
+            VPERM(vperm_add_key)(s, &subkeys->k[i]);
+            VPERM(vperm_sbox)(s, grasshopper_pi_inv);
+            VPERM(vperm_l_inv)(s);
+        }
+        VPERM(vperm_add_key)(s, &subkeys->k[1]);
+        VPERM(vperm_sbox)(s, grasshopper_pi_inv);
+        VPERM(vperm_add_key)(s, &subkeys->k[0]);
+
+        VPERM(vperm_transpose)(s);
+        V_STORE_BATCH(target + done, s);
+    }
+
+    return done;
+}
+
+#undef VPERM_BATCH
+#undef VPERM
+#undef VPERM_CAT
+#undef VPERM_CAT_
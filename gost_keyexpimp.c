@@ -8,11 +8,11 @@
 
 #include <string.h>
 #include <openssl/evp.h>
-#include <openssl/hmac.h>
 #include <openssl/buffer.h>
 
 #include "gost_lcl.h"
 #include "e_gost_err.h"
+#include "gosthash2012.h"
 
 static uint32_t be32(uint32_t host)
 {
@@ -204,56 +204,170 @@ int gost_kdftree2012_256(unsigned char *keyout, size_t keyout_len,
                          const unsigned char *seed, size_t seed_len,
                          const size_t representation)
 {
-    int iters, i = 0;
-    unsigned char zero = 0;
-    unsigned char *ptr = keyout;
-    HMAC_CTX *ctx;
-    unsigned char *len_ptr = NULL;
-    uint32_t len_repr = be32(keyout_len * 8);
-    size_t len_repr_len = 4;
-
-    ctx = HMAC_CTX_new();
-    if (ctx == NULL) {
-        GOSTerr(GOST_F_GOST_KDFTREE2012_256, ERR_R_MALLOC_FAILURE);
+    gost2012_hmac_ctx ctx;
+    int ret;
+
+    if ((keyout_len == 0) || (keyout_len % 32 != 0)) {
+        GOSTerr(GOST_F_GOST_KDFTREE2012_256, ERR_R_INTERNAL_ERROR);
         return 0;
     }
 
-    if ((keyout_len == 0) || (keyout_len % 32 != 0)) {
+    gost2012_hmac_init(&ctx, 256, key, keylen);
+    ret = gost_kdftree2012_256_keyed(&ctx, keyout, keyout_len, label,
+                                     label_len, seed, seed_len,
+                                     representation);
+    OPENSSL_cleanse(&ctx, sizeof(ctx));
+
+    return ret;
+}
+
+/*
+ * The blocks K(i) = HMAC(key, [i]_R | label | 0x00 | seed | [L]) differ
+ * only in i, so GOST2012_HASH_LANES of them are hashed side by side.
+ */
+int gost_kdftree2012_256_keyed(const gost2012_hmac_ctx *hmac,
+                               unsigned char *keyout, size_t keyout_len,
+                               const unsigned char *label, size_t label_len,
+                               const unsigned char *seed, size_t seed_len,
+                               const size_t representation)
+{
+    gost2012_hash_ctx lane[GOST2012_HASH_LANES];
+    gost2012_hash_ctx *plane[GOST2012_HASH_LANES];
+    unsigned char counter[GOST2012_HASH_LANES][4];
+    unsigned char block[GOST2012_HASH_LANES][32];
+    unsigned char *pblock[GOST2012_HASH_LANES];
+    const unsigned char *data[GOST2012_HASH_LANES];
+    const unsigned char zero = 0;
+    unsigned char len_repr[8];
+    size_t len_repr_len, iters, i, n, k;
+    uint64_t bits = (uint64_t)keyout_len * 8;
+
+    iters = (keyout_len + 31) / 32;
+    if (keyout_len == 0 || representation < 1 || representation > 4
+        || (representation < 4 && iters >> (8 * representation) != 0)) {
         GOSTerr(GOST_F_GOST_KDFTREE2012_256, ERR_R_INTERNAL_ERROR);
         return 0;
     }
-    iters = keyout_len / 32;
 
-    len_ptr = (unsigned char *)&len_repr;
-    while (*len_ptr == 0) {
-        len_ptr++;
-        len_repr_len--;
+    /* [L] is the bit length in as few bytes as it takes */
+    for (len_repr_len = 0; bits != 0; bits >>= 8)
+        len_repr[7 - len_repr_len++] = (unsigned char)bits;
+
+    for (i = 0; i < GOST2012_HASH_LANES; i++) {
+        plane[i] = &lane[i];
+        pblock[i] = block[i];
+    }
+
+    for (i = 0; i < iters; i += n) {
+        n = iters - i < GOST2012_HASH_LANES ? iters - i : GOST2012_HASH_LANES;
+
+        for (k = 0; k < n; k++) {
+            uint32_t iter_net = be32((uint32_t)(i + k + 1));
+
+            memcpy(counter[k], &iter_net, 4);
+            data[k] = counter[k] + 4 - representation;
+        }
+        gost2012_hmac_start_multi(hmac, plane, n);
+        gost2012_hash_block_multi(plane, data, representation, n);
+        for (k = 0; k < n; k++)
+            data[k] = label;
+        gost2012_hash_block_multi(plane, data, label_len, n);
+        for (k = 0; k < n; k++)
+            data[k] = &zero;
+        gost2012_hash_block_multi(plane, data, 1, n);
+        for (k = 0; k < n; k++)
+            data[k] = seed;
+        gost2012_hash_block_multi(plane, data, seed_len, n);
+        for (k = 0; k < n; k++)
+            data[k] = len_repr + 8 - len_repr_len;
+        gost2012_hash_block_multi(plane, data, len_repr_len, n);
+        gost2012_hmac_final_multi(hmac, plane, pblock, n);
+
+        for (k = 0; k < n; k++) {
+            size_t len = keyout_len - 32 * (i + k);
+
+            memcpy(keyout + 32 * (i + k), block[k], len < 32 ? len : 32);
+        }
+    }
+
+    OPENSSL_cleanse(lane, sizeof(lane));
+    OPENSSL_cleanse(block, sizeof(block));
+
+    return 1;
+}
+
+/*
+ * The blocks T(i) of PBKDF2 are independent chains of iter HMACs, so
+ * GOST2012_HASH_LANES of them are hashed side by side. Every HMAC starts
+ * from the key states in hmac.
+ */
+int gost_pbkdf2_hmac2012_keyed(const gost2012_hmac_ctx *hmac,
+                               const unsigned char *salt, size_t salt_len,
+                               uint64_t iter, unsigned char *keyout,
+                               size_t keyout_len)
+{
+    gost2012_hash_ctx lane[GOST2012_HASH_LANES];
+    gost2012_hash_ctx *plane[GOST2012_HASH_LANES];
+    unsigned char counter[GOST2012_HASH_LANES][4];
+    unsigned char u[GOST2012_HASH_LANES][64];
+    unsigned char t[GOST2012_HASH_LANES][64];
+    unsigned char *pu[GOST2012_HASH_LANES];
+    const unsigned char *data[GOST2012_HASH_LANES];
+    size_t dlen = hmac->ipad.digest_size / 8;
+    size_t blocks, i, n, k, j;
+    uint64_t c;
+
+    blocks = (keyout_len + dlen - 1) / dlen;
+    if (keyout_len == 0 || iter == 0 || blocks > 0xFFFFFFFF) {
+        GOSTerr(GOST_F_GOST_PBKDF2_HMAC2012, ERR_R_PASSED_INVALID_ARGUMENT);
+        return 0;
+    }
+
+    for (i = 0; i < GOST2012_HASH_LANES; i++) {
+        plane[i] = &lane[i];
+        pu[i] = u[i];
     }
 
-    for (i = 1; i <= iters; i++) {
-        uint32_t iter_net = be32(i);
-        unsigned char *rep_ptr =
-            ((unsigned char *)&iter_net) + (4 - representation);
-
-        if (HMAC_Init_ex(ctx, key, keylen,
-                         EVP_get_digestbynid(NID_id_GostR3411_2012_256),
-                         NULL) <= 0
-            || HMAC_Update(ctx, rep_ptr, representation) <= 0
-            || HMAC_Update(ctx, label, label_len) <= 0
-            || HMAC_Update(ctx, &zero, 1) <= 0
-            || HMAC_Update(ctx, seed, seed_len) <= 0
-            || HMAC_Update(ctx, len_ptr, len_repr_len) <= 0
-            || HMAC_Final(ctx, ptr, NULL) <= 0) {
-            GOSTerr(GOST_F_GOST_KDFTREE2012_256, ERR_R_INTERNAL_ERROR);
-            HMAC_CTX_free(ctx);
-            return 0;
+    for (i = 0; i < blocks; i += n) {
+        n = blocks - i < GOST2012_HASH_LANES ? blocks - i : GOST2012_HASH_LANES;
+
+        /* U(1) = HMAC(P, S | INT(i)) */
+        for (k = 0; k < n; k++) {
+            uint32_t block_net = be32((uint32_t)(i + k + 1));
+
+            memcpy(counter[k], &block_net, 4);
+            data[k] = salt;
+        }
+        gost2012_hmac_start_multi(hmac, plane, n);
+        gost2012_hash_block_multi(plane, data, salt_len, n);
+        for (k = 0; k < n; k++)
+            data[k] = counter[k];
+        gost2012_hash_block_multi(plane, data, 4, n);
+        gost2012_hmac_final_multi(hmac, plane, pu, n);
+        memcpy(t, u, sizeof(t));
+
+        /* U(c) = HMAC(P, U(c - 1)), T = U(1) ^ ... ^ U(iter) */
+        for (k = 0; k < n; k++)
+            data[k] = u[k];
+        for (c = 1; c < iter; c++) {
+            gost2012_hmac_start_multi(hmac, plane, n);
+            gost2012_hash_block_multi(plane, data, dlen, n);
+            gost2012_hmac_final_multi(hmac, plane, pu, n);
+            for (k = 0; k < n; k++)
+                for (j = 0; j < dlen; j++)
+                    t[k][j] ^= u[k][j];
         }
 
-        HMAC_CTX_reset(ctx);
-        ptr += 32;
+        for (k = 0; k < n; k++) {
+            size_t len = keyout_len - dlen * (i + k);
+
+            memcpy(keyout + dlen * (i + k), t[k], len < dlen ? len : dlen);
+        }
     }
 
-    HMAC_CTX_free(ctx);
+    OPENSSL_cleanse(lane, sizeof(lane));
+    OPENSSL_cleanse(u, sizeof(u));
+    OPENSSL_cleanse(t, sizeof(t));
 
     return 1;
 }
@@ -261,25 +375,39 @@ int gost_kdftree2012_256(unsigned char *keyout, size_t keyout_len,
 int gost_tlstree(int cipher_nid, const unsigned char *in, unsigned char *out,
                  const unsigned char *tlsseq)
 {
-    uint64_t gh_c1 = 0x00000000FFFFFFFF, gh_c2 = 0x0000F8FFFFFFFFFF,
-        gh_c3 = 0xC0FFFFFFFFFFFFFF;
-    uint64_t mg_c1 = 0x00000000C0FFFFFF, mg_c2 = 0x000000FEFFFFFFFF,
-        mg_c3 = 0x00F0FFFFFFFFFFFF;
-    uint64_t c1, c2, c3;
-    uint64_t seed1, seed2, seed3;
+    gost_tlstree_cache cache;
+    int ret;
+
+    cache.levels = 0;
+    ret = gost_tlstree_cached(cipher_nid, in, out, tlsseq, &cache);
+    OPENSSL_cleanse(&cache, sizeof(cache));
+
+    return ret > 0;
+}
+
+int gost_tlstree_cached(int cipher_nid, const unsigned char *in,
+                        unsigned char *out, const unsigned char *tlsseq,
+                        gost_tlstree_cache *cache)
+{
+    static const uint64_t gh_c[3] = {
+        0x00000000FFFFFFFF, 0x0000F8FFFFFFFFFF, 0xC0FFFFFFFFFFFFFF
+    };
+    static const uint64_t mg_c[3] = {
+        0x00000000C0FFFFFF, 0x000000FEFFFFFFFF, 0x00F0FFFFFFFFFFFF
+    };
+    static const char *const labels[3] = { "level1", "level2", "level3" };
+    const uint64_t *c;
+    const unsigned char *key = in;
+    uint64_t seed;
     uint64_t seq;
-    unsigned char ko1[32], ko2[32];
+    int i, changed = 0;
 
     switch (cipher_nid) {
     case NID_magma_cbc:
-        c1 = mg_c1;
-        c2 = mg_c2;
-        c3 = mg_c3;
+        c = mg_c;
         break;
     case NID_grasshopper_cbc:
-        c1 = gh_c1;
-        c2 = gh_c2;
-        c3 = gh_c3;
+        c = gh_c;
         break;
     default:
         return 0;
@@ -289,19 +417,25 @@ int gost_tlstree(int cipher_nid, const unsigned char *in, unsigned char *out,
 #else
     memcpy(&seq, tlsseq, 8);
 #endif
-    seed1 = seq & c1;
-    seed2 = seq & c2;
-    seed3 = seq & c3;
-
-    if (gost_kdftree2012_256(ko1, 32, in, 32, (const unsigned char *)"level1", 6,
-                         (const unsigned char *)&seed1, 8, 1) <= 0
-			  || gost_kdftree2012_256(ko2, 32, ko1, 32, (const unsigned char *)"level2", 6,
-                         (const unsigned char *)&seed2, 8, 1) <= 0
-        || gost_kdftree2012_256(out, 32, ko2, 32, (const unsigned char *)"level3", 6,
-                         (const unsigned char *)&seed3, 8, 1) <= 0)
-			return 0;
 
-    return 1;
+    /* A new key of a level invalidates the levels below it */
+    for (i = 0; i < 3; i++) {
+        seed = seq & c[i];
+        if (i >= cache->levels || seed != cache->seed[i]) {
+            cache->levels = i;
+            if (gost_kdftree2012_256(cache->key[i], 32, key, 32,
+                                     (const unsigned char *)labels[i], 6,
+                                     (const unsigned char *)&seed, 8, 1) <= 0)
+                return 0;
+            cache->seed[i] = seed;
+            cache->levels = i + 1;
+            changed = 1;
+        }
+        key = cache->key[i];
+    }
+    memcpy(out, cache->key[2], 32);
+
+    return changed ? 1 : 2;
 }
 
 #define GOST_WRAP_FLAGS  EVP_CIPH_CTRL_INIT | EVP_CIPH_WRAP_MODE | EVP_CIPH_CUSTOM_IV | EVP_CIPH_FLAG_CUSTOM_CIPHER | EVP_CIPH_FLAG_DEFAULT_ASN1
@@ -18,15 +18,27 @@
 # include <openssl/engine.h>
 # include <openssl/ec.h>
 # include "gost89.h"
+# include "gost-engine.h"
 # include "gosthash.h"
+# include "gost_mgm128.h"
 /* Control commands */
 # define GOST_PARAM_CRYPT_PARAMS 0
 # define GOST_PARAM_PBE_PARAMS 1
 # define GOST_PARAM_PK_FORMAT 2
-# define GOST_PARAM_MAX 3
+# define GOST_PARAM_KUZNYECHIK_BULK 3
+# define GOST_PARAM_MAX 4
 # define GOST_CTRL_CRYPT_PARAMS (ENGINE_CMD_BASE+GOST_PARAM_CRYPT_PARAMS)
 # define GOST_CTRL_PBE_PARAMS   (ENGINE_CMD_BASE+GOST_PARAM_PBE_PARAMS)
 # define GOST_CTRL_PK_FORMAT   (ENGINE_CMD_BASE+GOST_PARAM_PK_FORMAT)
+# define GOST_CTRL_KUZNYECHIK_BULK (ENGINE_CMD_BASE+GOST_PARAM_KUZNYECHIK_BULK)
+/* Commands past the parameters act instead of setting a value */
+# define GOST_CTRL_SIGN_POOL (ENGINE_CMD_BASE+GOST_PARAM_MAX+1)
+# define GOST_CTRL_SIGN_POOL_THREAD (ENGINE_CMD_BASE+GOST_PARAM_MAX+2)
+# define GOST_CTRL_SIGN_POOL_PRECOMPUTE (ENGINE_CMD_BASE+GOST_PARAM_MAX+3)
+# define GOST_CTRL_SIGN_POOL_STATS (ENGINE_CMD_BASE+GOST_PARAM_MAX+4)
+# define GOST_CTRL_VERIFY_BATCH (ENGINE_CMD_BASE+GOST_PARAM_MAX+5)
+# define GOST_CTRL_VERIFY_CACHE (ENGINE_CMD_BASE+GOST_PARAM_MAX+6)
+# define GOST_CTRL_DIGEST_VERIFY_BATCH (ENGINE_CMD_BASE+GOST_PARAM_MAX+7)
 
 typedef struct R3410_ec {
     int nid;
@@ -49,6 +61,7 @@ extern const ENGINE_CMD_DEFN gost_cmds[];
 int gost_control_func(ENGINE *e, int cmd, long i, void *p, void (*f) (void));
 const char *get_gost_engine_param(int param);
 int gost_set_default_param(int param, const char *value);
+int gost_kuznyechik_constant_time(void);
 void gost_param_free(void);
 
 /* method registration */
@@ -56,6 +69,7 @@ void gost_param_free(void);
 /* Provider implementation data */
 extern const OSSL_ALGORITHM GOST_prov_macs[];
 void GOST_prov_deinit_mac_digests(void);
+extern const OSSL_ALGORITHM GOST_prov_kdfs[];
 
 int register_ameth_gost(int nid, EVP_PKEY_ASN1_METHOD **ameth,
                         const char *pemstr, const char *info);
@@ -205,6 +219,16 @@ struct ossl_gost_digest_ctx {
     gost_hash_ctx dctx;
     gost_ctx cctx;
 };
+/*
+ * TLSTREE keys of the last record. Consecutive records mostly share the
+ * masked sequence numbers, so only the levels below the first changed seed
+ * are derived again.
+ */
+typedef struct {
+    int levels;                 /* valid levels, 0 after the key changed */
+    uint64_t seed[3];
+    unsigned char key[3][32];
+} gost_tlstree_cache;
 /* Cipher context used for EVP_CIPHER operation */
 struct ossl_gost_cipher_ctx {
     int paramNID;
@@ -214,6 +238,16 @@ struct ossl_gost_cipher_ctx {
     unsigned char tag[8];
     gost_ctx cctx;
     EVP_MD_CTX *omac_ctx;
+    gost_tlstree_cache tlstree;
+};
+/* Cipher context used for Magma in MGM mode */
+struct ossl_gost_mgm_ctx {
+    gost_ctx cctx;
+    mgm128_context mgm;
+    int key_set;
+    int iv_set;                 /* cleared by the final call */
+    int taglen;                 /* 0 while there is no tag */
+    unsigned char tag[8];
 };
 /* Structure to map parameter NID to S-block */
 struct gost_cipher_info {
@@ -239,6 +273,9 @@ void inc_counter(unsigned char *counter, size_t counter_bytes);
 
 # define EVP_MD_CTRL_KEY_LEN (EVP_MD_CTRL_ALG_CTRL+3)
 # define EVP_MD_CTRL_SET_KEY (EVP_MD_CTRL_ALG_CTRL+4)
+/* Streebog state export/import, see gost2012_hash_export */
+# define EVP_MD_CTRL_GET_STATE (EVP_MD_CTRL_ALG_CTRL+5)
+# define EVP_MD_CTRL_SET_STATE (EVP_MD_CTRL_ALG_CTRL+6)
 /* EVP_PKEY_METHOD key encryption callbacks */
 /* From gost_ec_keyx.c */
 int pkey_gost_encrypt(EVP_PKEY_CTX *pctx, unsigned char *out,
@@ -257,6 +294,14 @@ int gost_ec_keygen(EC_KEY *ec);
 ECDSA_SIG *gost_ec_sign(const unsigned char *dgst, int dlen, EC_KEY *eckey);
 int gost_ec_verify(const unsigned char *dgst, int dgst_len,
                    ECDSA_SIG *sig, EC_KEY *ec);
+/* 1 if all n signatures are good, each item's result is set */
+int gost_ec_verify_batch(GOST_VERIFY_BATCH_ITEM *items, size_t n);
+/* The same with messages to be digested as tbs */
+int gost_ec_digest_verify_batch(GOST_VERIFY_BATCH_ITEM *items, size_t n);
+ECDSA_SIG *unpack_cp_signature(const unsigned char *sigbuf, size_t siglen);
+/* Verifications with a public key before it gets a table, 0 disables */
+int gost_ec_verify_cache_set(long uses);
+void gost_ec_verify_cache_free(void);
 int gost_ec_compute_public(EC_KEY *ec);
 int gost_ec_point_mul(const EC_GROUP *group, EC_POINT *r, const BIGNUM *n,
                       const EC_POINT *q, const BIGNUM *m, BN_CTX *ctx);
@@ -264,7 +309,13 @@ int gost_ec_point_mul(const EC_GROUP *group, EC_POINT *r, const BIGNUM *n,
 #define CURVEDEF(a) \
 int point_mul_##a(const EC_GROUP *group, EC_POINT *r, const EC_POINT *q, const BIGNUM *m, BN_CTX *ctx);\
 int point_mul_g_##a(const EC_GROUP *group, EC_POINT *r, const BIGNUM *n, BN_CTX *ctx);\
-int point_mul_two_##a(const EC_GROUP *group, EC_POINT *r, const BIGNUM *n, const EC_POINT *q, const BIGNUM *m, BN_CTX *ctx);
+int point_mul_two_##a(const EC_GROUP *group, EC_POINT *r, const BIGNUM *n, const EC_POINT *q, const BIGNUM *m, BN_CTX *ctx);\
+void point_mul_raw_##a(unsigned char *outx, unsigned char *outy, const unsigned char *m, const unsigned char *inx, const unsigned char *iny);\
+void point_mul_g_raw_##a(unsigned char *outx, unsigned char *outy, const unsigned char *n);\
+void point_mul_two_raw_##a(unsigned char *outx, unsigned char *outy, const unsigned char *n, const unsigned char *m, const unsigned char *inx, const unsigned char *iny);\
+void point_mul_two_batch_raw_##a(size_t count, unsigned char *outx, unsigned char *outy, const unsigned char *n, const unsigned char *m, const unsigned char *inx, const unsigned char *iny);\
+void *point_table_new_raw_##a(const unsigned char *inx, const unsigned char *iny);\
+void point_mul_two_table_raw_##a(unsigned char *outx, unsigned char *outy, const unsigned char *n, const unsigned char *m, const void *table);
 
 CURVEDEF(id_GostR3410_2001_CryptoPro_A_ParamSet)
 CURVEDEF(id_GostR3410_2001_CryptoPro_B_ParamSet)
@@ -275,6 +326,93 @@ CURVEDEF(id_tc26_gost_3410_2012_512_paramSetA)
 CURVEDEF(id_tc26_gost_3410_2012_512_paramSetB)
 CURVEDEF(id_tc26_gost_3410_2012_512_paramSetC)
 
+/*
+ * Raw GOST R 34.10 operations for the curves above. Scalars, coordinates
+ * and signature halves are little-endian byte strings of
+ * gost_ec_raw_size() bytes.
+ */
+typedef struct gost_ec_raw_curve GOST_EC_RAW_CURVE;
+const GOST_EC_RAW_CURVE *gost_ec_raw_curve(int nid);
+size_t gost_ec_raw_size(const GOST_EC_RAW_CURVE *curve);
+# define GOST_EC_RAW_CURVES 8
+int gost_ec_raw_index(const GOST_EC_RAW_CURVE *curve);
+/* A random k in [1, q - 1] and r = (k * P).x mod q, both non-zero */
+int gost_ec_raw_pair(const GOST_EC_RAW_CURVE *curve, unsigned char *k,
+                     unsigned char *r);
+/* 1 if 0 < a < q */
+int gost_ec_raw_check_scalar(const GOST_EC_RAW_CURVE *curve,
+                             const unsigned char *a);
+int gost_ec_raw_sign(const GOST_EC_RAW_CURVE *curve, unsigned char *r,
+                     unsigned char *s, const unsigned char *priv,
+                     const unsigned char *dgst, size_t dgst_len);
+/* Affine coordinates of a point of the group, 0 at infinity */
+int gost_ec_raw_point(const GOST_EC_RAW_CURVE *curve, const EC_GROUP *group,
+                      const EC_POINT *point, unsigned char *x,
+                      unsigned char *y);
+/* r and s must have passed gost_ec_raw_check_scalar */
+int gost_ec_raw_verify(const GOST_EC_RAW_CURVE *curve,
+                       const unsigned char *r, const unsigned char *s,
+                       const unsigned char *pub_x, const unsigned char *pub_y,
+                       const unsigned char *dgst, size_t dgst_len);
+typedef struct {
+    const unsigned char *dgst;
+    size_t dgst_len;
+    const unsigned char *r, *s, *pub_x, *pub_y;
+} GOST_EC_RAW_VERIFY;
+/*
+ * Comb table of a public point, which makes its verifications cost about
+ * as much as signing. NULL on malloc failure, else free with OPENSSL_free.
+ */
+void *gost_ec_raw_table_new(const GOST_EC_RAW_CURVE *curve,
+                            const unsigned char *pub_x,
+                            const unsigned char *pub_y);
+int gost_ec_raw_verify_table(const GOST_EC_RAW_CURVE *curve,
+                             const unsigned char *r, const unsigned char *s,
+                             const void *table,
+                             const unsigned char *dgst, size_t dgst_len);
+/* Sets ok[i] for each item as gost_ec_raw_verify would, 0 on malloc failure */
+int gost_ec_raw_verify_batch(const GOST_EC_RAW_CURVE *curve,
+                             const GOST_EC_RAW_VERIFY *items, size_t n,
+                             int *ok);
+/* (ukm * priv) * pub */
+int gost_ec_raw_derive(const GOST_EC_RAW_CURVE *curve,
+                       unsigned char *out_x, unsigned char *out_y,
+                       const unsigned char *priv,
+                       const unsigned char *ukm, size_t ukm_len,
+                       const unsigned char *pub_x, const unsigned char *pub_y);
+
+/*
+ * AVX-512 IFMA code for the 512-bit curves: as point_mul_two_batch_raw_*,
+ * eight points at a time. Returns how many of the first points it did,
+ * 0 if the CPU lacks IFMA; the caller does the rest. For verification
+ * only: the table lookups depend on a and b. A call costs more than one
+ * point_mul_two_raw_*, so single verifications do not come here.
+ */
+typedef struct gost_ec_ifma_curve GOST_EC_IFMA_CURVE;
+extern const GOST_EC_IFMA_CURVE gost_ec_ifma_512_a, gost_ec_ifma_512_b,
+    gost_ec_ifma_512_c;
+size_t gost_ec_ifma_mul_two_batch(const GOST_EC_IFMA_CURVE *curve, size_t n,
+                                  unsigned char *outx, unsigned char *outy,
+                                  const unsigned char *a,
+                                  const unsigned char *b,
+                                  const unsigned char *inx,
+                                  const unsigned char *iny);
+
+/*
+ * Pools of precomputed (k, r) pairs for gost_ec_raw_sign, one per curve,
+ * kept in secure memory and wiped in the child after fork
+ */
+int gost_ec_pool_take(const GOST_EC_RAW_CURVE *curve, unsigned char *k,
+                      unsigned char *r);
+int gost_ec_pool_set_capacity(long capacity);
+int gost_ec_pool_set_thread(long on);
+/* "curve:count", curve by name or OID */
+int gost_ec_pool_precompute(const char *arg);
+/* capacity, available, hits, misses, generated */
+# define GOST_EC_POOL_STATS 5
+int gost_ec_pool_stats(int nid, long *stats);
+void gost_ec_pool_free(void);
+
 /* VKO */
 int VKO_compute_key(unsigned char *shared_key,
                     const EC_POINT *pub_key, const EC_KEY *priv_key,
@@ -287,9 +425,31 @@ int gost_kdftree2012_256(unsigned char *keyout, size_t keyout_len,
                          const unsigned char *label, size_t label_len,
                          const unsigned char *seed, size_t seed_len,
                          const size_t representation);
+/*
+ * The same with the HMAC key already set in hmac, for deriving repeatedly
+ * from one key. keyout_len need not be a multiple of 32.
+ */
+struct gost2012_hmac_ctx;
+int gost_kdftree2012_256_keyed(const struct gost2012_hmac_ctx *hmac,
+                               unsigned char *keyout, size_t keyout_len,
+                               const unsigned char *label, size_t label_len,
+                               const unsigned char *seed, size_t seed_len,
+                               const size_t representation);
+/* PBKDF2 (RFC 8018) with the HMAC-Streebog password key set in hmac */
+int gost_pbkdf2_hmac2012_keyed(const struct gost2012_hmac_ctx *hmac,
+                               const unsigned char *salt, size_t salt_len,
+                               uint64_t iter, unsigned char *keyout,
+                               size_t keyout_len);
 
 int gost_tlstree(int cipher_nid, const unsigned char *in, unsigned char *out,
                  const unsigned char *tlsseq);
+/*
+ * gost_tlstree() reusing the level keys kept in cache for the same key in.
+ * Returns 2 when out is the key of the previous call, 1 when it is new.
+ */
+int gost_tlstree_cached(int cipher_nid, const unsigned char *in,
+                        unsigned char *out, const unsigned char *tlsseq,
+                        gost_tlstree_cache *cache);
 /* KExp/KImp */
 int gost_kexp15(const unsigned char *shared_key, const int shared_len,
                 int cipher_nid, const unsigned char *cipher_key,
@@ -341,6 +501,19 @@ typedef struct gost_cipher_st GOST_cipher;
 EVP_CIPHER *GOST_init_cipher(GOST_cipher *c);
 void GOST_deinit_cipher(GOST_cipher *c);
 
+/*
+ * Names of algorithms OpenSSL has no objects for yet, their NIDs are
+ * created at load time.
+ */
+# ifndef SN_kuznyechik_mgm
+#  define SN_kuznyechik_mgm "kuznyechik-mgm"
+#  define LN_kuznyechik_mgm "kuznyechik-mgm"
+# endif
+# ifndef SN_magma_mgm
+#  define SN_magma_mgm "magma-mgm"
+#  define LN_magma_mgm "magma-mgm"
+# endif
+
 /* ENGINE implementation data */
 extern GOST_cipher Gost28147_89_cipher;
 extern GOST_cipher Gost28147_89_cbc_cipher;
@@ -349,6 +522,7 @@ extern GOST_cipher Gost28147_89_cnt_12_cipher;
 extern GOST_cipher magma_ctr_cipher;
 extern GOST_cipher magma_ctr_acpkm_cipher;
 extern GOST_cipher magma_ctr_acpkm_omac_cipher;
+extern GOST_cipher magma_mgm_cipher;
 extern GOST_cipher magma_ecb_cipher;
 extern GOST_cipher magma_cbc_cipher;
 extern GOST_cipher grasshopper_ecb_cipher;
@@ -358,6 +532,7 @@ extern GOST_cipher grasshopper_ofb_cipher;
 extern GOST_cipher grasshopper_ctr_cipher;
 extern GOST_cipher grasshopper_ctr_acpkm_cipher;
 extern GOST_cipher grasshopper_ctr_acpkm_omac_cipher;
+extern GOST_cipher grasshopper_mgm_cipher;
 extern GOST_cipher magma_kexp15_cipher;
 extern GOST_cipher kuznyechik_kexp15_cipher;
 
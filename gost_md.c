@@ -82,9 +82,8 @@ static int gost_digest_init(EVP_MD_CTX *ctx)
 {
     struct ossl_gost_digest_ctx *c = EVP_MD_CTX_md_data(ctx);
     memset(&(c->dctx), 0, sizeof(gost_hash_ctx));
-    gost_init(&(c->cctx), &GostR3411_94_CryptoProParamSet);
     c->dctx.cipher_ctx = &(c->cctx);
-    return 1;
+    return gost_init(&(c->cctx), &GostR3411_94_CryptoProParamSet);
 }
 
 static int gost_digest_update(EVP_MD_CTX *ctx, const void *data, size_t count)
@@ -13,6 +13,7 @@
 #include <openssl/evp.h>
 #include "gosthash2012.h"
 #include "gost_lcl.h"
+#include "e_gost_err.h"
 
 static int gost_digest_init512(EVP_MD_CTX *ctx);
 static int gost_digest_init256(EVP_MD_CTX *ctx);
@@ -100,9 +101,48 @@ static int gost_digest_cleanup(EVP_MD_CTX *ctx)
     return 1;
 }
 
+/*
+ * EVP_MD_CTRL_GET_STATE writes the serialized state to the arg bytes at
+ * ptr, or with ptr NULL returns its size. EVP_MD_CTRL_SET_STATE restores
+ * the arg bytes at ptr into an initialized context of the same digest.
+ */
+static int gost_digest_state_ctrl(EVP_MD_CTX *ctx, int type, int arg,
+                                  void *ptr, unsigned int digest_size)
+{
+    gost2012_hash_ctx *c = EVP_MD_CTX_md_data(ctx);
+    gost2012_hash_ctx tmp;
+
+    if (c == NULL)
+        return 0;
+
+    if (type == EVP_MD_CTRL_GET_STATE) {
+        if (ptr == NULL)
+            return GOST2012_HASH_STATE_SIZE;
+        if (arg < GOST2012_HASH_STATE_SIZE) {
+            GOSTerr(GOST_F_GOST_DIGEST_STATE_CTRL, GOST_R_INVALID_BUFFER_SIZE);
+            return 0;
+        }
+        gost2012_hash_export(c, ptr);
+        return 1;
+    }
+
+    if (ptr == NULL || arg < 0
+        || !gost2012_hash_import(&tmp, ptr, (size_t)arg)
+        || tmp.digest_size != digest_size) {
+        GOSTerr(GOST_F_GOST_DIGEST_STATE_CTRL, GOST_R_INVALID_DIGEST_STATE);
+        return 0;
+    }
+    memcpy(c, &tmp, sizeof(tmp));
+    OPENSSL_cleanse(&tmp, sizeof(tmp));
+    return 1;
+}
+
 static int gost_digest_ctrl_256(EVP_MD_CTX *ctx, int type, int arg, void *ptr)
 {
     switch (type) {
+    case EVP_MD_CTRL_GET_STATE:
+    case EVP_MD_CTRL_SET_STATE:
+        return gost_digest_state_ctrl(ctx, type, arg, ptr, 256);
     case EVP_MD_CTRL_MICALG:
         {
             *((char **)ptr) = OPENSSL_malloc(strlen(micalg_256) + 1);
@@ -120,6 +160,9 @@ static int gost_digest_ctrl_256(EVP_MD_CTX *ctx, int type, int arg, void *ptr)
 static int gost_digest_ctrl_512(EVP_MD_CTX *ctx, int type, int arg, void *ptr)
 {
     switch (type) {
+    case EVP_MD_CTRL_GET_STATE:
+    case EVP_MD_CTRL_SET_STATE:
+        return gost_digest_state_ctrl(ctx, type, arg, ptr, 512);
     case EVP_MD_CTRL_MICALG:
         {
             *((char **)ptr) = OPENSSL_malloc(strlen(micalg_512) + 1);
@@ -0,0 +1,405 @@
+/**********************************************************************
+ *                         gost_mgm128.c                              *
+ *       Multilinear Galois Mode (MGM) of block cipher operation      *
+ *                                                                    *
+ *       This file is distributed under the same license as OpenSSL   *
+ *                                                                    *
+ * Implementation of the AEAD mode defined in R 1323565.1.026-2019    *
+ * (RFC 9058) for 64-bit (Magma) and 128-bit (Kuznyechik) ciphers.    *
+ * Doesn't need OpenSSL                                               *
+ **********************************************************************/
+#include <string.h>
+#include "gost_mgm128.h"
+#include "gost_cpu.h"
+
+#ifdef GOST_X86_DISPATCH
+# include <immintrin.h>
+#endif
+
+/*-
+ * Blocks are big-endian integers representing polynomials over GF(2):
+ * the most significant bit of the first byte is the coefficient at
+ * x^(n-1). Products are taken modulo
+ *   x^128 + x^7 + x^2 + x + 1 for n = 128,
+ *   x^64 + x^4 + x^3 + x + 1  for n = 64.
+ *
+ * Since the tag only depends on the sum of the products, the sum is
+ * kept as a 2n-bit polynomial and reduced once per message.
+ */
+
+static uint64_t load_be64(const unsigned char *p)
+{
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48)
+        | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32)
+        | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16)
+        | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+static void store_be64(unsigned char *p, uint64_t v)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--, v >>= 8)
+        p[i] = (unsigned char)v;
+}
+
+/* Constant-time carry-less 64x64 -> 128 bit multiplication */
+static void clmul64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo)
+{
+    uint64_t h = 0, l = a & (0 - (b & 1));
+    int i;
+
+    for (i = 1; i < 64; i++) {
+        uint64_t m = 0 - ((b >> i) & 1);
+
+        l ^= (a << i) & m;
+        h ^= (a >> (64 - i)) & m;
+    }
+    *hi = h;
+    *lo = l;
+}
+
+static void mgm_mul_acc64(uint64_t *sum, const unsigned char *h,
+                          const unsigned char *x)
+{
+    uint64_t hi, lo;
+
+    clmul64(load_be64(h), load_be64(x), &hi, &lo);
+    sum[0] ^= lo;
+    sum[1] ^= hi;
+}
+
+/* Karatsuba: three 64-bit products per 128-bit one */
+static void mgm_mul_acc128(uint64_t *sum, const unsigned char *h,
+                           const unsigned char *x)
+{
+    uint64_t a1 = load_be64(h), a0 = load_be64(h + 8);
+    uint64_t b1 = load_be64(x), b0 = load_be64(x + 8);
+    uint64_t l1, l0, h1, h0, m1, m0;
+
+    clmul64(a0, b0, &l1, &l0);
+    clmul64(a1, b1, &h1, &h0);
+    clmul64(a0 ^ a1, b0 ^ b1, &m1, &m0);
+    m0 ^= l0 ^ h0;
+    m1 ^= l1 ^ h1;
+
+    sum[0] ^= l0;
+    sum[1] ^= l1 ^ m0;
+    sum[2] ^= h0 ^ m1;
+    sum[3] ^= h1;
+}
+
+#ifdef GOST_X86_DISPATCH
+GOST_TARGET("pclmul")
+static void mgm_mul_acc64_clmul(uint64_t *sum, const unsigned char *h,
+                                const unsigned char *x)
+{
+    __m128i a = _mm_set_epi64x(0, (long long)load_be64(h));
+    __m128i b = _mm_set_epi64x(0, (long long)load_be64(x));
+    __m128i s = _mm_loadu_si128((const __m128i *)sum);
+
+    s = _mm_xor_si128(s, _mm_clmulepi64_si128(a, b, 0x00));
+    _mm_storeu_si128((__m128i *)sum, s);
+}
+
+GOST_TARGET("pclmul")
+static void mgm_mul_acc128_clmul(uint64_t *sum, const unsigned char *h,
+                                 const unsigned char *x)
+{
+    __m128i a = _mm_set_epi64x((long long)load_be64(h),
+                               (long long)load_be64(h + 8));
+    __m128i b = _mm_set_epi64x((long long)load_be64(x),
+                               (long long)load_be64(x + 8));
+    __m128i lo = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(a, b, 0x11);
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x01),
+                                _mm_clmulepi64_si128(a, b, 0x10));
+
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+    lo = _mm_xor_si128(lo, _mm_loadu_si128((const __m128i *)sum));
+    hi = _mm_xor_si128(hi, _mm_loadu_si128((const __m128i *)(sum + 2)));
+    _mm_storeu_si128((__m128i *)sum, lo);
+    _mm_storeu_si128((__m128i *)(sum + 2), hi);
+}
+#endif
+
+/* Reduces the accumulated sum and stores it as a big-endian block */
+static void mgm_reduce(const mgm128_context *ctx, unsigned char *out)
+{
+    const uint64_t *s = ctx->sum;
+
+    if (ctx->blocklen == 16) {
+        /* x^128 = x^7 + x^2 + x + 1, twice to fold the overflow */
+        uint64_t ov = (s[3] >> 63) ^ (s[3] >> 62) ^ (s[3] >> 57);
+        uint64_t r1 = s[1] ^ s[3] ^ (s[3] << 1) ^ (s[3] << 2) ^ (s[3] << 7)
+            ^ (s[2] >> 63) ^ (s[2] >> 62) ^ (s[2] >> 57);
+        uint64_t r0 = s[0] ^ s[2] ^ (s[2] << 1) ^ (s[2] << 2) ^ (s[2] << 7)
+            ^ ov ^ (ov << 1) ^ (ov << 2) ^ (ov << 7);
+
+        store_be64(out, r1);
+        store_be64(out + 8, r0);
+    } else {
+        /* x^64 = x^4 + x^3 + x + 1 */
+        uint64_t ov = (s[1] >> 63) ^ (s[1] >> 61) ^ (s[1] >> 60);
+        uint64_t r0 = s[0] ^ s[1] ^ (s[1] << 1) ^ (s[1] << 3) ^ (s[1] << 4)
+            ^ ov ^ (ov << 1) ^ (ov << 3) ^ (ov << 4);
+
+        store_be64(out, r0);
+    }
+}
+
+/* Increments big-endian counter bytes [from, to) modulo 2^(8*(to-from)) */
+static void mgm_incr(unsigned char *ctr, int from, int to)
+{
+    int n = to;
+
+    do {
+        --n;
+        if (++ctr[n])
+            return;
+    } while (n > from);
+}
+
+/* Lengths are encoded in n/2 bits, so each must stay below 2^(n/2) bits */
+static uint64_t mgm_max_len(const mgm128_context *ctx)
+{
+    return (uint64_t)1 << (ctx->blocklen * 4 - 3);
+}
+
+/* sum += E_K(Z_i) * X_i, Z_{i+1} = incr_l(Z_i) */
+static void mgm_auth_block(mgm128_context *ctx, const unsigned char *x)
+{
+    mgm_block_t H;
+
+    ctx->block(ctx->Z.c, H.c, ctx->key);
+    mgm_incr(ctx->Z.c, 0, ctx->blocklen / 2);
+    ctx->mul_acc(ctx->sum, H.c, x);
+}
+
+/* Authenticates the zero padded partial block in ACi, if any */
+static void mgm_auth_partial(mgm128_context *ctx, unsigned int *res)
+{
+    if (*res == 0)
+        return;
+    memset(ctx->ACi.c + *res, 0, ctx->blocklen - *res);
+    mgm_auth_block(ctx, ctx->ACi.c);
+    *res = 0;
+}
+
+/* EKi = E_K(Y_i), Y_{i+1} = incr_r(Y_i) */
+static void mgm_next_keystream(mgm128_context *ctx)
+{
+    ctx->block(ctx->Y.c, ctx->EKi.c, ctx->key);
+    mgm_incr(ctx->Y.c, ctx->blocklen / 2, ctx->blocklen);
+}
+
+void gost_mgm128_init(mgm128_context *ctx, void *key, mgm_block_f block,
+                      int blocklen)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->blocklen = blocklen;
+    ctx->block = block;
+    ctx->key = key;
+    ctx->mul_acc = blocklen == 16 ? mgm_mul_acc128 : mgm_mul_acc64;
+#ifdef GOST_X86_DISPATCH
+    if (gost_cpu_caps() & GOST_CPU_PCLMUL)
+        ctx->mul_acc = blocklen == 16 ? mgm_mul_acc128_clmul
+            : mgm_mul_acc64_clmul;
+#endif
+}
+
+int gost_mgm128_setiv(mgm128_context *ctx, const unsigned char *iv)
+{
+    mgm_block_t n;
+
+    /* Nonce is n-1 bits long, it is prefixed with 0 for Y and 1 for Z */
+    if (iv[0] & 0x80)
+        return 0;
+
+    memcpy(n.c, iv, ctx->blocklen);
+    ctx->block(n.c, ctx->Y.c, ctx->key);
+    n.c[0] |= 0x80;
+    ctx->block(n.c, ctx->Z.c, ctx->key);
+
+    memset(ctx->sum, 0, sizeof(ctx->sum));
+    ctx->alen = 0;
+    ctx->clen = 0;
+    ctx->mres = 0;
+    ctx->ares = 0;
+    return 1;
+}
+
+int gost_mgm128_aad(mgm128_context *ctx, const unsigned char *aad,
+                    size_t len)
+{
+    unsigned int bl = ctx->blocklen;
+    unsigned int n = ctx->ares;
+    uint64_t alen = ctx->alen + len;
+
+    if (len == 0)
+        return 1;
+    if (ctx->clen != 0 || alen < ctx->alen || alen >= mgm_max_len(ctx))
+        return 0;
+    ctx->alen = alen;
+
+    if (n) {
+        while (n < bl && len) {
+            ctx->ACi.c[n++] = *aad++;
+            --len;
+        }
+        if (n < bl) {
+            ctx->ares = n;
+            return 1;
+        }
+        mgm_auth_block(ctx, ctx->ACi.c);
+        n = 0;
+    }
+    for (; len >= bl; aad += bl, len -= bl)
+        mgm_auth_block(ctx, aad);
+    if (len) {
+        memcpy(ctx->ACi.c, aad, len);
+        n = (unsigned int)len;
+    }
+    ctx->ares = n;
+    return 1;
+}
+
+static int mgm_payload_start(mgm128_context *ctx, size_t len)
+{
+    uint64_t clen = ctx->clen + len;
+
+    if (clen < ctx->clen || clen >= mgm_max_len(ctx))
+        return 0;
+    /* Switching from AAD to payload completes the last AAD block */
+    mgm_auth_partial(ctx, &ctx->ares);
+    ctx->clen = clen;
+    return 1;
+}
+
+int gost_mgm128_encrypt(mgm128_context *ctx, const unsigned char *in,
+                        unsigned char *out, size_t len)
+{
+    unsigned int bl = ctx->blocklen;
+    unsigned int n = ctx->mres;
+    unsigned int i;
+
+    if (!mgm_payload_start(ctx, len))
+        return 0;
+
+    if (n) {
+        while (n < bl && len) {
+            ctx->ACi.c[n] = *out++ = *in++ ^ ctx->EKi.c[n];
+            ++n;
+            --len;
+        }
+        if (n < bl) {
+            ctx->mres = n;
+            return 1;
+        }
+        mgm_auth_block(ctx, ctx->ACi.c);
+        n = 0;
+    }
+    for (; len >= bl; in += bl, out += bl, len -= bl) {
+        mgm_next_keystream(ctx);
+        for (i = 0; i < bl; i++)
+            out[i] = in[i] ^ ctx->EKi.c[i];
+        mgm_auth_block(ctx, out);
+    }
+    if (len) {
+        mgm_next_keystream(ctx);
+        for (i = 0; i < len; i++)
+            ctx->ACi.c[i] = out[i] = in[i] ^ ctx->EKi.c[i];
+        n = (unsigned int)len;
+    }
+    ctx->mres = n;
+    return 1;
+}
+
+int gost_mgm128_decrypt(mgm128_context *ctx, const unsigned char *in,
+                        unsigned char *out, size_t len)
+{
+    unsigned int bl = ctx->blocklen;
+    unsigned int n = ctx->mres;
+    unsigned int i;
+
+    if (!mgm_payload_start(ctx, len))
+        return 0;
+
+    if (n) {
+        while (n < bl && len) {
+            unsigned char c = *in++;
+
+            ctx->ACi.c[n] = c;
+            *out++ = c ^ ctx->EKi.c[n];
+            ++n;
+            --len;
+        }
+        if (n < bl) {
+            ctx->mres = n;
+            return 1;
+        }
+        mgm_auth_block(ctx, ctx->ACi.c);
+        n = 0;
+    }
+    /* Ciphertext is authenticated before |out| can overwrite it */
+    for (; len >= bl; in += bl, out += bl, len -= bl) {
+        mgm_auth_block(ctx, in);
+        mgm_next_keystream(ctx);
+        for (i = 0; i < bl; i++)
+            out[i] = in[i] ^ ctx->EKi.c[i];
+    }
+    if (len) {
+        mgm_next_keystream(ctx);
+        for (i = 0; i < len; i++) {
+            unsigned char c = in[i];
+
+            ctx->ACi.c[i] = c;
+            out[i] = c ^ ctx->EKi.c[i];
+        }
+        n = (unsigned int)len;
+    }
+    ctx->mres = n;
+    return 1;
+}
+
+void gost_mgm128_tag(mgm128_context *ctx, unsigned char *tag, size_t len)
+{
+    mgm_block_t lens, sum, T;
+    uint64_t abits = ctx->alen << 3, cbits = ctx->clen << 3;
+
+    mgm_auth_partial(ctx, &ctx->ares);
+    mgm_auth_partial(ctx, &ctx->mres);
+
+    /* len(A) || len(C), each n/2 bits */
+    if (ctx->blocklen == 16) {
+        store_be64(lens.c, abits);
+        store_be64(lens.c + 8, cbits);
+    } else {
+        store_be64(lens.c, (abits << 32) | cbits);
+    }
+    mgm_auth_block(ctx, lens.c);
+
+    mgm_reduce(ctx, sum.c);
+    ctx->block(sum.c, T.c, ctx->key);
+    memcpy(tag, T.c, len);
+
+    memset(sum.c, 0, sizeof(sum));
+    memset(T.c, 0, sizeof(T));
+}
+
+int gost_mgm128_finish(mgm128_context *ctx, const unsigned char *tag,
+                       size_t len)
+{
+    unsigned char T[MGM_MAX_BLOCK_SIZE];
+    unsigned char diff = 0;
+    size_t i;
+
+    if (len > (size_t)ctx->blocklen)
+        return 0;
+    gost_mgm128_tag(ctx, T, len);
+    for (i = 0; i < len; i++)
+        diff |= T[i] ^ tag[i];
+    return diff == 0;
+}
+/* vim: set expandtab cinoptions=\:0,l1,t0,g0,(0 sw=4 : */
@@ -0,0 +1,72 @@
+/**********************************************************************
+ *                         gost_mgm128.h                              *
+ *       Multilinear Galois Mode (MGM) of block cipher operation      *
+ *                                                                    *
+ *       This file is distributed under the same license as OpenSSL   *
+ *                                                                    *
+ * Implementation of the AEAD mode defined in R 1323565.1.026-2019    *
+ * (RFC 9058) for 64-bit (Magma) and 128-bit (Kuznyechik) ciphers.    *
+ * Doesn't need OpenSSL                                               *
+ **********************************************************************/
+#ifndef GOST_MGM128_H
+# define GOST_MGM128_H
+# include <stddef.h>
+# include <stdint.h>
+
+# define MGM_MAX_BLOCK_SIZE 16
+/* Tags are between 32 bits and the block size long */
+# define MGM_MIN_TAG_SIZE 4
+
+/* Encrypts one block of the underlying cipher */
+typedef void (*mgm_block_f) (const unsigned char *in, unsigned char *out,
+                             void *key);
+
+typedef union {
+    uint64_t u[MGM_MAX_BLOCK_SIZE / 8];
+    unsigned char c[MGM_MAX_BLOCK_SIZE];
+} mgm_block_t;
+
+typedef struct mgm128_context_st {
+    int blocklen;               /* 8 or 16 bytes */
+    mgm_block_f block;
+    void *key;
+    /* Sum of products H_i * X_i, accumulated unreduced (LSW first) */
+    void (*mul_acc) (uint64_t *sum, const unsigned char *h,
+                     const unsigned char *x);
+    uint64_t sum[4];
+    mgm_block_t Y;              /* encryption counter, incr_r */
+    mgm_block_t Z;              /* authentication counter, incr_l */
+    mgm_block_t EKi;            /* keystream of the current block */
+    mgm_block_t ACi;            /* partial AAD or ciphertext block */
+    uint64_t alen;              /* in bytes */
+    uint64_t clen;              /* in bytes */
+    unsigned int mres;          /* used bytes of EKi and ACi */
+    unsigned int ares;          /* used bytes of ACi (AAD) */
+} mgm128_context;
+
+/*-
+ * Binds the context to a cipher with block size |blocklen| (8 or 16).
+ * |key| is passed through to |block|, which must stay valid as long as
+ * the context is used.
+ */
+void gost_mgm128_init(mgm128_context *ctx, void *key, mgm_block_f block,
+                      int blocklen);
+/*
+ * Starts a new message with |iv| of blocklen bytes. The most significant
+ * bit of the nonce must be zero. Returns 1 on success, 0 otherwise.
+ */
+int gost_mgm128_setiv(mgm128_context *ctx, const unsigned char *iv);
+/* Associated data must be supplied before any payload */
+int gost_mgm128_aad(mgm128_context *ctx, const unsigned char *aad,
+                    size_t len);
+int gost_mgm128_encrypt(mgm128_context *ctx, const unsigned char *in,
+                        unsigned char *out, size_t len);
+int gost_mgm128_decrypt(mgm128_context *ctx, const unsigned char *in,
+                        unsigned char *out, size_t len);
+/* Computes the tag of the message, up to blocklen bytes */
+void gost_mgm128_tag(mgm128_context *ctx, unsigned char *tag, size_t len);
+/* Compares the tag of the message with |tag| in constant time */
+int gost_mgm128_finish(mgm128_context *ctx, const unsigned char *tag,
+                       size_t len);
+#endif
+/* vim: set expandtab cinoptions=\:0,l1,t0,g0,(0 sw=4 : */
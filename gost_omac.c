@@ -27,13 +27,8 @@ typedef struct omac_ctx {
  * and TLS seq no.
  * */
     unsigned char key[32];
-/*
- * TODO
- * TLSTREE intermediate values should be recalculated only when 
- * C_i & (seq_no+1) != C_i & (seq_no)
- * so somewhen we will store C_i & (seq_no) in this structure 
- * to avoid redundant hash calculations.
- * */
+    /* Level keys of the previous record, see gost_tlstree_cached() */
+    gost_tlstree_cache tlstree;
 } OMAC_CTX;
 
 #define MAX_GOST_OMAC_SIZE 16
@@ -106,6 +101,7 @@ static int omac_imit_copy(EVP_MD_CTX *to, const EVP_MD_CTX *from)
         c_to->cipher_name = c_from->cipher_name;
         c_to->key_set = c_from->key_set;
         memcpy(c_to->key, c_from->key, 32);
+        c_to->tlstree = c_from->tlstree;
     } else {
         return 0;
     }
@@ -241,9 +237,10 @@ int omac_imit_ctrl(EVP_MD_CTX *ctx, int type, int arg, void *ptr)
             if (c->key_set) {
                 unsigned char diversed_key[32];
                 int ret = 0;
-                if (gost_tlstree(OBJ_txt2nid(c->cipher_name),
-                                 c->key, diversed_key,
-                                 (const unsigned char *)ptr)) {
+                if (gost_tlstree_cached(OBJ_txt2nid(c->cipher_name),
+                                        c->key, diversed_key,
+                                        (const unsigned char *)ptr,
+                                        &c->tlstree) > 0) {
                     EVP_CIPHER *cipher;
                     if ((cipher = (EVP_CIPHER *)EVP_get_cipherbyname(c->cipher_name))
                         || (cipher = EVP_CIPHER_fetch(NULL, c->cipher_name, NULL)))
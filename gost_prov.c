@@ -52,6 +52,29 @@ static void provider_ctx_free(PROV_CTX *ctx)
     OPENSSL_free(ctx);
 }
 
+/*
+ * Engine parameters may also be given in the provider configuration
+ * section, e.g. KUZNYECHIK_BULK = CONSTANT_TIME
+ */
+static void provider_get_config(const OSSL_CORE_HANDLE *core,
+                                const OSSL_DISPATCH *in)
+{
+    OSSL_FUNC_core_get_params_fn *core_get_params = NULL;
+    char *bulk = NULL;
+    OSSL_PARAM params[2];
+
+    for (; in->function_id != 0; in++)
+        if (in->function_id == OSSL_FUNC_CORE_GET_PARAMS)
+            core_get_params = OSSL_FUNC_core_get_params(in);
+    if (core_get_params == NULL)
+        return;
+
+    params[0] = OSSL_PARAM_construct_utf8_ptr("KUZNYECHIK_BULK", &bulk, 0);
+    params[1] = OSSL_PARAM_construct_end();
+    if (core_get_params(core, params) && bulk != NULL)
+        gost_set_default_param(GOST_PARAM_KUZNYECHIK_BULK, bulk);
+}
+
 extern int populate_gost_engine(ENGINE *e);
 static PROV_CTX *provider_ctx_new(const OSSL_CORE_HANDLE *core,
                                   const OSSL_DISPATCH *in)
@@ -64,6 +87,7 @@ static PROV_CTX *provider_ctx_new(const OSSL_CORE_HANDLE *core,
         && (ctx->e = ENGINE_new()) != NULL
         && populate_gost_engine(ctx->e)) {
         ctx->core_handle = core;
+        provider_get_config(core, in);
 
         /* Ugly hack */
         err_handle = ctx->proverr_handle;
@@ -94,6 +118,8 @@ static const OSSL_ALGORITHM *gost_operation(void *vprovctx,
         return GOST_prov_digests;
     case OSSL_OP_MAC:
         return GOST_prov_macs;
+    case OSSL_OP_KDF:
+        return GOST_prov_kdfs;
     }
     return NULL;
 }
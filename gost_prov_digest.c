@@ -12,6 +12,7 @@
 #include <openssl/core_dispatch.h>
 #include "gost_prov.h"
 #include "gost_lcl.h"
+#include "gosthash2012.h"
 
 /*
  * Forward declarations of all OSSL_DISPATCH functions, to make sure they
@@ -22,6 +23,8 @@ static OSSL_FUNC_digest_freectx_fn digest_freectx;
 static OSSL_FUNC_digest_init_fn digest_init;
 static OSSL_FUNC_digest_update_fn digest_update;
 static OSSL_FUNC_digest_final_fn digest_final;
+static OSSL_FUNC_digest_get_ctx_params_fn digest_get_ctx_params;
+static OSSL_FUNC_digest_set_ctx_params_fn digest_set_ctx_params;
 
 
 struct gost_prov_crypt_ctx_st {
@@ -131,9 +134,58 @@ static int digest_final(void *vgctx,
     return res > 0;
 }
 
+/*
+ * "hash-state" is the serialized Streebog state (see gost2012_hash_export),
+ * to checkpoint a long hash and resume it, possibly in another process.
+ * It is set on an initialized context.
+ */
+static int digest_get_ctx_params(void *vgctx, OSSL_PARAM params[])
+{
+    GOST_CTX *gctx = vgctx;
+    OSSL_PARAM *p;
+
+    if ((p = OSSL_PARAM_locate(params, "hash-state")) != NULL) {
+        unsigned char state[GOST2012_HASH_STATE_SIZE];
+        int ret;
+
+        ret = EVP_MD_CTX_ctrl(gctx->dctx, EVP_MD_CTRL_GET_STATE,
+                              sizeof(state), state) > 0
+            && OSSL_PARAM_set_octet_string(p, state, sizeof(state));
+        OPENSSL_cleanse(state, sizeof(state));
+        if (!ret)
+            return 0;
+    }
+    return 1;
+}
+
+static int digest_set_ctx_params(void *vgctx, const OSSL_PARAM params[])
+{
+    GOST_CTX *gctx = vgctx;
+    const OSSL_PARAM *p;
+
+    if ((p = OSSL_PARAM_locate_const(params, "hash-state")) != NULL) {
+        const void *state = NULL;
+        size_t len = 0;
+
+        if (!OSSL_PARAM_get_octet_string_ptr(p, &state, &len)
+            || len > GOST2012_HASH_STATE_SIZE
+            || EVP_MD_CTX_ctrl(gctx->dctx, EVP_MD_CTRL_SET_STATE,
+                               (int)len, (void *)state) <= 0)
+            return 0;
+    }
+    return 1;
+}
+
+static const OSSL_PARAM known_GostR3411_2012_digest_params[] = {
+    OSSL_PARAM_octet_string("hash-state", NULL, 0),
+    OSSL_PARAM_END
+};
+
 static const OSSL_PARAM *known_GostR3411_94_digest_params;
-static const OSSL_PARAM *known_GostR3411_2012_256_digest_params;
-static const OSSL_PARAM *known_GostR3411_2012_512_digest_params;
+static const OSSL_PARAM *known_GostR3411_2012_256_digest_params =
+    known_GostR3411_2012_digest_params;
+static const OSSL_PARAM *known_GostR3411_2012_512_digest_params =
+    known_GostR3411_2012_digest_params;
 
 /*
  * These are named like the EVP_MD templates in gost_md.c etc, with the
@@ -152,6 +204,13 @@ typedef void (*fptr_t)(void);
     {                                                                   \
         return digest_newctx(provctx, &name, known_##name##_params);    \
     }                                                                   \
+    static OSSL_FUNC_digest_gettable_ctx_params_fn                      \
+        name##_gettable_ctx_params;                                     \
+    static const OSSL_PARAM *name##_gettable_ctx_params(void *dctx,     \
+                                                        void *provctx)  \
+    {                                                                   \
+        return known_##name##_params;                                   \
+    }                                                                   \
     static const OSSL_DISPATCH name##_functions[] = {                   \
         { OSSL_FUNC_DIGEST_GET_PARAMS, (fptr_t)name##_get_params },     \
         { OSSL_FUNC_DIGEST_NEWCTX, (fptr_t)name##_newctx },             \
@@ -160,6 +219,13 @@ typedef void (*fptr_t)(void);
         { OSSL_FUNC_DIGEST_INIT, (fptr_t)digest_init },                 \
         { OSSL_FUNC_DIGEST_UPDATE, (fptr_t)digest_update },             \
         { OSSL_FUNC_DIGEST_FINAL, (fptr_t)digest_final },               \
+        { OSSL_FUNC_DIGEST_GET_CTX_PARAMS, (fptr_t)digest_get_ctx_params }, \
+        { OSSL_FUNC_DIGEST_SET_CTX_PARAMS, (fptr_t)digest_set_ctx_params }, \
+        { OSSL_FUNC_DIGEST_GETTABLE_CTX_PARAMS,                         \
+          (fptr_t)name##_gettable_ctx_params },                         \
+        { OSSL_FUNC_DIGEST_SETTABLE_CTX_PARAMS,                         \
+          (fptr_t)name##_gettable_ctx_params },                         \
+        { 0, NULL },                                                    \
     }
 
 MAKE_FUNCTIONS(GostR3411_94_digest);
@@ -0,0 +1,346 @@
+/**********************************************************************
+ *               gost_prov_kdf.c - Initialize all KDFs                *
+ *                                                                    *
+ *     This file is distributed under the same license as OpenSSL     *
+ *                                                                    *
+ *          OpenSSL provider interface to GOST KDF functions          *
+ *                Requires OpenSSL 3.0 for compilation                *
+ **********************************************************************/
+
+#include <openssl/core.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include "gost_prov.h"
+#include "gost_lcl.h"
+#include "gosthash2012.h"
+
+/*
+ * Forward declarations of all generic OSSL_DISPATCH functions, to make sure
+ * they are correctly defined further down.  For the algorithm specific ones
+ * MAKE_FUNCTIONS() does it for us.
+ */
+
+static OSSL_FUNC_kdf_dupctx_fn kdf_dupctx;
+static OSSL_FUNC_kdf_freectx_fn kdf_freectx;
+static OSSL_FUNC_kdf_reset_fn kdf_reset;
+static OSSL_FUNC_kdf_derive_fn kdf_derive;
+static OSSL_FUNC_kdf_get_ctx_params_fn kdf_get_ctx_params;
+static OSSL_FUNC_kdf_set_ctx_params_fn kdf_set_ctx_params;
+
+/*
+ * KDF_TREE_GOSTR3411_2012_256 and KDF_GOSTR3411_2012_256 (R 50.1.113-2016),
+ * TLSTREE (R 1323565.1.043-2022) and PBKDF2 with HMAC-Streebog
+ * (R 50.1.111-2016). All of them are HMAC-Streebog underneath, which is
+ * computed directly, without the EVP layer.
+ */
+enum { KDF_TREE, KDF_GOSTR3411, TLSTREE, PBKDF2 };
+
+struct gost_prov_kdf_desc_st {
+    int type;
+    /* Output size, 0 for any */
+    size_t size;
+    /* Hash size of the HMAC in bits */
+    unsigned int digest_size;
+};
+typedef struct gost_prov_kdf_desc_st GOST_DESC;
+
+struct gost_prov_kdf_ctx_st {
+    /* Provider context */
+    PROV_CTX *provctx;
+    const GOST_DESC *descriptor;
+
+    int keyed;
+    /* The HMAC key of KDF_TREE and KDF_GOSTR3411, the password of PBKDF2 */
+    gost2012_hmac_ctx hmac;
+    /* The key of TLSTREE and its level keys of the last derivation */
+    unsigned char key[32];
+    gost_tlstree_cache tlstree;
+    int cipher_nid;
+
+    unsigned char *label;
+    size_t label_len;
+    /* The seed of KDF_TREE, the sequence number of TLSTREE, the salt */
+    unsigned char *seed;
+    size_t seed_len;
+    /* Counter size of KDF_TREE in bytes */
+    size_t representation;
+    /* Iteration count of PBKDF2 */
+    uint64_t iter;
+};
+typedef struct gost_prov_kdf_ctx_st GOST_CTX;
+
+static void kdf_reset(void *vgctx)
+{
+    GOST_CTX *gctx = vgctx;
+    PROV_CTX *provctx = gctx->provctx;
+    const GOST_DESC *descriptor = gctx->descriptor;
+
+    OPENSSL_clear_free(gctx->label, gctx->label_len);
+    OPENSSL_clear_free(gctx->seed, gctx->seed_len);
+    OPENSSL_cleanse(gctx, sizeof(*gctx));
+    gctx->provctx = provctx;
+    gctx->descriptor = descriptor;
+    gctx->representation = 1;
+    gctx->iter = PKCS5_DEFAULT_ITER;
+}
+
+static void kdf_freectx(void *vgctx)
+{
+    GOST_CTX *gctx = vgctx;
+
+    if (gctx == NULL)
+        return;
+    kdf_reset(gctx);
+    OPENSSL_free(gctx);
+}
+
+static GOST_CTX *kdf_newctx(void *provctx, const GOST_DESC *descriptor)
+{
+    GOST_CTX *gctx = NULL;
+
+    if ((gctx = OPENSSL_zalloc(sizeof(*gctx))) != NULL) {
+        gctx->provctx = provctx;
+        gctx->descriptor = descriptor;
+        gctx->representation = 1;
+        gctx->iter = PKCS5_DEFAULT_ITER;
+    }
+    return gctx;
+}
+
+static void *kdf_dupctx(void *vsrc)
+{
+    GOST_CTX *src = vsrc;
+    GOST_CTX *dst = OPENSSL_malloc(sizeof(*dst));
+
+    if (dst == NULL)
+        return NULL;
+    memcpy(dst, src, sizeof(*dst));
+    dst->label = NULL;
+    dst->seed = NULL;
+    if ((src->label != NULL
+         && (dst->label = OPENSSL_memdup(src->label, src->label_len)) == NULL)
+        || (src->seed != NULL
+            && (dst->seed = OPENSSL_memdup(src->seed, src->seed_len)) == NULL)) {
+        kdf_freectx(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static int kdf_derive(void *vgctx, unsigned char *key, size_t keylen,
+                      const OSSL_PARAM params[])
+{
+    GOST_CTX *gctx = vgctx;
+    static const unsigned char empty[1];
+
+    if (!kdf_set_ctx_params(gctx, params) || !gctx->keyed
+        || keylen == 0
+        || (gctx->descriptor->size != 0 && keylen != gctx->descriptor->size))
+        return 0;
+
+    switch (gctx->descriptor->type) {
+    case KDF_TREE:
+    case KDF_GOSTR3411:
+        /* KDF_GOSTR3411_2012_256 is one block of KDF_TREE with R = 1 */
+        return gost_kdftree2012_256_keyed(&gctx->hmac, key, keylen,
+                                          gctx->label ? gctx->label : empty,
+                                          gctx->label_len,
+                                          gctx->seed ? gctx->seed : empty,
+                                          gctx->seed_len,
+                                          gctx->descriptor->type == KDF_TREE
+                                          ? gctx->representation : 1);
+    case TLSTREE:
+        if (gctx->cipher_nid == NID_undef || gctx->seed_len != 8)
+            return 0;
+        return gost_tlstree_cached(gctx->cipher_nid, gctx->key, key,
+                                   gctx->seed, &gctx->tlstree) > 0;
+    case PBKDF2:
+        return gost_pbkdf2_hmac2012_keyed(&gctx->hmac,
+                                          gctx->seed ? gctx->seed : empty,
+                                          gctx->seed_len, gctx->iter,
+                                          key, keylen);
+    }
+    return 0;
+}
+
+static const OSSL_PARAM *kdf_gettable_params(void *provctx)
+{
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_size_t(OSSL_KDF_PARAM_SIZE, NULL),
+        OSSL_PARAM_END
+    };
+
+    return params;
+}
+
+static int kdf_get_params(const GOST_DESC *descriptor, OSSL_PARAM params[])
+{
+    OSSL_PARAM *p = NULL;
+
+    if ((p = OSSL_PARAM_locate(params, OSSL_KDF_PARAM_SIZE)) != NULL
+        && !OSSL_PARAM_set_size_t(p, descriptor->size != 0
+                                     ? descriptor->size : SIZE_MAX))
+        return 0;
+    return 1;
+}
+
+static const OSSL_PARAM *kdf_gettable_ctx_params(void *vgctx, void *provctx)
+{
+    return kdf_gettable_params(provctx);
+}
+
+static int kdf_get_ctx_params(void *vgctx, OSSL_PARAM params[])
+{
+    GOST_CTX *gctx = vgctx;
+
+    return kdf_get_params(gctx->descriptor, params);
+}
+
+static const OSSL_PARAM *kdf_settable_ctx_params(void *vgctx, void *provctx)
+{
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_octet_string(OSSL_KDF_PARAM_KEY, NULL, 0),
+        OSSL_PARAM_octet_string(OSSL_KDF_PARAM_LABEL, NULL, 0),
+        OSSL_PARAM_octet_string(OSSL_KDF_PARAM_SEED, NULL, 0),
+        OSSL_PARAM_int("r", NULL),
+        OSSL_PARAM_utf8_string(OSSL_KDF_PARAM_CIPHER, NULL, 0),
+        OSSL_PARAM_octet_string(OSSL_KDF_PARAM_PASSWORD, NULL, 0),
+        OSSL_PARAM_octet_string(OSSL_KDF_PARAM_SALT, NULL, 0),
+        OSSL_PARAM_uint64(OSSL_KDF_PARAM_ITER, NULL),
+        OSSL_PARAM_END
+    };
+
+    return params;
+}
+
+static int kdf_set_octets(const OSSL_PARAM *p, unsigned char **buf,
+                          size_t *len)
+{
+    void *tmp = NULL;
+    size_t tmplen = 0;
+
+    if (!OSSL_PARAM_get_octet_string(p, &tmp, 0, &tmplen))
+        return 0;
+    OPENSSL_clear_free(*buf, *len);
+    *buf = tmp;
+    *len = tmplen;
+    return 1;
+}
+
+static int kdf_set_ctx_params(void *vgctx, const OSSL_PARAM params[])
+{
+    GOST_CTX *gctx = vgctx;
+    const OSSL_PARAM *p = NULL;
+
+    if ((p = OSSL_PARAM_locate_const(params, OSSL_KDF_PARAM_KEY)) != NULL
+        || (p = OSSL_PARAM_locate_const(params,
+                                        OSSL_KDF_PARAM_PASSWORD)) != NULL) {
+        const unsigned char *key = NULL;
+        size_t keylen = 0;
+
+        if (!OSSL_PARAM_get_octet_string_ptr(p, (const void **)&key, &keylen))
+            return 0;
+        if (gctx->descriptor->type == TLSTREE) {
+            if (keylen != sizeof(gctx->key))
+                return 0;
+            memcpy(gctx->key, key, keylen);
+            gctx->tlstree.levels = 0;
+        } else {
+            gost2012_hmac_init(&gctx->hmac, gctx->descriptor->digest_size,
+                               key, keylen);
+        }
+        gctx->keyed = 1;
+    }
+    if ((p = OSSL_PARAM_locate_const(params, OSSL_KDF_PARAM_LABEL)) != NULL
+        && !kdf_set_octets(p, &gctx->label, &gctx->label_len))
+        return 0;
+    if (((p = OSSL_PARAM_locate_const(params, OSSL_KDF_PARAM_SEED)) != NULL
+         || (p = OSSL_PARAM_locate_const(params,
+                                         OSSL_KDF_PARAM_SALT)) != NULL)
+        && !kdf_set_octets(p, &gctx->seed, &gctx->seed_len))
+        return 0;
+    if ((p = OSSL_PARAM_locate_const(params, OSSL_KDF_PARAM_ITER)) != NULL
+        && (!OSSL_PARAM_get_uint64(p, &gctx->iter) || gctx->iter == 0))
+        return 0;
+    if ((p = OSSL_PARAM_locate_const(params, "r")) != NULL) {
+        int r = 0;
+
+        if (!OSSL_PARAM_get_int(p, &r) || r <= 0 || r > 32 || r % 8 != 0)
+            return 0;
+        gctx->representation = r / 8;
+    }
+    if ((p = OSSL_PARAM_locate_const(params, OSSL_KDF_PARAM_CIPHER)) != NULL) {
+        const char *name = NULL;
+        int nid;
+
+        if (!OSSL_PARAM_get_utf8_string_ptr(p, &name))
+            return 0;
+        nid = OBJ_sn2nid(name);
+        if (nid != NID_magma_cbc && nid != NID_grasshopper_cbc)
+            return 0;
+        if (nid != gctx->cipher_nid)
+            gctx->tlstree.levels = 0;
+        gctx->cipher_nid = nid;
+    }
+    return 1;
+}
+
+typedef void (*fptr_t)(void);
+#define MAKE_FUNCTIONS(name, type, size, digest_size)                   \
+    static const GOST_DESC name##_desc = {                              \
+        type,                                                           \
+        size,                                                           \
+        digest_size,                                                    \
+    };                                                                  \
+    static OSSL_FUNC_kdf_newctx_fn name##_newctx;                       \
+    static void *name##_newctx(void *provctx)                           \
+    {                                                                   \
+        return kdf_newctx(provctx, &name##_desc);                       \
+    }                                                                   \
+    static OSSL_FUNC_kdf_get_params_fn name##_get_params;               \
+    static int name##_get_params(OSSL_PARAM *params)                    \
+    {                                                                   \
+        return kdf_get_params(&name##_desc, params);                    \
+    }                                                                   \
+    static const OSSL_DISPATCH name##_functions[] = {                   \
+        { OSSL_FUNC_KDF_GETTABLE_PARAMS,                                \
+          (fptr_t)kdf_gettable_params },                                \
+        { OSSL_FUNC_KDF_GET_PARAMS, (fptr_t)name##_get_params },        \
+        { OSSL_FUNC_KDF_NEWCTX, (fptr_t)name##_newctx },                \
+        { OSSL_FUNC_KDF_DUPCTX, (fptr_t)kdf_dupctx },                   \
+        { OSSL_FUNC_KDF_FREECTX, (fptr_t)kdf_freectx },                 \
+        { OSSL_FUNC_KDF_RESET, (fptr_t)kdf_reset },                     \
+        { OSSL_FUNC_KDF_DERIVE, (fptr_t)kdf_derive },                   \
+        { OSSL_FUNC_KDF_GETTABLE_CTX_PARAMS,                            \
+          (fptr_t)kdf_gettable_ctx_params },                            \
+        { OSSL_FUNC_KDF_GET_CTX_PARAMS, (fptr_t)kdf_get_ctx_params },   \
+        { OSSL_FUNC_KDF_SETTABLE_CTX_PARAMS,                            \
+          (fptr_t)kdf_settable_ctx_params },                            \
+        { OSSL_FUNC_KDF_SET_CTX_PARAMS, (fptr_t)kdf_set_ctx_params },   \
+        { 0, NULL },                                                    \
+    }
+
+MAKE_FUNCTIONS(kdf_tree_gostr3411_2012_256, KDF_TREE, 0, 256);
+MAKE_FUNCTIONS(kdf_gostr3411_2012_256, KDF_GOSTR3411, 32, 256);
+MAKE_FUNCTIONS(tlstree, TLSTREE, 32, 256);
+MAKE_FUNCTIONS(pbkdf2_gostr3411_2012_256, PBKDF2, 0, 256);
+MAKE_FUNCTIONS(pbkdf2_gostr3411_2012_512, PBKDF2, 0, 512);
+
+/* The OSSL_ALGORITHM for the provider's operation query function */
+const OSSL_ALGORITHM GOST_prov_kdfs[] = {
+    { "KDF_TREE_GOSTR3411_2012_256:KDF-TREE-GOSTR3411-2012-256", NULL,
+      kdf_tree_gostr3411_2012_256_functions,
+      "KDF_TREE_GOSTR3411_2012_256 from R 50.1.113-2016" },
+    { "KDF_GOSTR3411_2012_256:KDF-GOSTR3411-2012-256", NULL,
+      kdf_gostr3411_2012_256_functions,
+      "KDF_GOSTR3411_2012_256 from R 50.1.113-2016" },
+    { "TLSTREE", NULL, tlstree_functions,
+      "TLSTREE from R 1323565.1.043-2022" },
+    { "PBKDF2_GOSTR3411_2012_256:PBKDF2-GOSTR3411-2012-256", NULL,
+      pbkdf2_gostr3411_2012_256_functions,
+      "PBKDF2 with HMAC_GOSTR3411_2012_256" },
+    { "PBKDF2_GOSTR3411_2012_512:PBKDF2-GOSTR3411-2012-512", NULL,
+      pbkdf2_gostr3411_2012_512_functions,
+      "PBKDF2 with HMAC_GOSTR3411_2012_512 from R 50.1.111-2016" },
+    { NULL , NULL, NULL }
+};
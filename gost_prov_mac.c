@@ -12,6 +12,7 @@
 #include <openssl/core_dispatch.h>
 #include "gost_prov.h"
 #include "gost_lcl.h"
+#include "gosthash2012.h"
 
 /*
  * Forward declarations of all generic OSSL_DISPATCH functions, to make sure
@@ -332,6 +333,198 @@ MAKE_FUNCTIONS(magma_mac, 8);
 MAKE_FUNCTIONS(grasshopper_mac, 16);
 MAKE_FUNCTIONS(id_tc26_cipher_gostr3412_2015_kuznyechik_ctracpkm_omac, 16);
 
+/*
+ * HMAC with GOST R 34.11-2012 (R 50.1.113-2016) is implemented natively,
+ * not on top of the wrapped EVP_MD: the states after the key blocks are
+ * kept in the context, so init without a key only copies them.
+ */
+struct gost_prov_hmac_ctx_st {
+    PROV_CTX *provctx;
+    unsigned int digest_size;
+    int keyed;
+    gost2012_hmac_ctx hmac;
+};
+typedef struct gost_prov_hmac_ctx_st GOST_HMAC_CTX;
+
+static OSSL_FUNC_mac_dupctx_fn hmac_dupctx;
+static OSSL_FUNC_mac_freectx_fn hmac_freectx;
+static OSSL_FUNC_mac_init_fn hmac_init;
+static OSSL_FUNC_mac_update_fn hmac_update;
+static OSSL_FUNC_mac_final_fn hmac_final;
+static OSSL_FUNC_mac_gettable_ctx_params_fn hmac_gettable_ctx_params;
+static OSSL_FUNC_mac_get_ctx_params_fn hmac_get_ctx_params;
+static OSSL_FUNC_mac_settable_ctx_params_fn hmac_settable_ctx_params;
+static OSSL_FUNC_mac_set_ctx_params_fn hmac_set_ctx_params;
+
+static void *hmac_newctx(void *provctx, unsigned int digest_size)
+{
+    GOST_HMAC_CTX *hctx = OPENSSL_zalloc(sizeof(*hctx));
+
+    if (hctx != NULL) {
+        hctx->provctx = provctx;
+        hctx->digest_size = digest_size;
+    }
+    return hctx;
+}
+
+static void hmac_freectx(void *vhctx)
+{
+    OPENSSL_clear_free(vhctx, sizeof(GOST_HMAC_CTX));
+}
+
+static void *hmac_dupctx(void *vsrc)
+{
+    GOST_HMAC_CTX *dst = OPENSSL_malloc(sizeof(*dst));
+
+    if (dst != NULL)
+        memcpy(dst, vsrc, sizeof(*dst));
+    return dst;
+}
+
+static int hmac_set_key(GOST_HMAC_CTX *hctx, const unsigned char *key,
+                        size_t keylen)
+{
+    gost2012_hmac_init(&hctx->hmac, hctx->digest_size, key, keylen);
+    hctx->keyed = 1;
+    return 1;
+}
+
+static int hmac_init(void *mctx, const unsigned char *key,
+                     size_t keylen, const OSSL_PARAM params[])
+{
+    GOST_HMAC_CTX *hctx = mctx;
+
+    if (!hmac_set_ctx_params(hctx, params))
+        return 0;
+    if (key != NULL)
+        return hmac_set_key(hctx, key, keylen);
+    if (!hctx->keyed)
+        return 0;
+    gost2012_hmac_reset(&hctx->hmac);
+    return 1;
+}
+
+static int hmac_update(void *mctx, const unsigned char *in, size_t inl)
+{
+    GOST_HMAC_CTX *hctx = mctx;
+
+    if (!hctx->keyed)
+        return 0;
+    gost2012_hmac_update(&hctx->hmac, in, inl);
+    return 1;
+}
+
+static int hmac_final(void *mctx, unsigned char *out, size_t *outl,
+                      size_t outsize)
+{
+    GOST_HMAC_CTX *hctx = mctx;
+    size_t size = hctx->digest_size / 8;
+
+    if (!hctx->keyed || outl == NULL)
+        return 0;
+    *outl = size;
+    if (out == NULL)
+        return 1;
+    if (outsize < size)
+        return 0;
+    gost2012_hmac_final(&hctx->hmac, out);
+    return 1;
+}
+
+static const OSSL_PARAM *hmac_gettable_params(void *provctx)
+{
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_size_t("size", NULL),
+        OSSL_PARAM_size_t("block-size", NULL),
+        OSSL_PARAM_END
+    };
+
+    return params;
+}
+
+static int hmac_get_params(unsigned int digest_size, OSSL_PARAM params[])
+{
+    OSSL_PARAM *p = NULL;
+
+    if (((p = OSSL_PARAM_locate(params, "size")) != NULL
+         && !OSSL_PARAM_set_size_t(p, digest_size / 8))
+        || ((p = OSSL_PARAM_locate(params, "block-size")) != NULL
+            && !OSSL_PARAM_set_size_t(p, 64)))
+        return 0;
+    return 1;
+}
+
+static const OSSL_PARAM *hmac_gettable_ctx_params(void *mctx, void *provctx)
+{
+    return hmac_gettable_params(provctx);
+}
+
+static int hmac_get_ctx_params(void *mctx, OSSL_PARAM params[])
+{
+    GOST_HMAC_CTX *hctx = mctx;
+
+    return hmac_get_params(hctx->digest_size, params);
+}
+
+static const OSSL_PARAM *hmac_settable_ctx_params(void *mctx, void *provctx)
+{
+    static const OSSL_PARAM params[] = {
+        OSSL_PARAM_octet_string("key", NULL, 0),
+        OSSL_PARAM_END
+    };
+
+    return params;
+}
+
+static int hmac_set_ctx_params(void *mctx, const OSSL_PARAM params[])
+{
+    GOST_HMAC_CTX *hctx = mctx;
+    const OSSL_PARAM *p = NULL;
+
+    if ((p = OSSL_PARAM_locate_const(params, "key")) != NULL) {
+        const unsigned char *key = NULL;
+        size_t keylen = 0;
+
+        if (!OSSL_PARAM_get_octet_string_ptr(p, (const void **)&key, &keylen)
+            || !hmac_set_key(hctx, key, keylen))
+            return 0;
+    }
+    return 1;
+}
+
+#define MAKE_HMAC_FUNCTIONS(name, digest_size)                          \
+    static OSSL_FUNC_mac_newctx_fn name##_newctx;                       \
+    static void *name##_newctx(void *provctx)                           \
+    {                                                                   \
+        return hmac_newctx(provctx, digest_size);                       \
+    }                                                                   \
+    static OSSL_FUNC_mac_get_params_fn name##_get_params;               \
+    static int name##_get_params(OSSL_PARAM *params)                    \
+    {                                                                   \
+        return hmac_get_params(digest_size, params);                    \
+    }                                                                   \
+    static const OSSL_DISPATCH name##_functions[] = {                   \
+        { OSSL_FUNC_MAC_GETTABLE_PARAMS,                                \
+          (fptr_t)hmac_gettable_params },                               \
+        { OSSL_FUNC_MAC_GET_PARAMS, (fptr_t)name##_get_params },        \
+        { OSSL_FUNC_MAC_NEWCTX, (fptr_t)name##_newctx },                \
+        { OSSL_FUNC_MAC_DUPCTX, (fptr_t)hmac_dupctx },                  \
+        { OSSL_FUNC_MAC_FREECTX, (fptr_t)hmac_freectx },                \
+        { OSSL_FUNC_MAC_INIT, (fptr_t)hmac_init },                      \
+        { OSSL_FUNC_MAC_UPDATE, (fptr_t)hmac_update },                  \
+        { OSSL_FUNC_MAC_FINAL, (fptr_t)hmac_final },                    \
+        { OSSL_FUNC_MAC_GETTABLE_CTX_PARAMS,                            \
+          (fptr_t)hmac_gettable_ctx_params },                           \
+        { OSSL_FUNC_MAC_GET_CTX_PARAMS, (fptr_t)hmac_get_ctx_params },  \
+        { OSSL_FUNC_MAC_SETTABLE_CTX_PARAMS,                            \
+          (fptr_t)hmac_settable_ctx_params },                           \
+        { OSSL_FUNC_MAC_SET_CTX_PARAMS, (fptr_t)hmac_set_ctx_params },  \
+        { 0, NULL },                                                    \
+    }
+
+MAKE_HMAC_FUNCTIONS(id_tc26_hmac_gost_3411_2012_256, 256);
+MAKE_HMAC_FUNCTIONS(id_tc26_hmac_gost_3411_2012_512, 512);
+
 /* The OSSL_ALGORITHM for the provider's operation query function */
 const OSSL_ALGORITHM GOST_prov_macs[] = {
     { SN_id_Gost28147_89_MAC ":1.2.643.2.2.22", NULL,
@@ -342,6 +535,13 @@ const OSSL_ALGORITHM GOST_prov_macs[] = {
     { SN_id_tc26_cipher_gostr3412_2015_kuznyechik_ctracpkm_omac
       ":1.2.643.7.1.1.5.2.2", NULL,
       id_tc26_cipher_gostr3412_2015_kuznyechik_ctracpkm_omac_functions },
+    /* Described in RFC 7836, section 4.1 */
+    { SN_id_tc26_hmac_gost_3411_2012_256 ":HMAC-GOSTR3411-2012-256"
+      ":1.2.643.7.1.1.4.1", NULL, id_tc26_hmac_gost_3411_2012_256_functions,
+      "HMAC with GOST R 34.11-2012 with 256 bit hash" },
+    { SN_id_tc26_hmac_gost_3411_2012_512 ":HMAC-GOSTR3411-2012-512"
+      ":1.2.643.7.1.1.4.2", NULL, id_tc26_hmac_gost_3411_2012_512_functions,
+      "HMAC with GOST R 34.11-2012 with 512 bit hash" },
     { NULL , NULL, NULL }
 };
 
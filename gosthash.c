@@ -26,126 +26,222 @@
 # endif
 #endif
 /*
- * Following functions are various bit meshing routines used in GOST R
- * 34.11-94 algorithms
+ * The step function works on 256-bit blocks as four 64-bit words, the
+ * first word holding bytes 0 to 7 of the block, little-endian.
  */
-static void swap_bytes(byte * w, byte * k)
-{
-    int i, j;
-    for (i = 0; i < 4; i++)
-        for (j = 0; j < 8; j++)
-            k[i + 4 * j] = w[8 * i + j];
+typedef unsigned long long u8;
 
+static inline u8 load64(const byte * p)
+{
+#ifdef L_ENDIAN
+    u8 v;
+    memcpy(&v, p, 8);
+    return v;
+#else
+    return (u8)p[0] | (u8)p[1] << 8 | (u8)p[2] << 16 | (u8)p[3] << 24 |
+        (u8)p[4] << 32 | (u8)p[5] << 40 | (u8)p[6] << 48 | (u8)p[7] << 56;
+#endif
 }
 
-/* was A_A */
-static void circle_xor8(const byte * w, byte * k)
+static inline void store64(byte * p, u8 v)
 {
-    byte buf[8];
+#ifdef L_ENDIAN
+    memcpy(p, &v, 8);
+#else
     int i;
-    memcpy(buf, w, 8);
-    memmove(k, w + 8, 24);
-    for (i = 0; i < 8; i++)
-        k[i + 24] = buf[i] ^ k[i];
+    for (i = 0; i < 8; i++, v >>= 8)
+        p[i] = (byte)v;
+#endif
+}
+
+/* A: (y4, y3, y2, y1) -> (y1 ^ y2, y4, y3, y2) */
+#define A(w) do { \
+        u8 _t = w[0] ^ w[1]; \
+        w[0] = w[1]; w[1] = w[2]; w[2] = w[3]; w[3] = _t; \
+    } while (0)
+
+/* Spreads the bytes, or the 16-bit halves, of x over twice the width */
+static inline u8 spread8(u8 x)
+{
+    x = (x | x << 16) & 0x0000ffff0000ffffULL;
+    return (x | x << 8) & 0x00ff00ff00ff00ffULL;
 }
 
-/* was R_R */
-static void transform_3(byte * data)
+static inline u8 spread16(u8 x)
 {
-    unsigned short int acc;
-    acc = (data[0] ^ data[2] ^ data[4] ^ data[6] ^ data[24] ^ data[30]) |
-        ((data[1] ^ data[3] ^ data[5] ^ data[7] ^ data[25] ^ data[31]) << 8);
-    memmove(data, data + 2, 30);
-    data[30] = acc & 0xff;
-    data[31] = acc >> 8;
+    return (x | x << 16) & 0x0000ffff0000ffffULL;
 }
 
-/* Adds blocks of N bytes modulo 2**(8*n). Returns carry*/
-static int add_blocks(int n, byte * left, const byte * right)
+/*
+ * P: key word n is byte n of each of the four words of w. The transpose
+ * is done by interleaving w[0] with w[1] and w[2] with w[3] bytewise, and
+ * then the two results by 16-bit halves, so the key of the transform is
+ * read straight off w without building it as bytes.
+ */
+static inline void key_from(u4 *key, const u8 *w)
 {
+    u8 a, b, k;
     int i;
-    int carry = 0;
-    for (i = 0; i < n; i++) {
-        int sum = (int)left[i] + (int)right[i] + carry;
-        left[i] = sum & 0xff;
-        carry = sum >> 8;
+
+    for (i = 0; i < 2; i++) {
+        a = spread8((u4)(w[0] >> 32 * i)) | spread8((u4)(w[1] >> 32 * i)) << 8;
+        b = spread8((u4)(w[2] >> 32 * i)) | spread8((u4)(w[3] >> 32 * i)) << 8;
+        k = spread16((u4)a) | spread16((u4)b) << 16;
+        key[4 * i] = (u4)k;
+        key[4 * i + 1] = (u4)(k >> 32);
+        k = spread16(a >> 32) | spread16(b >> 32) << 16;
+        key[4 * i + 2] = (u4)k;
+        key[4 * i + 3] = (u4)(k >> 32);
     }
-    return carry;
 }
 
-/* Xor two sequences of bytes */
-static void xor_blocks(byte * result, const byte * a, const byte * b,
-                       size_t len)
+/*
+ * psi applied four times. With the block as sixteen 16-bit words y0..y15,
+ * psi shifts them down by one and puts y0^y1^y2^y3^y12^y15 on top. The
+ * four new words are computed at once: the sums of y(k)..y(k+3) as lanes
+ * of a 64-bit word, then a prefix xor over the lanes for the feedback of
+ * each step into the next.
+ */
+static inline void psi4(u8 *w)
 {
-    size_t i;
-    for (i = 0; i < len; i++)
-        result[i] = a[i] ^ b[i];
+    u8 a, g;
+
+    a = w[0] ^ (w[0] >> 16 | w[1] << 48) ^ (w[0] >> 32 | w[1] << 32) ^
+        (w[0] >> 48 | w[1] << 16);
+    g = a ^ w[3];
+    g ^= g << 16;
+    g ^= g << 32;
+    g ^= (w[3] >> 48) * 0x0001000100010001ULL;
+    w[0] = w[1];
+    w[1] = w[2];
+    w[2] = w[3];
+    w[3] = g;
+}
+
+static inline void psi(u8 *w)
+{
+    u8 fb = w[0] ^ w[0] >> 16 ^ w[0] >> 32 ^ w[0] >> 48 ^ w[3] ^ w[3] >> 48;
+
+    w[0] = w[0] >> 16 | w[1] << 48;
+    w[1] = w[1] >> 16 | w[2] << 48;
+    w[2] = w[2] >> 16 | w[3] << 48;
+    w[3] = w[3] >> 16 | fb << 48;
 }
 
+/*
+ * GOST 28147-89 encryption of the four words of h, each with its own key.
+ * The four blocks are independent and go through the rounds side by side.
+ */
+#define F(x) (_f = (x), \
+        _f = k->k87[_f >> 24 & 255] | k->k65[_f >> 16 & 255] | \
+             k->k43[_f >> 8 & 255] | k->k21[_f & 255], \
+        _f << 11 | _f >> 21)
+#define ROUND(a, b, i) \
+        a##0 ^= F(b##0 + key[0][i]); a##1 ^= F(b##1 + key[1][i]); \
+        a##2 ^= F(b##2 + key[2][i]); a##3 ^= F(b##3 + key[3][i])
+#define ROUNDS(i0, i1, i2, i3, i4, i5, i6, i7) \
+        ROUND(n2, n1, i0); ROUND(n1, n2, i1); \
+        ROUND(n2, n1, i2); ROUND(n1, n2, i3); \
+        ROUND(n2, n1, i4); ROUND(n1, n2, i5); \
+        ROUND(n2, n1, i6); ROUND(n1, n2, i7)
+
+static void encrypt4(const gost_kbox *k, u4 key[4][8], const u8 *h, u8 *s)
+{
+    u4 n10 = (u4)h[0], n20 = (u4)(h[0] >> 32);
+    u4 n11 = (u4)h[1], n21 = (u4)(h[1] >> 32);
+    u4 n12 = (u4)h[2], n22 = (u4)(h[2] >> 32);
+    u4 n13 = (u4)h[3], n23 = (u4)(h[3] >> 32);
+    u4 _f;
+
+    ROUNDS(0, 1, 2, 3, 4, 5, 6, 7);
+    ROUNDS(0, 1, 2, 3, 4, 5, 6, 7);
+    ROUNDS(0, 1, 2, 3, 4, 5, 6, 7);
+    ROUNDS(7, 6, 5, 4, 3, 2, 1, 0);
+
+    s[0] = (u8)n10 << 32 | n20;
+    s[1] = (u8)n11 << 32 | n21;
+    s[2] = (u8)n12 << 32 | n22;
+    s[3] = (u8)n13 << 32 | n23;
+}
+
+/* The constant C3 of the third key, bytes 0xff and 0x00 */
+static const u8 C3[4] = {
+    0xff00ff00ff00ff00ULL, 0x00ff00ff00ff00ffULL,
+    0xff0000ff00ffff00ULL, 0xff00ffff000000ffULL
+};
+
 /*
  *      Calculate H(i+1) = Hash(Hi,Mi)
  *      Where H and M are 32 bytes long
  */
 static int hash_step(gost_ctx * c, byte * H, const byte * M)
 {
-    byte U[32], W[32], V[32], S[32], Key[32];
+    u8 h[4], m[4], u[4], v[4], w[4], s[4];
+    u4 key[4][8];
     int i;
-    /* Compute first key */
-    xor_blocks(W, H, M, 32);
-    swap_bytes(W, Key);
-    /* Encrypt first 8 bytes of H with first key */
-    gost_enc_with_key(c, Key, H, S);
-    /* Compute second key */
-    circle_xor8(H, U);
-    circle_xor8(M, V);
-    circle_xor8(V, V);
-    xor_blocks(W, U, V, 32);
-    swap_bytes(W, Key);
-    /* encrypt second 8 bytes of H with second key */
-    gost_enc_with_key(c, Key, H + 8, S + 8);
-    /* compute third key */
-    circle_xor8(U, U);
-    U[31] = ~U[31];
-    U[29] = ~U[29];
-    U[28] = ~U[28];
-    U[24] = ~U[24];
-    U[23] = ~U[23];
-    U[20] = ~U[20];
-    U[18] = ~U[18];
-    U[17] = ~U[17];
-    U[14] = ~U[14];
-    U[12] = ~U[12];
-    U[10] = ~U[10];
-    U[8] = ~U[8];
-    U[7] = ~U[7];
-    U[5] = ~U[5];
-    U[3] = ~U[3];
-    U[1] = ~U[1];
-    circle_xor8(V, V);
-    circle_xor8(V, V);
-    xor_blocks(W, U, V, 32);
-    swap_bytes(W, Key);
-    /* encrypt third 8 bytes of H with third key */
-    gost_enc_with_key(c, Key, H + 16, S + 16);
-    /* Compute fourth key */
-    circle_xor8(U, U);
-    circle_xor8(V, V);
-    circle_xor8(V, V);
-    xor_blocks(W, U, V, 32);
-    swap_bytes(W, Key);
-    /* Encrypt last 8 bytes with fourth key */
-    gost_enc_with_key(c, Key, H + 24, S + 24);
-    for (i = 0; i < 12; i++)
-        transform_3(S);
-    xor_blocks(S, S, M, 32);
-    transform_3(S);
-    xor_blocks(S, S, H, 32);
-    for (i = 0; i < 61; i++)
-        transform_3(S);
-    memcpy(H, S, 32);
+
+    for (i = 0; i < 4; i++) {
+        h[i] = load64(H + 8 * i);
+        m[i] = load64(M + 8 * i);
+        u[i] = h[i];
+        v[i] = m[i];
+        w[i] = h[i] ^ m[i];
+    }
+    /* Keys: K1 = P(H ^ M), then U and V advance by A and A^2 */
+    key_from(key[0], w);
+    A(u);
+    A(v);
+    A(v);
+    for (i = 0; i < 4; i++)
+        w[i] = u[i] ^ v[i];
+    key_from(key[1], w);
+    A(u);
+    A(v);
+    A(v);
+    for (i = 0; i < 4; i++) {
+        u[i] ^= C3[i];
+        w[i] = u[i] ^ v[i];
+    }
+    key_from(key[2], w);
+    A(u);
+    A(v);
+    A(v);
+    for (i = 0; i < 4; i++)
+        w[i] = u[i] ^ v[i];
+    key_from(key[3], w);
+
+    encrypt4(c->kbox, key, h, s);
+
+    /* H = psi^61(H ^ psi(M ^ psi^12(S))) */
+    for (i = 0; i < 3; i++)
+        psi4(s);
+    for (i = 0; i < 4; i++)
+        s[i] ^= m[i];
+    psi(s);
+    for (i = 0; i < 4; i++)
+        s[i] ^= h[i];
+    for (i = 0; i < 15; i++)
+        psi4(s);
+    psi(s);
+    for (i = 0; i < 4; i++)
+        store64(H + 8 * i, s[i]);
     return 1;
 }
 
+/* Adds the 32-byte M to the 32-byte S modulo 2**256 */
+static void add_blocks(byte * S, const byte * M)
+{
+    u8 l, r, sum, carry = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        l = load64(S + 8 * i);
+        r = load64(M + 8 * i);
+        sum = l + r + carry;
+        carry = carry ? sum <= l : sum < l;
+        store64(S + 8 * i, sum);
+    }
+}
+
 /*
  * Initialize gost_hash ctx - cleans up temporary structures and set up
  * substitution blocks
@@ -158,7 +254,11 @@ int init_gost_hash_ctx(gost_hash_ctx * ctx,
     if (!ctx->cipher_ctx) {
         return 0;
     }
-    gost_init(ctx->cipher_ctx, subst_block);
+    if (!gost_init(ctx->cipher_ctx, subst_block)) {
+        MYFREE(ctx->cipher_ctx);
+        ctx->cipher_ctx = NULL;
+        return 0;
+    }
     return 1;
 }
 
@@ -214,14 +314,14 @@ int hash_block(gost_hash_ctx * ctx, const byte * block, size_t length)
         block += add_bytes;
         length -= add_bytes;
         hash_step(ctx->cipher_ctx, ctx->H, ctx->remainder);
-        add_blocks(32, ctx->S, ctx->remainder);
+        add_blocks(ctx->S, ctx->remainder);
         ctx->len += 32;
         ctx->left = 0;
     }
     while (length >= 32) {
         hash_step(ctx->cipher_ctx, ctx->H, block);
 
-        add_blocks(32, ctx->S, block);
+        add_blocks(ctx->S, block);
         ctx->len += 32;
         block += 32;
         length -= 32;
@@ -250,7 +350,7 @@ int finish_hash(gost_hash_ctx * ctx, byte * hashval)
         memset(buf, 0, 32);
         memcpy(buf, ctx->remainder, ctx->left);
         hash_step(ctx->cipher_ctx, H, buf);
-        add_blocks(32, S, buf);
+        add_blocks(S, buf);
         fin_len += ctx->left;
     }
     memset(buf, 0, 32);
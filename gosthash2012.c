@@ -8,7 +8,9 @@
  *
  */
 
+#include <openssl/crypto.h>
 #include "gosthash2012.h"
+#include "gost_cpu.h"
 #if defined(__x86_64__) || defined(__e2k__)
 # ifdef _MSC_VER
 #  include <intrin.h>
@@ -23,6 +25,11 @@
 # define INLINE inline
 #endif
 
+#if defined(GOST_X86_DISPATCH) && !defined(__GOST3411_BIG_ENDIAN__)
+# define GOST3411_DISPATCH
+# include "gosthash2012_avx512.h"
+#endif
+
 #define BSWAP64(x) \
     (((x & 0xFF00000000000000ULL) >> 56) | \
      ((x & 0x00FF000000000000ULL) >> 40) | \
@@ -53,6 +60,48 @@ void init_gost2012_hash_ctx(gost2012_hash_ctx * CTX,
         memset(&CTX->h, 0x01, sizeof(uint512_u));
 }
 
+/* Writes GOST2012_HASH_STATE_SIZE bytes of the state of CTX to out */
+void gost2012_hash_export(const gost2012_hash_ctx * CTX, unsigned char *out)
+{
+    out[0] = GOST2012_HASH_STATE_VERSION;
+    out[1] = (unsigned char)(CTX->digest_size / 8);
+    out[2] = (unsigned char)CTX->bufsize;
+    out[3] = 0;
+    /*
+     * No per-word swapping: with __GOST3411_BIG_ENDIAN__ the words hold
+     * byte-swapped values (see add512 and the length block in
+     * gost2012_finish_hash_multi), so B[] is the little-endian byte
+     * string on every host, the one the digest is copied from.
+     */
+    memcpy(out + 4, CTX->h.B, 64);
+    memcpy(out + 4 + 64, CTX->N.B, 64);
+    memcpy(out + 4 + 128, CTX->Sigma.B, 64);
+    /* Only the buffered bytes are meaningful */
+    memcpy(out + 4 + 192, CTX->buffer.B, CTX->bufsize);
+    memset(out + 4 + 192 + CTX->bufsize, 0, 64 - CTX->bufsize);
+}
+
+/*
+ * Restores CTX from a state written by gost2012_hash_export, possibly on
+ * another host. Returns 0 and leaves CTX alone if the state is malformed.
+ */
+int gost2012_hash_import(gost2012_hash_ctx * CTX, const unsigned char *in,
+                         size_t len)
+{
+    if (len != GOST2012_HASH_STATE_SIZE
+        || in[0] != GOST2012_HASH_STATE_VERSION
+        || (in[1] != 32 && in[1] != 64) || in[2] >= 64 || in[3] != 0)
+        return 0;
+
+    CTX->digest_size = in[1] * 8;
+    CTX->bufsize = in[2];
+    memcpy(CTX->h.B, in + 4, 64);
+    memcpy(CTX->N.B, in + 4 + 64, 64);
+    memcpy(CTX->Sigma.B, in + 4 + 128, 64);
+    memcpy(CTX->buffer.B, in + 4 + 192, 64);
+    return 1;
+}
+
 static INLINE void pad(gost2012_hash_ctx * CTX)
 {
     memset(&(CTX->buffer.B[CTX->bufsize]), 0, sizeof(CTX->buffer) - CTX->bufsize);
@@ -60,22 +109,28 @@ static INLINE void pad(gost2012_hash_ctx * CTX)
 
 }
 
+/* y may be unaligned, it is read through memcpy */
 static INLINE void add512(union uint512_u * RESTRICT x,
-                          const union uint512_u * RESTRICT y)
+                          const unsigned char * RESTRICT y)
 {
 #ifndef __GOST3411_BIG_ENDIAN__
     unsigned int CF = 0;
     unsigned int i;
 
 # ifdef HAVE_ADDCARRY_U64
-    for (i = 0; i < 8; i++)
-        CF = _addcarry_u64(CF, x->QWORD[i] , y->QWORD[i], &(x->QWORD[i]));
+    for (i = 0; i < 8; i++) {
+        unsigned long long right;
+
+        memcpy(&right, y + 8 * i, 8);
+        CF = _addcarry_u64(CF, x->QWORD[i], right, &(x->QWORD[i]));
+    }
 # else
     for (i = 0; i < 8; i++) {
         const unsigned long long left = x->QWORD[i];
-        unsigned long long sum;
+        unsigned long long right, sum;
 
-        sum = left + y->QWORD[i] + CF;
+        memcpy(&right, y + 8 * i, 8);
+        sum = left + right + CF;
         /*
          * (sum == left): is noop, because it's possible only
          * when `left' is added with `0 + 0' or with `ULLONG_MAX + 1',
@@ -100,7 +155,7 @@ static INLINE void add512(union uint512_u * RESTRICT x,
     int buf;
 
     xp = (unsigned char *)&x[0];
-    yp = (const unsigned char *)&y[0];
+    yp = y;
 
     buf = 0;
     for (i = 0; i < 64; i++) {
@@ -110,8 +165,8 @@ static INLINE void add512(union uint512_u * RESTRICT x,
 #endif /* __GOST3411_BIG_ENDIAN__ */
 }
 
-static void g(union uint512_u *h, const union uint512_u * RESTRICT N,
-              const union uint512_u * RESTRICT m)
+static void g_default(union uint512_u *h, const union uint512_u * RESTRICT N,
+                      const unsigned char * RESTRICT m)
 {
 #ifdef __GOST3411_HAS_SSE2__
     __m128i xmm0, xmm2, xmm4, xmm6; /* XMMR0-quadruple */
@@ -135,7 +190,7 @@ static void g(union uint512_u *h, const union uint512_u * RESTRICT N,
     X128R(xmm0, xmm2, xmm4, xmm6, xmm1, xmm3, xmm5, xmm7);
 
     STORE(h, xmm0, xmm2, xmm4, xmm6);
-# ifndef __i386__
+# ifdef __i386__
     /* Restore the Floating-point status on the CPU */
     /* This is only required on MMX, but EXTRACT32 is using MMX */
     _mm_empty();
@@ -148,7 +203,7 @@ static void g(union uint512_u *h, const union uint512_u * RESTRICT N,
 
     /* Starting E() */
     Ki = data;
-    XLPS((&Ki), ((const union uint512_u *)&m[0]), (&data));
+    XLPSM((&Ki), m, (&data));
 
     for (i = 0; i < 11; i++)
         ROUND(i, (&Ki), (&data));
@@ -158,34 +213,110 @@ static void g(union uint512_u *h, const union uint512_u * RESTRICT N,
     /* E() done */
 
     X((&data), h, (&data));
-    X((&data), m, h);
+    XM((&data), m, h);
 #endif
 }
 
-static INLINE void stage2(gost2012_hash_ctx * CTX, const union uint512_u *data)
+/*
+ * The message block m is read with unaligned loads, so it may point
+ * straight into the caller's data.
+ */
+static void g(union uint512_u *h, const union uint512_u * RESTRICT N,
+              const unsigned char * RESTRICT m)
+{
+#ifdef GOST3411_DISPATCH
+    unsigned int caps = gost_cpu_caps();
+
+    if ((caps & GOST3411_AVX512_CAPS) == GOST3411_AVX512_CAPS) {
+        g_avx512(h, N, m);
+        return;
+    }
+#endif
+    g_default(h, N, m);
+}
+
+static INLINE void stage2(gost2012_hash_ctx * CTX, const unsigned char *data)
 {
     g(&(CTX->h), &(CTX->N), data);
 
-    add512(&(CTX->N), &buffer512);
+    add512(&(CTX->N), buffer512.B);
     add512(&(CTX->Sigma), data);
 }
 
-static INLINE void stage3(gost2012_hash_ctx * CTX)
+/*
+ * g() of n independent contexts. The AVX-512 kernel takes them in pairs,
+ * so that the LPS chains of both keep the pipeline busy.
+ */
+static void g_multi(union uint512_u *const h[],
+                    const union uint512_u *const N[],
+                    const unsigned char *const m[], unsigned int n)
 {
-    pad(CTX);
-    g(&(CTX->h), &(CTX->N), &(CTX->buffer));
-    add512(&(CTX->Sigma), &CTX->buffer);
+    unsigned int i = 0;
 
-    memset(&(CTX->buffer.B[0]), 0, sizeof(uint512_u));
+#ifdef GOST3411_DISPATCH
+    unsigned int caps = gost_cpu_caps();
+
+    if ((caps & GOST3411_AVX512_CAPS) == GOST3411_AVX512_CAPS)
+        for (; i + 1 < n; i += 2)
+            g2_avx512(h + i, N + i, m + i);
+#endif
+    for (; i < n; i++)
+        g(h[i], N[i], m[i]);
+}
+
+static void stage2_multi(gost2012_hash_ctx *const CTX[],
+                         const unsigned char *const data[], unsigned int n)
+{
+    union uint512_u *h[GOST2012_HASH_LANES] = { NULL };
+    const union uint512_u *N[GOST2012_HASH_LANES] = { NULL };
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        h[i] = &(CTX[i]->h);
+        N[i] = &(CTX[i]->N);
+    }
+    g_multi(h, N, data, n);
+
+    for (i = 0; i < n; i++) {
+        add512(&(CTX[i]->N), buffer512.B);
+        add512(&(CTX[i]->Sigma), data[i]);
+    }
+}
+
+static void stage3_multi(gost2012_hash_ctx *const CTX[], unsigned int n)
+{
+    union uint512_u *h[GOST2012_HASH_LANES] = { NULL };
+    const union uint512_u *N[GOST2012_HASH_LANES] = { NULL };
+    const unsigned char *m[GOST2012_HASH_LANES] = { NULL };
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        pad(CTX[i]);
+        h[i] = &(CTX[i]->h);
+        N[i] = &(CTX[i]->N);
+        m[i] = CTX[i]->buffer.B;
+    }
+    g_multi(h, N, m, n);
+
+    for (i = 0; i < n; i++) {
+        add512(&(CTX[i]->Sigma), CTX[i]->buffer.B);
+
+        memset(&(CTX[i]->buffer.B[0]), 0, sizeof(uint512_u));
 #ifndef __GOST3411_BIG_ENDIAN__
-    CTX->buffer.QWORD[0] = CTX->bufsize << 3;
+        CTX[i]->buffer.QWORD[0] = CTX[i]->bufsize << 3;
 #else
-    CTX->buffer.QWORD[0] = BSWAP64(CTX->bufsize << 3);
+        CTX[i]->buffer.QWORD[0] = BSWAP64(CTX[i]->bufsize << 3);
 #endif
-    add512(&(CTX->N), &(CTX->buffer));
+        add512(&(CTX[i]->N), CTX[i]->buffer.B);
 
-    g(&(CTX->h), &buffer0, &(CTX->N));
-    g(&(CTX->h), &buffer0, &(CTX->Sigma));
+        N[i] = &buffer0;
+        m[i] = CTX[i]->N.B;
+    }
+    g_multi(h, N, m, n);
+
+    for (i = 0; i < n; i++)
+        m[i] = CTX[i]->Sigma.B;
+    g_multi(h, N, m, n);
 }
 
 /*
@@ -197,16 +328,10 @@ void gost2012_hash_block(gost2012_hash_ctx * CTX,
 {
     register size_t bufsize = CTX->bufsize;
 
-    if (bufsize == 0) {
-        while (len >= 64) {
-            memcpy(&CTX->buffer.B[0], data, 64);
-            stage2(CTX, &(CTX->buffer));
-            data += 64;
-            len -= 64;
-        }
-    }
+    if (len == 0)
+        return;
 
-    while (len) {
+    if (bufsize > 0) {
         register size_t chunksize = 64 - bufsize;
         if (chunksize > len)
             chunksize = len;
@@ -217,12 +342,22 @@ void gost2012_hash_block(gost2012_hash_ctx * CTX,
         len -= chunksize;
         data += chunksize;
 
-        if (bufsize == 64) {
-            stage2(CTX, &(CTX->buffer) );
-            bufsize = 0;
+        if (bufsize < 64) {
+            CTX->bufsize = bufsize;
+            return;
         }
+        stage2(CTX, CTX->buffer.B);
     }
-    CTX->bufsize = bufsize;
+
+    /* Whole blocks are hashed in place, only the tail is buffered */
+    while (len >= 64) {
+        stage2(CTX, data);
+        data += 64;
+        len -= 64;
+    }
+
+    memcpy(&CTX->buffer.B[0], data, len);
+    CTX->bufsize = len;
 }
 
 /*
@@ -232,12 +367,221 @@ void gost2012_hash_block(gost2012_hash_ctx * CTX,
  */
 void gost2012_finish_hash(gost2012_hash_ctx * CTX, unsigned char *digest)
 {
-    stage3(CTX);
+    gost2012_finish_hash_multi(&CTX, &digest, 1);
+}
+
+/*
+ * Hash len bytes of data[i] into CTX[i] for each of the n contexts,
+ * advancing them in lockstep. Contexts which are not at the same offset
+ * in their blocks are hashed one by one.
+ */
+void gost2012_hash_block_multi(gost2012_hash_ctx *const CTX[],
+                               const unsigned char *const data[], size_t len,
+                               unsigned int n)
+{
+    size_t bufsize, done = 0;
+    unsigned int i;
+
+    while (n > GOST2012_HASH_LANES) {
+        gost2012_hash_block_multi(CTX, data, len, GOST2012_HASH_LANES);
+        CTX += GOST2012_HASH_LANES;
+        data += GOST2012_HASH_LANES;
+        n -= GOST2012_HASH_LANES;
+    }
+    if (n == 0 || len == 0)
+        return;
+
+    bufsize = CTX[0]->bufsize;
+    for (i = 1; i < n; i++)
+        if (CTX[i]->bufsize != bufsize)
+            break;
+    if (i < n) {
+        for (i = 0; i < n; i++)
+            gost2012_hash_block(CTX[i], data[i], len);
+        return;
+    }
+
+    if (bufsize > 0) {
+        const unsigned char *m[GOST2012_HASH_LANES];
+
+        done = 64 - bufsize;
+        if (done > len)
+            done = len;
+        for (i = 0; i < n; i++) {
+            memcpy(&CTX[i]->buffer.B[bufsize], data[i], done);
+            m[i] = CTX[i]->buffer.B;
+        }
+        bufsize += done;
+        if (bufsize < 64) {
+            for (i = 0; i < n; i++)
+                CTX[i]->bufsize = bufsize;
+            return;
+        }
+        stage2_multi(CTX, m, n);
+    }
+
+    while (len - done >= 64) {
+        const unsigned char *m[GOST2012_HASH_LANES];
+
+        for (i = 0; i < n; i++)
+            m[i] = data[i] + done;
+        stage2_multi(CTX, m, n);
+        done += 64;
+    }
+
+    bufsize = len - done;
+    for (i = 0; i < n; i++)
+        memcpy(&CTX[i]->buffer.B[0], data[i] + done, bufsize);
+    for (i = 0; i < n; i++)
+        CTX[i]->bufsize = bufsize;
+}
+
+/*
+ * Finish the n contexts as gost2012_finish_hash() does, with digest[i]
+ * receiving the hash of CTX[i].
+ */
+void gost2012_finish_hash_multi(gost2012_hash_ctx *const CTX[],
+                                unsigned char *const digest[], unsigned int n)
+{
+    unsigned int i;
+
+    while (n > GOST2012_HASH_LANES) {
+        gost2012_finish_hash_multi(CTX, digest, GOST2012_HASH_LANES);
+        CTX += GOST2012_HASH_LANES;
+        digest += GOST2012_HASH_LANES;
+        n -= GOST2012_HASH_LANES;
+    }
+    stage3_multi(CTX, n);
+
+    for (i = 0; i < n; i++) {
+        CTX[i]->bufsize = 0;
+
+        if (CTX[i]->digest_size == 256)
+            memcpy(digest[i], &(CTX[i]->h.QWORD[4]), 32);
+        else
+            memcpy(digest[i], &(CTX[i]->h.QWORD[0]), 64);
+    }
+}
+
+/*
+ * Compute the digests of n messages of len bytes each, data[i] hashing
+ * to digest[i].
+ */
+void gost2012_hash_multi(const unsigned int digest_size,
+                         const unsigned char *const data[], size_t len,
+                         unsigned char *const digest[], unsigned int n)
+{
+    gost2012_hash_ctx ctx[GOST2012_HASH_LANES];
+    gost2012_hash_ctx *pctx[GOST2012_HASH_LANES];
+    unsigned int i, lanes;
+
+    for (; n > 0; n -= lanes, data += lanes, digest += lanes) {
+        lanes = n < GOST2012_HASH_LANES ? n : GOST2012_HASH_LANES;
+        for (i = 0; i < lanes; i++) {
+            init_gost2012_hash_ctx(&ctx[i], digest_size);
+            pctx[i] = &ctx[i];
+        }
+        gost2012_hash_block_multi(pctx, data, len, lanes);
+        gost2012_finish_hash_multi(pctx, digest, lanes);
+    }
+    OPENSSL_cleanse(ctx, sizeof(ctx));
+}
 
-    CTX->bufsize = 0;
+/*
+ * Key CTX for HMAC: the key blocks xored with ipad and opad are hashed
+ * once here, then the MAC of each message starts from their states.
+ */
+void gost2012_hmac_init(gost2012_hmac_ctx * CTX,
+                        const unsigned int digest_size,
+                        const unsigned char *key, size_t keylen)
+{
+    unsigned char block[64];
+    size_t i;
+
+    memset(block, 0, sizeof(block));
+    if (keylen > sizeof(block)) {
+        init_gost2012_hash_ctx(&CTX->inner, digest_size);
+        gost2012_hash_block(&CTX->inner, key, keylen);
+        gost2012_finish_hash(&CTX->inner, block);
+    } else {
+        memcpy(block, key, keylen);
+    }
+
+    for (i = 0; i < sizeof(block); i++)
+        block[i] ^= 0x36;
+    init_gost2012_hash_ctx(&CTX->ipad, digest_size);
+    gost2012_hash_block(&CTX->ipad, block, sizeof(block));
+
+    for (i = 0; i < sizeof(block); i++)
+        block[i] ^= 0x36 ^ 0x5c;
+    init_gost2012_hash_ctx(&CTX->opad, digest_size);
+    gost2012_hash_block(&CTX->opad, block, sizeof(block));
+
+    OPENSSL_cleanse(block, sizeof(block));
+    CTX->inner = CTX->ipad;
+}
+
+/* Start a new message with the key of CTX */
+void gost2012_hmac_reset(gost2012_hmac_ctx * CTX)
+{
+    CTX->inner = CTX->ipad;
+}
+
+void gost2012_hmac_update(gost2012_hmac_ctx * CTX,
+                          const unsigned char *data, size_t len)
+{
+    gost2012_hash_block(&CTX->inner, data, len);
+}
+
+/*
+ * Write digest_size / 8 bytes of MAC and reset CTX for the next message
+ * with the same key.
+ */
+void gost2012_hmac_final(gost2012_hmac_ctx * CTX, unsigned char *mac)
+{
+    unsigned char digest[64];
+    size_t len = CTX->inner.digest_size / 8;
+
+    gost2012_finish_hash(&CTX->inner, digest);
+    CTX->inner = CTX->opad;
+    gost2012_hash_block(&CTX->inner, digest, len);
+    gost2012_finish_hash(&CTX->inner, mac);
+    OPENSSL_cleanse(digest, sizeof(digest));
+    CTX->inner = CTX->ipad;
+}
+
+void gost2012_hmac_start_multi(const gost2012_hmac_ctx * KEY,
+                               gost2012_hash_ctx *const CTX[], unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        *CTX[i] = KEY->ipad;
+}
+
+void gost2012_hmac_final_multi(const gost2012_hmac_ctx * KEY,
+                               gost2012_hash_ctx *const CTX[],
+                               unsigned char *const mac[], unsigned int n)
+{
+    unsigned char digest[GOST2012_HASH_LANES][64];
+    unsigned char *pdigest[GOST2012_HASH_LANES];
+    size_t len = KEY->ipad.digest_size / 8;
+    unsigned int i;
+
+    while (n > GOST2012_HASH_LANES) {
+        gost2012_hmac_final_multi(KEY, CTX, mac, GOST2012_HASH_LANES);
+        CTX += GOST2012_HASH_LANES;
+        mac += GOST2012_HASH_LANES;
+        n -= GOST2012_HASH_LANES;
+    }
 
-    if (CTX->digest_size == 256)
-        memcpy(digest, &(CTX->h.QWORD[4]), 32);
-    else
-        memcpy(digest, &(CTX->h.QWORD[0]), 64);
+    for (i = 0; i < GOST2012_HASH_LANES; i++)
+        pdigest[i] = digest[i];
+    gost2012_finish_hash_multi(CTX, pdigest, n);
+    for (i = 0; i < n; i++)
+        *CTX[i] = KEY->opad;
+    gost2012_hash_block_multi(CTX, (const unsigned char *const *)pdigest,
+                              len, n);
+    gost2012_finish_hash_multi(CTX, mac, n);
+    OPENSSL_cleanse(digest, sizeof(digest));
 }
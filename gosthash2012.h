@@ -53,8 +53,8 @@
 # define ALIGN(x) __attribute__ ((__aligned__(x)))
 #endif
 
-ALIGN(16)
-typedef union uint512_u {
+/* Aligned by the tag, so that contexts inside other structures are too */
+typedef union ALIGN(16) uint512_u {
     unsigned long long QWORD[8];
     unsigned char B[64];
 } uint512_u;
@@ -77,3 +77,59 @@ void init_gost2012_hash_ctx(gost2012_hash_ctx * CTX,
 void gost2012_hash_block(gost2012_hash_ctx * CTX,
                          const unsigned char *data, size_t len);
 void gost2012_finish_hash(gost2012_hash_ctx * CTX, unsigned char *digest);
+
+/*
+ * Serialized hash state: a 4-byte header (format version, digest size in
+ * bytes, bytes buffered, zero), then h, N, Sigma and the buffer, 64 bytes
+ * each, in the byte order of the digest: N and Sigma are little-endian
+ * numbers. The big-endian code keeps these bytes in the same order, see
+ * gost2012_hash_export.
+ */
+#define GOST2012_HASH_STATE_VERSION 1
+#define GOST2012_HASH_STATE_SIZE (4 + 4 * 64)
+
+void gost2012_hash_export(const gost2012_hash_ctx * CTX, unsigned char *out);
+int gost2012_hash_import(gost2012_hash_ctx * CTX, const unsigned char *in,
+                         size_t len);
+
+/* Multi-buffer interface: up to this many contexts are interleaved */
+#define GOST2012_HASH_LANES 8
+
+void gost2012_hash_block_multi(gost2012_hash_ctx *const CTX[],
+                               const unsigned char *const data[], size_t len,
+                               unsigned int n);
+void gost2012_finish_hash_multi(gost2012_hash_ctx *const CTX[],
+                                unsigned char *const digest[], unsigned int n);
+void gost2012_hash_multi(const unsigned int digest_size,
+                         const unsigned char *const data[], size_t len,
+                         unsigned char *const digest[], unsigned int n);
+
+/*
+ * HMAC (R 50.1.113-2016) with the hash of digest_size bits. The hash
+ * states after the key blocks are kept, so restarting with the same key
+ * copies them instead of hashing the key again.
+ */
+typedef struct gost2012_hmac_ctx {
+    gost2012_hash_ctx ipad;
+    gost2012_hash_ctx opad;
+    gost2012_hash_ctx inner;
+} gost2012_hmac_ctx;
+
+void gost2012_hmac_init(gost2012_hmac_ctx * CTX,
+                        const unsigned int digest_size,
+                        const unsigned char *key, size_t keylen);
+void gost2012_hmac_reset(gost2012_hmac_ctx * CTX);
+void gost2012_hmac_update(gost2012_hmac_ctx * CTX,
+                          const unsigned char *data, size_t len);
+void gost2012_hmac_final(gost2012_hmac_ctx * CTX, unsigned char *mac);
+
+/*
+ * n MACs with the key of KEY at once: the contexts are started with
+ * gost2012_hmac_start_multi, fed with gost2012_hash_block_multi and
+ * finished into mac[i] with gost2012_hmac_final_multi.
+ */
+void gost2012_hmac_start_multi(const gost2012_hmac_ctx * KEY,
+                               gost2012_hash_ctx *const CTX[], unsigned int n);
+void gost2012_hmac_final_multi(const gost2012_hmac_ctx * KEY,
+                               gost2012_hash_ctx *const CTX[],
+                               unsigned char *const mac[], unsigned int n);
@@ -0,0 +1,198 @@
+/*
+ * Implementation of core functions for GOST R 34.11-2012 using AVX-512
+ * with VBMI and GFNI, selected at run time.
+ *
+ * This file is distributed under the same license as OpenSSL.
+ *
+ * The 512-bit state is held in one register with its 8x8 byte matrix
+ * transposed: byte i of word w is at 8 * i + w, so P costs nothing. S is
+ * a vpermi2b lookup of each half of the S-box. Byte i of L(y) is the xor
+ * over j of A_ij applied to byte j of y, where the A_ij are 8x8 bit
+ * matrices. With byte j of the eight words broadcast to every qword, one
+ * gf2p8affineqb applies A_ij to them for all i at once. There are no
+ * table lookups, so the kernel runs in constant time.
+ */
+
+#if !defined(GOST_X86_DISPATCH) || defined(__GOST3411_BIG_ENDIAN__)
+# error "GOST R 34.11-2012: AVX-512 implementation requires x86 dispatch"
+#endif
+
+#include <immintrin.h>
+
+#define GOST3411_AVX512 GOST_TARGET("avx512f,avx512bw,avx512vbmi,gfni")
+#define GOST3411_AVX512_CAPS \
+    (GOST_CPU_AVX512F | GOST_CPU_AVX512BW | GOST_CPU_AVX512VBMI | GOST_CPU_GFNI)
+
+/* the S-box, in the halves for vpermi2b */
+ALIGN(64)
+static const unsigned char gost3411_avx512_pi[256] = {
+    0xFC, 0xEE, 0xDD, 0x11, 0xCF, 0x6E, 0x31, 0x16,
+    0xFB, 0xC4, 0xFA, 0xDA, 0x23, 0xC5, 0x04, 0x4D,
+    0xE9, 0x77, 0xF0, 0xDB, 0x93, 0x2E, 0x99, 0xBA,
+    0x17, 0x36, 0xF1, 0xBB, 0x14, 0xCD, 0x5F, 0xC1,
+    0xF9, 0x18, 0x65, 0x5A, 0xE2, 0x5C, 0xEF, 0x21,
+    0x81, 0x1C, 0x3C, 0x42, 0x8B, 0x01, 0x8E, 0x4F,
+    0x05, 0x84, 0x02, 0xAE, 0xE3, 0x6A, 0x8F, 0xA0,
+    0x06, 0x0B, 0xED, 0x98, 0x7F, 0xD4, 0xD3, 0x1F,
+    0xEB, 0x34, 0x2C, 0x51, 0xEA, 0xC8, 0x48, 0xAB,
+    0xF2, 0x2A, 0x68, 0xA2, 0xFD, 0x3A, 0xCE, 0xCC,
+    0xB5, 0x70, 0x0E, 0x56, 0x08, 0x0C, 0x76, 0x12,
+    0xBF, 0x72, 0x13, 0x47, 0x9C, 0xB7, 0x5D, 0x87,
+    0x15, 0xA1, 0x96, 0x29, 0x10, 0x7B, 0x9A, 0xC7,
+    0xF3, 0x91, 0x78, 0x6F, 0x9D, 0x9E, 0xB2, 0xB1,
+    0x32, 0x75, 0x19, 0x3D, 0xFF, 0x35, 0x8A, 0x7E,
+    0x6D, 0x54, 0xC6, 0x80, 0xC3, 0xBD, 0x0D, 0x57,
+    0xDF, 0xF5, 0x24, 0xA9, 0x3E, 0xA8, 0x43, 0xC9,
+    0xD7, 0x79, 0xD6, 0xF6, 0x7C, 0x22, 0xB9, 0x03,
+    0xE0, 0x0F, 0xEC, 0xDE, 0x7A, 0x94, 0xB0, 0xBC,
+    0xDC, 0xE8, 0x28, 0x50, 0x4E, 0x33, 0x0A, 0x4A,
+    0xA7, 0x97, 0x60, 0x73, 0x1E, 0x00, 0x62, 0x44,
+    0x1A, 0xB8, 0x38, 0x82, 0x64, 0x9F, 0x26, 0x41,
+    0xAD, 0x45, 0x46, 0x92, 0x27, 0x5E, 0x55, 0x2F,
+    0x8C, 0xA3, 0xA5, 0x7D, 0x69, 0xD5, 0x95, 0x3B,
+    0x07, 0x58, 0xB3, 0x40, 0x86, 0xAC, 0x1D, 0xF7,
+    0x30, 0x37, 0x6B, 0xE4, 0x88, 0xD9, 0xE7, 0x89,
+    0xE1, 0x1B, 0x83, 0x49, 0x4C, 0x3F, 0xF8, 0xFE,
+    0x8D, 0x53, 0xAA, 0x90, 0xCA, 0xD8, 0x85, 0x61,
+    0x20, 0x71, 0x67, 0xA4, 0x2D, 0x2B, 0x09, 0x5B,
+    0xCB, 0x9B, 0x25, 0xD0, 0xBE, 0xE5, 0x6C, 0x52,
+    0x59, 0xA6, 0x74, 0xD2, 0xE6, 0xF4, 0xB4, 0xC0,
+    0xD1, 0x66, 0xAF, 0xC2, 0x39, 0x4B, 0x63, 0xB6
+};
+
+/* A_ij in qword i of row j, derived from Ax */
+ALIGN(64)
+static const unsigned long long gost3411_avx512_l[8][8] = {
+    {0x63c7ecba162c58b1ULL, 0xae5c1682aa55ab57ULL, 0x0205091120408001ULL,
+     0x29538e3542850a14ULL, 0x65cbf28166cc9932ULL, 0x9932fc6059b366ccULL,
+     0x70e0b11357ae5cb8ULL, 0x0c183d76e0c18306ULL},
+    {0x3060f0d193264c98ULL, 0x56ac0f49c58a152bULL, 0xfffe03f80f1f3f7fULL,
+     0x122559a151a24489ULL, 0x254bb343a2448912ULL, 0x050b132240800102ULL,
+     0x43874cdbf4e8d0a1ULL, 0x2a54832c72e5ca95ULL},
+    {0xa85008b9dab56ad4ULL, 0x9d3beb4a0913274eULL, 0x18317aecc183060cULL,
+     0x428548d3e4c89021ULL, 0x172e4a831122458bULL, 0x2245a970c2840811ULL,
+     0x3d7ac9af63c78f1eULL, 0x9f3ee25b2953a74fULL},
+    {0x122559a151a24489ULL, 0x4a94628f54a952a5ULL, 0x102050b071e2c488ULL,
+     0x3060f0d193264c98ULL, 0x0d1a397ef0e1c386ULL, 0x82048b95a850a041ULL,
+     0xc081c3464c983060ULL, 0x75eba231172e5dbaULL},
+    {0xb8705809ab57ae5cULL, 0x274eba5282040913ULL, 0x73e7bc0a67ce9c39ULL,
+     0xdab5b0bbad5bb66dULL, 0x82048b95a850a041ULL, 0x0d1a397ef0e1c386ULL,
+     0x8912acd02851a244ULL, 0x8103868c983060c0ULL},
+    {0xd4a884dc6ddab56aULL, 0xc386ce5f7cf8f0e1ULL, 0x428548d3e4c89021ULL,
+     0x18317aecc183060cULL, 0x4b96668744891225ULL, 0x9224db25d9b264c9ULL,
+     0x468c5ff9b468d1a3ULL, 0x0a14234d90214285ULL},
+    {0x0205091120408001ULL, 0xd2a49ae71d3a74e9ULL, 0x63c7ecba162c58b1ULL,
+     0xb06172551b366cd8ULL, 0x0102040810204080ULL, 0xe1c3672fbe7cf8f0ULL,
+     0xba7551188b172e5dULL, 0x0409172a50a04182ULL},
+    {0x0c183d76e0c18306ULL, 0x2347ad78d2a44891ULL, 0x0409172a50a04182ULL,
+     0xfaf510da4f9f3e7dULL, 0xc183c74e5cb870e0ULL, 0x43874cdbf4e8d0a1ULL,
+     0x050b132240800102ULL, 0x63c7ecba162c58b1ULL}
+};
+
+/* transposes the 8x8 byte matrix */
+ALIGN(64)
+static const unsigned char gost3411_avx512_tr[64] = {
+    0, 8, 16, 24, 32, 40, 48, 56, 1, 9, 17, 25, 33, 41, 49, 57,
+    2, 10, 18, 26, 34, 42, 50, 58, 3, 11, 19, 27, 35, 43, 51, 59,
+    4, 12, 20, 28, 36, 44, 52, 60, 5, 13, 21, 29, 37, 45, 53, 61,
+    6, 14, 22, 30, 38, 46, 54, 62, 7, 15, 23, 31, 39, 47, 55, 63
+};
+
+typedef struct {
+    __m512i s[4];               /* the S-box */
+    __m512i l[8];               /* the A_ij of byte j */
+    __m512i b[8];               /* vpermb indices broadcasting byte j */
+} gost3411_avx512_tables;
+
+static GOST3411_AVX512 __m512i lps_avx512(__m512i x,
+                                          const gost3411_avx512_tables *t)
+{
+    __m512i lo = _mm512_permutex2var_epi8(t->s[0], x, t->s[1]);
+    __m512i hi = _mm512_permutex2var_epi8(t->s[2], x, t->s[3]);
+    __m512i y;
+    int j;
+
+    x = _mm512_mask_blend_epi8(_mm512_movepi8_mask(x), lo, hi);
+    y = _mm512_gf2p8affine_epi64_epi8(_mm512_permutexvar_epi8(t->b[0], x),
+                                      t->l[0], 0);
+    for (j = 1; j < 8; j++)
+        y = _mm512_xor_si512(y, _mm512_gf2p8affine_epi64_epi8(
+                _mm512_permutexvar_epi8(t->b[j], x), t->l[j], 0));
+    return y;
+}
+
+static GOST3411_AVX512 void tables_avx512(gost3411_avx512_tables *t)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        t->s[i] = _mm512_load_si512((const void *)(gost3411_avx512_pi + 64 * i));
+    for (i = 0; i < 8; i++) {
+        t->l[i] = _mm512_load_si512((const void *)gost3411_avx512_l[i]);
+        /* byte 8 * w + i to position w of every qword */
+        t->b[i] = _mm512_set1_epi64((long long)(0x3830282018100800ULL
+                                                + 0x0101010101010101ULL * i));
+    }
+}
+
+#define TLOAD(P) _mm512_permutexvar_epi8(tr, _mm512_loadu_si512((const void *)(P)))
+
+static GOST3411_AVX512 void g_avx512(union uint512_u *h,
+                                     const union uint512_u * RESTRICT N,
+                                     const unsigned char * RESTRICT m)
+{
+    gost3411_avx512_tables t;
+    __m512i tr = _mm512_load_si512((const void *)gost3411_avx512_tr);
+    __m512i hh, mm, k, s;
+    unsigned int i;
+
+    tables_avx512(&t);
+    hh = TLOAD(h);
+    mm = TLOAD(m);
+    k = lps_avx512(_mm512_xor_si512(hh, TLOAD(N)), &t);
+    s = _mm512_xor_si512(k, mm);
+    /* K[i + 1] does not depend on the state, so the two LPS overlap */
+    for (i = 0; i < 12; i++) {
+        s = lps_avx512(s, &t);
+        k = lps_avx512(_mm512_xor_si512(k, TLOAD(&C[i])), &t);
+        s = _mm512_xor_si512(s, k);
+    }
+    s = _mm512_xor_si512(s, _mm512_xor_si512(hh, mm));
+    _mm512_storeu_si512((void *)h, _mm512_permutexvar_epi8(tr, s));
+}
+
+/* g() of two independent contexts, four LPS chains in flight */
+static GOST3411_AVX512 void g2_avx512(union uint512_u *const h[2],
+                                      const union uint512_u *const N[2],
+                                      const unsigned char *const m[2])
+{
+    gost3411_avx512_tables t;
+    __m512i tr = _mm512_load_si512((const void *)gost3411_avx512_tr);
+    __m512i h0, m0, k0, s0, h1, m1, k1, s1, c;
+    unsigned int i;
+
+    tables_avx512(&t);
+    h0 = TLOAD(h[0]);
+    m0 = TLOAD(m[0]);
+    h1 = TLOAD(h[1]);
+    m1 = TLOAD(m[1]);
+    k0 = lps_avx512(_mm512_xor_si512(h0, TLOAD(N[0])), &t);
+    k1 = lps_avx512(_mm512_xor_si512(h1, TLOAD(N[1])), &t);
+    s0 = _mm512_xor_si512(k0, m0);
+    s1 = _mm512_xor_si512(k1, m1);
+    for (i = 0; i < 12; i++) {
+        c = TLOAD(&C[i]);
+        s0 = lps_avx512(s0, &t);
+        s1 = lps_avx512(s1, &t);
+        k0 = lps_avx512(_mm512_xor_si512(k0, c), &t);
+        k1 = lps_avx512(_mm512_xor_si512(k1, c), &t);
+        s0 = _mm512_xor_si512(s0, k0);
+        s1 = _mm512_xor_si512(s1, k1);
+    }
+    s0 = _mm512_xor_si512(s0, _mm512_xor_si512(h0, m0));
+    s1 = _mm512_xor_si512(s1, _mm512_xor_si512(h1, m1));
+    _mm512_storeu_si512((void *)h[0], _mm512_permutexvar_epi8(tr, s0));
+    _mm512_storeu_si512((void *)h[1], _mm512_permutexvar_epi8(tr, s1));
+}
+
+#undef TLOAD
@@ -30,20 +30,23 @@
 # define _datai 7 - _i
 #endif
 
-#define XLPS(x, y, data) { \
-    register unsigned long long r0, r1, r2, r3, r4, r5, r6, r7; \
+/* block m may be unaligned, its words are read through memcpy */
+#define XM(x, m, z) { \
+    unsigned long long _w[8]; \
+    memcpy(_w, m, sizeof(_w)); \
+    z->QWORD[0] = x->QWORD[0] ^ _w[0]; \
+    z->QWORD[1] = x->QWORD[1] ^ _w[1]; \
+    z->QWORD[2] = x->QWORD[2] ^ _w[2]; \
+    z->QWORD[3] = x->QWORD[3] ^ _w[3]; \
+    z->QWORD[4] = x->QWORD[4] ^ _w[4]; \
+    z->QWORD[5] = x->QWORD[5] ^ _w[5]; \
+    z->QWORD[6] = x->QWORD[6] ^ _w[6]; \
+    z->QWORD[7] = x->QWORD[7] ^ _w[7]; \
+}
+
+#define __LPS(data) { \
     int _i; \
     \
-    r0 = x->QWORD[0] ^ y->QWORD[0]; \
-    r1 = x->QWORD[1] ^ y->QWORD[1]; \
-    r2 = x->QWORD[2] ^ y->QWORD[2]; \
-    r3 = x->QWORD[3] ^ y->QWORD[3]; \
-    r4 = x->QWORD[4] ^ y->QWORD[4]; \
-    r5 = x->QWORD[5] ^ y->QWORD[5]; \
-    r6 = x->QWORD[6] ^ y->QWORD[6]; \
-    r7 = x->QWORD[7] ^ y->QWORD[7]; \
-    \
-    \
     __XLPS_FOR {\
         data->QWORD[_datai]  = Ax[0][r0 & 0xFF]; \
         data->QWORD[_datai] ^= Ax[1][r1 & 0xFF]; \
@@ -64,6 +67,38 @@
     }\
 }
 
+#define XLPS(x, y, data) { \
+    register unsigned long long r0, r1, r2, r3, r4, r5, r6, r7; \
+    \
+    r0 = x->QWORD[0] ^ y->QWORD[0]; \
+    r1 = x->QWORD[1] ^ y->QWORD[1]; \
+    r2 = x->QWORD[2] ^ y->QWORD[2]; \
+    r3 = x->QWORD[3] ^ y->QWORD[3]; \
+    r4 = x->QWORD[4] ^ y->QWORD[4]; \
+    r5 = x->QWORD[5] ^ y->QWORD[5]; \
+    r6 = x->QWORD[6] ^ y->QWORD[6]; \
+    r7 = x->QWORD[7] ^ y->QWORD[7]; \
+    \
+    __LPS(data); \
+}
+
+#define XLPSM(x, m, data) { \
+    register unsigned long long r0, r1, r2, r3, r4, r5, r6, r7; \
+    unsigned long long _w[8]; \
+    \
+    memcpy(_w, m, sizeof(_w)); \
+    r0 = x->QWORD[0] ^ _w[0]; \
+    r1 = x->QWORD[1] ^ _w[1]; \
+    r2 = x->QWORD[2] ^ _w[2]; \
+    r3 = x->QWORD[3] ^ _w[3]; \
+    r4 = x->QWORD[4] ^ _w[4]; \
+    r5 = x->QWORD[5] ^ _w[5]; \
+    r6 = x->QWORD[6] ^ _w[6]; \
+    r7 = x->QWORD[7] ^ _w[7]; \
+    \
+    __LPS(data); \
+}
+
 #define ROUND(i, Ki, data) { \
     XLPS(Ki, (&C[i]), Ki); \
     XLPS(Ki, data, data); \
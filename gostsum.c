@@ -21,22 +21,24 @@ typedef SSIZE_T ssize_t;
 #endif
 #include <limits.h>
 #include <fcntl.h>
+#include <errno.h>
 #ifdef _WIN32
 # include <io.h>
 #endif
 #include <string.h>
 #include "gosthash.h"
-#define BUF_SIZE 262144
+#include "gostsum_pool.h"
 int hash_file(gost_hash_ctx * ctx, char *filename, char *sum, int mode);
 int hash_stream(gost_hash_ctx * ctx, int fd, char *sum);
 int get_line(FILE *f, char *hash, char *filename);
 void help()
 {
-    fprintf(stderr, "gostsum [-bvt] [-c [file]]| [files]\n"
+    fprintf(stderr, "gostsum [-bvt] [-j jobs] [-c [file]]| [files]\n"
             "\t-c check message digests (default is generate)\n"
             "\t-v verbose, print file names when checking\n"
             "\t-b read files in binary mode\n"
             "\t-t use test GOST paramset (default is CryptoPro paramset)\n"
+            "\t-j hash jobs files at once, 0 for one per processor (default 1)\n"
             "The input for -c should be the list of message digests and file names\n"
             "that is printed on stdout by this program when it generates digests.\n");
     exit(3);
@@ -46,17 +48,89 @@ void help()
 # define O_BINARY 0
 #endif
 
+/* A file to hash, and in check mode its expected digest */
+struct sum_item {
+    char filename[PATH_MAX + 1];
+    char inhash[65];
+    char sum[65];
+    int error;                  /* errno of a failure */
+};
+
+struct sum_run {
+    gost_subst_block *b;
+    int check;
+    int verbose;
+    int open_mode;
+    int count;
+    int errors;
+    int failcount;
+    const char *prog;
+};
+
+/* Runs on the workers of the pool */
+static void hash_item(void *p, void *arg)
+{
+    struct sum_item *item = p;
+    struct sum_run *run = arg;
+    gost_hash_ctx ctx;
+
+    item->error = 0;
+    if (!init_gost_hash_ctx(&ctx, run->b)) {
+        item->error = ENOMEM;
+        return;
+    }
+    if (!hash_file(&ctx, item->filename, item->sum, run->open_mode))
+        item->error = errno ? errno : EIO;
+    done_gost_hash_ctx(&ctx);
+}
+
+/* Runs on the main thread, in the order of the files */
+static void report_item(void *p, void *arg)
+{
+    struct sum_item *item = p;
+    struct sum_run *run = arg;
+
+    run->count++;
+    if (item->error) {
+        fprintf(stderr, "%s: %s\n", item->filename, strerror(item->error));
+        run->errors++;
+        return;
+    }
+    if (!run->check) {
+        printf("%s %s\n", item->sum, item->filename);
+        return;
+    }
+
+    if (strncmp(item->sum, item->inhash, 65) == 0) {
+        if (run->verbose) {
+            fprintf(stderr, "%s\tOK\n", item->filename);
+        }
+    } else {
+        if (run->verbose) {
+            fprintf(stderr, "%s\tFAILED\n", item->filename);
+        } else {
+            fprintf(stderr,
+                    "%s: GOST hash sum check failed for '%s'\n",
+                    run->prog, item->filename);
+        }
+        run->failcount++;
+    }
+}
+
 int main(int argc, char **argv)
 {
     int c, i;
     int verbose = 0;
-    int errors = 0;
     int open_mode = O_RDONLY;
     gost_subst_block *b = &GostR3411_94_CryptoProParamSet;
     FILE *check_file = NULL;
+    int jobs = 1;
     gost_hash_ctx ctx;
+    struct sum_item item;
+    struct sum_run run;
+    sum_pool *pool;
 
-    while ((c = getopt(argc, argv, "bc::tv")) != -1) {
+    while ((c = getopt(argc, argv, "bc::tvj:")) != -1) {
         switch (c) {
         case 'v':
             verbose = 1;
@@ -67,6 +141,13 @@ int main(int argc, char **argv)
         case 'b':
             open_mode |= O_BINARY;
             break;
+        case 'j':
+            jobs = sum_pool_jobs(optarg);
+            if (jobs < 0) {
+                fprintf(stderr, "invalid number of jobs %s\n", optarg);
+                exit(3);
+            }
+            break;
         case 'c':
             if (optarg) {
                 check_file = fopen(optarg, "r");
@@ -83,11 +164,37 @@ int main(int argc, char **argv)
             help();
         }
     }
-    init_gost_hash_ctx(&ctx, b);
+    if (jobs == 0)
+        jobs = sum_pool_cpus();
+    memset(&item, 0, sizeof(item));
+    memset(&run, 0, sizeof(run));
+    run.b = b;
+    run.check = check_file != NULL;
+    run.verbose = verbose;
+    run.open_mode = open_mode;
+    run.prog = argv[0];
+    if (optind == argc && !check_file) {
+        char sum[65];
+        init_gost_hash_ctx(&ctx, b);
+#ifdef _WIN32
+        if (open_mode & O_BINARY) {
+            _setmode(fileno(stdin), O_BINARY);
+        }
+#endif
+        if (!hash_stream(&ctx, fileno(stdin), sum)) {
+            perror("stdin");
+            exit(1);
+        }
+        printf("%s -\n", sum);
+        exit(0);
+    }
+    if (!(pool = sum_pool_new(jobs, sizeof(item), hash_item, report_item,
+                              &run))) {
+        perror(argv[0]);
+        exit(2);
+    }
+
     if (check_file) {
-        char inhash[65], calcsum[65], filename[PATH_MAX];
-        int failcount = 0, count = 0;
-        errors = 0;
         if (check_file == stdin && optind < argc) {
             check_file = fopen(argv[optind], "r");
             if (!check_file) {
@@ -95,93 +202,65 @@ int main(int argc, char **argv)
                 exit(2);
             }
         }
-        while (get_line(check_file, inhash, filename)) {
-            count++;
-            if (!hash_file(&ctx, filename, calcsum, open_mode)) {
-                errors++;
-                continue;
-            }
-            if (strncmp(calcsum, inhash, 65) == 0) {
-                if (verbose) {
-                    fprintf(stderr, "%s\tOK\n", filename);
-                }
-            } else {
-                if (verbose) {
-                    fprintf(stderr, "%s\tFAILED\n", filename);
-                } else {
-                    fprintf(stderr,
-                            "%s: GOST hash sum check failed for '%s'\n",
-                            argv[0], filename);
-                }
-                failcount++;
-            }
+        while (get_line(check_file, item.inhash, item.filename)) {
+            sum_pool_add(pool, &item);
         }
-        if (errors) {
+        sum_pool_finish(pool);
+        if (run.errors) {
             fprintf(stderr,
                     "%s: WARNING %d of %d file(s) cannot be processed\n",
-                    argv[0], errors, count);
+                    argv[0], run.errors, run.count);
 
         }
-        if (verbose && failcount) {
+        if (verbose && run.failcount) {
             fprintf(stderr,
                     "%s: %d of %d file(f) failed GOST hash sum check\n",
-                    argv[0], failcount, count);
+                    argv[0], run.failcount, run.count);
         }
-        exit((failcount || errors) ? 1 : 0);
-    }
-    if (optind == argc) {
-        char sum[65];
-#ifdef _WIN32
-        if (open_mode & O_BINARY) {
-            _setmode(fileno(stdin), O_BINARY);
-        }
-#endif
-        if (!hash_stream(&ctx, fileno(stdin), sum)) {
-            perror("stdin");
-            exit(1);
-        }
-        printf("%s -\n", sum);
-        exit(0);
+        exit((run.failcount || run.errors) ? 1 : 0);
     }
     for (i = optind; i < argc; i++) {
-        char sum[65];
-        if (!hash_file(&ctx, argv[i], sum, open_mode)) {
-            errors++;
-        } else {
-            printf("%s %s\n", sum, argv[i]);
+        if (strlen(argv[i]) > PATH_MAX) {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(ENAMETOOLONG));
+            run.errors++;
+            continue;
         }
+        strcpy(item.filename, argv[i]);
+        sum_pool_add(pool, &item);
     }
-    exit(errors ? 1 : 0);
+    sum_pool_finish(pool);
+    exit(run.errors ? 1 : 0);
 }
 
+/* Leaves errno set on failure, for the caller to report */
 int hash_file(gost_hash_ctx * ctx, char *filename, char *sum, int mode)
 {
-    int fd;
+    int fd, error;
     if ((fd = open(filename, mode)) < 0) {
-        perror(filename);
         return 0;
     }
     if (!hash_stream(ctx, fd, sum)) {
-        perror(filename);
+        error = errno;
         close(fd);
+        errno = error;
         return 0;
     }
     close(fd);
     return 1;
 }
 
+static void sum_update(void *ctx, const unsigned char *data, size_t len)
+{
+    hash_block(ctx, data, len);
+}
+
 int hash_stream(gost_hash_ctx * ctx, int fd, char *sum)
 {
-    unsigned char buffer[BUF_SIZE];
-    ssize_t bytes;
+    unsigned char buffer[32];
     int i;
     start_hash(ctx);
-    while ((bytes = read(fd, buffer, BUF_SIZE)) > 0) {
-        hash_block(ctx, buffer, bytes);
-    }
-    if (bytes < 0) {
+    if (!sum_read(fd, sum_update, ctx))
         return 0;
-    }
     finish_hash(ctx, buffer);
     for (i = 0; i < 32; i++) {
         sprintf(sum + 2 * i, "%02x", buffer[31 - i]);
@@ -0,0 +1,368 @@
+/**********************************************************************
+ *                          gostsum_pool.c                            *
+ *         This file is distributed under the same license as OpenSSL *
+ *                                                                    *
+ *    Ordered worker pool of the gostsum and gost12sum utilities      *
+ **********************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+# include <unistd.h>
+# include <pthread.h>
+# define POOL_THREADS
+#else
+# include <io.h>
+#endif
+#ifdef _MSC_VER
+# include <BaseTsd.h>
+typedef SSIZE_T ssize_t;
+#endif
+#include "gostsum_pool.h"
+
+#define SUM_READ_SIZE 262144
+
+/*
+ * The items in flight are a window of a ring: from head to next they are
+ * taken by the workers, from next to tail queued. The window is a few
+ * items per worker, so a slow file does not stall the others while its
+ * result waits to be reported.
+ */
+struct sum_pool {
+    size_t item_size;
+    void (*hash)(void *item, void *arg);
+    void (*report)(void *item, void *arg);
+    void *arg;
+    int jobs;
+    size_t slots;
+    unsigned char *items;
+    unsigned char *done;
+    size_t head, next, tail;    /* ever growing, taken modulo slots */
+    int stop;
+#ifdef POOL_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t finished;
+    pthread_t *tid;
+    int started;
+#endif
+};
+
+#define POOL_WINDOW 4
+
+int sum_pool_cpus(void)
+{
+#ifdef POOL_THREADS
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n > 0)
+        return (int)n;
+#endif
+    return 1;
+}
+
+int sum_pool_jobs(const char *arg)
+{
+    char *end;
+    long jobs;
+
+    errno = 0;
+    jobs = strtol(arg, &end, 10);
+    if (errno || end == arg || *end || jobs < 0 || jobs > INT_MAX)
+        return -1;
+    return (int)jobs;
+}
+
+/* Reads a buffer, 0 at the end of the file, -1 with errno on error */
+static ssize_t sum_read_buf(int fd, unsigned char *buf)
+{
+    ssize_t bytes;
+
+    do
+        bytes = read(fd, buf, SUM_READ_SIZE);
+    while (bytes < 0 && errno == EINTR);
+    return bytes;
+}
+
+#ifdef POOL_THREADS
+/*
+ * Double buffering of a large file: a reader thread fills one buffer
+ * while the caller hashes the other, so the two overlap even when a single
+ * file is hashed.
+ */
+typedef struct {
+    int fd;
+    unsigned char *buf[2];
+    ssize_t len[2];
+    int full[2];
+    int error;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} sum_reader;
+
+static void *sum_reader_thread(void *arg)
+{
+    sum_reader *r = arg;
+    ssize_t bytes;
+    int i = 0;
+
+    do {
+        pthread_mutex_lock(&r->lock);
+        while (r->full[i])
+            pthread_cond_wait(&r->cond, &r->lock);
+        pthread_mutex_unlock(&r->lock);
+
+        bytes = sum_read_buf(r->fd, r->buf[i]);
+
+        pthread_mutex_lock(&r->lock);
+        r->len[i] = bytes;
+        r->error = bytes < 0 ? errno : 0;
+        r->full[i] = 1;
+        pthread_cond_signal(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+        i ^= 1;
+    } while (bytes > 0);
+    return NULL;
+}
+
+/* Returns -1 if the reader thread could not be started */
+static int sum_read_threaded(int fd, unsigned char *buf,
+                             void (*update)(void *ctx,
+                                            const unsigned char *data,
+                                            size_t len), void *ctx)
+{
+    sum_reader r;
+    pthread_t tid;
+    ssize_t bytes;
+    int i = 0;
+
+    memset(&r, 0, sizeof(r));
+    r.fd = fd;
+    r.buf[0] = buf;
+    r.buf[1] = buf + SUM_READ_SIZE;
+    pthread_mutex_init(&r.lock, NULL);
+    pthread_cond_init(&r.cond, NULL);
+    if (pthread_create(&tid, NULL, sum_reader_thread, &r) != 0) {
+        pthread_mutex_destroy(&r.lock);
+        pthread_cond_destroy(&r.cond);
+        return -1;
+    }
+    for (;;) {
+        pthread_mutex_lock(&r.lock);
+        while (!r.full[i])
+            pthread_cond_wait(&r.cond, &r.lock);
+        bytes = r.len[i];
+        pthread_mutex_unlock(&r.lock);
+        if (bytes <= 0)
+            break;
+
+        update(ctx, r.buf[i], bytes);
+
+        pthread_mutex_lock(&r.lock);
+        r.full[i] = 0;
+        pthread_cond_signal(&r.cond);
+        pthread_mutex_unlock(&r.lock);
+        i ^= 1;
+    }
+    /* The reader stops after the end of the file or an error */
+    pthread_join(tid, NULL);
+    pthread_mutex_destroy(&r.lock);
+    pthread_cond_destroy(&r.cond);
+    errno = r.error;
+    return bytes == 0;
+}
+#endif
+
+int sum_read(int fd, void (*update)(void *ctx, const unsigned char *data,
+                                    size_t len), void *ctx)
+{
+    unsigned char *buf = malloc(2 * SUM_READ_SIZE);
+    ssize_t bytes;
+    int ret = -1, error;
+
+    if (buf == NULL) {
+        errno = ENOMEM;
+        return 0;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#ifdef POOL_THREADS
+    {
+        struct stat st;
+
+        /* A thread is not worth it for what fits in one read */
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+            && st.st_size > SUM_READ_SIZE)
+            ret = sum_read_threaded(fd, buf, update, ctx);
+    }
+#endif
+    if (ret < 0) {
+        while ((bytes = sum_read_buf(fd, buf)) > 0)
+            update(ctx, buf, bytes);
+        ret = bytes == 0;
+    }
+    error = errno;
+    free(buf);
+    errno = error;
+    return ret;
+}
+
+#ifdef POOL_THREADS
+static void *sum_pool_worker(void *arg)
+{
+    sum_pool *pool = arg;
+    size_t slot;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->next == pool->tail && !pool->stop)
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        if (pool->next == pool->tail)
+            break;
+        slot = pool->next++ % pool->slots;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->hash(pool->items + slot * pool->item_size, pool->arg);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->done[slot] = 1;
+        pthread_cond_signal(&pool->finished);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+#endif
+
+sum_pool *sum_pool_new(int jobs, size_t item_size,
+                       void (*hash)(void *item, void *arg),
+                       void (*report)(void *item, void *arg), void *arg)
+{
+    sum_pool *pool = calloc(1, sizeof(*pool));
+
+    if (pool == NULL)
+        return NULL;
+#ifndef POOL_THREADS
+    jobs = 1;
+#endif
+    pool->item_size = item_size;
+    pool->hash = hash;
+    pool->report = report;
+    pool->arg = arg;
+    pool->jobs = jobs > 1 ? jobs : 1;
+    pool->slots = pool->jobs > 1 ? POOL_WINDOW * (size_t)pool->jobs : 1;
+    pool->items = malloc(pool->slots * item_size);
+    pool->done = calloc(pool->slots, 1);
+    if (pool->items == NULL || pool->done == NULL)
+        goto err;
+
+#ifdef POOL_THREADS
+    if (pool->jobs > 1) {
+        int i;
+
+        pool->tid = malloc(pool->jobs * sizeof(*pool->tid));
+        if (pool->tid == NULL)
+            goto err;
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_cond_init(&pool->queued, NULL);
+        pthread_cond_init(&pool->finished, NULL);
+        for (i = 0; i < pool->jobs; i++) {
+            if (pthread_create(&pool->tid[pool->started], NULL,
+                               sum_pool_worker, pool) == 0)
+                pool->started++;
+        }
+        /* Hash on the calling thread if no worker could be started */
+        if (pool->started == 0)
+            pool->jobs = 1;
+    }
+#endif
+    return pool;
+
+ err:
+#ifdef POOL_THREADS
+    free(pool->tid);
+#endif
+    free(pool->items);
+    free(pool->done);
+    free(pool);
+    return NULL;
+}
+
+#ifdef POOL_THREADS
+/* Reports the finished items at the head, waiting for one if wait is set */
+static void sum_pool_drain(sum_pool *pool, int wait)
+{
+    size_t slot;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->head != pool->tail) {
+        slot = pool->head % pool->slots;
+        if (!pool->done[slot]) {
+            if (!wait)
+                break;
+            pthread_cond_wait(&pool->finished, &pool->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->report(pool->items + slot * pool->item_size, pool->arg);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->done[slot] = 0;
+        pool->head++;
+        wait = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+#endif
+
+int sum_pool_add(sum_pool *pool, const void *item)
+{
+#ifdef POOL_THREADS
+    if (pool->jobs > 1) {
+        size_t slot;
+
+        sum_pool_drain(pool, pool->tail - pool->head == pool->slots);
+        pthread_mutex_lock(&pool->lock);
+        slot = pool->tail % pool->slots;
+        memcpy(pool->items + slot * pool->item_size, item, pool->item_size);
+        pool->tail++;
+        pthread_cond_signal(&pool->queued);
+        pthread_mutex_unlock(&pool->lock);
+        return 1;
+    }
+#endif
+    memcpy(pool->items, item, pool->item_size);
+    pool->hash(pool->items, pool->arg);
+    pool->report(pool->items, pool->arg);
+    return 1;
+}
+
+void sum_pool_finish(sum_pool *pool)
+{
+#ifdef POOL_THREADS
+    if (pool->tid != NULL) {
+        int i;
+
+        while (pool->head != pool->tail)
+            sum_pool_drain(pool, 1);
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        pthread_cond_broadcast(&pool->queued);
+        pthread_mutex_unlock(&pool->lock);
+        for (i = 0; i < pool->started; i++)
+            pthread_join(pool->tid[i], NULL);
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->queued);
+        pthread_cond_destroy(&pool->finished);
+        free(pool->tid);
+    }
+#endif
+    free(pool->items);
+    free(pool->done);
+    free(pool);
+}
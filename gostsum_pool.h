@@ -0,0 +1,42 @@
+/**********************************************************************
+ *                          gostsum_pool.h                            *
+ *         This file is distributed under the same license as OpenSSL *
+ *                                                                    *
+ *    Ordered worker pool of the gostsum and gost12sum utilities:     *
+ *    files are hashed concurrently, results are reported in the      *
+ *    order the files were given                                      *
+ **********************************************************************/
+#ifndef GOSTSUM_POOL_H
+# define GOSTSUM_POOL_H
+# include <stddef.h>
+
+typedef struct sum_pool sum_pool;
+
+/*
+ * hash is called on a worker thread for every item added, report on the
+ * calling thread, in the order of sum_pool_add. Items are copied into the
+ * pool. With jobs 1, or without threads, an item is hashed and reported
+ * within sum_pool_add.
+ */
+sum_pool *sum_pool_new(int jobs, size_t item_size,
+                       void (*hash)(void *item, void *arg),
+                       void (*report)(void *item, void *arg), void *arg);
+int sum_pool_add(sum_pool *pool, const void *item);
+/* Reports the remaining items and frees the pool */
+void sum_pool_finish(sum_pool *pool);
+
+/* Online processors, the default for -j 0 */
+int sum_pool_cpus(void);
+/* The number of jobs given to -j, or -1 if it is not one */
+int sum_pool_jobs(const char *arg);
+
+/*
+ * Reads fd to the end, passing the data to update. The file is read rather
+ * than mapped, as a mapping faults if the file is truncated meanwhile.
+ * Large files are read ahead on another thread while update runs.
+ * Returns 0 with errno set on failure.
+ */
+int sum_read(int fd, void (*update)(void *ctx, const unsigned char *data,
+                                    size_t len), void *ctx);
+
+#endif
@@ -505,6 +505,116 @@ static int test_stream(const EVP_CIPHER *type, const char *name,
     return ret;
 }
 
+/*
+ * Long messages go through the multi-block kernels. Check them against
+ * block by block processing and decryption in one call.
+ */
+#define BULK_BLOCKS 131
+static int test_bulk(const EVP_CIPHER *type, const char *name, int block_size,
+    const unsigned char *key, const unsigned char *iv, int acpkm)
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    const size_t size = BULK_BLOCKS * block_size;
+    unsigned char *pt = alloca(size);
+    unsigned char *c[3];
+    int ret, test;
+    int i, pass;
+
+    OPENSSL_assert(ctx);
+    printf("Bulk test [%s]: ", name);
+    for (i = 0; i < size; i++)
+	pt[i] = (unsigned char)(i * 7 + (i >> 8));
+
+    /* one call, block by block, decryption of the first */
+    for (pass = 0; pass < 3; pass++) {
+	const unsigned char *in = pass == 2 ? c[0] : pt;
+	size_t chunk = pass == 1 ? block_size : size;
+	int outlen, tmplen;
+	size_t off;
+
+	c[pass] = alloca(size);
+	EVP_CIPHER_CTX_init(ctx);
+	T(EVP_CipherInit_ex(ctx, type, NULL, key, iv, pass != 2));
+	T(EVP_CIPHER_CTX_set_padding(ctx, 0));
+	if (acpkm) {
+	    if (EVP_CIPHER_get0_provider(type) != NULL) {
+		OSSL_PARAM params[] = { OSSL_PARAM_END, OSSL_PARAM_END };
+		size_t v = (size_t)acpkm;
+
+		params[0] = OSSL_PARAM_construct_size_t("key-mesh", &v);
+		T(EVP_CIPHER_CTX_set_params(ctx, params));
+	    } else {
+		T(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_KEY_MESH, acpkm, NULL));
+	    }
+	}
+	for (off = 0; off < size; off += chunk) {
+	    T(EVP_CipherUpdate(ctx, c[pass] + off, &outlen, in + off, chunk));
+	    OPENSSL_assert(outlen == chunk);
+	}
+	T(EVP_CipherFinal_ex(ctx, c[pass] + size, &tmplen));
+	EVP_CIPHER_CTX_cleanup(ctx);
+    }
+    EVP_CIPHER_CTX_free(ctx);
+
+    ret = memcmp(c[0], c[1], size) || memcmp(c[2], pt, size);
+    TEST_ASSERT(ret);
+    return ret;
+}
+
+/* Sets the ACPKM section size, as test_block does */
+static int set_key_mesh(EVP_CIPHER_CTX *ctx, const EVP_CIPHER *type, int acpkm)
+{
+    if (EVP_CIPHER_get0_provider(type) != NULL) {
+	OSSL_PARAM params[] = { OSSL_PARAM_END, OSSL_PARAM_END };
+	size_t v = (size_t)acpkm;
+
+	params[0] = OSSL_PARAM_construct_size_t("key-mesh", &v);
+	return EVP_CIPHER_CTX_set_params(ctx, params) > 0;
+    }
+    return EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_KEY_MESH, acpkm, NULL) > 0;
+}
+
+/*
+ * Sections which are not whole blocks are refused: the multi-block code
+ * stops its runs at section ends and used to loop forever on them.
+ */
+static int test_key_mesh_period(const char *name, int block_size)
+{
+    static const int bad[] = { 4, 12, 20 };
+    static const unsigned char key[32], iv[8];
+    unsigned char buf[256] = { 0 };
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    EVP_CIPHER *type;
+    int err = 0, test, i, outlen;
+
+    OPENSSL_assert(ctx);
+    ERR_set_mark();
+    T((type = (EVP_CIPHER *)EVP_get_cipherbyname(name))
+      || (type = EVP_CIPHER_fetch(NULL, name, NULL)));
+    ERR_pop_to_mark();
+    printf("Key mesh periods [%s]: ", name);
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+	if (bad[i] % block_size == 0)
+	    continue;
+	T(EVP_CipherInit_ex(ctx, type, NULL, key, iv, 1));
+	ERR_set_mark();
+	err |= set_key_mesh(ctx, type, bad[i]);
+	ERR_pop_to_mark();
+	EVP_CIPHER_CTX_reset(ctx);
+    }
+
+    T(EVP_CipherInit_ex(ctx, type, NULL, key, iv, 1));
+    T(set_key_mesh(ctx, type, 2 * block_size));
+    T(EVP_CipherUpdate(ctx, buf, &outlen, buf, sizeof(buf)));
+    err |= outlen != sizeof(buf);
+    TEST_ASSERT(err);
+
+    EVP_CIPHER_CTX_free(ctx);
+    EVP_CIPHER_free(type);
+    return test;
+}
+
 int engine_is_available(const char *name)
 {
     ENGINE *e = ENGINE_get_first();
@@ -594,10 +704,15 @@ int main(int argc, char **argv)
 	    ret |= test_stream(ciph, t->algname,
 		t->plaintext, t->key, t->expected, t->size,
 		t->iv, t->iv_size, t->acpkm);
+	ret |= test_bulk(ciph, t->algname, t->block, t->key, t->iv,
+	    t->acpkm);
 
 	EVP_CIPHER_free(ciph);
     }
 
+    ret |= test_key_mesh_period(SN_magma_ctr_acpkm, 8);
+    ret |= test_key_mesh_period(SN_kuznyechik_ctr_acpkm, 16);
+
     warn_all_untested();
 
     if (ret)
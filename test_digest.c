@@ -895,6 +895,201 @@ static int do_synthetic_test(const struct hash_testvec *tv)
     return 0;
 }
 
+/* Serialized Streebog state through the ctrls or the provider params */
+static int get_state(EVP_MD_CTX *ctx, unsigned char *state, size_t *len)
+{
+    if (EVP_MD_get0_provider(EVP_MD_CTX_md(ctx)) == NULL) {
+	int size = EVP_MD_CTX_ctrl(ctx, EVP_MD_CTRL_GET_STATE, 0, NULL);
+
+	if (size <= 0 || (size_t)size > *len
+	    || EVP_MD_CTX_ctrl(ctx, EVP_MD_CTRL_GET_STATE, size, state) <= 0)
+	    return 0;
+	*len = size;
+	return 1;
+    }
+
+    OSSL_PARAM params[] = {
+	OSSL_PARAM_octet_string("hash-state", state, *len),
+	OSSL_PARAM_END
+    };
+    if (!EVP_MD_CTX_get_params(ctx, params))
+	return 0;
+    *len = params[0].return_size;
+    return 1;
+}
+
+static int set_state(EVP_MD_CTX *ctx, unsigned char *state, size_t len)
+{
+    if (EVP_MD_get0_provider(EVP_MD_CTX_md(ctx)) == NULL)
+	return EVP_MD_CTX_ctrl(ctx, EVP_MD_CTRL_SET_STATE, len, state) > 0;
+
+    OSSL_PARAM params[] = {
+	OSSL_PARAM_octet_string("hash-state", state, len),
+	OSSL_PARAM_END
+    };
+    return EVP_MD_CTX_set_params(ctx, params);
+}
+
+static EVP_MD *get_digest(const char *algname)
+{
+    EVP_MD *md;
+
+    ERR_set_mark();
+    T((md = (EVP_MD *)EVP_get_digestbyname(algname))
+      || (md = EVP_MD_fetch(NULL, algname, NULL)));
+    ERR_pop_to_mark();
+    return md;
+}
+
+/*
+ * Hash a message in two parts, moving the state to a new context between
+ * them, and compare with the digest of the whole message. The state must
+ * not be accepted by the other Streebog or when damaged.
+ */
+static int do_state_test(const char *algname, const char *other)
+{
+    static const size_t cuts[] = { 0, 1, 63, 64, 65, 500, 1000 };
+    unsigned char msg[1000], state[512], out[EVP_MAX_MD_SIZE],
+		  etalon[EVP_MAX_MD_SIZE], n512[64];
+    unsigned int i, len;
+    size_t statelen;
+    int ret = 0;
+    EVP_MD *md = get_digest(algname), *md2 = get_digest(other);
+    EVP_MD_CTX *ctx;
+
+    printf(cBLUE "Test %s: state export/import: " cNORM, algname);
+    for (i = 0; i < sizeof(msg); i++)
+	msg[i] = i * 7;
+    T(EVP_Digest(msg, sizeof(msg), etalon, NULL, md, NULL));
+
+    for (i = 0; i < sizeof(cuts) / sizeof(cuts[0]) && !ret; i++) {
+	T(ctx = EVP_MD_CTX_new());
+	T(EVP_DigestInit_ex(ctx, md, NULL));
+	T(EVP_DigestUpdate(ctx, msg, cuts[i]));
+	statelen = sizeof(state);
+	T(get_state(ctx, state, &statelen));
+	EVP_MD_CTX_free(ctx);
+
+	T(ctx = EVP_MD_CTX_new());
+	T(EVP_DigestInit_ex(ctx, md, NULL));
+	T(set_state(ctx, state, statelen));
+	T(EVP_DigestUpdate(ctx, msg + cuts[i], sizeof(msg) - cuts[i]));
+	T(EVP_DigestFinal_ex(ctx, out, &len));
+	EVP_MD_CTX_free(ctx);
+	if (memcmp(out, etalon, len) != 0) {
+	    printf(cRED "digest mismatch (cut at %zu)" cNORM "\n", cuts[i]);
+	    ret = 1;
+	}
+    }
+
+    /*
+     * The state is the same on every host: after one block N is 512 and
+     * Sigma is the block, as little-endian numbers
+     */
+    T(ctx = EVP_MD_CTX_new());
+    T(EVP_DigestInit_ex(ctx, md, NULL));
+    T(EVP_DigestUpdate(ctx, msg, 64));
+    statelen = sizeof(state);
+    T(get_state(ctx, state, &statelen));
+    EVP_MD_CTX_free(ctx);
+    memset(n512, 0, sizeof(n512));
+    n512[1] = 2;
+    if (statelen != 4 + 4 * 64 || state[0] != 1 || state[2] != 0
+	|| memcmp(state + 4 + 64, n512, 64) != 0
+	|| memcmp(state + 4 + 128, msg, 64) != 0) {
+	printf(cRED "unexpected state layout" cNORM "\n");
+	ret = 1;
+    }
+
+    T(ctx = EVP_MD_CTX_new());
+    ERR_set_mark();
+    T(EVP_DigestInit_ex(ctx, md2, NULL));
+    if (set_state(ctx, state, statelen)) {
+	printf(cRED "state accepted by %s" cNORM "\n", other);
+	ret = 1;
+    }
+    T(EVP_DigestInit_ex(ctx, md, NULL));
+    state[0] ^= 0xff;
+    if (set_state(ctx, state, statelen)) {
+	printf(cRED "damaged state accepted" cNORM "\n");
+	ret = 1;
+    }
+    state[0] ^= 0xff;
+    if (set_state(ctx, state, statelen - 1)) {
+	printf(cRED "truncated state accepted" cNORM "\n");
+	ret = 1;
+    }
+    ERR_pop_to_mark();
+    EVP_MD_CTX_free(ctx);
+    EVP_MD_free(md);
+    EVP_MD_free(md2);
+
+    if (!ret)
+	printf(cGREEN "success" cNORM "\n");
+    else
+	printf(cRED "fail" cNORM "\n");
+    return ret;
+}
+
+/*
+ * Compare the native HMAC-Streebog MAC of the provider with HMAC over the
+ * digest, for keys shorter, as long as and longer than the block, and
+ * with the MAC restarted without a key.
+ */
+static int do_native_hmac_test(const char *macname, const char *algname)
+{
+    static const size_t keylens[] = { 32, 64, 100 };
+    static const size_t msglens[] = { 0, 16, 64, 200 };
+    unsigned char key[100], msg[200], out[EVP_MAX_MD_SIZE],
+		  etalon[EVP_MAX_MD_SIZE];
+    unsigned int i, j, len;
+    size_t outlen;
+    int ret = 0;
+    EVP_MAC *mac;
+    EVP_MAC_CTX *ctx;
+    EVP_MD *md;
+
+    ERR_set_mark();
+    mac = EVP_MAC_fetch(NULL, macname, NULL);
+    ERR_pop_to_mark();
+    if (mac == NULL)
+	return 0;
+
+    printf(cBLUE "Test %s: native MAC: " cNORM, macname);
+    md = get_digest(algname);
+    for (i = 0; i < sizeof(key); i++)
+	key[i] = i * 3;
+    for (i = 0; i < sizeof(msg); i++)
+	msg[i] = i * 7;
+
+    for (i = 0; i < sizeof(keylens) / sizeof(keylens[0]) && !ret; i++) {
+	T(ctx = EVP_MAC_CTX_new(mac));
+	T(EVP_MAC_init(ctx, key, keylens[i], NULL));
+	for (j = 0; j < sizeof(msglens) / sizeof(msglens[0]) && !ret; j++) {
+	    /* The first message uses the key given, the others restart */
+	    if (j > 0)
+		T(EVP_MAC_init(ctx, NULL, 0, NULL));
+	    T(EVP_MAC_update(ctx, msg, msglens[j]));
+	    T(EVP_MAC_final(ctx, out, &outlen, sizeof(out)));
+	    T(HMAC(md, key, keylens[i], msg, msglens[j], etalon, &len));
+	    if (outlen != len || memcmp(out, etalon, len) != 0) {
+		printf(cRED "mac mismatch (key %zu, message %zu)" cNORM "\n",
+		       keylens[i], msglens[j]);
+		ret = 1;
+	    }
+	}
+	EVP_MAC_CTX_free(ctx);
+    }
+    EVP_MD_free(md);
+    EVP_MAC_free(mac);
+
+    if (!ret)
+	printf(cGREEN "success" cNORM "\n");
+    else
+	printf(cRED "fail" cNORM "\n");
+    return ret;
+}
+
 int engine_is_available(const char *name)
 {
     ENGINE *e = ENGINE_get_first();
@@ -970,6 +1165,12 @@ int main(int argc, char **argv)
 	else
 	    ret |= do_synthetic_test(tv);
     }
+    ret |= do_state_test(SN_id_GostR3411_2012_256, SN_id_GostR3411_2012_512);
+    ret |= do_state_test(SN_id_GostR3411_2012_512, SN_id_GostR3411_2012_256);
+    ret |= do_native_hmac_test(SN_id_tc26_hmac_gost_3411_2012_256,
+			       SN_id_GostR3411_2012_256);
+    ret |= do_native_hmac_test(SN_id_tc26_hmac_gost_3411_2012_512,
+			       SN_id_GostR3411_2012_512);
 
     warn_all_untested();
 
@@ -0,0 +1,76 @@
+# Known answers for gost12sum tree mode and for checking tree sums, run by
+# ctest as cmake -DGOST12SUM=<program> -DDIR=<scratch directory> -P this.
+# The files are 0, 1 and 20.1 chunks of 1 KiB; the last makes runs of
+# eight leaves and an odd node at two levels.
+
+file(REMOVE_RECURSE "${DIR}")
+file(MAKE_DIRECTORY "${DIR}")
+string(REPEAT "0123456789abcdef" 1287 pattern)
+file(WRITE "${DIR}/empty" "")
+string(SUBSTRING "${pattern}" 0 1024 data)
+file(WRITE "${DIR}/one" "${data}")
+string(SUBSTRING "${pattern}" 0 20580 data)
+file(WRITE "${DIR}/many" "${data}")
+
+set(expected_256
+  "tree:1:6f7305265dc0937440881f9493ef1260f61a9d47742d369e952d41bdb2a9edd1 empty\n"
+  "tree:1:edaaffab97376fd97ef788d7655ff691c2c301a62c0dee838dddf0c7ab8e4bbe one\n"
+  "tree:1:0a65a6937b80c9abaae5d1b6a993a1087812c0d40c79dd66be44d4d883f7adbf many\n")
+set(expected_512
+  "tree:1:c6b638133ba9706410ddf1bea05d40bf7014500d410c0abde17bff0383c1bd363be2da85c428be86ed48c87fb76013622b22b6aa391d6252ce3a65487b1ba9e4 empty\n"
+  "tree:1:f57baf59b7378816183c6b765ae47420750aeef09f049061cc8a7d9148aa557267646134b3cc44e5295938c13291bd70931479697f9e2bd7d8090a3611f2b613 one\n"
+  "tree:1:92772de20b3a4ec333314e9acc70befa30f382d78dd152c5884379382a4ff2439309816a2028cd62a97a37b46c22a72b815d4770f4656f6e119ef4cc717b48c6 many\n")
+string(CONCAT expected_256 ${expected_256})
+string(CONCAT expected_512 ${expected_512})
+
+# Runs gost12sum with the arguments, and stdin from the file input if set
+function(run_sum expected_result)
+  if(NOT input)
+    set(input "${DIR}/empty")
+  endif()
+  execute_process(COMMAND "${GOST12SUM}" ${ARGN}
+    WORKING_DIRECTORY "${DIR}" INPUT_FILE "${input}"
+    RESULT_VARIABLE result OUTPUT_VARIABLE out ERROR_VARIABLE err)
+  if(NOT result EQUAL expected_result)
+    message(FATAL_ERROR "gost12sum ${ARGN}: exit ${result}\n${out}${err}")
+  endif()
+  set(out "${out}" PARENT_SCOPE)
+endfunction()
+
+foreach(size 256 512)
+  if(size EQUAL 512)
+    set(flags -l)
+  else()
+    set(flags)
+  endif()
+  run_sum(0 ${flags} -t1 empty one many)
+  if(NOT out STREQUAL expected_${size})
+    message(FATAL_ERROR "tree sums ${size}:\n${out}expected:\n${expected_${size}}")
+  endif()
+  # Tree sums from a pipe
+  set(input "${DIR}/many")
+  run_sum(0 ${flags} -t1)
+  unset(input)
+  string(REGEX REPLACE " many\n" " -\n" stdin_sum "${expected_${size}}")
+  string(REGEX MATCH "[^\n]* -\n" stdin_sum "${stdin_sum}")
+  if(NOT out STREQUAL stdin_sum)
+    message(FATAL_ERROR "tree sum ${size} of stdin:\n${out}")
+  endif()
+endforeach()
+
+# Checking lists of tree and plain sums
+run_sum(0 one)
+file(WRITE "${DIR}/good" "${expected_256}${expected_512}${out}")
+run_sum(0 -c good)
+string(REPLACE "tree:1:0a65" "tree:1:1a65" bad "${expected_256}")
+file(WRITE "${DIR}/bad" "${bad}")
+run_sum(1 -c bad)
+# The same sum with another chunk size fails
+string(REPLACE "tree:1:" "tree:2:" bad "${expected_512}")
+file(WRITE "${DIR}/bad" "${bad}")
+run_sum(1 -c bad)
+
+# Chunk sizes out of range or not numbers
+foreach(bad 0 1025 1x)
+  run_sum(3 -t${bad} one)
+endforeach()
@@ -30,6 +30,99 @@ static void hexdump(FILE *f, const char *title, const unsigned char *s, int l)
     fprintf(f, "\n");
 }
 
+/* GOST 28147-89 straight from the substitution block, as a reference */
+static unsigned int ref_f(const gost_subst_block *b, unsigned int x)
+{
+    const byte *rows[8] = { b->k1, b->k2, b->k3, b->k4,
+                            b->k5, b->k6, b->k7, b->k8 };
+    unsigned int y = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        y |= (unsigned int)rows[i][(x >> (4 * i)) & 15] << (4 * i);
+    return y << 11 | y >> 21;
+}
+
+static void ref_encrypt(const gost_subst_block *b, const unsigned char *key,
+                        const unsigned char *in, unsigned char *out)
+{
+    unsigned int k[8], n1, n2, t;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        k[i] = key[4 * i] | key[4 * i + 1] << 8 | key[4 * i + 2] << 16
+            | (unsigned int)key[4 * i + 3] << 24;
+    n1 = in[0] | in[1] << 8 | in[2] << 16 | (unsigned int)in[3] << 24;
+    n2 = in[4] | in[5] << 8 | in[6] << 16 | (unsigned int)in[7] << 24;
+    for (i = 0; i < 32; i++) {
+        t = n1;
+        n1 = n2 ^ ref_f(b, n1 + k[i < 24 ? i % 8 : 31 - i]);
+        n2 = t;
+    }
+    for (i = 0; i < 4; i++) {
+        out[i] = (unsigned char)(n2 >> (8 * i));
+        out[i + 4] = (unsigned char)(n1 >> (8 * i));
+    }
+}
+
+/*
+ * A substitution block which is none of the parameter sets gets its own
+ * shared tables
+ */
+static int test_custom_sbox(const unsigned char *key)
+{
+    gost_subst_block b, copy;
+    byte *rows[8] = { b.k1, b.k2, b.k3, b.k4, b.k5, b.k6, b.k7, b.k8 };
+    unsigned char in[64 * 8], out[64 * 8], ref[64 * 8];
+    gost_ctx ctx, ctx2;
+    int i, j;
+
+    for (i = 0; i < 8; i++)
+        for (j = 0; j < 16; j++)
+            rows[i][j] = (byte)((j * (2 * i + 3) + 5 * i + 1) & 15);
+    for (i = 0; i < (int)sizeof(in); i++)
+        in[i] = (unsigned char)(i * 13 + 7);
+    for (i = 0; i < 64; i++)
+        ref_encrypt(&b, key, in + 8 * i, ref + 8 * i);
+
+    if (!gost_kbox_lock_init() || !gost_init(&ctx, &b))
+        return 1;
+    gost_key(&ctx, key);
+    gostcrypt(&ctx, in, out);
+    if (memcmp(out, ref, 8)) {
+        fprintf(stderr, "Custom S-box: single block differs\n");
+        return 1;
+    }
+    gostcrypt_blocks(&ctx, in, out, 64);
+    if (memcmp(out, ref, sizeof(ref))) {
+        fprintf(stderr, "Custom S-box: multi-block differs\n");
+        return 1;
+    }
+    memcpy(&copy, &b, sizeof(b));
+    if (!gost_init(&ctx2, &copy) || ctx2.kbox != ctx.kbox) {
+        fprintf(stderr, "Custom S-box: tables not shared\n");
+        return 1;
+    }
+    gost_destroy(&ctx);
+    gost_destroy(&ctx2);
+    gost_kbox_free();
+    /* as when the engine is unloaded and loaded again */
+    if (!gost_kbox_lock_init() || !gost_init(&ctx, &b)) {
+        fprintf(stderr, "Custom S-box: init after gost_kbox_free failed\n");
+        return 1;
+    }
+    gost_key(&ctx, key);
+    gostcrypt_blocks(&ctx, in, out, 64);
+    gost_destroy(&ctx);
+    gost_kbox_free();
+    if (memcmp(out, ref, sizeof(ref))) {
+        fprintf(stderr, "Custom S-box: differs after gost_kbox_free\n");
+        return 1;
+    }
+    printf("Custom S-box: ok\n");
+    return 0;
+}
+
 int main(void)
 {
     int ret = 0;
@@ -51,7 +144,8 @@ int main(void)
     unsigned char buf[32];
 
     gost_ctx ctx;
-    kboxinit(&ctx, &Gost28147_TC26ParamSetZ);
+    if (!kboxinit(&ctx, &Gost28147_TC26ParamSetZ))
+        return 1;
     magma_key(&ctx, initial_key);
     magma_get_key(&ctx, buf);
 
@@ -74,5 +168,7 @@ int main(void)
     magma_get_key(&ctx, buf);
     hexdump(stdout, "Meshed key - K4", buf, 32);
 
+    ret |= test_custom_sbox(initial_key);
+
     return ret;
 }
@@ -0,0 +1,95 @@
+/*
+ * Test the multi-buffer interface of the GOST R 34.11-2012 core against
+ * the single-stream one.
+ *
+ * Contents licensed under the terms of the OpenSSL license
+ * See https://www.openssl.org/source/license.html for details
+ */
+
+#ifdef _MSC_VER
+# pragma warning(push, 3)
+# include <openssl/applink.c>
+# pragma warning(pop)
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "gosthash2012.h"
+
+#define cRED	"\033[1;31m"
+#define cGREEN	"\033[1;32m"
+#define cNORM	"\033[m"
+
+#define MAX_MSGS 11
+#define MAX_LEN 300
+
+static unsigned char msg[MAX_MSGS][MAX_LEN];
+
+static void single(unsigned int digest_size, const unsigned char *data,
+                   size_t len, size_t split, unsigned char *digest)
+{
+    gost2012_hash_ctx ctx;
+
+    init_gost2012_hash_ctx(&ctx, digest_size);
+    gost2012_hash_block(&ctx, data, split);
+    gost2012_hash_block(&ctx, data + split, len - split);
+    gost2012_finish_hash(&ctx, digest);
+}
+
+/* n messages of len bytes, hashed in two updates split at split */
+static int test_multi(unsigned int digest_size, unsigned int n, size_t len,
+                      size_t split)
+{
+    gost2012_hash_ctx ctx[MAX_MSGS], *pctx[MAX_MSGS];
+    unsigned char md[MAX_MSGS][64], md2[MAX_MSGS][64], expect[64];
+    const unsigned char *data[MAX_MSGS], *tail[MAX_MSGS];
+    unsigned char *digest[MAX_MSGS], *digest2[MAX_MSGS];
+    unsigned int i;
+    int ret = 0;
+
+    for (i = 0; i < n; i++) {
+        init_gost2012_hash_ctx(&ctx[i], digest_size);
+        pctx[i] = &ctx[i];
+        data[i] = msg[i];
+        tail[i] = msg[i] + split;
+        digest[i] = md[i];
+        digest2[i] = md2[i];
+    }
+    gost2012_hash_block_multi(pctx, data, split, n);
+    gost2012_hash_block_multi(pctx, tail, len - split, n);
+    gost2012_finish_hash_multi(pctx, digest, n);
+    gost2012_hash_multi(digest_size, data, len, digest2, n);
+
+    for (i = 0; i < n; i++) {
+        single(digest_size, msg[i], len, split, expect);
+        if (memcmp(md[i], expect, digest_size / 8)
+            || memcmp(md2[i], expect, digest_size / 8)) {
+            printf(cRED "Test FAILED: %u-bit, %u messages of %u bytes,"
+                   " message %u" cNORM "\n", digest_size, n,
+                   (unsigned int)len, i);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+int main(void)
+{
+    static const size_t lens[] = { 0, 1, 63, 64, 65, 128, 191, 300 };
+    unsigned int i, j, n, ret = 0;
+
+    for (i = 0; i < MAX_MSGS; i++)
+        for (j = 0; j < MAX_LEN; j++)
+            msg[i][j] = (unsigned char)(i * 131 + j * 7 + (j >> 8));
+
+    for (n = 1; n <= MAX_MSGS; n++)
+        for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            ret |= test_multi(512, n, lens[i], lens[i] / 3);
+            ret |= test_multi(256, n, lens[i], lens[i] / 2);
+        }
+
+    if (ret)
+        printf(cRED "Multi-buffer Streebog test FAILED" cNORM "\n");
+    else
+        printf(cGREEN "Multi-buffer Streebog test OK" cNORM "\n");
+    return ret;
+}
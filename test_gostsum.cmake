@@ -0,0 +1,84 @@
+# Checks that gostsum and gost12sum print the same sums with several jobs
+# as with one, in the order of the files, run by ctest as
+# cmake -DSUM=<program> -DDIR=<scratch directory> -P this.
+
+file(REMOVE_RECURSE "${DIR}")
+file(MAKE_DIRECTORY "${DIR}")
+set(files)
+set(data "")
+# Sizes growing then shrinking, so that files finish out of order
+foreach(i RANGE 1 24)
+  if(i LESS 12)
+    string(REPEAT "${i} data to digest\n" ${i}000 data)
+  else()
+    math(EXPR n "24 - ${i}")
+    string(REPEAT "${i} data to digest\n" ${n} data)
+  endif()
+  file(WRITE "${DIR}/f${i}" "${data}")
+  list(APPEND files f${i})
+endforeach()
+
+function(run_sum expected_result)
+  execute_process(COMMAND "${SUM}" ${ARGN}
+    WORKING_DIRECTORY "${DIR}"
+    RESULT_VARIABLE result OUTPUT_VARIABLE out ERROR_VARIABLE err)
+  if(NOT result EQUAL expected_result)
+    message(FATAL_ERROR "${SUM} ${ARGN}: exit ${result}\n${out}${err}")
+  endif()
+  set(out "${out}" PARENT_SCOPE)
+  set(err "${err}" PARENT_SCOPE)
+endfunction()
+
+run_sum(0 ${files})
+set(sequential "${out}")
+list(LENGTH files count)
+string(REGEX MATCHALL "\n" lines "${sequential}")
+list(LENGTH lines n)
+if(NOT n EQUAL count)
+  message(FATAL_ERROR "expected ${count} sums:\n${sequential}")
+endif()
+foreach(jobs 2 4 0)
+  run_sum(0 -j ${jobs} ${files})
+  if(NOT out STREQUAL sequential)
+    message(FATAL_ERROR "-j ${jobs}:\n${out}expected:\n${sequential}")
+  endif()
+endforeach()
+
+# Checking with several jobs reports the failures of the right files
+file(WRITE "${DIR}/sums" "${sequential}")
+run_sum(0 -j 4 -c sums)
+file(APPEND "${DIR}/f7" "changed")
+file(APPEND "${DIR}/f20" "changed")
+run_sum(1 -j 4 -c sums)
+string(REGEX MATCHALL "f[0-9]+" failed "${err}")
+list(REMOVE_DUPLICATES failed)
+if(NOT failed STREQUAL "f7;f20")
+  message(FATAL_ERROR "-c reported ${failed}:\n${err}")
+endif()
+
+foreach(bad x -1 2x "")
+  run_sum(3 -j "${bad}" f1)
+endforeach()
+
+# Names longer than PATH_MAX are refused, not truncated
+string(REPEAT "n" 5000 long)
+run_sum(1 f1 ${long} f2)
+string(REGEX MATCHALL "[^\n]*\n" lines "${out}")
+list(LENGTH lines n)
+if(NOT n EQUAL 2 OR NOT err MATCHES "long")
+  message(FATAL_ERROR "long name:\n${out}${err}")
+endif()
+
+# A file larger than a read buffer is read ahead on another thread; its sum
+# must be the one of the same data read from a pipe
+string(REPEAT "big data to digest\n" 65000 data)
+file(WRITE "${DIR}/big" "${data}")
+run_sum(0 big)
+string(REGEX MATCH "^[0-9a-f]+" threaded "${out}")
+execute_process(COMMAND "${CMAKE_COMMAND}" -E cat big
+  COMMAND "${SUM}"
+  WORKING_DIRECTORY "${DIR}" RESULT_VARIABLE result OUTPUT_VARIABLE out)
+string(REGEX MATCH "^[0-9a-f]+" piped "${out}")
+if(NOT result EQUAL 0 OR threaded STREQUAL "" OR NOT threaded STREQUAL piped)
+  message(FATAL_ERROR "large file: ${threaded}, piped: ${piped}")
+endif()
@@ -0,0 +1,300 @@
+/*
+ * Test the KDFs of the GOST provider against R 50.1.113-2016,
+ * R 50.1.111-2016 and R 1323565.1.043-2022 vectors and against the generic
+ * HMAC and PBKDF2 over the digest.
+ *
+ * Contents licensed under the terms of the OpenSSL license
+ * See https://www.openssl.org/source/license.html for details
+ */
+
+#ifdef _MSC_VER
+# pragma warning(push, 3)
+# include <openssl/applink.c>
+# pragma warning(pop)
+#endif
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/hmac.h>
+#include <openssl/err.h>
+#include <openssl/core_names.h>
+#include <string.h>
+
+#define T(e) \
+    if (!(e)) { \
+        ERR_print_errors_fp(stderr); \
+        OpenSSLDie(__FILE__, __LINE__, #e); \
+    }
+
+#define cRED	"\033[1;31m"
+#define cDRED	"\033[0;31m"
+#define cGREEN	"\033[1;32m"
+#define cDGREEN	"\033[0;32m"
+#define cBLUE	"\033[1;34m"
+#define cNORM	"\033[m"
+
+static void hexdump(const void *ptr, size_t len)
+{
+    const unsigned char *p = ptr;
+    size_t i, j;
+
+    for (i = 0; i < len; i += j) {
+	for (j = 0; j < 16 && i + j < len; j++)
+	    printf("%s%02x", j? "" : " ", p[i + j]);
+    }
+    printf("\n");
+}
+
+static const unsigned char key[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+};
+static const unsigned char label[4] = { 0x26, 0xbd, 0xb8, 0x78 };
+static const unsigned char seed[8] = {
+    0xaf, 0x21, 0x43, 0x41, 0x45, 0x65, 0x63, 0x78
+};
+
+/* R 50.1.113-2016, A.1.4 and A.1.5 */
+static const unsigned char kdf256_etalon[32] = {
+    0xa1, 0xaa, 0x5f, 0x7d, 0xe4, 0x02, 0xd7, 0xb3,
+    0xd3, 0x23, 0xf2, 0x99, 0x1c, 0x8d, 0x45, 0x34,
+    0x01, 0x31, 0x37, 0x01, 0x0a, 0x83, 0x75, 0x4f,
+    0xd0, 0xaf, 0x6d, 0x7c, 0xd4, 0x92, 0x2e, 0xd9,
+};
+static const unsigned char kdftree_etalon[64] = {
+    0x22, 0xb6, 0x83, 0x78, 0x45, 0xc6, 0xbe, 0xf6,
+    0x5e, 0xa7, 0x16, 0x72, 0xb2, 0x65, 0x83, 0x10,
+    0x86, 0xd3, 0xc7, 0x6a, 0xeb, 0xe6, 0xda, 0xe9,
+    0x1c, 0xad, 0x51, 0xd8, 0x3f, 0x79, 0xd1, 0x6b,
+    0x07, 0x4c, 0x93, 0x30, 0x59, 0x9d, 0x7f, 0x8d,
+    0x71, 0x2f, 0xca, 0x54, 0x39, 0x2f, 0x4d, 0xdd,
+    0xe9, 0x37, 0x51, 0x20, 0x6b, 0x35, 0x84, 0xc8,
+    0xf4, 0x3f, 0x9e, 0x6d, 0xc5, 0x15, 0x31, 0xf9,
+};
+/* Root key of all 0xff, sequence number 63 */
+static const unsigned char tlstree_etalon[32] = {
+    0x50, 0x76, 0x42, 0xd9, 0x58, 0xc5, 0x20, 0xc6,
+    0xd7, 0xee, 0xf5, 0xca, 0x8a, 0x53, 0x16, 0xd4,
+    0xf3, 0x4b, 0x85, 0x5d, 0x2d, 0xd4, 0xbc, 0xbf,
+    0x4e, 0x5b, 0xf0, 0xff, 0x64, 0x1a, 0x19, 0xff,
+};
+
+static int check(const char *what, const unsigned char *out,
+		 const unsigned char *etalon, size_t len)
+{
+    if (memcmp(out, etalon, len) == 0)
+	return 0;
+    printf(cRED "%s mismatch" cNORM "\n", what);
+    hexdump(etalon, len);
+    hexdump(out, len);
+    return 1;
+}
+
+static EVP_KDF_CTX *new_kdf(const char *name)
+{
+    EVP_KDF *kdf;
+    EVP_KDF_CTX *ctx;
+
+    T(kdf = EVP_KDF_fetch(NULL, name, NULL));
+    T(ctx = EVP_KDF_CTX_new(kdf));
+    EVP_KDF_free(kdf);
+    return ctx;
+}
+
+static int test_kdf256(void)
+{
+    EVP_KDF_CTX *ctx = new_kdf("KDF_GOSTR3411_2012_256");
+    OSSL_PARAM params[] = {
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_KEY, (void *)key, sizeof(key)),
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_LABEL, (void *)label,
+				sizeof(label)),
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_SEED, (void *)seed,
+				sizeof(seed)),
+	OSSL_PARAM_END
+    };
+    unsigned char out[32];
+    int ret;
+
+    printf(cBLUE "Test KDF_GOSTR3411_2012_256" cNORM "\n");
+    T(EVP_KDF_CTX_get_kdf_size(ctx) == sizeof(out));
+    T(EVP_KDF_derive(ctx, out, sizeof(out), params));
+    ret = check("KDF_256", out, kdf256_etalon, sizeof(out));
+    ERR_set_mark();
+    if (EVP_KDF_derive(ctx, out, 64, NULL) > 0) {
+	printf(cRED "64 byte output accepted" cNORM "\n");
+	ret = 1;
+    }
+    ERR_pop_to_mark();
+    EVP_KDF_CTX_free(ctx);
+    return ret;
+}
+
+/*
+ * The vector, then outputs over several rounds of the parallel lanes, one
+ * of them not a whole number of blocks, against HMAC over the digest.
+ */
+static int test_kdftree(void)
+{
+    static const size_t lens[] = { 32, 100, 320, 1000 };
+    EVP_KDF_CTX *ctx = new_kdf("KDF_TREE_GOSTR3411_2012_256");
+    EVP_MD *md;
+    int r = 8, ret = 0;
+    OSSL_PARAM params[] = {
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_KEY, (void *)key, sizeof(key)),
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_LABEL, (void *)label,
+				sizeof(label)),
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_SEED, (void *)seed,
+				sizeof(seed)),
+	OSSL_PARAM_int("r", &r),
+	OSSL_PARAM_END
+    };
+    unsigned char out[1000], etalon[1024], msg[32];
+    size_t i, j;
+
+    printf(cBLUE "Test KDF_TREE_GOSTR3411_2012_256" cNORM "\n");
+    T(EVP_KDF_derive(ctx, out, sizeof(kdftree_etalon), params));
+    ret |= check("KDF_TREE", out, kdftree_etalon, sizeof(kdftree_etalon));
+
+    T(md = EVP_MD_fetch(NULL, "md_gost12_256", NULL));
+    for (r = 8; r <= 32 && !ret; r += 8) {
+	OSSL_PARAM rparams[] = {
+	    OSSL_PARAM_int("r", &r),
+	    OSSL_PARAM_END
+	};
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]) && !ret; i++) {
+	    uint32_t bits = (uint32_t)lens[i] * 8;
+	    size_t n = 0, lenlen = bits >> 8 ? 2 : 1;
+
+	    for (j = 0; j < (lens[i] + 31) / 32; j++) {
+		uint32_t c = (uint32_t)j + 1;
+		int k;
+
+		n = 0;
+		for (k = r / 8 - 1; k >= 0; k--)
+		    msg[n++] = (unsigned char)(c >> (8 * k));
+		memcpy(msg + n, label, sizeof(label));
+		n += sizeof(label);
+		msg[n++] = 0;
+		memcpy(msg + n, seed, sizeof(seed));
+		n += sizeof(seed);
+		if (lenlen == 2)
+		    msg[n++] = (unsigned char)(bits >> 8);
+		msg[n++] = (unsigned char)bits;
+		T(HMAC(md, key, sizeof(key), msg, n, etalon + 32 * j, NULL));
+	    }
+	    /* The key is set once, only r changes */
+	    T(EVP_KDF_derive(ctx, out, lens[i], rparams));
+	    if (check("KDF_TREE long output", out, etalon, lens[i]))
+		ret = 1;
+	}
+    }
+    EVP_MD_free(md);
+    EVP_KDF_CTX_free(ctx);
+    return ret;
+}
+
+static int test_tlstree(void)
+{
+    EVP_KDF_CTX *ctx = new_kdf("TLSTREE");
+    unsigned char root[32], seq[8], out[32];
+    OSSL_PARAM params[] = {
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_KEY, root, sizeof(root)),
+	OSSL_PARAM_utf8_string(OSSL_KDF_PARAM_CIPHER, "kuznyechik-cbc", 0),
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_SEED, seq, sizeof(seq)),
+	OSSL_PARAM_END
+    };
+    int i, ret;
+
+    printf(cBLUE "Test TLSTREE" cNORM "\n");
+    memset(root, 0xff, sizeof(root));
+    memset(seq, 0, sizeof(seq));
+    seq[7] = 63;
+    T(EVP_KDF_derive(ctx, out, sizeof(out), params));
+    ret = check("TLSTREE", out, tlstree_etalon, sizeof(out));
+
+    /* Derive for other records and come back, the level keys are reused */
+    for (i = 0; i < 3 && !ret; i++) {
+	seq[7 - i] ^= 0x80;
+	T(EVP_KDF_derive(ctx, out, sizeof(out), params + 2));
+	seq[7 - i] ^= 0x80;
+	T(EVP_KDF_derive(ctx, out, sizeof(out), params + 2));
+	ret = check("TLSTREE again", out, tlstree_etalon, sizeof(out));
+    }
+    EVP_KDF_CTX_free(ctx);
+    return ret;
+}
+
+/* R 50.1.111-2016, 4.1: P = "password", S = "salt", c = 1 */
+static const unsigned char pbkdf2_etalon[64] = {
+    0x64, 0x77, 0x0a, 0xf7, 0xf7, 0x48, 0xc3, 0xb1,
+    0xc9, 0xac, 0x83, 0x1d, 0xbc, 0xfd, 0x85, 0xc2,
+    0x61, 0x11, 0xb3, 0x0a, 0x8a, 0x65, 0x7d, 0xdc,
+    0x30, 0x56, 0xb8, 0x0c, 0xa7, 0x3e, 0x04, 0x0d,
+    0x28, 0x54, 0xfd, 0x36, 0x81, 0x1f, 0x6d, 0x82,
+    0x5c, 0xc4, 0xab, 0x66, 0xec, 0x0a, 0x68, 0xa4,
+    0x90, 0xa9, 0xe5, 0xcf, 0x51, 0x56, 0xb3, 0xa2,
+    0xb7, 0xee, 0xcd, 0xdb, 0xf9, 0xa1, 0x6b, 0x47,
+};
+
+/* The vector, then against PBKDF2 over the digest */
+static int test_pbkdf2(const char *name, const char *mdname)
+{
+    static const size_t lens[] = { 32, 100, 600 };
+    static const uint64_t iters[] = { 1, 2, 1000 };
+    EVP_KDF_CTX *ctx = new_kdf(name);
+    EVP_MD *md;
+    uint64_t iter = 1;
+    OSSL_PARAM params[] = {
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_PASSWORD, "password", 8),
+	OSSL_PARAM_octet_string(OSSL_KDF_PARAM_SALT, "salt", 4),
+	OSSL_PARAM_uint64(OSSL_KDF_PARAM_ITER, &iter),
+	OSSL_PARAM_END
+    };
+    unsigned char out[600], etalon[600];
+    size_t i, j;
+    int ret = 0;
+
+    printf(cBLUE "Test %s" cNORM "\n", name);
+    T(md = EVP_MD_fetch(NULL, mdname, NULL));
+    T(EVP_KDF_CTX_set_params(ctx, params));
+    if (EVP_MD_get_size(md) == sizeof(pbkdf2_etalon)) {
+	T(EVP_KDF_derive(ctx, out, sizeof(pbkdf2_etalon), NULL));
+	ret |= check("PBKDF2", out, pbkdf2_etalon, sizeof(pbkdf2_etalon));
+    }
+
+    for (i = 0; i < sizeof(iters) / sizeof(iters[0]) && !ret; i++) {
+	iter = iters[i];
+	for (j = 0; j < sizeof(lens) / sizeof(lens[0]) && !ret; j++) {
+	    T(PKCS5_PBKDF2_HMAC("password", 8, (const unsigned char *)"salt",
+				4, (int)iter, md, (int)lens[j], etalon));
+	    /* The password is set once, only the count changes */
+	    T(EVP_KDF_derive(ctx, out, lens[j], params + 2));
+	    if (check("PBKDF2 long output", out, etalon, lens[j]))
+		ret = 1;
+	}
+    }
+    EVP_MD_free(md);
+    EVP_KDF_CTX_free(ctx);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+
+    OPENSSL_add_all_algorithms_conf();
+
+    ret |= test_kdf256();
+    ret |= test_kdftree();
+    ret |= test_tlstree();
+    ret |= test_pbkdf2("PBKDF2_GOSTR3411_2012_256", "md_gost12_256");
+    ret |= test_pbkdf2("PBKDF2_GOSTR3411_2012_512", "md_gost12_512");
+
+    if (ret)
+	printf(cDRED "= Some tests FAILED!" cNORM "\n");
+    else
+	printf(cDGREEN "= All tests passed!" cNORM "\n");
+    return ret;
+}
@@ -111,6 +111,7 @@ int main(void)
     unsigned char kroot[32];
     unsigned char tlsseq[8];
     unsigned char out[32];
+    int i;
 
 #ifdef _MSC_VER
     _putenv_s("OPENSSL_ENGINES", ENGINE_DIR);
@@ -186,6 +187,43 @@ int main(void)
         }
     }
 
+    /* Consecutive records through the cache, across the level boundaries */
+    for (i = 0; i < 2; i++) {
+        static const uint64_t starts[] = {
+            0, 0xFFFFFFC0, 0x7FFFFFFFFC0, 0xFFFFFFFFFFFFFFC0
+        };
+        int nid = i ? NID_magma_cbc : NID_grasshopper_cbc;
+        gost_tlstree_cache cache;
+        unsigned char prev[32];
+        int s, j, k, unchanged = 0;
+
+        cache.levels = 0;
+        for (s = 0; s < 4; s++) {
+            for (j = 0; j < 128 && err == 0; j++) {
+                uint64_t seq = starts[s] + j;
+
+                for (k = 0; k < 8; k++)
+                    tlsseq[k] = (unsigned char)(seq >> (56 - 8 * k));
+                T(gost_tlstree(nid, kroot, out, tlsseq));
+                memcpy(prev, buf, 32);
+                ret = gost_tlstree_cached(nid, kroot, buf, tlsseq, &cache);
+                if (ret <= 0 || memcmp(buf, out, 32) != 0
+                    || (ret == 2 && memcmp(buf, prev, 32) != 0)) {
+                    fprintf(stdout, "ERROR! cached TLSTREE %s seq %016llx\n",
+                            OBJ_nid2sn(nid), (unsigned long long)seq);
+                    err = 9;
+                }
+                unchanged += ret == 2;
+            }
+        }
+        if (unchanged == 0) {
+            fprintf(stdout, "ERROR! TLSTREE cache is never used\n");
+            err = 10;
+        }
+    }
+    if (err == 0)
+        fprintf(stdout, "Cached TLSTREE OK\n");
+
     ENGINE_finish(eng);
     ENGINE_free(eng);
 
@@ -0,0 +1,254 @@
+/*
+ * Test GOST R 34.12-2015 ciphers in MGM mode (R 1323565.1.026-2019)
+ *
+ * Contents licensed under the terms of the OpenSSL license
+ * See https://www.openssl.org/source/license.html for details
+ */
+
+#ifdef _MSC_VER
+# pragma warning(push, 3)
+# include <openssl/applink.c>
+# pragma warning(pop)
+#endif
+#include <openssl/engine.h>
+#include <openssl/evp.h>
+#include <openssl/err.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define T(e) \
+    if (!(e)) { \
+	ERR_print_errors_fp(stderr); \
+	OpenSSLDie(__FILE__, __LINE__, #e); \
+    }
+
+#define cRED	"\033[1;31m"
+#define cDRED	"\033[0;31m"
+#define cGREEN	"\033[1;32m"
+#define cDGREEN	"\033[0;32m"
+#define cBLUE	"\033[1;34m"
+#define cNORM	"\033[m"
+#define TEST_ASSERT(e) {if ((test = (e))) \
+		 printf(cRED "Test FAILED" cNORM "\n"); \
+	     else \
+		 printf(cGREEN "Test passed" cNORM "\n");}
+
+/* Test vectors from R 1323565.1.026-2019 A.1 (also RFC 9058) */
+static const unsigned char K[32] = {
+    0x88,0x99,0xaa,0xbb,0xcc,0xdd,0xee,0xff,0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,
+    0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10,0x01,0x23,0x45,0x67,0x89,0xab,0xcd,0xef,
+};
+static const unsigned char N[16] = {
+    0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x00,0xff,0xee,0xdd,0xcc,0xbb,0xaa,0x99,0x88,
+};
+static const unsigned char A[41] = {
+    0x02,0x02,0x02,0x02,0x02,0x02,0x02,0x02,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,
+    0x04,0x04,0x04,0x04,0x04,0x04,0x04,0x04,0x03,0x03,0x03,0x03,0x03,0x03,0x03,0x03,
+    0xea,0x05,0x05,0x05,0x05,0x05,0x05,0x05,0x05,
+};
+static const unsigned char P[67] = {
+    0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x00,0xff,0xee,0xdd,0xcc,0xbb,0xaa,0x99,0x88,
+    0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xaa,0xbb,0xcc,0xee,0xff,0x0a,
+    0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xaa,0xbb,0xcc,0xee,0xff,0x0a,0x00,
+    0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xaa,0xbb,0xcc,0xee,0xff,0x0a,0x00,0x11,
+    0xaa,0xbb,0xcc,
+};
+static const unsigned char E[67] = {
+    0xa9,0x75,0x7b,0x81,0x47,0x95,0x6e,0x90,0x55,0xb8,0xa3,0x3d,0xe8,0x9f,0x42,0xfc,
+    0x80,0x75,0xd2,0x21,0x2b,0xf9,0xfd,0x5b,0xd3,0xf7,0x06,0x9a,0xad,0xc1,0x6b,0x39,
+    0x49,0x7a,0xb1,0x59,0x15,0xa6,0xba,0x85,0x93,0x6b,0x5d,0x0e,0xa9,0xf6,0x85,0x1c,
+    0xc6,0x0c,0x14,0xd4,0xd3,0xf8,0x83,0xd0,0xab,0x94,0x42,0x06,0x95,0xc7,0x6d,0xeb,
+    0x2c,0x75,0x52,
+};
+static const unsigned char Tag[16] = {
+    0xcf,0x5d,0x65,0x6f,0x40,0xc3,0x4f,0x5c,0x46,0xe8,0xbb,0x0e,0x29,0xfc,0xdb,0x4c,
+};
+
+/* Test vectors from R 1323565.1.026-2019 A.2 (also RFC 9058) */
+static const unsigned char Km[32] = {
+    0xff,0xee,0xdd,0xcc,0xbb,0xaa,0x99,0x88,0x77,0x66,0x55,0x44,0x33,0x22,0x11,0x00,
+    0xf0,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa,0xfb,0xfc,0xfd,0xfe,0xff,
+};
+static const unsigned char Nm[8] = {
+    0x12,0xde,0xf0,0x6b,0x3c,0x13,0x0a,0x59,
+};
+static const unsigned char Am[41] = {
+    0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x01,0x02,0x02,0x02,0x02,0x02,0x02,0x02,0x02,
+    0x03,0x03,0x03,0x03,0x03,0x03,0x03,0x03,0x04,0x04,0x04,0x04,0x04,0x04,0x04,0x04,
+    0x05,0x05,0x05,0x05,0x05,0x05,0x05,0x05,0xea,
+};
+static const unsigned char Pm[67] = {
+    0xff,0xee,0xdd,0xcc,0xbb,0xaa,0x99,0x88,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x00,
+    0x88,0x99,0xaa,0xbb,0xcc,0xee,0xff,0x0a,0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,
+    0x99,0xaa,0xbb,0xcc,0xee,0xff,0x0a,0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,
+    0xaa,0xbb,0xcc,0xee,0xff,0x0a,0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,
+    0xaa,0xbb,0xcc,
+};
+static const unsigned char Em[67] = {
+    0xc7,0x95,0x06,0x6c,0x5f,0x9e,0xa0,0x3b,0x85,0x11,0x33,0x42,0x45,0x91,0x85,0xae,
+    0x1f,0x2e,0x00,0xd6,0xbf,0x2b,0x78,0x5d,0x94,0x04,0x70,0xb8,0xbb,0x9c,0x8e,0x7d,
+    0x9a,0x5d,0xd3,0x73,0x1f,0x7d,0xdc,0x70,0xec,0x27,0xcb,0x0a,0xce,0x6f,0xa5,0x76,
+    0x70,0xf6,0x5c,0x64,0x6a,0xbb,0x75,0xd5,0x47,0xaa,0x37,0xc3,0xbc,0xb5,0xc3,0x4e,
+    0x03,0xbb,0x9c,
+};
+static const unsigned char Tagm[8] = {
+    0xa7,0x92,0x80,0x69,0xaa,0x10,0xfd,0x10,
+};
+
+static struct testcase {
+    const char *algname;
+    const unsigned char *key;
+    const unsigned char *nonce;
+    size_t nonce_size;
+    const unsigned char *aad;
+    size_t aad_size;
+    const unsigned char *plaintext;
+    const unsigned char *expected;
+    size_t size;
+    const unsigned char *tag;
+    size_t tag_size;
+} testcases[] = {
+    {
+        .algname = "kuznyechik-mgm",
+        .key = K,
+        .nonce = N,
+        .nonce_size = sizeof(N),
+        .aad = A,
+        .aad_size = sizeof(A),
+        .plaintext = P,
+        .expected = E,
+        .size = sizeof(P),
+        .tag = Tag,
+        .tag_size = sizeof(Tag),
+    },
+    {
+        .algname = "magma-mgm",
+        .key = Km,
+        .nonce = Nm,
+        .nonce_size = sizeof(Nm),
+        .aad = Am,
+        .aad_size = sizeof(Am),
+        .plaintext = Pm,
+        .expected = Em,
+        .size = sizeof(Pm),
+        .tag = Tagm,
+        .tag_size = sizeof(Tagm),
+    },
+    { 0 }
+};
+
+/* Feeds |in| in pieces of |step| bytes, or all at once if |step| is 0 */
+static int mgm_update(EVP_CIPHER_CTX *ctx, unsigned char *out,
+                      const unsigned char *in, size_t size, size_t step)
+{
+    size_t i;
+    int outlen;
+
+    if (!step)
+        step = size;
+    for (i = 0; i < size; i += step) {
+        size_t len = size - i < step ? size - i : step;
+
+        if (!EVP_CipherUpdate(ctx, out ? out + i : NULL, &outlen, in + i,
+                              (int)len) || (size_t)outlen != len)
+            return 0;
+    }
+    return 1;
+}
+
+static int test_mgm(const EVP_CIPHER *ciph, const struct testcase *t,
+                    size_t step, int inplace)
+{
+    EVP_CIPHER_CTX *ctx;
+    unsigned char *buf, *cbuf, *c;
+    unsigned char tag[16];
+    int outlen = 0;
+    int ret = 0, test;
+
+    T(ctx = EVP_CIPHER_CTX_new());
+    T(buf = OPENSSL_malloc(t->size));
+    T(cbuf = OPENSSL_malloc(t->size));
+    c = inplace ? buf : cbuf;
+
+    printf("Encryption (step %zu%s): ", step, inplace ? ", in-place" : "");
+    memcpy(buf, t->plaintext, t->size);
+    T(EVP_CipherInit_ex(ctx, ciph, NULL, NULL, NULL, 1));
+    T(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_IVLEN, t->nonce_size, NULL));
+    T(EVP_CipherInit_ex(ctx, NULL, NULL, t->key, t->nonce, 1));
+    T(mgm_update(ctx, NULL, t->aad, t->aad_size, step));
+    T(mgm_update(ctx, c, buf, t->size, step));
+    T(EVP_CipherFinal_ex(ctx, c + t->size, &outlen));
+    T(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, t->tag_size, tag));
+    test = outlen != 0 || memcmp(c, t->expected, t->size)
+        || memcmp(tag, t->tag, t->tag_size);
+    TEST_ASSERT(test);
+    ret |= test;
+
+    printf("Decryption (step %zu%s): ", step, inplace ? ", in-place" : "");
+    memcpy(buf, t->expected, t->size);
+    T(EVP_CIPHER_CTX_reset(ctx));
+    T(EVP_CipherInit_ex(ctx, ciph, NULL, t->key, t->nonce, 0));
+    T(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, t->tag_size,
+                          (void *)t->tag));
+    T(mgm_update(ctx, NULL, t->aad, t->aad_size, step));
+    T(mgm_update(ctx, c, buf, t->size, step));
+    test = EVP_CipherFinal_ex(ctx, c + t->size, &outlen) <= 0
+        || memcmp(c, t->plaintext, t->size);
+    TEST_ASSERT(test);
+    ret |= test;
+
+    /* Any change to the AAD must be detected */
+    printf("Forged AAD (step %zu%s): ", step, inplace ? ", in-place" : "");
+    memcpy(buf, t->aad, t->aad_size);
+    buf[t->aad_size - 1] ^= 1;
+    T(EVP_CipherInit_ex(ctx, ciph, NULL, t->key, t->nonce, 0));
+    T(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, t->tag_size,
+                          (void *)t->tag));
+    T(mgm_update(ctx, NULL, buf, t->aad_size, step));
+    memcpy(buf, t->expected, t->size);
+    T(mgm_update(ctx, c, buf, t->size, step));
+    ERR_set_mark();
+    test = EVP_CipherFinal_ex(ctx, c + t->size, &outlen) > 0;
+    ERR_pop_to_mark();
+    TEST_ASSERT(test);
+    ret |= test;
+
+    EVP_CIPHER_CTX_free(ctx);
+    OPENSSL_free(buf);
+    OPENSSL_free(cbuf);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    const struct testcase *t;
+    static const size_t steps[] = { 0, 1, 7, 16, 17 };
+
+    OPENSSL_add_all_algorithms_conf();
+
+    for (t = testcases; t->algname; t++) {
+	EVP_CIPHER *ciph;
+	size_t i;
+	int inplace;
+
+	ERR_set_mark();
+	T((ciph = (EVP_CIPHER *)EVP_get_cipherbyname(t->algname))
+	  || (ciph = EVP_CIPHER_fetch(NULL, t->algname, NULL)));
+	ERR_pop_to_mark();
+
+	printf(cBLUE "# Tests for %s [R 1323565.1.026-2019]" cNORM "\n",
+	       t->algname);
+	for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+	    for (inplace = 0; inplace <= 1; inplace++)
+		ret |= test_mgm(ciph, t, steps[i], inplace);
+
+	EVP_CIPHER_free(ciph);
+    }
+
+    if (ret)
+	printf(cDRED "= Some tests FAILED!" cNORM "\n");
+    else
+	printf(cDGREEN "= All tests passed!" cNORM "\n");
+    return ret;
+}
@@ -24,6 +24,10 @@
 #include <openssl/engine.h>
 #include <string.h>
 #include <stdlib.h>
+#ifndef _WIN32
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
 
 #define T(e) \
     if (!(e)) { \
@@ -103,6 +107,54 @@ static void print_test_result(int err)
 	ERR_print_errors_fp(stderr);
 }
 
+/*
+ * Checks a signature with the generic EC arithmetic of libcrypto,
+ * independent of the curve backends of the engine.
+ */
+static int verify_generic(EVP_PKEY *pkey, const unsigned char *sig,
+                          size_t siglen, const unsigned char *hash, size_t len)
+{
+    const EC_KEY *ec = EVP_PKEY_get0(pkey);
+    const EC_GROUP *group = EC_KEY_get0_group(ec);
+    const BIGNUM *q = EC_GROUP_get0_order(group);
+    BN_CTX *bn_ctx;
+    BIGNUM *r, *s, *e, *v, *z1, *z2, *x;
+    EC_POINT *C;
+    int ok;
+
+    T(bn_ctx = BN_CTX_new());
+    BN_CTX_start(bn_ctx);
+    T(r = BN_CTX_get(bn_ctx));
+    T(s = BN_CTX_get(bn_ctx));
+    T(e = BN_CTX_get(bn_ctx));
+    T(v = BN_CTX_get(bn_ctx));
+    T(z1 = BN_CTX_get(bn_ctx));
+    T(z2 = BN_CTX_get(bn_ctx));
+    T(x = BN_CTX_get(bn_ctx));
+    T(C = EC_POINT_new(group));
+
+    /* Signature is s || r, digest is little-endian. */
+    T(BN_bin2bn(sig, siglen / 2, s));
+    T(BN_bin2bn(sig + siglen / 2, siglen / 2, r));
+    T(BN_lebin2bn(hash, len, e));
+    T(BN_nnmod(e, e, q, bn_ctx));
+    if (BN_is_zero(e))
+        T(BN_one(e));
+    T(BN_mod_inverse(v, e, q, bn_ctx));
+    T(BN_mod_mul(z1, s, v, q, bn_ctx));
+    T(BN_sub(z2, q, r));
+    T(BN_mod_mul(z2, z2, v, q, bn_ctx));
+    T(EC_POINT_mul(group, C, z1, EC_KEY_get0_public_key(ec), z2, bn_ctx));
+    T(EC_POINT_get_affine_coordinates(group, C, x, NULL, bn_ctx));
+    T(BN_nnmod(x, x, q, bn_ctx));
+    ok = BN_cmp(x, r) == 0;
+
+    EC_POINT_free(C);
+    BN_CTX_end(bn_ctx);
+    BN_CTX_free(bn_ctx);
+    return ok;
+}
+
 static int test_sign(struct test_sign *t)
 {
     int ret = 0, err;
@@ -296,6 +348,19 @@ static int test_sign(struct test_sign *t)
     ret |= err != 1;
     OPENSSL_free(sig2);
 
+    /* Cross-check with libcrypto for a random digest. */
+    unsigned char *hash2;
+    T(sig2 = OPENSSL_malloc(siglen));
+    T(hash2 = OPENSSL_malloc(len));
+    T(RAND_bytes(hash2, len));
+    TE(EVP_PKEY_sign(ctx, sig2, &siglen, hash2, len) == 1);
+    printf("\tGeneric verify:\t\t");
+    err = verify_generic(priv_key, sig2, siglen, hash2, len);
+    print_test_result(err);
+    ret |= err != 1;
+    OPENSSL_free(sig2);
+    OPENSSL_free(hash2);
+
     /* Verify. */
     T(EVP_PKEY_verify_init(ctx));
     hash[0]++; /* JFF */
@@ -322,6 +387,395 @@ static int test_sign(struct test_sign *t)
     return ret;
 }
 
+/*
+ * Signing with nonces from the precomputed pool of the engine.
+ */
+static int pool_stats(ENGINE *e, int nid, long *stats)
+{
+    T(ENGINE_ctrl_cmd(e, "SIGN_POOL_STATS", nid, stats, NULL, 0));
+    return 1;
+}
+
+static int test_sign_pool(void)
+{
+    const int nid = NID_id_tc26_gost_3410_2012_256_paramSetA;
+    const int type = NID_id_GostR3410_2012_256;
+    ENGINE *e;
+    EVP_PKEY *pkey, *priv_key = NULL;
+    EVP_PKEY_CTX *ctx;
+    unsigned char hash[32], sig[64];
+    size_t siglen;
+    long stats[5];
+    int ret = 0, err, i;
+
+    printf(cBLUE "Test signature nonce pool:" cNORM "\n");
+    T(e = ENGINE_by_id("gost"));
+    T(ENGINE_ctrl_cmd(e, "SIGN_POOL", 4, NULL, NULL, 0));
+    /* Stops at the capacity */
+    T(ENGINE_ctrl_cmd_string(e, "SIGN_POOL_PRECOMPUTE",
+                             "id-tc26-gost-3410-2012-256-paramSetA:8", 0));
+
+    T(pkey = EVP_PKEY_new());
+    TE(EVP_PKEY_set_type(pkey, type));
+    T(ctx = EVP_PKEY_CTX_new(pkey, NULL));
+    T(EVP_PKEY_keygen_init(ctx));
+    T(EVP_PKEY_CTX_ctrl(ctx, type, -1, EVP_PKEY_CTRL_GOST_PARAMSET, nid, NULL));
+    T(EVP_PKEY_keygen(ctx, &priv_key));
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+
+    /* Four signatures from the pool, two computed inline. */
+    T(ctx = EVP_PKEY_CTX_new(priv_key, NULL));
+    T(EVP_PKEY_sign_init(ctx));
+    err = 1;
+    for (i = 0; i < 6; i++) {
+        T(RAND_bytes(hash, sizeof(hash)));
+        siglen = sizeof(sig);
+        TE(EVP_PKEY_sign(ctx, sig, &siglen, hash, sizeof(hash)) == 1);
+        err &= verify_generic(priv_key, sig, siglen, hash, sizeof(hash));
+    }
+    printf("\tGeneric verify:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    pool_stats(e, nid, stats);
+    err = stats[0] == 4 && stats[1] == 0 && stats[2] == 4 && stats[3] == 2
+        && stats[4] == 4;
+    printf("\tPool statistics:\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+#ifndef _WIN32
+    /* The child must not inherit the nonces. */
+    T(ENGINE_ctrl_cmd_string(e, "SIGN_POOL_PRECOMPUTE",
+                             "id-tc26-gost-3410-2012-256-paramSetA:4", 0));
+    pid_t pid;
+    int status;
+    T((pid = fork()) >= 0);
+    if (pid == 0) {
+        pool_stats(e, nid, stats);
+        _exit(stats[1] != 0);
+    }
+    T(waitpid(pid, &status, 0) == pid);
+    pool_stats(e, nid, stats);
+    err = WIFEXITED(status) && WEXITSTATUS(status) == 0 && stats[1] == 4;
+    printf("\tWiped on fork:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    /* Drained to half, the thread refills to capacity. */
+    T(ENGINE_ctrl_cmd(e, "SIGN_POOL_THREAD", 1, NULL, NULL, 0));
+    for (i = 0; i < 3; i++) {
+        siglen = sizeof(sig);
+        TE(EVP_PKEY_sign(ctx, sig, &siglen, hash, sizeof(hash)) == 1);
+    }
+    for (i = 0; i < 1000; i++) {
+        pool_stats(e, nid, stats);
+        if (stats[1] == 4)
+            break;
+        usleep(10000);
+    }
+    T(ENGINE_ctrl_cmd(e, "SIGN_POOL_THREAD", 0, NULL, NULL, 0));
+    err = stats[1] == 4;
+    printf("\tBackground refill:\t");
+    print_test_result(err);
+    ret |= err != 1;
+#endif
+
+    T(ENGINE_ctrl_cmd(e, "SIGN_POOL", 0, NULL, NULL, 0));
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(priv_key);
+    ENGINE_free(e);
+    return ret;
+}
+
+static EVP_PKEY *keygen(int type, int nid)
+{
+    EVP_PKEY *pkey, *priv_key = NULL;
+    EVP_PKEY_CTX *ctx;
+
+    T(pkey = EVP_PKEY_new());
+    T(EVP_PKEY_set_type(pkey, type));
+    T(ctx = EVP_PKEY_CTX_new(pkey, NULL));
+    T(EVP_PKEY_keygen_init(ctx));
+    T(EVP_PKEY_CTX_ctrl(ctx, type, -1, EVP_PKEY_CTRL_GOST_PARAMSET, nid, NULL));
+    T(EVP_PKEY_keygen(ctx, &priv_key));
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+    return priv_key;
+}
+
+#define BATCH 80
+
+static int test_verify_batch(void)
+{
+    const int keys[][2] = {
+        { NID_id_GostR3410_2012_256, NID_id_tc26_gost_3410_2012_256_paramSetA },
+        { NID_id_GostR3410_2012_256, NID_id_tc26_gost_3410_2012_256_paramSetA },
+        { NID_id_GostR3410_2012_256, NID_id_GostR3410_2001_CryptoPro_A_ParamSet },
+        { NID_id_GostR3410_2012_256, NID_id_GostR3410_2001_CryptoPro_C_ParamSet },
+        { NID_id_GostR3410_2012_512, NID_id_tc26_gost_3410_2012_512_paramSetB },
+        { NID_id_GostR3410_2012_512, NID_id_tc26_gost_3410_2012_512_paramSetC },
+    };
+    const int long_runs[] = {
+        NID_id_tc26_gost_3410_2012_512_paramSetA,
+        NID_id_tc26_gost_3410_2012_512_paramSetB,
+        NID_id_tc26_gost_3410_2012_512_paramSetC,
+    };
+    const int nkeys = sizeof(keys) / sizeof(keys[0]);
+    EVP_PKEY *pkeys[sizeof(keys) / sizeof(keys[0])];
+    static unsigned char hash[BATCH][64], sig[BATCH][128];
+    GOST_VERIFY_BATCH_ITEM items[BATCH];
+    EVP_PKEY_CTX *ctx;
+    ENGINE *e;
+    int ret = 0, err, i, all;
+
+    printf(cBLUE "Test batch verification:" cNORM "\n");
+    T(e = ENGINE_by_id("gost"));
+    for (i = 0; i < nkeys; i++)
+        pkeys[i] = keygen(keys[i][0], keys[i][1]);
+
+    /* Runs of one key, the curve changing between some of them */
+    for (i = 0; i < BATCH; i++) {
+        EVP_PKEY *pkey = pkeys[(i / 6) % nkeys];
+
+        items[i].pkey = pkey;
+        items[i].sig = sig[i];
+        items[i].siglen = EVP_PKEY_get_size(pkey);
+        items[i].tbs = hash[i];
+        items[i].tbslen = EVP_PKEY_get_bits(pkey) / 8;
+        T(RAND_bytes(hash[i], items[i].tbslen));
+        T(ctx = EVP_PKEY_CTX_new(pkey, NULL));
+        T(EVP_PKEY_sign_init(ctx));
+        T(EVP_PKEY_sign(ctx, sig[i], &items[i].siglen, hash[i],
+                        items[i].tbslen) == 1);
+        EVP_PKEY_CTX_free(ctx);
+    }
+    T(ENGINE_ctrl_cmd(e, "VERIFY_BATCH", BATCH, items, NULL, 0) == 1);
+    err = 1;
+    for (i = 0; i < BATCH; i++)
+        err &= items[i].result == 1;
+    printf("\tAll good:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    /* Bad signature, digest, signature length and key type */
+    sig[3][5] ^= 1;
+    hash[31][0] ^= 1;
+    items[50].siglen--;
+    items[77].pkey = NULL;
+    T(ENGINE_ctrl_cmd(e, "VERIFY_BATCH", BATCH, items, NULL, 0) == 0);
+    err = 1;
+    for (i = 0; i < BATCH; i++) {
+        T(ctx = EVP_PKEY_CTX_new(pkeys[(i / 6) % nkeys], NULL));
+        T(EVP_PKEY_verify_init(ctx));
+        all = items[i].pkey
+            && EVP_PKEY_verify(ctx, sig[i], items[i].siglen, hash[i],
+                               items[i].tbslen) == 1;
+        EVP_PKEY_CTX_free(ctx);
+        err &= items[i].result == all;
+        err &= all == (i != 3 && i != 31 && i != 50 && i != 77);
+    }
+    ERR_clear_error();
+    printf("\tBad items:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    for (i = 0; i < nkeys; i++)
+        EVP_PKEY_free(pkeys[i]);
+
+    /*
+     * Runs of 19 on the 512-bit curves: vectors of eight points where
+     * the CPU has them, the last three in the portable code
+     */
+    for (i = 0; i < 3; i++)
+        pkeys[i] = keygen(NID_id_GostR3410_2012_512, long_runs[i]);
+    for (i = 0; i < 3 * 19; i++) {
+        EVP_PKEY *pkey = pkeys[i / 19];
+
+        items[i].pkey = pkey;
+        items[i].sig = sig[i];
+        items[i].siglen = EVP_PKEY_get_size(pkey);
+        items[i].tbs = hash[i];
+        items[i].tbslen = 64;
+        T(RAND_bytes(hash[i], 64));
+        T(ctx = EVP_PKEY_CTX_new(pkey, NULL));
+        T(EVP_PKEY_sign_init(ctx));
+        T(EVP_PKEY_sign(ctx, sig[i], &items[i].siglen, hash[i], 64) == 1);
+        EVP_PKEY_CTX_free(ctx);
+    }
+    sig[5][70] ^= 1;
+    hash[19 + 17][9] ^= 1;
+    sig[38 + 12][1] ^= 1;
+    T(ENGINE_ctrl_cmd(e, "VERIFY_BATCH", 3 * 19, items, NULL, 0) == 0);
+    err = 1;
+    for (i = 0; i < 3 * 19; i++)
+        err &= items[i].result == (i != 5 && i != 19 + 17 && i != 38 + 12);
+    ERR_clear_error();
+    printf("\t512-bit runs:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    for (i = 0; i < 3; i++)
+        EVP_PKEY_free(pkeys[i]);
+    ENGINE_free(e);
+    return ret;
+}
+
+/* Messages of a few lengths, so that some Streebog lanes are shared */
+static int test_digest_verify_batch(void)
+{
+    const int keys[][2] = {
+        { NID_id_GostR3410_2012_256, NID_id_tc26_gost_3410_2012_256_paramSetA },
+        { NID_id_GostR3410_2012_512, NID_id_tc26_gost_3410_2012_512_paramSetA },
+        { NID_id_GostR3410_2001, NID_id_GostR3410_2001_CryptoPro_A_ParamSet },
+        { NID_id_GostR3410_2012_256, NID_id_GostR3410_2001_CryptoPro_B_ParamSet },
+    };
+    const int nkeys = sizeof(keys) / sizeof(keys[0]);
+    EVP_PKEY *pkeys[sizeof(keys) / sizeof(keys[0])];
+    static unsigned char msg[BATCH][200], sig[BATCH][128];
+    GOST_VERIFY_BATCH_ITEM items[BATCH];
+    EVP_MD_CTX *mctx;
+    ENGINE *e;
+    int ret = 0, err, i;
+
+    printf(cBLUE "Test batch verification of messages:" cNORM "\n");
+    T(e = ENGINE_by_id("gost"));
+    for (i = 0; i < nkeys; i++)
+        pkeys[i] = keygen(keys[i][0], keys[i][1]);
+
+    for (i = 0; i < BATCH; i++) {
+        EVP_PKEY *pkey = pkeys[i % nkeys];
+
+        items[i].pkey = pkey;
+        items[i].sig = sig[i];
+        items[i].siglen = sizeof(sig[i]);
+        items[i].tbs = msg[i];
+        items[i].tbslen = (i / nkeys) % 3 * 67;
+        T(RAND_bytes(msg[i], sizeof(msg[i])));
+        T(mctx = EVP_MD_CTX_new());
+        T(EVP_DigestSignInit(mctx, NULL, NULL, NULL, pkey));
+        T(EVP_DigestSign(mctx, sig[i], &items[i].siglen, msg[i],
+                         items[i].tbslen) == 1);
+        EVP_MD_CTX_free(mctx);
+    }
+    T(ENGINE_ctrl_cmd(e, "DIGEST_VERIFY_BATCH", BATCH, items, NULL, 0) == 1);
+    err = 1;
+    for (i = 0; i < BATCH; i++)
+        err &= items[i].result == 1;
+    printf("\tAll good:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    /* A changed message in a shared lane, of each key type */
+    for (i = 20; i < 20 + nkeys; i++)
+        msg[i][1] ^= 1;
+    T(ENGINE_ctrl_cmd(e, "DIGEST_VERIFY_BATCH", BATCH, items, NULL, 0) == 0);
+    err = 1;
+    for (i = 0; i < BATCH; i++)
+        err &= items[i].result == (i < 20 || i >= 20 + nkeys);
+    ERR_clear_error();
+    printf("\tBad messages:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    for (i = 0; i < nkeys; i++)
+        EVP_PKEY_free(pkeys[i]);
+    ENGINE_free(e);
+    return ret;
+}
+
+static int test_verify_cache(void)
+{
+    const int keys[][2] = {
+        { NID_id_GostR3410_2012_256, NID_id_tc26_gost_3410_2012_256_paramSetA },
+        { NID_id_GostR3410_2012_256, NID_id_GostR3410_2001_CryptoPro_A_ParamSet },
+        { NID_id_GostR3410_2012_256, NID_id_GostR3410_2001_CryptoPro_B_ParamSet },
+        { NID_id_GostR3410_2012_512, NID_id_tc26_gost_3410_2012_512_paramSetA },
+        { NID_id_GostR3410_2012_512, NID_id_tc26_gost_3410_2012_512_paramSetC },
+    };
+    unsigned char hash[64], sig[128], hash0[64], sig0[128];
+    size_t siglen, siglen0 = 0, len;
+    EVP_PKEY *pkey, *other;
+    EVP_PKEY_CTX *ctx;
+    ENGINE *e;
+    int ret = 0, err, i, k;
+
+    printf(cBLUE "Test verification tables:" cNORM "\n");
+    T(e = ENGINE_by_id("gost"));
+    T(ENGINE_ctrl_cmd(e, "VERIFY_CACHE", 3, NULL, NULL, 0));
+    err = 1;
+    for (k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+        pkey = keygen(keys[k][0], keys[k][1]);
+        len = EVP_PKEY_get_bits(pkey) / 8;
+        /* The first three verify as before, the rest with the table */
+        for (i = 0; i < 8; i++) {
+            T(RAND_bytes(hash, len));
+            T(ctx = EVP_PKEY_CTX_new(pkey, NULL));
+            T(EVP_PKEY_sign_init(ctx));
+            siglen = sizeof(sig);
+            T(EVP_PKEY_sign(ctx, sig, &siglen, hash, len) == 1);
+            T(EVP_PKEY_verify_init(ctx));
+            err &= EVP_PKEY_verify(ctx, sig, siglen, hash, len) == 1;
+            err &= verify_generic(pkey, sig, siglen, hash, len) == 1;
+            hash[i] ^= 1;
+            err &= EVP_PKEY_verify(ctx, sig, siglen, hash, len) != 1;
+            EVP_PKEY_CTX_free(ctx);
+        }
+        EVP_PKEY_free(pkey);
+    }
+    ERR_clear_error();
+    printf("\tCached keys:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    /*
+     * A key with a table given another key pair verifies with the new
+     * point, and gets a table for it in turn
+     */
+    err = 1;
+    pkey = keygen(keys[0][0], keys[0][1]);
+    other = keygen(keys[0][0], keys[0][1]);
+    len = 32;
+    for (k = 0; k < 2; k++) {
+        for (i = 0; i < 6; i++) {
+            T(RAND_bytes(hash, len));
+            T(ctx = EVP_PKEY_CTX_new(pkey, NULL));
+            T(EVP_PKEY_sign_init(ctx));
+            siglen = sizeof(sig);
+            T(EVP_PKEY_sign(ctx, sig, &siglen, hash, len) == 1);
+            T(EVP_PKEY_verify_init(ctx));
+            err &= EVP_PKEY_verify(ctx, sig, siglen, hash, len) == 1;
+            err &= verify_generic(k ? other : pkey, sig, siglen, hash,
+                                  len) == 1;
+            /* A signature by the old pair no longer verifies */
+            if (k == 1)
+                err &= EVP_PKEY_verify(ctx, sig0, siglen0, hash0, len) != 1;
+            EVP_PKEY_CTX_free(ctx);
+        }
+        if (k == 0) {
+            memcpy(sig0, sig, siglen);
+            memcpy(hash0, hash, len);
+            siglen0 = siglen;
+            EC_KEY *ec = EVP_PKEY_get0(pkey);
+            const EC_KEY *from = EVP_PKEY_get0(other);
+
+            T(EC_KEY_set_private_key(ec, EC_KEY_get0_private_key(from)));
+            T(EC_KEY_set_public_key(ec, EC_KEY_get0_public_key(from)));
+        }
+    }
+    EVP_PKEY_free(other);
+    EVP_PKEY_free(pkey);
+    ERR_clear_error();
+    T(ENGINE_ctrl_cmd(e, "VERIFY_CACHE", 0, NULL, NULL, 0));
+    printf("\tKey changed:\t\t");
+    print_test_result(err);
+    ret |= err != 1;
+
+    ENGINE_free(e);
+    return ret;
+}
+
 int main(int argc, char **argv)
 {
     int ret = 0;
@@ -331,6 +785,10 @@ int main(int argc, char **argv)
     struct test_sign *sp;
     for (sp = test_signs; sp->name; sp++)
 	ret |= test_sign(sp);
+    ret |= test_sign_pool();
+    ret |= test_verify_batch();
+    ret |= test_digest_verify_batch();
+    ret |= test_verify_cache();
 
     if (ret)
 	printf(cDRED "= Some tests FAILED!" cNORM "\n");